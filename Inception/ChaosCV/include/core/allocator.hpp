@@ -4,8 +4,14 @@
 #include "log.hpp"
 
 #include <intrin.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
 
-#define MALLOC_ALIGN 16
+#define MALLOC_ALIGN 64 // cache line
 
 // exchange-add operation for atomic operations on reference counters
 // Just for windows, reference to NCNN
@@ -178,6 +184,34 @@ namespace chaos
 	}
 
 
+	/// <summary>
+	/// <para>The counters of an allocator at a time, the sizes are in bytes. A hit is a request served by a cached</para>
+	/// <para>block, a miss goes to the system. The counters the allocator does not keep are 0.</para>
+	/// </summary>
+	struct CHAOS_API AllocatorStats
+	{
+		// the requests of the blocks in use, and the most in use at once
+		size_t in_use = 0;
+		size_t peak = 0;
+		// the blocks in use are larger than their requests by the rounding to the classes or the size compare ratio
+		size_t wasted = 0;
+		// held from the system, in use or cached, in blocks
+		size_t reserved = 0;
+		size_t blocks = 0;
+		size_t mallocs = 0;
+		size_t frees = 0;
+		size_t hits = 0;
+		size_t misses = 0;
+		// the mallocs of each size class of the pool allocators, PoolAllocator::ClassBytes of the index
+		std::vector<size_t> class_mallocs;
+
+		double HitRate() const { return mallocs ? (double)hits / mallocs : 0.; }
+		/// <summary>The part of the reserved bytes which serves no request, the cached blocks and the waste</summary>
+		double Fragmentation() const { return reserved ? 1. - (double)std::min(in_use, reserved) / reserved : 0.; }
+		/// <summary>A line of the counters, then a line of the size classes which were asked</summary>
+		std::string ToString() const;
+	};
+
 	class CHAOS_API Allocator
 	{
 	public:
@@ -185,29 +219,62 @@ namespace chaos
 
 		virtual void* FastMalloc(size_t size) = 0;
 		virtual void FastFree(void* ptr) = 0;
+
+		/// <summary>The counters, the allocators without them give all 0</summary>
+		virtual AllocatorStats Snapshot() const { return AllocatorStats(); }
 	};
 
+	struct PoolBlock;
+
+	/// <summary>
+	/// <para>Segregated fit pool, the sizes are rounded up to 4 classes per power of two (at most 25% waste),</para>
+	/// <para>every class keeps a lock-free free list, so FastMalloc and FastFree are O(1) and never block.</para>
+	/// <para>The class is kept in a MALLOC_ALIGN header in front of the block, so FastFree does not search.</para>
+	/// <para>The cached blocks go back to the system on Clear or destruction.</para>
+	/// <para>The counters of a class share the line of its list, so the threads of different classes touch no common line.</para>
+	/// <para>The peak is the most in use seen by the snapshots, with track_peak every request raises it exactly</para>
+	/// <para>on a line shared by all the threads.</para>
+	/// </summary>
 	class CHAOS_API PoolAllocator : public Allocator
 	{
 	public:
-		PoolAllocator();
+		explicit PoolAllocator(bool track_peak = false);
 		~PoolAllocator();
 
 		virtual void* FastMalloc(size_t size) override;
 		virtual void FastFree(void* ptr) override;
 
-		void SetSizeCompareRatio(float scr);
-		__declspec(property(put = SetSizeCompareRatio)) uint size_compare_ratio;
-
+		/// <summary>Free the cached blocks, must not run concurrently with FastMalloc/FastFree</summary>
 		void Clear();
+
+		/// <summary>The counters, read one by one while the other threads may change them</summary>
+		virtual AllocatorStats Snapshot() const override;
+
+		// up to 1TB
+		static constexpr int num_classes = 137;
+		/// <summary>The bytes of the blocks of a size class</summary>
+		static size_t ClassBytes(int size_class);
 	private:
-		std::mutex budgets_lock;
-		std::mutex payouts_lock;
-		uint _size_compare_ratio; // 0~256
-		std::list<std::pair<size_t, void*>> budgets;
-		std::list<std::pair<size_t, void*>> payouts;
+		// tagged pointer to the top of the stack, the counters of the class share its line
+		struct alignas(64) FreeList
+		{
+			std::atomic<uint64> head = 0;
+			std::atomic<size_t> mallocs = 0;
+			std::atomic<size_t> frees = 0;
+			std::atomic<size_t> misses = 0;
+			std::atomic<size_t> deleted = 0;
+			// the requests of the blocks in use
+			std::atomic<size_t> in_use = 0;
+		};
+
+		FreeList free_lists[num_classes];
+		const bool track_peak;
+		// the requests of all the classes, kept only to track the peak
+		alignas(64) std::atomic<size_t> in_use = 0;
+		mutable std::atomic<size_t> peak = 0;
 	};
 
+	/// <summary>The PoolAllocator without atomics, for the single thread use</summary>
 	class CHAOS_API UnlockedPoolAllocator : public Allocator
 	{
 	public:
@@ -217,14 +284,243 @@ namespace chaos
 		virtual void* FastMalloc(size_t size) override;
 		virtual void FastFree(void* ptr) override;
 
-		void SetSizeCompareRatio(float scr);
-		__declspec(property(put = SetSizeCompareRatio)) uint size_compare_ratio;
+		void Clear();
+
+		virtual AllocatorStats Snapshot() const override;
+
+	private:
+		PoolBlock* free_lists[PoolAllocator::num_classes];
+		size_t outstanding = 0;
+		AllocatorStats stats;
+	};
 
+	/// <summary>
+	/// <para>The blocks from threshold bytes up are mapped from the system pages on their own, the smaller ones come from</para>
+	/// <para>FastMalloc. The mapped blocks take the large pages (2MB on x64) if the process may lock them in memory</para>
+	/// <para>(SeLockMemoryPrivilege), which cuts the TLB misses of the large weights and blobs, and are placed on</para>
+	/// <para>the NUMA nodes by the policy. Without the large pages or the nodes it falls back to the normal pages</para>
+	/// <para>where the system puts them. The large pages of an interleaved block are mapped a stripe at a time,</para>
+	/// <para>each stripe an allocation of its own on its node.</para>
+	/// <para>The counters are kept per size class and the peak is sampled unless track_peak, as in the PoolAllocator.</para>
+	/// </summary>
+	/// <code>
+	/// PageAllocator weights(1 &lt;&lt; 20, PageAllocator::INTERLEAVE), blobs(1 &lt;&lt; 20, PageAllocator::LOCAL);
+	/// opt.weight_allocator = &amp;weights; // read by the workers of all the nodes
+	/// opt.blob_allocator = &amp;blobs; // the node of the pool of the executor
+	/// ThreadPool pool(0, false, node); // an executor per node, each on the workers of its node
+	/// executor->SetThreadPool(&amp;pool);
+	/// </code>
+	class CHAOS_API PageAllocator : public Allocator
+	{
+	public:
+		enum NumaPolicy
+		{
+			ANY, // where the system puts the pages, the node of the thread which touches them first
+			LOCAL, // the node of the current ThreadPool (Option::thread_pool of the executor), else of the calling thread
+			BIND, // the node given
+			INTERLEAVE, // a stripe of 2MB per node in turn
+		};
+
+		PageAllocator(size_t threshold = 1 << 20, NumaPolicy policy = ANY, int node = 0, bool large_pages = true, bool track_peak = false);
+		~PageAllocator();
+
+		virtual void* FastMalloc(size_t size) override;
+		virtual void FastFree(void* ptr) override;
+
+		/// <summary>The blocks and the reserved bytes are the mapped ones, the waste is their rounding to the pages</summary>
+		virtual AllocatorStats Snapshot() const override;
+		/// <summary>The bytes mapped on the large pages</summary>
+		size_t LargePageBytes() const { return large_page_bytes.load(std::memory_order_relaxed); }
+
+		/// <summary>The size of a large page, 0 if the process can not take them</summary>
+		static size_t LargePageSize();
+		static int NumNodes();
+		/// <summary>The NUMA node of the processor running the calling thread</summary>
+		static int CurrentNode();
+
+	private:
+		void* Map(size_t size, size_t& mapped, size_t& stripe, bool& large);
+
+		const size_t threshold;
+		const NumaPolicy policy;
+		const int node;
+		const bool large_pages;
+		const bool track_peak;
+
+		// the requests of a size class, on their own line
+		struct alignas(64) Counters
+		{
+			std::atomic<size_t> mallocs = 0;
+			std::atomic<size_t> frees = 0;
+			std::atomic<size_t> in_use = 0;
+		};
+		Counters counters[PoolAllocator::num_classes];
+
+		// the mapped blocks, which take a system call anyway
+		alignas(64) std::atomic<size_t> reserved = 0;
+		// the requests of the mapped blocks
+		std::atomic<size_t> mapped_requests = 0;
+		std::atomic<size_t> blocks = 0;
+		std::atomic<size_t> large_page_bytes = 0;
+		alignas(64) std::atomic<size_t> in_use = 0;
+		mutable std::atomic<size_t> peak = 0;
+	};
+
+	struct ThreadCache;
+
+	/// <summary>
+	/// <para>A cache per thread in front of the upstream (FastMalloc without one), the freed blocks stay in lists of</para>
+	/// <para>their size class in the thread which allocated them, so a thread reusing its sizes takes no atomic.</para>
+	/// <para>A block freed by another thread is put in a batch for its owner, and a full batch goes to the remote list</para>
+	/// <para>of the owner with one CAS. The owner takes back the whole list when its own list of the class runs dry.</para>
+	/// <para>A thread caches up to max_cached bytes, the blocks beyond go back to the upstream, as do the blocks</para>
+	/// <para>larger than an eighth of it, which are not cached. The state of a thread lives until Clear, so a thread</para>
+	/// <para>which ends should Flush first, or its blocks stay cached until then.</para>
+	/// </summary>
+	/// <code>
+	/// PoolAllocator pool;
+	/// ThreadCachingAllocator allocator(&amp;pool);
+	/// opt.blob_allocator = &amp;allocator;
+	/// </code>
+	class CHAOS_API ThreadCachingAllocator : public Allocator
+	{
+	public:
+		ThreadCachingAllocator(Allocator* upstream = nullptr, size_t max_cached = 4 << 20);
+		~ThreadCachingAllocator();
+
+		virtual void* FastMalloc(size_t size) override;
+		virtual void FastFree(void* ptr) override;
+
+		/// <summary>Send the batches of the calling thread and give the blocks cached by it back to the upstream</summary>
+		void Flush();
+		/// <summary>Give all the cached blocks back to the upstream, must not run concurrently with the others</summary>
 		void Clear();
+
+		/// <summary>The bytes cached by the calling thread</summary>
+		size_t Cached();
+
+		// the blocks a batch of remote frees takes before it is sent
+		static constexpr int batch_size = 32;
+
+	private:
+		ThreadCache* Local();
+		void Release(ThreadCache* cache);
+		void Send(ThreadCache* cache, int slot);
+
+		Allocator* upstream;
+		const size_t max_cached;
+		// the key of the caches of the threads
+		const uint64 id;
+		std::mutex lock;
+		std::vector<ThreadCache*> caches;
+	};
+
+	struct Arena;
+
+	/// <summary>
+	/// <para>Monotonic workspace, FastMalloc bumps a pointer in a chunk and FastFree does nothing,</para>
+	/// <para>the memory comes back by Rewind to a Mark or by Reset. Each thread bumps in an arena of its own,</para>
+	/// <para>so the threads never share a line and all the calls are lock free after the first of a thread.</para>
+	/// <para>When an arena outgrows its chunk another one is added, rewinding to the start merges them into one,</para>
+	/// <para>so after the first request a thread allocates nothing. The arenas are freed with the allocator.</para>
+	/// </summary>
+	/// <code>
+	/// auto mark = arena.Mark();
+	/// Tensor scratch(shape, Depth::D4, Packing::CHW, &amp;arena);
+	/// ...
+	/// scratch.Release();
+	/// arena.Rewind(mark);
+	/// </code>
+	class CHAOS_API ArenaAllocator : public Allocator
+	{
+	public:
+		/// <param name="chunk_size">The bytes of the first chunk of a thread</param>
+		ArenaAllocator(size_t chunk_size = 1 << 16);
+		~ArenaAllocator();
+
+		virtual void* FastMalloc(size_t size) override;
+		virtual void FastFree(void* ptr) override {}
+
+		/// <summary>A position in the arena of the calling thread</summary>
+		struct Marker
+		{
+			size_t chunk = 0;
+			size_t offset = 0;
+		};
+		Marker Mark();
+		/// <summary>Release what the calling thread got after the mark</summary>
+		void Rewind(const Marker& marker);
+		/// <summary>Release all of the calling thread, the Rewind to the start</summary>
+		void Reset() { Rewind(Marker()); }
+
+		/// <summary>The bytes in use and reserved by the calling thread</summary>
+		size_t Used();
+		size_t Capacity();
+
+	private:
+		Arena* Local();
+
+		const size_t chunk_size;
+		// the key of the arenas of the threads
+		const uint64 id;
+		std::mutex lock;
+		std::vector<Arena*> arenas;
+	};
+
+	/// <summary>
+	/// <para>The workspace allocator of the calling thread for the routines which do not take an Option,</para>
+	/// <para>eg. the scratch of Invert and SVD, set for the lifetime of the scope. nullptr is the heap.</para>
+	/// </summary>
+	class CHAOS_API WorkspaceScope
+	{
+	public:
+		explicit WorkspaceScope(Allocator* workspace);
+		~WorkspaceScope();
+
+		WorkspaceScope(const WorkspaceScope&) = delete;
+		WorkspaceScope& operator=(const WorkspaceScope&) = delete;
+
+		static Allocator* Current();
+
+	private:
+		Allocator* previous;
+	};
+
+	/// <summary>
+	/// <para>The AutoBuffer of the scratch of the math routines, on the stack up to fixed_size elements,</para>
+	/// <para>then from WorkspaceScope::Current() or the heap. The elements are not initialized.</para>
+	/// </summary>
+	template<class Type, size_t fixed_size = 1024 / sizeof(Type) + 8> class WorkBuffer
+	{
+		static_assert(std::is_trivial_v<Type>, "the elements are not constructed");
+	public:
+		explicit WorkBuffer(size_t size) : sz(size)
+		{
+			if (size > fixed_size)
+			{
+				allocator = WorkspaceScope::Current();
+				ptr = (Type*)(allocator ? allocator->FastMalloc(size * sizeof(Type)) : chaos::FastMalloc(size * sizeof(Type)));
+			}
+		}
+		~WorkBuffer()
+		{
+			if (ptr == buf) return;
+			if (allocator) allocator->FastFree(ptr);
+			else chaos::FastFree(ptr);
+		}
+
+		WorkBuffer(const WorkBuffer&) = delete;
+		WorkBuffer& operator=(const WorkBuffer&) = delete;
+
+		inline size_t size() const noexcept { return sz; }
+		inline Type* data() noexcept { return ptr; }
+		inline const Type* data() const noexcept { return ptr; }
+
 	private:
-		uint _size_compare_ratio; // 0~256
-		std::list<std::pair<size_t, void*>> budgets;
-		std::list<std::pair<size_t, void*>> payouts;
+		Type* ptr = buf;
+		size_t sz;
+		Allocator* allocator = nullptr;
+		Type buf[fixed_size];
 	};
 
 }
\ No newline at end of file
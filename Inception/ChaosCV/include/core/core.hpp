@@ -6,12 +6,37 @@
 #include "allocator.hpp"
 
 #include <string>
+#include <type_traits>
 
 namespace chaos
 {
 	template<class Type>
 	using Ptr = std::shared_ptr<Type>;
 
+	/// <summary>
+	/// <para>A callback which does not own the callable, two pointers passed by value, it neither allocates nor copies.</para>
+	/// <para>The callable has to outlive the reference, eg. a lambda given in the call which takes it.</para>
+	/// </summary>
+	template<class Signature> class FunctionRef;
+	template<class Result, class... Args>
+	class FunctionRef<Result(Args...)>
+	{
+	public:
+		FunctionRef() = default;
+		FunctionRef(std::nullptr_t) noexcept {}
+		template<class Function, std::enable_if_t<not std::is_same_v<std::decay_t<Function>, FunctionRef> &&
+			std::is_invocable_r_v<Result, Function&, Args...>, bool> = true>
+		FunctionRef(Function&& func) noexcept : obj((void*)std::addressof(func)),
+			call([](void* p, Args... args) -> Result { return (*(std::remove_reference_t<Function>*)p)(std::forward<Args>(args)...); }) {}
+
+		Result operator()(Args... args) const { return call(obj, std::forward<Args>(args)...); }
+		explicit operator bool() const noexcept { return call != nullptr; }
+
+	private:
+		void* obj = nullptr;
+		Result (*call)(void*, Args...) = nullptr;
+	};
+
 	/// <summary>Split the string data by delimiter</summary>
 	CHAOS_API std::vector<std::string> Split(const std::string& data, const std::string& delimiter);
 
@@ -34,4 +59,10 @@ namespace chaos
 	/// <para>execution time in seconds</para>
 	/// </summary>
 	CHAOS_API double GetTickFrequency();
+
+	/// <summary>
+	/// <para>Returns true if the specified feature is supported by the host hardware and the OS.</para>
+	/// <para>The kernels use it to pick the SIMD implementation at run time, the features are detected only once.</para>
+	/// </summary>
+	CHAOS_API bool CheckHardwareSupport(CpuFeature feature);
 }
\ No newline at end of file
@@ -23,6 +23,10 @@ namespace chaos
 	using int64 = __int64;
 	using uint64 = unsigned __int64;
 
+	// the half floats of a D2 tensor, only stored, they are computed as float (math/half.hpp), the type of the tensor tells which
+	struct float16 { uint16 bits; };  // IEEE binary16
+	struct bfloat16 { uint16 bits; }; // the high half of a float
+
 	enum class Depth
 	{
 		D1 = 1,
@@ -31,6 +35,14 @@ namespace chaos
 		D8 = 8,
 	};
 
+	// what the bytes of an element are, FLOAT is the float of the depth (float16, float, double) or the bytes of D1,
+	// BFLOAT16 the bfloat16 of a D2 tensor
+	enum class ElemType
+	{
+		FLOAT,
+		BFLOAT16,
+	};
+
 	enum class Packing
 	{
 		CHW = 1,
@@ -40,6 +52,20 @@ namespace chaos
 		C8HW8 = 8,
 	};
 
+	enum class CpuFeature
+	{
+		SSE2,
+		AVX,
+		FMA3,
+		F16C,
+		AVX2,
+		AVX512F,
+		AVX512BW,
+		AVX512VNNI,
+		AVX512BF16,
+		AVXVNNI,
+	};
+
 	enum class LogSeverity
 	{
 		INFO,
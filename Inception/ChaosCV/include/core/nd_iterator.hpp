@@ -0,0 +1,161 @@
+#pragma once
+
+#include "core.hpp"
+#include "vec.hpp"
+#include "thread_pool.hpp"
+
+#include <array>
+
+namespace chaos
+{
+	/// <summary>
+	/// <para>Strided iteration over N operands which share one (broadcast) shape.</para>
+	/// <para>The dims of size 1 are dropped and the neighbouring dims which are contiguous for all the operands are merged,</para>
+	/// <para>a broadcast operand simply has 0 steps on the broadcast dims (and merges as well).</para>
+	/// <para>The innermost merged dim is a run walked by the caller with constant steps, the outer indices advance</para>
+	/// <para>incrementally on Next, so there is no division per element or per row.</para>
+	/// </summary>
+	/// <code>
+	/// NdIterator&lt;2&gt; it(shape, { &amp;dst.steps, &amp;src.steps });
+	/// do {
+	///     float* d = dst + it.offset(0); const float* s = src + it.offset(1);
+	///     for (size_t i = 0; i &lt; it.size(); i++) d[i * it.step(0)] = s[i * it.step(1)];
+	/// } while (it.Next());
+	/// </code>
+	template<size_t N>
+	class NdIterator
+	{
+	public:
+		static constexpr size_t max_dims = 16;
+
+		/// <param name="shape">The shape to iterate</param>
+		/// <param name="steps">The element steps of each operand, with the dims of shape</param>
+		NdIterator(const Shape& shape, const std::array<const Steps*, N>& steps)
+		{
+			size_t dims = shape.size();
+			CHECK_LE(dims, max_dims) << "too many dims";
+			for (size_t i = 0; i < N; i++)
+				CHECK_EQ(steps[i]->size(), dims);
+
+			// from the innermost dim, merge into the previous one when contiguous
+			num_dims = 0;
+			for (int64 j = dims - 1; j >= 0; j--)
+			{
+				size_t size = shape[j];
+				if (size == 1) continue;
+				if (num_dims > 0)
+				{
+					bool contiguous = true;
+					for (size_t i = 0; i < N; i++)
+						contiguous &= (size_t)(*steps[i])[j] == strides[num_dims - 1][i] * sizes[num_dims - 1];
+					if (contiguous)
+					{
+						sizes[num_dims - 1] *= size;
+						continue;
+					}
+				}
+				sizes[num_dims] = size;
+				for (size_t i = 0; i < N; i++)
+					strides[num_dims][i] = (*steps[i])[j];
+				num_dims++;
+			}
+			if (num_dims == 0) // all ones
+			{
+				sizes[0] = 1;
+				strides[0].fill(0);
+				num_dims = 1;
+			}
+			// an empty shape iterates nothing, one run of size 0
+			if (shape.vol() == 0)
+			{
+				sizes[0] = 0;
+				num_dims = 1;
+			}
+
+			Seek(0);
+		}
+
+		/// <summary>The length of the current run</summary>
+		size_t size() const noexcept { return sizes[0]; }
+		/// <summary>The element step of operand i in a run</summary>
+		size_t step(size_t i) const noexcept { return strides[0][i]; }
+		/// <summary>The element offset of operand i at the start of the current run</summary>
+		size_t offset(size_t i) const noexcept { return offsets[i]; }
+		/// <summary>The element offsets of all the operands at the start of the current run</summary>
+		const std::array<size_t, N>& offset() const noexcept { return offsets; }
+		/// <summary>The number of runs, Next returns true runs - 1 times</summary>
+		size_t runs() const noexcept
+		{
+			size_t n = 1;
+			for (size_t k = 1; k < num_dims; k++) n *= sizes[k];
+			return n;
+		}
+		/// <summary>The number of dims after merging, the innermost is the run</summary>
+		size_t ndims() const noexcept { return num_dims; }
+
+		/// <summary>Go to the start of the run-th run, to split the iteration among threads</summary>
+		void Seek(size_t run)
+		{
+			offsets.fill(0);
+			for (size_t k = 1; k < num_dims; k++)
+			{
+				counters[k] = run % sizes[k];
+				run /= sizes[k];
+				for (size_t i = 0; i < N; i++)
+					offsets[i] += counters[k] * strides[k][i];
+			}
+		}
+
+		/// <summary>Advance to the next run, returns false after the last one</summary>
+		bool Next() noexcept
+		{
+			for (size_t k = 1; k < num_dims; k++)
+			{
+				if (++counters[k] < sizes[k])
+				{
+					for (size_t i = 0; i < N; i++)
+						offsets[i] += strides[k][i];
+					return true;
+				}
+				counters[k] = 0;
+				for (size_t i = 0; i < N; i++)
+					offsets[i] -= strides[k][i] * (sizes[k] - 1);
+			}
+			return false;
+		}
+
+	private:
+		size_t num_dims;
+		// innermost first
+		size_t sizes[max_dims];
+		std::array<size_t, N> strides[max_dims];
+		size_t counters[max_dims];
+		std::array<size_t, N> offsets;
+	};
+
+	/// <summary>
+	/// <para>Call func(offsets, size) on the runs of it on the global pool, grain is in elements.</para>
+	/// <para>A single run is cut into pieces, the operands move by it.step(i) in each.</para>
+	/// </summary>
+	template<size_t N, class Function>
+	void ParallelForEach(const NdIterator<N>& it, size_t grain, const Function& func, int num_threads = 0)
+	{
+		size_t n = it.size();
+		if (n == 0) return;
+		if (it.runs() == 1)
+		{
+			ParallelFor(0, n, grain, [&](size_t i0, size_t i1) {
+				std::array<size_t, N> offsets;
+				for (size_t i = 0; i < N; i++) offsets[i] = it.offset(i) + i0 * it.step(i);
+				func(offsets, i1 - i0);
+			}, num_threads);
+			return;
+		}
+		ParallelFor(0, it.runs(), std::max(grain / n, (size_t)1), [&](size_t r0, size_t r1) {
+			NdIterator<N> local = it;
+			local.Seek(r0);
+			for (size_t r = r0; r < r1; r++, local.Next())
+				func(local.offset(), n);
+		}, num_threads);
+	}
+}
\ No newline at end of file
@@ -18,8 +18,10 @@ namespace chaos
 
 		Tensor(const Tensor& t);
 		Tensor& operator=(const Tensor& t);
+		Tensor(Tensor&& t) noexcept;
+		Tensor& operator=(Tensor&& t) noexcept;
 
-		void Create(const Shape& _shape, const Steps& steps, const Depth& _depth, const Packing& _packing, Allocator* _allocator);
+		void Create(const Shape& _shape, const Steps& steps, const Depth& _depth, const Packing& _packing, Allocator* _allocator, ElemType _type = ElemType::FLOAT);
 		void CreateLike(const VkTensor& t, Allocator* allocator);
 
 		//void CopyTo(Tensor& t) const;
@@ -36,9 +38,13 @@ namespace chaos
 		/// <summary>ref_cnt++</summary>
 		void AddRef() noexcept { if(ref_cnt) CHAOS_XADD(ref_cnt, 1); }
 
-		template<class Type, std::enable_if_t<std::is_arithmetic_v<Type> or std::is_void_v<Type>, bool> = true> 
+		template<class Type>
+		static constexpr bool is_element_v = std::is_arithmetic_v<Type> or std::is_void_v<Type> or
+			std::is_same_v<Type, float16> or std::is_same_v<Type, bfloat16>;
+
+		template<class Type, std::enable_if_t<is_element_v<Type>, bool> = true> 
 		operator const Type* () const { return (const Type*)data; }
-		template<class Type, std::enable_if_t<std::is_arithmetic_v<Type> or std::is_void_v<Type>, bool> = true> 
+		template<class Type, std::enable_if_t<is_element_v<Type>, bool> = true> 
 		operator Type* () { return (Type*)data; }
 
 		const float& operator[](size_t idx) const noexcept { return ((float*)data)[idx]; }
@@ -49,10 +55,14 @@ namespace chaos
 
 		// pointer to the reference counter
 		// when points to user-allocated data, the pointer is NULL
+		// it is the allocated block, a control block of one cache line in front of the data,
+		// so the atomic updates never touch the line of the first elements
 		int* ref_cnt = nullptr;
 
 		Depth depth = Depth::D1;
 		Packing packing = Packing::CHW;
+		// float16 or bfloat16 for a D2 tensor, kept by the copies, the conversions and the files
+		ElemType type = ElemType::FLOAT;
 		Shape shape;
 		Steps steps;
 	};
@@ -93,7 +103,7 @@ namespace chaos
 		OutputArray(Tensor& data);
 
 		bool Needed() const;
-		void Create(const Shape& shape, const Steps& steps, const Depth& depth, const Packing& packing, Allocator* allocator = nullptr) const;
+		void Create(const Shape& shape, const Steps& steps, const Depth& depth, const Packing& packing, Allocator* allocator = nullptr, ElemType type = ElemType::FLOAT) const;
 		void Release() const;
 		Tensor& GetTensorRef() const;
 	};
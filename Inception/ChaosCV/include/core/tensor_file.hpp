@@ -0,0 +1,67 @@
+#pragma once
+
+#include "core.hpp"
+#include "tensor.hpp"
+
+#include <map>
+#include <mutex>
+
+namespace chaos
+{
+	/// <summary>
+	/// <para>A file mapped copy-on-write, the pages are read on the first touch and a write stays private.</para>
+	/// <para>The tensors of GetTensor point into the pages without a copy, each has its own reference counter,</para>
+	/// <para>freed by this allocator, and keeps the mapping alive after the last Ptr to it is released.</para>
+	/// </summary>
+	class CHAOS_API MappedFile : public Allocator, public std::enable_shared_from_this<MappedFile>
+	{
+	public:
+		/// <summary>Map the whole file, LOG(FATAL) if it can not be opened</summary>
+		static Ptr<MappedFile> Open(const std::string& file);
+		~MappedFile();
+
+		const uchar* data() const noexcept { return base; }
+		size_t size() const noexcept { return length; }
+
+		/// <summary>A tensor on the mapped bytes from offset, the total bytes of shape and steps must be in the file</summary>
+		Tensor GetTensor(size_t offset, const Shape& shape, const Steps& steps, Depth depth, Packing packing);
+
+		/// <summary>A mapping allocates nothing</summary>
+		virtual void* FastMalloc(size_t size) override;
+		/// <summary>Free the reference counter of a tensor of GetTensor</summary>
+		virtual void FastFree(void* ptr) override;
+
+	private:
+		MappedFile() = default;
+
+		uchar* base = nullptr;
+		size_t length = 0;
+
+		std::mutex lock;
+		// the live tensors, the mapping keeps itself while there is one
+		size_t views = 0;
+		Ptr<MappedFile> self;
+	};
+
+	/// <summary>
+	/// <para>Save the tensors in the tensor container with an optional meta text (eg. the graph of LoadNet), version 2:</para>
+	/// <para>a 64 byte header, the table (name, depth, packing, element type, shape, steps, offset and size of each tensor),</para>
+	/// <para>the meta text, then the raw bytes of each tensor with its steps at an offset aligned to 64 bytes.</para>
+	/// </summary>
+	CHAOS_API void SaveTensors(const std::string& file, const std::map<std::string, Tensor>& tensors, const std::string& meta = std::string());
+	/// <summary>
+	/// <para>Load a tensor container, the tensors are on the mapped file unless map is false,</para>
+	/// <para>then they are read into new buffers. LOG(FATAL) on a file which is not a valid container.</para>
+	/// <para>The tensors of a version 1 file have no element type, their D2 is float16.</para>
+	/// </summary>
+	CHAOS_API std::map<std::string, Tensor> LoadTensors(const std::string& file, std::string* meta = nullptr, bool map = true);
+
+	/// <summary>
+	/// <para>Load a .npy file (version 1 to 3, C order, little endian) of float16, float32, float64 or a 1 byte dtype</para>
+	/// <para>(int8, uint8, bool), the depth is the size of the dtype. The wider integers are refused, they are no depth.</para>
+	/// <para>The data is mapped unless map is false or it is not aligned to its element, a 0-d array has the shape (1).</para>
+	/// </summary>
+	CHAOS_API Tensor LoadNpy(const std::string& file, bool map = true);
+	/// <summary>Save a tensor as a .npy file, D1 as int8, D2 as float16 (bfloat16 widened to float32), D4 as float32 and D8 as float64 (times packing on the last axis)</summary>
+	CHAOS_API void SaveNpy(const std::string& file, const Tensor& tensor);
+}
\ No newline at end of file
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "def.hpp"
+#include "core.hpp"
+
+#include <atomic>
+#include <algorithm>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+
+namespace chaos
+{
+	/// <summary>
+	/// <para>The persistent workers of the intra-op parallelism.</para>
+	/// <para>ParallelFor cuts the range into chunks of grain and deals them out evenly, a thread which runs out of</para>
+	/// <para>its own chunks steals half of what is left to another one. The calling thread works as the thread 0.</para>
+	/// <para>The jobs of several threads run at once, an idle worker joins any of them, so a ParallelFor nested</para>
+	/// <para>in a job (eg. a layer run by the inter-op executor) takes the idle cores, or goes serially without one.</para>
+	/// <para>A pool of a NUMA node keeps its workers on the processors of the node, so an executor given the pool</para>
+	/// <para>(Option::thread_pool) computes there and its PageAllocator::LOCAL blobs are placed there.</para>
+	/// </summary>
+	class CHAOS_API ThreadPool
+	{
+	public:
+		using Function = std::function<void(size_t begin, size_t end)>;
+
+		/// <param name="num_threads">The threads with the caller, 0 for all the cores (of the node)</param>
+		/// <param name="affinity">Pin the worker i to the logical processor i (of the node), over the processor groups</param>
+		/// <param name="node">The NUMA node the workers run on, -1 for any</param>
+		ThreadPool(int num_threads = 0, bool affinity = false, int node = -1);
+		~ThreadPool();
+
+		/// <summary>The pool used by the layers, with a thread per core</summary>
+		static ThreadPool& Global();
+		/// <summary>The pool of the ThreadPoolScope of the calling thread, the pool of a worker, or the global one</summary>
+		static ThreadPool& Current();
+
+		/// <summary>Call func on the chunks of [begin, end), on num_threads threads at most (0 for all)</summary>
+		void ParallelFor(size_t begin, size_t end, size_t grain, const Function& func, int num_threads = 0);
+
+		/// <summary>Work on the chunks of a job of another thread while waiting for something else</summary>
+		/// <return>false if there is no job to join</return>
+		bool Help();
+		/// <summary>
+		/// <para>Help the jobs of the other threads until done() is true, sleeping between them as an idle worker,</para>
+		/// <para>so a ParallelFor nested in a job counts the waiting thread and publishes its chunks to it.</para>
+		/// <para>done() is called under the lock of the pool, whoever makes it true calls Notify after.</para>
+		/// </summary>
+		void HelpUntil(FunctionRef<bool()> done);
+		/// <summary>Wake the threads of HelpUntil to check their condition again</summary>
+		void Notify();
+
+		int num_threads() const noexcept { return (int)workers.size() + 1; }
+		/// <summary>The NUMA node of the workers, -1 for any</summary>
+		int node() const noexcept { return numa_node; }
+
+	private:
+		struct Job;
+		Job* Join(int& id);
+		void Loop();
+
+		std::vector<std::thread> workers;
+		int numa_node = -1;
+
+		std::mutex lock;
+		std::condition_variable cv;
+		uint64 generation = 0;
+		bool stop = false;
+		std::vector<Job*> jobs;
+		// the workers and the threads of HelpUntil waiting for a job
+		std::atomic<int> idle = 0;
+	};
+
+	/// <summary>
+	/// <para>The pool of ParallelFor and of the layers on the calling thread, set for the lifetime of the scope.</para>
+	/// <para>nullptr is the global pool.</para>
+	/// </summary>
+	class CHAOS_API ThreadPoolScope
+	{
+	public:
+		explicit ThreadPoolScope(ThreadPool* pool);
+		~ThreadPoolScope();
+
+		ThreadPoolScope(const ThreadPoolScope&) = delete;
+		ThreadPoolScope& operator=(const ThreadPoolScope&) = delete;
+
+	private:
+		ThreadPool* previous;
+	};
+
+	/// <summary>The number of the logical cores</summary>
+	CHAOS_API int GetNumCPUs();
+
+	/// <summary>ThreadPool::ParallelFor on the current pool</summary>
+	CHAOS_API void ParallelFor(size_t begin, size_t end, size_t grain, const ThreadPool::Function& func, int num_threads = 0);
+
+	/// <summary>
+	/// <para>Reduce map(begin, end) of the chunks of [begin, end) with reduce, from init.</para>
+	/// <para>The partial results are reduced in the order of the chunks, so the result only depends on grain.</para>
+	/// </summary>
+	template<class Type, class Map, class Reduce>
+	Type ParallelReduce(size_t begin, size_t end, size_t grain, const Type& init, const Map& map, const Reduce& reduce, int num_threads = 0)
+	{
+		if (end <= begin) return init;
+		grain = std::max(grain, (size_t)1);
+		size_t num_chunks = (end - begin + grain - 1) / grain;
+		std::vector<Type> partials(num_chunks);
+		ParallelFor(0, num_chunks, 1, [&](size_t c0, size_t c1) {
+			for (size_t c = c0; c < c1; c++)
+			{
+				size_t b = begin + c * grain;
+				partials[c] = map(b, std::min(b + grain, end));
+			}
+		}, num_threads);
+
+		Type result = init;
+		for (const auto& partial : partials)
+			result = reduce(result, partial);
+		return result;
+	}
+}
\ No newline at end of file
@@ -14,7 +14,7 @@ namespace chaos
 		using ConstIterator = VecConstIterator<Type>;
 		Vec() = default;
 		
-		virtual ~Vec() { Deallocate(); }
+		~Vec() { Deallocate(); }
 
 		template<class Tp, std::enable_if_t<std::is_convertible_v<Tp,Type>, bool> = true>
 		Vec(const std::initializer_list<Tp>& list)
@@ -59,47 +59,62 @@ namespace chaos
 			}
 			return *this;
 		}
+		Vec(Vec&& v) noexcept
+		{
+			Steal(v);
+		}
+		Vec& operator=(Vec&& v) noexcept
+		{
+			if (this != &v)
+			{
+				Deallocate();
+				Steal(v);
+			}
+			return *this;
+		}
 
+		/// <summary>Resize and keep the elements, the new elements are zeros</summary>
 		void Resize(size_t size)
 		{
-			if (size < sz)
-				return;
-
-			size_t prev_size = sz;
-			Type* prev_buf = buf;
-
-			buf = new Type[size];
-			sz = size;
-
-			size_t i = 0;
-			for (; i < prev_size; i++)
+			if (size > capacity)
 			{
-				buf[i] = prev_buf[i];
+				Type* prev_buf = buf;
+				size_t new_capacity = std::max(size, capacity * 2);
+				buf = new Type[new_capacity];
+				for (size_t i = 0; i < sz; i++)
+				{
+					buf[i] = prev_buf[i];
+				}
+				if (prev_buf != inline_buf)
+					delete[] prev_buf;
+				capacity = new_capacity;
 			}
-			for (; i < size; i++)
+			for (size_t i = sz; i < size; i++)
 				buf[i] = Type();
-
-			delete[] prev_buf;
+			sz = size;
 		}
 
+		/// <summary>Resize without keeping the elements, no allocation up to inline_size</summary>
 		void Allocate(size_t size)
 		{
-			if (size <= sz)
+			if (size <= capacity)
 			{
 				sz = size;
 				return;
 			}
 			Deallocate();
-			sz = size;
 			buf = new Type[size];
+			capacity = size;
+			sz = size;
 		}
 
 		void Deallocate()
 		{
-			if (buf)
+			if (buf != inline_buf)
 			{
 				delete[] buf;
-				buf = nullptr;
+				buf = inline_buf;
+				capacity = inline_size;
 			}
 			sz = 0;
 		}
@@ -123,9 +138,9 @@ namespace chaos
 		void Remove(size_t pos)
 		{
 			CHECK_LT(pos, sz) << "out of range";
-			size_t rest = sz - pos;
+			size_t rest = sz - pos - 1;
 			memmove(buf + pos, buf + pos + 1, rest * sizeof(Type));
-			Resize(sz - 1);
+			sz--;
 		}
 
 		template<class Tp, std::enable_if_t<std::is_convertible_v<Type, Tp>, bool> =  true>
@@ -147,7 +162,7 @@ namespace chaos
 		ConstIterator begin() const { return ConstIterator(*this); }
 		ConstIterator end() const { return ConstIterator(*this) + sz; }
 
-		bool empty() const noexcept { return sz == 0 || buf == nullptr; }
+		bool empty() const noexcept { return sz == 0; }
 
 		friend std::ostream& operator<<(std::ostream& stream, const Vec& v)
 		{
@@ -170,8 +185,33 @@ namespace chaos
 		}
 
 	protected:
-		Type* buf = nullptr;
+		// up to inline_size elements are kept in the object, so the usual shapes never touch the heap
+		static constexpr size_t inline_size = 8;
+
+		void Steal(Vec& v) noexcept
+		{
+			if (v.buf == v.inline_buf)
+			{
+				for (size_t i = 0; i < v.sz; i++)
+				{
+					inline_buf[i] = v.inline_buf[i];
+				}
+			}
+			else
+			{
+				buf = v.buf;
+				capacity = v.capacity;
+				v.buf = v.inline_buf;
+				v.capacity = inline_size;
+			}
+			sz = v.sz;
+			v.sz = 0;
+		}
+
+		Type* buf = inline_buf;
 		size_t sz = 0;
+		size_t capacity = inline_size;
+		Type inline_buf[inline_size];
 	};
 
 	template<class Type>
@@ -247,15 +287,17 @@ namespace chaos
 			buf[0] = n; buf[1] = c; buf[2] = h; buf[3] = w;
 		}
 
-		size_t vol() const noexcept { return empty() ? 0 : std::accumulate(begin(), end(), 1, std::multiplies<uint>()); }
+		size_t vol() const noexcept { return empty() ? 0 : std::accumulate(buf, buf + sz, (size_t)1, std::multiplies<size_t>()); }
 
+		/// <summary>The dense steps, no allocation up to inline_size dims</summary>
 		Steps steps() const noexcept
 		{
 			Steps _steps(sz);
-			_steps[sz - 1] = 1;
+			uint* data = _steps.data();
+			if (sz > 0) data[sz - 1] = 1;
 			for (int64 i = sz - 2; i >= 0; i--)
 			{
-				_steps[i] = buf[i + 1] * _steps[i + 1];
+				data[i] = buf[i + 1] * data[i + 1];
 			}
 			return _steps;
 		}
@@ -15,6 +15,8 @@ namespace chaos
         // the base offset assigned by allocator
         size_t offset;
         size_t capacity;
+        // the request, for the statistics of the allocator
+        size_t size;
 
         VkDeviceMemory memory;
         void* mapped_data;
@@ -40,6 +42,9 @@ namespace chaos
         virtual void Flush(VkBufferMemory* data);
         virtual void Invalidate(VkBufferMemory* data);
 
+        // the counters, the allocators without them give all 0
+        virtual AllocatorStats Snapshot() const { return AllocatorStats(); }
+
     public:
         const VulkanDevice* vkdev;
         uint32_t buffer_memory_type_index;
@@ -69,7 +74,11 @@ namespace chaos
         virtual VkBufferMemory* FastMalloc(size_t size) override;
         virtual void FastFree(VkBufferMemory* ptr) override;
 
+        // a hit is a request served by the budgets, the waste is the alignment of the sub buffers
+        virtual AllocatorStats Snapshot() const override { return stats; }
+
     protected:
+        AllocatorStats stats;
         size_t block_size;
         size_t buffer_offset_alignment;
         size_t bind_memory_offset_alignment;
@@ -97,7 +106,11 @@ namespace chaos
         virtual VkBufferMemory* FastMalloc(size_t size) override;
         virtual void FastFree(VkBufferMemory* ptr) override;
 
+        // the waste is the capacity of the reused buffers beyond the requests, up to 1 - size_compare_ratio
+        virtual AllocatorStats Snapshot() const override { return stats; }
+
     protected:
+        AllocatorStats stats;
         unsigned int size_compare_ratio; // 0~256
         std::list<VkBufferMemory*> buffer_budgets;
     };
@@ -19,6 +19,8 @@ namespace chaos
 
 		VkTensor(const VkTensor& t);
 		VkTensor& operator=(const VkTensor& t);
+		VkTensor(VkTensor&& t) noexcept;
+		VkTensor& operator=(VkTensor&& t) noexcept;
 
 		void Create(const Shape& shape, const Steps& steps, const Depth& depth, const Packing& packing, VkAllocator* allocator);
 		// allocate like
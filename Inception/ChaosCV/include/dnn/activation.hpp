@@ -0,0 +1,96 @@
+#pragma once
+
+#include "dnn/layer.hpp"
+#include "math/vmath.hpp"
+
+#include <type_traits>
+
+namespace chaos
+{
+	namespace dnn
+	{
+		/// <summary>
+		/// <para>The activations on a row of a layer output, y = f(y) with the activation_params of the layer.</para>
+		/// <para>Instantiated per ActiveType, so the loops of an epilogue have no branch on the type.</para>
+		/// </summary>
+		template<ActiveType type>
+		struct Activation;
+
+		template<>
+		struct Activation<NONE>
+		{
+			static void Run(float*, size_t, const float*) {}
+		};
+
+		template<>
+		struct Activation<RELU>
+		{
+			static void Run(float* y, size_t n, const float*)
+			{
+				for (size_t i = 0; i < n; i++) y[i] = std::max(0.f, y[i]);
+			}
+		};
+
+		template<>
+		struct Activation<LEAKYRELU>
+		{
+			static void Run(float* y, size_t n, const float* params)
+			{
+				const float slope = params[0];
+				for (size_t i = 0; i < n; i++) y[i] = y[i] > 0.f ? y[i] : y[i] * slope;
+			}
+		};
+
+		template<>
+		struct Activation<CLIP>
+		{
+			static void Run(float* y, size_t n, const float* params)
+			{
+				const float min = params[0], max = params[1];
+				for (size_t i = 0; i < n; i++) y[i] = std::min(std::max(y[i], min), max);
+			}
+		};
+
+		template<>
+		struct Activation<SIGMOID>
+		{
+			static void Run(float* y, size_t n, const float*) { Sigmoid(y, y, n); }
+		};
+
+		template<>
+		struct Activation<MISH>
+		{
+			static void Run(float* y, size_t n, const float*) { Mish(y, y, n); }
+		};
+
+		/// <summary>
+		/// <para>Call func(std::integral_constant&lt;ActiveType, type&gt;) for the run time type, once per forward,</para>
+		/// <para>func instantiates the kernels of the layer for every type.</para>
+		/// </summary>
+		/// <code>
+		/// DispatchActivation(activation_type, [&amp;](auto act) { Kernel&lt;decltype(act)::value&gt;(...); });
+		/// </code>
+		template<class Function>
+		void DispatchActivation(int type, const Function& func)
+		{
+			switch (type)
+			{
+			case NONE: return func(std::integral_constant<ActiveType, NONE>());
+			case RELU: return func(std::integral_constant<ActiveType, RELU>());
+			case LEAKYRELU: return func(std::integral_constant<ActiveType, LEAKYRELU>());
+			case CLIP: return func(std::integral_constant<ActiveType, CLIP>());
+			case SIGMOID: return func(std::integral_constant<ActiveType, SIGMOID>());
+			case MISH: return func(std::integral_constant<ActiveType, MISH>());
+			default: LOG(FATAL) << Format("unknown activation type %d", type);
+			}
+		}
+
+		/// <summary>Call func(std::bool_constant&lt;value&gt;) for a run time bool</summary>
+		template<class Function>
+		void DispatchBool(bool value, const Function& func)
+		{
+			if (value) return func(std::true_type());
+			return func(std::false_type());
+		}
+	}
+}
\ No newline at end of file
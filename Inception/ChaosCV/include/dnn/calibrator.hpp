@@ -0,0 +1,56 @@
+#pragma once
+
+#include "core/core.hpp"
+#include "core/tensor.hpp"
+
+#include "net.hpp"
+
+#include <map>
+
+namespace chaos
+{
+	namespace dnn
+	{
+		/// <summary>
+		/// <para>Record the ranges of the float blobs of a net over the sample inputs to calibrate the int8 inference.</para>
+		/// <para>Each blob keeps a histogram of |x|, the threshold is the percentile of it (1 for the max),</para>
+		/// <para>and the scale is threshold / 127. The net must not be in light mode, the blobs are read after Forward.</para>
+		/// </summary>
+		/// <code>
+		/// Calibrator calibrator(float_net, 0.9999f);
+		/// for (auto&amp; sample : samples) calibrator.Feed({ { "data", sample } });
+		/// calibrator.Apply(int8_net);
+		/// </code>
+		class CHAOS_API Calibrator
+		{
+		public:
+			Calibrator(const Ptr<Net>& net, float percentile = 1.f);
+
+			/// <summary>Forward the inputs (name to tensor) and record every float blob</summary>
+			void Feed(const std::map<std::string, Tensor>& inputs);
+
+			/// <summary>The scale of each recorded blob</summary>
+			std::map<std::string, float> GetScales() const;
+
+			/// <summary>Set the input_scale of the layers of net by the names of their bottoms, the nets may differ in options</summary>
+			void Apply(const Ptr<Net>& net) const;
+
+		private:
+			struct Histogram
+			{
+				// the bins of [0, range)
+				std::vector<double> bins;
+				float range = 0.f;
+
+				void Add(const float* x, size_t n);
+				float Threshold(float percentile) const;
+			};
+
+			Ptr<Net> net;
+			Ptr<Executor> executor;
+			float percentile;
+
+			std::map<std::string, Histogram> histograms;
+		};
+	}
+}
\ No newline at end of file
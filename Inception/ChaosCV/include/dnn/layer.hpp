@@ -31,6 +31,9 @@ namespace chaos
 			virtual void Forward(std::vector<Tensor>& blobs, const Option& opt) const;
 			virtual void Forward(Tensor& blob, const Option& opt) const;
 
+			/// <summary>The estimated floating point operations of a Forward on the shapes for the profiler, one per top element by default</summary>
+			virtual double Flops(const std::vector<Shape>& bottoms, const std::vector<Shape>& tops) const;
+
 
 
 			const std::string type;
@@ -58,7 +61,7 @@ namespace chaos
 			RELU,
 			LEAKYRELU,
 			CLIP,
-			SOFTMAX,
+			SIGMOID,
 			MISH,
 		};
 
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "dnn/layer.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		/// <summary>
+		/// <para>A standalone activation, y = f(x) in place on a float blob with the activation_type and activation_params</para>
+		/// <para>of InnerProduct. The graph optimizer folds it into the InnerProduct before it.</para>
+		/// </summary>
+		class ActivationLayer : public Layer
+		{
+		public:
+			ActivationLayer();
+
+			virtual void Set(const std::string& key, const ParamValue& value) override;
+
+			virtual void Forward(Tensor& blob, const Option& opt) const override;
+
+			// 0=none, 1=relu, 2=leakyrelu, 3=clip, 4=sigmoid, 5=mish
+			int activation_type = 0;
+			Tensor activation_params;
+		};
+	}
+}
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include "dnn/layer.hpp"
 
+#include "math/gemm.hpp"
+
 namespace chaos
 {
 	namespace dnn
@@ -14,13 +16,46 @@ namespace chaos
 
 			virtual void Set(const std::string& key, const ParamValue& val) override;
 
+			/// <summary>
+			/// <para>Pack the weight into the panels of the gemm, FP16 with use_fp16_storage, BF16 with use_bf16_storage</para>
+			/// <para>and INT8 with use_int8_storage.</para>
+			/// <para>With use_int8_inference and use_int8_arithmetic it is quantized for the int8 gemm instead.</para>
+			/// <para>The weight is released in light mode unless the vulkan pipeline still uploads it.</para>
+			/// </summary>
+			virtual void CreatePipeline(const Option& opt) override;
+			virtual void DestroyPipeline(const Option& opt) override;
+
+			/// <summary>
+			/// <para>y = f(x * w^t + b), accumulated in float. A half (D2) x gives a half y of the type of x,</para>
+			/// <para>an int8 (D1) x or y needs the int8 weight and the scales.</para>
+			/// </summary>
 			virtual void Forward(const Tensor& bottom, Tensor& top, const Option& opt) const override;
+			/// <summary>
+			/// <para>The second bottom is the bias in place of the bias param, a BinaryOp ADD after the layer folded into it</para>
+			/// <para>by the graph optimizer, which clears one_blob_only then. A bias which is neither a row nor the shape of y</para>
+			/// <para>is broadcast after the gemm like the BinaryOp did, before the activation.</para>
+			/// </summary>
+			virtual void Forward(const std::vector<Tensor>& bottoms, std::vector<Tensor>& tops, const Option& opt) const override;
+
+			/// <summary>2k per element of y, and one more for the bias and for the activation</summary>
+			virtual double Flops(const std::vector<Shape>& bottoms, const std::vector<Shape>& tops) const override;
 
 			Tensor weight; // MxN
+			// the shape of y, or a row of it added to each row
 			Tensor bias;
 			// 0=none, 1=relu, 2=leakyrelu, 3=clip, 4=sigmoid, 5=mish
 			int activation_type = 0;
 			Tensor activation_params;
+			// w^t in the panels of the gemm, Forward takes it over weight
+			PackedMatrix packed_weight;
+			// int8 inference: the scale of the bottom, from a calibration or of an int8 bottom,
+			// 0 to quantize each row of a float bottom by its own max
+			float input_scale = 0.f;
+			// the scale to requantize the top to int8, 0 for a float top
+			float output_scale = 0.f;
+
+		private:
+			void ForwardBias(const Tensor& bottom, const Tensor& bias, Tensor& top, int activation_type, const Option& opt) const;
 		};
 	}
 }
\ No newline at end of file
@@ -13,6 +13,7 @@ namespace chaos
 
 			virtual void Forward(Tensor& blob, const Option& opt) const override;
 			virtual void Forward(std::vector<Tensor>& blobs, const Option& opt) const override;
+			virtual double Flops(const std::vector<Shape>&, const std::vector<Shape>&) const override { return 0.; }
 		};
 	}
 }
\ No newline at end of file
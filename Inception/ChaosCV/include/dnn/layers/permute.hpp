@@ -13,6 +13,8 @@ namespace chaos
 
 			virtual void Set(const std::string& key, const ParamValue& value) override;
 			virtual void Forward(const Tensor& bottom, Tensor& top, const Option& opt) const override;
+			// only moves the data
+			virtual double Flops(const std::vector<Shape>&, const std::vector<Shape>&) const override { return 0.; }
 
 			Vec<uint> orders;
 		};
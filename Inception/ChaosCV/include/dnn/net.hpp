@@ -3,6 +3,9 @@
 #include "core/core.hpp"
 #include "core/tensor.hpp"
 
+#include "layer.hpp"
+#include "profiler.hpp"
+
 namespace chaos
 {
 	namespace dnn
@@ -13,12 +16,45 @@ namespace chaos
 		public:
 			virtual ~Net() = default;
 
+			/// <summary>
+			/// <para>Create an executor to run the net, the first call prepares the net</para>
+			/// <para>(topological order, blob liveness, CreatePipeline), no layer can be added after that.</para>
+			/// <para>Each executor owns its blobs, so use one executor per thread.</para>
+			/// </summary>
 			virtual Ptr<Executor> BindExecutor() const = 0;
 
-			virtual void AddLayer(const std::string& type) {};
+			/// <summary>
+			/// <para>Append a layer to the net, blobs are referred by names.</para>
+			/// <para>A blob which is not produced by any layer is an input of the net.</para>
+			/// </summary>
+			/// <return>The created layer, use it to Set the params</return>
+			virtual Ptr<Layer> AddLayer(const std::string& type, const std::string& name,
+				const std::vector<std::string>& bottoms, const std::vector<std::string>& tops) = 0;
+
+			/// <summary>Set the option used by the executors, must be called before BindExecutor</summary>
+			virtual void SetOption(const Option& opt) = 0;
+
+			/// <summary>
+			/// <para>Run the GraphOptimizer on the layers, before BindExecutor. It runs in BindExecutor with use_graph_optimization.</para>
+			/// </summary>
+			/// <return>A line per change</return>
+			virtual std::vector<std::string> Optimize() = 0;
+
+			/// <summary>The layers in the adding order</summary>
+			virtual const std::vector<Ptr<Layer>>& GetLayers() const = 0;
+			/// <summary>The blob names, layer->bottoms_idx and layer->tops_idx index them</summary>
+			virtual const std::vector<std::string>& GetBlobNames() const = 0;
 
 			static Ptr<Net> CreateNet();
-			static Ptr<Net> LoadNet();
+			/// <summary>
+			/// <para>Load a net saved by SaveTensors, the weights stay on the mapped file and the meta text is the graph,</para>
+			/// <para>a layer per line: type name bottoms tops key=value ..., the blobs separated by ',' or '-' for none.</para>
+			/// <para>A value is an int, a float, @name for a tensor of the file or else a string, '#' starts a comment.</para>
+			/// </summary>
+			/// <code>
+			/// InnerProduct fc1 data fc1 weight=@fc1.weight activation_type=1
+			/// </code>
+			static Ptr<Net> LoadNet(const std::string& file, const Option& opt = Option());
 			//static Ptr<Net> LoadChaosNet();
 			//static Ptr<Net> LoadMxNet();
 			//static Ptr<Net> LoadCaffeNet();
@@ -30,9 +66,23 @@ namespace chaos
 		public:
 			virtual ~Executor() = default;
 
+			/// <summary>Set the input blob, the data is referenced, not copied</summary>
 			virtual void SetLayerData(const std::string& name, const Tensor& data) const = 0;
+			/// <summary>Copy the blob out, the data is reused if it has the same shape</summary>
 			virtual void GetLayerData(const std::string& name, Tensor& data) const = 0;
 			virtual void Forward() const = 0;
+
+			/// <summary>
+			/// <para>Record every layer of the next Forwards into the profiler, nullptr to stop, the profiler must outlive the Forwards.</para>
+			/// <para>The blobs and the workspaces then go through a ProfilingAllocator to count the requests of each layer.</para>
+			/// </summary>
+			virtual void SetProfiler(Profiler* profiler) const = 0;
+
+			/// <summary>
+			/// <para>Run the next Forwards on the pool, eg. a ThreadPool of a NUMA node per executor, which also places</para>
+			/// <para>the blobs of a PageAllocator::LOCAL there. nullptr for Option::thread_pool, the pool must outlive the Forwards.</para>
+			/// </summary>
+			virtual void SetThreadPool(ThreadPool* pool) const = 0;
 		};
 	}
-}
\ No newline at end of file
+}
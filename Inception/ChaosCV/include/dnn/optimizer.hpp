@@ -0,0 +1,49 @@
+#pragma once
+
+#include "core/core.hpp"
+
+#include "layer.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		/// <summary>
+		/// <para>The passes over the layers of a net before its pipelines are created, each change saves a write and a read of a blob:</para>
+		/// <para>a BinaryOp ADD becomes the bias (the second bottom) of the InnerProduct of one operand, with its broadcast,</para>
+		/// <para>an Activation goes into the InnerProduct before it, the Noop layers are bypassed,</para>
+		/// <para>and consecutive Permutes are composed into one, or none if the orders cancel.</para>
+		/// <para>A fused blob is not produced anymore, the names of the other blobs are kept.</para>
+		/// </summary>
+		class CHAOS_API GraphOptimizer
+		{
+		public:
+			GraphOptimizer(std::vector<Ptr<Layer>>& layers, const std::vector<std::string>& blob_names, const Option& opt);
+
+			/// <summary>Run the passes until none changes the layers</summary>
+			/// <return>A line per change</return>
+			std::vector<std::string> Run();
+
+		private:
+			// the producer and the consumers of each blob
+			void Analyze();
+			int GetConsumer(int blob) const;
+			void RemoveLayer(int layer);
+
+			bool FuseBinaryOp();
+			bool FuseActivation();
+			bool MergePermute();
+			bool RemoveNoop();
+			// remove a layer whose tops equal its bottoms
+			bool Bypass(int layer);
+
+			std::vector<Ptr<Layer>>& layers;
+			const std::vector<std::string>& blob_names;
+			Option opt;
+
+			std::vector<int> producers;
+			std::vector<std::vector<int>> consumers;
+			std::vector<std::string> report;
+		};
+	}
+}
\ No newline at end of file
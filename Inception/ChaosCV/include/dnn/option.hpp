@@ -6,6 +6,7 @@ namespace chaos
 {
 	class VkAllocator;
 	class PipelineCache;
+	class ThreadPool;
 	namespace dnn
 	{
 		class CHAOS_API Option
@@ -15,6 +16,7 @@ namespace chaos
 
 			// ligth mode
 			// intermediate blob will be recycled when enabled
+			// the weights packed by CreatePipeline are kept without their originals
 			// disable by default
 			bool light_mode = false;
 
@@ -22,8 +24,17 @@ namespace chaos
 			Allocator* blob_allocator = nullptr;
 
 			// workspace allocator
+			// an ArenaAllocator is rewound by the executor after each layer
 			Allocator* workspace_allocator = nullptr;
 
+			// the weights packed by CreatePipeline, eg. a PageAllocator on the large pages
+			// it has to outlive the layers
+			Allocator* weight_allocator = nullptr;
+
+			// log the Snapshot of the memory plan and the allocators after each Executor::Forward
+			// disable by default
+			bool log_allocator_stats = false;
+
 			// blob memory allocator
 			VkAllocator* blob_vkallocator = nullptr;
 
@@ -34,23 +45,47 @@ namespace chaos
 			VkAllocator* staging_vkallocator = nullptr;
 
 			// pipeline cache
-			PipelineCache* pipeline_cache;
+			PipelineCache* pipeline_cache = nullptr;
+
+			// the threads of the pool a layer runs on
+			// 0 to use all of them
+			int num_threads = 0;
+
+			// the pool the executor runs the layers on, eg. a ThreadPool of a NUMA node per executor
+			// nullptr for the global pool
+			ThreadPool* thread_pool = nullptr;
 
 			// enable quantized int8 inference
 			// use low-precision int8 path for quantized model
 			// changes should be applied before loading network structure and weight
 			// enabled by default
-			bool use_int8_inference;
+			bool use_int8_inference = true;
 
 			// enable vulkan compute
-			bool use_vulkan_compute;
+			bool use_vulkan_compute = false;
 
 			// enable options for gpu inference
-			bool use_fp16_packed;
-			bool use_fp16_storage;
-			bool use_fp16_arithmetic;
-			bool use_int8_storage;
-			bool use_int8_arithmetic;
+			// fp16 and int8 storage also choose the packed weights on cpu
+			// int8 arithmetic with int8 inference runs the int8 gemm on cpu
+			bool use_fp16_packed = false;
+			bool use_fp16_storage = false;
+			bool use_fp16_arithmetic = false;
+			bool use_int8_storage = false;
+			bool use_int8_arithmetic = false;
+
+			// the packed weights on cpu are bf16
+			// the half (D2) blobs carry their own type, bfloat16 or float16 (core/def.hpp)
+			bool use_bf16_storage = false;
+
+			// run the graph optimizer on the layers before the pipelines are created
+			// the fused intermediate blobs can not be read by GetLayerData then
+			// disable by default
+			bool use_graph_optimization = false;
+
+			// run the layers of independent branches at once on the threads of the global pool
+			// the blob allocator is then used as is, without the memory plan, and has to be thread safe
+			// disable by default
+			bool use_inter_op_parallel = false;
 		};
 	}
 }
\ No newline at end of file
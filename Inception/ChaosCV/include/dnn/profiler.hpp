@@ -0,0 +1,89 @@
+#pragma once
+
+#include "core/core.hpp"
+#include "core/tensor.hpp"
+
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace chaos
+{
+	namespace dnn
+	{
+		/// <summary>A layer run by a profiled Forward</summary>
+		struct LayerProfile
+		{
+			std::string name;
+			std::string type;
+			int layer_idx = -1;
+			// the order the threads first recorded a layer, 0 for the first
+			int thread = 0;
+			// GetTickCount around the layer Forward
+			int64 begin = 0;
+			int64 end = 0;
+			std::vector<Shape> bottoms_shapes;
+			std::vector<Shape> tops_shapes;
+			// the bottoms read and the tops written, the padding is not counted
+			size_t bytes = 0;
+			// Layer::Flops of the shapes
+			double flops = 0.;
+			// the requests of the layer to the blob and the workspace allocators
+			size_t mallocs = 0;
+			size_t malloc_bytes = 0;
+			size_t frees = 0;
+		};
+
+		/// <summary>
+		/// <para>The layers recorded by Executor::Forward after Executor::SetProfiler, one LayerProfile per layer and Forward.</para>
+		/// <para>The layers of concurrent branches record at once, so read the profile after Forward returns.</para>
+		/// </summary>
+		/// <code>
+		/// dnn::Profiler profiler;
+		/// executor->SetProfiler(&amp;profiler);
+		/// executor->Forward();
+		/// profiler.SaveChromeTrace("forward.json"); // chrome://tracing or ui.perfetto.dev
+		/// LOG(INFO) &lt;&lt; profiler.Summary();
+		/// </code>
+		class CHAOS_API Profiler
+		{
+		public:
+			Profiler() = default;
+
+			/// <summary>Drop the recorded layers</summary>
+			void Clear();
+			/// <summary>Add a layer, from the thread which ran it</summary>
+			void Record(LayerProfile&& profile);
+
+			/// <summary>The trace_event JSON, a complete event per layer with the shapes, bytes, flops and allocations as args</summary>
+			std::string ChromeTrace() const;
+			void SaveChromeTrace(const std::string& file) const;
+			/// <summary>A line per layer with its total over the Forwards, the slowest first</summary>
+			std::string Summary() const;
+
+			std::vector<LayerProfile> profiles;
+
+		private:
+			mutable std::mutex lock;
+			std::map<std::thread::id, int> threads;
+		};
+
+		/// <summary>
+		/// <para>Pass the requests to the upstream (FastMalloc without one) and count them for the layer the calling thread</para>
+		/// <para>runs, set by Attach. The layers allocate their blobs and workspaces on the thread calling their Forward.</para>
+		/// </summary>
+		class CHAOS_API ProfilingAllocator : public Allocator
+		{
+		public:
+			ProfilingAllocator(Allocator* upstream = nullptr) : upstream(upstream) {}
+
+			virtual void* FastMalloc(size_t size) override;
+			virtual void FastFree(void* ptr) override;
+
+			/// <summary>Count the requests of the calling thread into profile, nullptr to stop</summary>
+			static void Attach(LayerProfile* profile);
+
+			Allocator* upstream;
+		};
+	}
+}
\ No newline at end of file
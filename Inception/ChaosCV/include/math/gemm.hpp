@@ -0,0 +1,86 @@
+#pragma once
+
+#include "core/core.hpp"
+#include "core/tensor.hpp"
+
+
+namespace chaos
+{
+	/// <summary>
+	/// <para>C = alpha * op(A) * op(B) + beta * C, op(A) is MxK, op(B) is KxN and C is MxN.</para>
+	/// <para>All the matrices are row major, lda, ldb and ldc are the row steps in elements,</para>
+	/// <para>op(X) = X^t if trans_x, C is not read if beta is 0.</para>
+	/// <para>The packed, register blocked kernel is selected by the cpu features at run time (AVX-512, AVX2/FMA or scalar).</para>
+	/// </summary>
+	CHAOS_API void Gemm(bool trans_a, bool trans_b, int m, int n, int k, float alpha,
+		const float* A, size_t lda, const float* B, size_t ldb, float beta, float* C, size_t ldc);
+
+	/// <summary>
+	/// <para>Called on the blocks of C once they are final, while they are still in cache.</para>
+	/// <para>c is C + i * ldc + j and the block has m rows of n elements, every element of C is in one block.</para>
+	/// <para>The callable is only referenced, no heap for the captures of a lambda.</para>
+	/// </summary>
+	using GemmEpilogue = FunctionRef<void(float* c, size_t ldc, int i, int j, int m, int n)>;
+
+	/// <summary>Gemm with an epilogue on C, eg. the bias and the activation of a layer</summary>
+	CHAOS_API void Gemm(bool trans_a, bool trans_b, int m, int n, int k, float alpha,
+		const float* A, size_t lda, const float* B, size_t ldb, float beta, float* C, size_t ldc, GemmEpilogue epilogue);
+
+	/// <summary>
+	/// <para>The KxN op(B) of a Gemm packed once into the column panels of the kernel selected at run time, eg. the weights of a layer.</para>
+	/// <para>FP16, BF16 and INT8 (symmetric, a scale per column) keep it in a half and a quarter of the memory,</para>
+	/// <para>the panels are widened to float block by block in the gemm.</para>
+	/// <para>INT8_DOT is quantized as INT8 in the layout of the int8 dot products, only GemmInt8 takes it.</para>
+	/// </summary>
+	class CHAOS_API PackedMatrix
+	{
+	public:
+		enum Format
+		{
+			FP32,
+			FP16, // needs F16C
+			BF16,
+			INT8,
+			INT8_DOT, // 4 k of a column side by side
+		};
+
+		PackedMatrix() = default;
+		/// <param name="allocator">Of the panels, the scales and the sums, FastMalloc if nullptr</param>
+		PackedMatrix(bool trans_b, int k, int n, const float* B, size_t ldb, Format format = FP32, Allocator* allocator = nullptr);
+
+		bool empty() const noexcept { return panels.empty(); }
+		void Release();
+
+		int k = 0;
+		int n = 0;
+		// the columns of a panel, the NR of the kernel
+		int nr = 0;
+		Format format = FP32;
+		// (n / nr) x k x nr, the last panel is padded by zeros
+		Tensor panels;
+		// the scale of each column for INT8 and INT8_DOT
+		Tensor scales;
+		// the int32 sum of each column for INT8_DOT
+		Tensor sums;
+	};
+
+	/// <summary>
+	/// <para>C = alpha * op(A) * B[:, j0 : j0 + n] + beta * C with a packed B, j0 is a multiple of B.nr.</para>
+	/// <para>The column range lets threads take tiles of C from one packed B.</para>
+	/// </summary>
+	CHAOS_API void Gemm(bool trans_a, int m, int n, float alpha, const float* A, size_t lda, const PackedMatrix& B, int j0,
+		float beta, float* C, size_t ldc, GemmEpilogue epilogue = nullptr);
+
+	/// <summary>
+	/// <para>Called on the int32 blocks of C = A * B of GemmInt8, c is a buffer of the gemm with the row step ldc,</para>
+	/// <para>the block is the rows [i, i + m) and the columns [j, j + n) of C.</para>
+	/// </summary>
+	using GemmInt8Epilogue = FunctionRef<void(const int32_t* c, size_t ldc, int i, int j, int m, int n)>;
+
+	/// <summary>
+	/// <para>C = A * B[:, j0 : j0 + n] in int32 with A an MxK int8 matrix in [-127, 127] and B packed as INT8_DOT.</para>
+	/// <para>C is only given to the epilogue to dequantize or requantize it, it is never stored as int32.</para>
+	/// <para>The kernel is selected at run time, AVX-512 VNNI (vpdpbusd), AVX2 (vpmaddubsw) or scalar.</para>
+	/// </summary>
+	CHAOS_API void GemmInt8(int m, int n, const int8_t* A, size_t lda, const PackedMatrix& B, int j0, GemmInt8Epilogue epilogue);
+}
\ No newline at end of file
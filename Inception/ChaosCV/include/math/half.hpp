@@ -0,0 +1,29 @@
+#pragma once
+
+#include "core/core.hpp"
+#include "core/tensor.hpp"
+
+namespace chaos
+{
+	/// <summary>
+	/// <para>The conversions of the half floats of the D2 tensors (core/def.hpp), float16 is IEEE binary16,</para>
+	/// <para>bfloat16 the high half of a float. They round to nearest even, a nan stays a nan and float16 overflows to inf.</para>
+	/// <para>F16C, AVX-512 and AVX-512 BF16 are selected at run time, AVX-512 BF16 flushes the subnormals to 0.</para>
+	/// </summary>
+
+	CHAOS_API float16 ToFloat16(float x);
+	CHAOS_API bfloat16 ToBFloat16(float x);
+	CHAOS_API float ToFloat(float16 x);
+	CHAOS_API float ToFloat(bfloat16 x);
+
+	/// <summary>y[i] = x[i] in the type of y</summary>
+	CHAOS_API void Cast(const float* x, float16* y, size_t n);
+	CHAOS_API void Cast(const float* x, bfloat16* y, size_t n);
+	CHAOS_API void Cast(const float16* x, float* y, size_t n);
+	CHAOS_API void Cast(const bfloat16* x, float* y, size_t n);
+
+	/// <summary>A D4 tensor to a D2 one of float16 (or bfloat16, the type of dst), any steps of src, on num_threads threads (0 for all)</summary>
+	CHAOS_API void ToHalf(const InputArray& src, const OutputArray& dst, bool bf16 = false, int num_threads = 0);
+	/// <summary>A D2 tensor to a D4 one, float16 or bfloat16 by the type of src</summary>
+	CHAOS_API void ToFloat(const InputArray& src, const OutputArray& dst, int num_threads = 0);
+}
\ No newline at end of file
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "core/core.hpp"
+
+namespace chaos
+{
+	/// <summary>
+	/// <para>The symmetric int8 quantization of the int8 inference, x = scale * q with q in [-127, 127].</para>
+	/// <para>-128 is never produced, so |q| fits the unsigned operand of the int8 dot products.</para>
+	/// </summary>
+
+	/// <summary>max |x[i]|, 0 for n = 0</summary>
+	CHAOS_API float AbsMax(const float* x, size_t n);
+	/// <summary>y = clamp(round(x / scale), -127, 127), rounded half to even, all 0 if scale is 0</summary>
+	CHAOS_API void Quantize(const float* x, int8_t* y, size_t n, float scale);
+}
\ No newline at end of file
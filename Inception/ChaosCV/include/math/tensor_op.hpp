@@ -19,5 +19,10 @@ namespace chaos
 
 	CHAOS_API void SetIdentity(const InputOutputArray& src, double val = 1.);
 	CHAOS_API void Transpose(const InputArray& src, const OutputArray& dst);
-	CHAOS_API void Permute(const InputArray& src, const OutputArray& dst, const Vec<uint>& orders);
+	/// <summary>
+	/// <para>dst.shape[i] = src.shape[orders[i]], for any depth and packing (an element is depth * packing bytes).</para>
+	/// <para>The axes which stay adjacent are merged first, the permute then runs as a batch of tiled 2D transposes,</para>
+	/// <para>as a copy of rows or as a strided copy, on num_threads threads at most (0 for all).</para>
+	/// </summary>
+	CHAOS_API void Permute(const InputArray& src, const OutputArray& dst, const Vec<uint>& orders, int num_threads = 0);
 }
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "core/core.hpp"
+
+namespace chaos
+{
+	/// <summary>
+	/// <para>The element-wise functions of the activations on float arrays, y may be x.</para>
+	/// <para>Range reduced polynomials on AVX-512 or AVX2/FMA selected at run time, std:: functions without them.</para>
+	/// <para>The error bounds are the largest errors against double precision over a sweep of every 13th float.</para>
+	/// </summary>
+
+	/// <summary>
+	/// <para>y = exp(x), under 1.5 ulp. Below -87.33 the results would be subnormal and are 0,</para>
+	/// <para>above 88.72 they are inf.</para>
+	/// </summary>
+	CHAOS_API void Exp(const float* x, float* y, size_t n);
+	/// <summary>y = log(x), under 1 ulp, log(0) = -inf and log(x &lt; 0) = nan</summary>
+	CHAOS_API void Log(const float* x, float* y, size_t n);
+	/// <summary>y = tanh(x), under 1.5 ulp</summary>
+	CHAOS_API void Tanh(const float* x, float* y, size_t n);
+	/// <summary>y = 1 / (1 + exp(-x)), under 3.5 ulp</summary>
+	CHAOS_API void Sigmoid(const float* x, float* y, size_t n);
+	/// <summary>
+	/// <para>y = x * tanh(log(1 + exp(x))), under 4.5 ulp.</para>
+	/// <para>It is computed as x * n / (n + 2) with n = e^x * (e^x + 2), which has no cancellation for x &lt; 0.</para>
+	/// </summary>
+	CHAOS_API void Mish(const float* x, float* y, size_t n);
+}
\ No newline at end of file
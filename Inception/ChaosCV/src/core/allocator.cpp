@@ -1,182 +1,879 @@
 #include "core/core.hpp"
+#include "core/thread_pool.hpp"
+
+#include <bit>
+#include <thread>
+
+#include <Windows.h>
 
 namespace chaos
 {
-	PoolAllocator::PoolAllocator()
+	// sizes up to 64 bytes share the class 0, then 4 classes per power of two
+	static constexpr int min_class_shift = 6;
+
+	static inline int SizeClass(size_t size)
+	{
+		if (size <= ((size_t)1 << min_class_shift))
+			return 0;
+		size_t s = size - 1;
+		int e = (int)std::bit_width(s) - 1;
+		int q = (int)(s >> (e - 2)) & 3;
+		return 1 + (e - min_class_shift) * 4 + q;
+	}
+
+	static inline size_t ClassSize(int cls)
+	{
+		if (cls == 0)
+			return (size_t)1 << min_class_shift;
+		int e = min_class_shift + (cls - 1) / 4;
+		int q = (cls - 1) % 4;
+		return ((size_t)1 << e) + ((size_t)(q + 1) << (e - 2));
+	}
+
+	// the header in front of every pooled block
+	struct PoolBlock
+	{
+		std::atomic<PoolBlock*> next; // valid while the block is in a free list
+		int size_class;
+		uint magic;
+		size_t size; // the request, valid while the block is in use
+	};
+	static_assert(sizeof(PoolBlock) <= MALLOC_ALIGN, "the header has to fit in the alignment");
+	static constexpr uint pool_magic = 0x9001b10c;
+
+	static inline PoolBlock* GetBlock(void* ptr)
+	{
+		return (PoolBlock*)((uchar*)ptr - MALLOC_ALIGN);
+	}
+
+	static inline void* GetData(PoolBlock* block)
+	{
+		return (uchar*)block + MALLOC_ALIGN;
+	}
+
+	static PoolBlock* NewBlock(int cls)
+	{
+		CHECK_LT(cls, PoolAllocator::num_classes) << "pool allocator can not allocate " << ClassSize(cls) << " bytes";
+		PoolBlock* block = new (chaos::FastMalloc(MALLOC_ALIGN + ClassSize(cls))) PoolBlock;
+		block->next.store(nullptr, std::memory_order_relaxed);
+		block->size_class = cls;
+		block->magic = pool_magic;
+		return block;
+	}
+
+	static void DeleteBlock(PoolBlock* block)
+	{
+		block->~PoolBlock();
+		chaos::FastFree(block);
+	}
+
+	// Treiber stack, the tag in the high bits is bumped on every update, so a head
+	// which is popped and pushed back in between does not pass the CAS (ABA)
+	static constexpr int tag_shift = 48;
+
+	static inline PoolBlock* Pointer(uint64 head)
 	{
-		_size_compare_ratio = 192; // 0.75f * 256
+		return (PoolBlock*)(uintptr_t)(head & (((uint64)1 << tag_shift) - 1));
 	}
 
+	static inline uint64 Tagged(PoolBlock* block, uint64 head)
+	{
+		return (uint64)(uintptr_t)block | (((head >> tag_shift) + 1) << tag_shift);
+	}
+
+	static void Push(std::atomic<uint64>& head, PoolBlock* block)
+	{
+		uint64 top = head.load(std::memory_order_relaxed);
+		do
+		{
+			block->next.store(Pointer(top), std::memory_order_relaxed);
+		} while (not head.compare_exchange_weak(top, Tagged(block, top), std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	static PoolBlock* Pop(std::atomic<uint64>& head)
+	{
+		uint64 top = head.load(std::memory_order_acquire);
+		while (PoolBlock* block = Pointer(top))
+		{
+			// the block may be taken by another thread meanwhile, then next is stale and the CAS fails
+			PoolBlock* next = block->next.load(std::memory_order_relaxed);
+			if (head.compare_exchange_weak(top, Tagged(next, top), std::memory_order_acquire, std::memory_order_acquire))
+				return block;
+		}
+		return nullptr;
+	}
+
+	static std::string Bytes(size_t bytes)
+	{
+		if (bytes >= ((size_t)1 << 20)) return Format("%.1f MB", bytes / 1048576.);
+		if (bytes >= ((size_t)1 << 10)) return Format("%.1f KB", bytes / 1024.);
+		return Format("%zu B", bytes);
+	}
+
+	std::string AllocatorStats::ToString() const
+	{
+		std::string text = Format("in use %s, peak %s, wasted %s, reserved %s in %zu blocks, fragmentation %.1f%%, "
+			"mallocs %zu, frees %zu, hit rate %.1f%%", Bytes(in_use).c_str(), Bytes(peak).c_str(), Bytes(wasted).c_str(),
+			Bytes(reserved).c_str(), blocks, 100. * Fragmentation(), mallocs, frees, 100. * HitRate());
+		bool first = true;
+		for (size_t cls = 0; cls < class_mallocs.size(); cls++)
+		{
+			if (class_mallocs[cls] == 0) continue;
+			text += Format("%s %s:%zu", first ? "\nclasses" : "", Bytes(PoolAllocator::ClassBytes((int)cls)).c_str(), class_mallocs[cls]);
+			first = false;
+		}
+		return text;
+	}
+
+	// the peak is raised by the thread which passes it, the others see it and give up
+	static inline void RaisePeak(std::atomic<size_t>& peak, size_t bytes)
+	{
+		size_t top = peak.load(std::memory_order_relaxed);
+		while (bytes > top && not peak.compare_exchange_weak(top, bytes, std::memory_order_relaxed));
+	}
+
+	PoolAllocator::PoolAllocator(bool track_peak) : track_peak(track_peak) {}
+
 	PoolAllocator::~PoolAllocator()
 	{
 		Clear();
 
-		if (not payouts.empty())
+		size_t count = 0;
+		for (const auto& list : free_lists) count += list.mallocs.load() - list.frees.load();
+		if (count != 0)
 		{
-			LOG(ERROR) << "pool allocator destroyed too early";
-			for (const auto& [size, ptr] : payouts)
-			{
-				LOG(ERROR) << Format("%p still in use", ptr);
-			}
+			LOG(ERROR) << Format("%zu blocks still in use", count);
 			LOG(FATAL) << "pool allocator destroyed too early";
 		}
 	}
 
 	void PoolAllocator::Clear()
 	{
-		budgets_lock.lock();
-		for (const auto& [size, ptr] : budgets)
+		for (auto& list : free_lists)
 		{
-			chaos::FastFree(ptr);
+			while (PoolBlock* block = Pop(list.head))
+			{
+				DeleteBlock(block);
+				list.deleted.fetch_add(1, std::memory_order_relaxed);
+			}
 		}
-		budgets.clear();
-
-		budgets_lock.unlock();
 	}
 
-	void PoolAllocator::SetSizeCompareRatio(float scr)
+	size_t PoolAllocator::ClassBytes(int size_class)
 	{
-		CHECK_GE(scr, 0.f) << "invalid size compare ratio " << scr;
-		CHECK_LE(scr, 1.f) << "invalid size compare ratio " << scr;
+		return ClassSize(size_class);
+	}
 
-		_size_compare_ratio = static_cast<uint>(scr * 256.f);
+	AllocatorStats PoolAllocator::Snapshot() const
+	{
+		AllocatorStats stats;
+		stats.class_mallocs.resize(num_classes);
+		for (int cls = 0; cls < num_classes; cls++)
+		{
+			const FreeList& list = free_lists[cls];
+			size_t mallocs = list.mallocs.load(std::memory_order_relaxed), frees = list.frees.load(std::memory_order_relaxed);
+			size_t misses = list.misses.load(std::memory_order_relaxed);
+			size_t blocks = misses - list.deleted.load(std::memory_order_relaxed);
+			size_t bytes = list.in_use.load(std::memory_order_relaxed);
+			stats.class_mallocs[cls] = mallocs;
+			stats.mallocs += mallocs;
+			stats.frees += frees;
+			stats.misses += misses;
+			stats.in_use += bytes;
+			// the classes of the blocks in use less their requests, the counters are not read at once
+			// so a request may be counted in the mallocs and not yet in the bytes
+			size_t classes = (mallocs - frees) * ClassSize(cls);
+			stats.wasted += classes > bytes ? classes - bytes : 0;
+			stats.blocks += blocks;
+			stats.reserved += blocks * ClassSize(cls);
+		}
+		while (not stats.class_mallocs.empty() && stats.class_mallocs.back() == 0) stats.class_mallocs.pop_back();
+		stats.hits = stats.mallocs - stats.misses;
+		RaisePeak(peak, stats.in_use);
+		stats.peak = peak.load(std::memory_order_relaxed);
+		return stats;
 	}
 
 	void* PoolAllocator::FastMalloc(size_t size)
 	{
-		budgets_lock.lock();
+		int cls = SizeClass(size);
+		PoolBlock* block = cls < num_classes ? Pop(free_lists[cls].head) : nullptr;
+		if (not block)
+		{
+			block = NewBlock(cls);
+			free_lists[cls].misses.fetch_add(1, std::memory_order_relaxed);
+		}
 
-		// find free budget
-		for (auto it = budgets.begin(); it != budgets.end(); ++it)
+		FreeList& list = free_lists[cls];
+		list.mallocs.fetch_add(1, std::memory_order_relaxed);
+		list.in_use.fetch_add(size, std::memory_order_relaxed);
+		block->size = size;
+		if (track_peak) RaisePeak(peak, in_use.fetch_add(size, std::memory_order_relaxed) + size);
+		return GetData(block);
+	}
+
+	void PoolAllocator::FastFree(void* ptr)
+	{
+		if (not ptr)
+			return;
+
+		PoolBlock* block = GetBlock(ptr);
+		CHECK_EQ(block->magic, pool_magic) << Format("pool allocator get wild %p", ptr);
+
+		FreeList& list = free_lists[block->size_class];
+		list.frees.fetch_add(1, std::memory_order_relaxed);
+		list.in_use.fetch_sub(block->size, std::memory_order_relaxed);
+		if (track_peak) in_use.fetch_sub(block->size, std::memory_order_relaxed);
+		Push(list.head, block);
+	}
+
+	UnlockedPoolAllocator::UnlockedPoolAllocator()
+	{
+		for (auto& list : free_lists)
+			list = nullptr;
+		stats.class_mallocs.resize(PoolAllocator::num_classes);
+	}
+
+	UnlockedPoolAllocator::~UnlockedPoolAllocator()
+	{
+		Clear();
+
+		if (outstanding != 0)
 		{
-			size_t bs = it->first;
+			LOG(ERROR) << Format("%zu blocks still in use", outstanding);
+			LOG(FATAL) << "unlocked pool allocator destroyed too early";
+		}
+	}
 
-			// size_compare_ratio ~ 100%
-			if (bs >= size && ((bs * _size_compare_ratio) >> 8) <= size)
+	void UnlockedPoolAllocator::Clear()
+	{
+		for (auto& list : free_lists)
+		{
+			while (PoolBlock* block = list)
 			{
-				void* ptr = it->second;
-				budgets.erase(it);
-				budgets_lock.unlock();
-				payouts_lock.lock();
-				payouts.push_back(std::make_pair(bs, ptr));
-				payouts_lock.unlock();
-				return ptr;
+				list = block->next.load(std::memory_order_relaxed);
+				stats.blocks--;
+				stats.reserved -= ClassSize(block->size_class);
+				DeleteBlock(block);
 			}
 		}
+	}
 
-		budgets_lock.unlock();
+	AllocatorStats UnlockedPoolAllocator::Snapshot() const
+	{
+		AllocatorStats snapshot = stats;
+		while (not snapshot.class_mallocs.empty() && snapshot.class_mallocs.back() == 0) snapshot.class_mallocs.pop_back();
+		snapshot.hits = snapshot.mallocs - snapshot.misses;
+		return snapshot;
+	}
 
-		// new
-		void* ptr = chaos::FastMalloc(size);
-		payouts_lock.lock();
-		payouts.push_back(std::make_pair(size, ptr));
-		payouts_lock.unlock();
+	void* UnlockedPoolAllocator::FastMalloc(size_t size)
+	{
+		int cls = SizeClass(size);
+		PoolBlock* block = cls < PoolAllocator::num_classes ? free_lists[cls] : nullptr;
+		if (block)
+			free_lists[cls] = block->next.load(std::memory_order_relaxed);
+		else
+		{
+			block = NewBlock(cls);
+			stats.misses++;
+			stats.blocks++;
+			stats.reserved += ClassSize(cls);
+		}
 
-		return ptr;
+		outstanding++;
+		stats.mallocs++;
+		stats.class_mallocs[cls]++;
+		stats.wasted += ClassSize(cls) - size;
+		stats.in_use += size;
+		stats.peak = std::max(stats.peak, stats.in_use);
+		block->size = size;
+		return GetData(block);
 	}
 
-	void PoolAllocator::FastFree(void* ptr)
+	void UnlockedPoolAllocator::FastFree(void* ptr)
+	{
+		if (not ptr)
+			return;
+
+		PoolBlock* block = GetBlock(ptr);
+		CHECK_EQ(block->magic, pool_magic) << Format("unlocked pool allocator get wild %p", ptr);
+
+		outstanding--;
+		stats.frees++;
+		stats.wasted -= ClassSize(block->size_class) - block->size;
+		stats.in_use -= block->size;
+		block->next.store(free_lists[block->size_class], std::memory_order_relaxed);
+		free_lists[block->size_class] = block;
+	}
+
+
+	// the header in front of every block of the page allocator
+	struct PageBlock
+	{
+		size_t size; // the request
+		size_t mapped; // the bytes mapped from the pages, 0 for a block of FastMalloc
+		size_t stripe; // the bytes of each allocation of an interleaved block on the large pages, else 0
+		uint magic;
+		int large; // on the large pages
+	};
+	static_assert(sizeof(PageBlock) <= MALLOC_ALIGN, "the header has to fit in the alignment");
+	static constexpr uint page_magic = 0x9a9eb10c;
+	static constexpr size_t stripe_size = (size_t)2 << 20;
+
+	size_t PageAllocator::LargePageSize()
+	{
+		// the privilege is enabled in the token of the process once, it is granted by the local security policy
+		static const size_t size = []() -> size_t {
+			size_t minimum = GetLargePageMinimum();
+			if (minimum == 0) return 0;
+			HANDLE token = nullptr;
+			if (not OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) return 0;
+			TOKEN_PRIVILEGES privileges = {};
+			privileges.PrivilegeCount = 1;
+			privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+			bool enabled = LookupPrivilegeValueA(nullptr, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid) &&
+				AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) && GetLastError() == ERROR_SUCCESS;
+			CloseHandle(token);
+			if (not enabled) LOG(WARNING) << "no SeLockMemoryPrivilege, the page allocators map the normal pages";
+			return enabled ? minimum : 0;
+		}();
+		return size;
+	}
+
+	int PageAllocator::NumNodes()
 	{
-		payouts_lock.lock();
+		ULONG highest = 0;
+		return GetNumaHighestNodeNumber(&highest) ? (int)highest + 1 : 1;
+	}
+
+	int PageAllocator::CurrentNode()
+	{
+		PROCESSOR_NUMBER processor;
+		GetCurrentProcessorNumberEx(&processor);
+		USHORT node = 0;
+		return GetNumaProcessorNodeEx(&processor, &node) ? (int)node : 0;
+	}
 
-		// return to budgets
-		for (auto it = payouts.begin(); it != payouts.end(); ++it)
+	PageAllocator::PageAllocator(size_t threshold, NumaPolicy policy, int node, bool large_pages, bool track_peak) :
+		threshold(threshold), policy(NumNodes() > 1 ? policy : ANY), node(node), large_pages(large_pages && LargePageSize() > 0),
+		track_peak(track_peak)
+	{
+		CHECK(node >= 0 && node < NumNodes()) << "no NUMA node " << node << " of " << NumNodes();
+	}
+
+	PageAllocator::~PageAllocator()
+	{
+		size_t count = 0;
+		for (const auto& c : counters) count += c.mallocs.load() - c.frees.load();
+		if (count != 0)
 		{
-			if (it->second == ptr)
+			LOG(ERROR) << Format("%zu blocks still in use", count);
+			LOG(FATAL) << "page allocator destroyed too early";
+		}
+	}
+
+	// the large pages can not be committed in a reservation, so the stripes are mapped one by one in a range which
+	// is reserved and given back just before, another thread may take it meanwhile and then the range is tried again
+	static void* MapLargeStripes(size_t size, size_t& mapped, size_t& stripe)
+	{
+		size_t page = PageAllocator::LargePageSize();
+		stripe = AlignSize(stripe_size, (int)page);
+		mapped = AlignSize(size, (int)stripe);
+		HANDLE process = GetCurrentProcess();
+		int num_nodes = PageAllocator::NumNodes();
+		for (int attempt = 0; attempt < 3; attempt++)
+		{
+			uchar* range = (uchar*)VirtualAlloc(nullptr, mapped + page, MEM_RESERVE, PAGE_READWRITE);
+			if (not range) return nullptr;
+			uchar* base = AlignPtr(range, (int)page);
+			VirtualFree(range, 0, MEM_RELEASE);
+
+			size_t offset = 0;
+			for (size_t s = 0; offset < mapped; offset += stripe, s++)
 			{
-				size_t size = it->first;
-				payouts.erase(it);
-				payouts_lock.unlock();
-				budgets_lock.lock();
-				budgets.push_back(std::make_pair(size, ptr));
-				budgets_lock.unlock();
-				return;
+				DWORD type = MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES;
+				if (not VirtualAllocExNuma(process, base + offset, stripe, type, PAGE_READWRITE, (DWORD)(s % num_nodes))) break;
 			}
+			if (offset >= mapped) return base;
+			for (size_t o = 0; o < offset; o += stripe) VirtualFree(base + o, 0, MEM_RELEASE);
+		}
+		return nullptr;
+	}
+
+	void* PageAllocator::Map(size_t size, size_t& mapped, size_t& stripe, bool& large)
+	{
+		HANDLE process = GetCurrentProcess();
+		int target = node;
+		if (policy == LOCAL)
+		{
+			// the blobs of an executor on the pool of a node go there, whichever thread allocates them
+			int pool_node = ThreadPool::Current().node();
+			target = pool_node >= 0 ? pool_node : CurrentNode();
+		}
+		stripe = 0;
+		if (large_pages && policy == INTERLEAVE)
+		{
+			void* ptr = MapLargeStripes(size, mapped, stripe);
+			large = ptr != nullptr;
+			if (ptr) return ptr;
+			stripe = 0;
+		}
+		else if (large_pages)
+		{
+			// falls back to the normal pages when the memory is too fragmented for the large ones
+			mapped = AlignSize(size, (int)LargePageSize());
+			DWORD type = MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES;
+			void* ptr = policy == ANY ? VirtualAlloc(nullptr, mapped, type, PAGE_READWRITE) :
+				VirtualAllocExNuma(process, nullptr, mapped, type, PAGE_READWRITE, (DWORD)target);
+			large = ptr != nullptr;
+			if (ptr) return ptr;
 		}
 
-		payouts_lock.unlock();
+		large = false;
+		mapped = AlignSize(size, 1 << 16);
+		if (policy == ANY) return VirtualAlloc(nullptr, mapped, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+		if (policy != INTERLEAVE) return VirtualAllocExNuma(process, nullptr, mapped, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, (DWORD)target);
 
-		LOG(FATAL) << Format("pool allocator get wild %p", ptr);
-		chaos::FastFree(ptr);
+		// the stripes of a reservation committed on the nodes in turn, the pages take the node when they are committed
+		uchar* base = (uchar*)VirtualAlloc(nullptr, mapped, MEM_RESERVE, PAGE_READWRITE);
+		if (not base) return nullptr;
+		int num_nodes = NumNodes();
+		for (size_t offset = 0, s = 0; offset < mapped; offset += stripe_size, s++)
+		{
+			size_t length = std::min(stripe_size, mapped - offset);
+			if (not VirtualAllocExNuma(process, base + offset, length, MEM_COMMIT, PAGE_READWRITE, (DWORD)(s % num_nodes)))
+			{
+				VirtualFree(base, 0, MEM_RELEASE);
+				return nullptr;
+			}
+		}
+		return base;
 	}
 
-	UnlockedPoolAllocator::UnlockedPoolAllocator()
+	void* PageAllocator::FastMalloc(size_t size)
 	{
-		_size_compare_ratio = 192; // 0.75 * 256
+		PageBlock* block = nullptr;
+		size_t mapped = 0, stripe = 0;
+		bool large = false;
+		if (size + MALLOC_ALIGN >= threshold)
+		{
+			block = (PageBlock*)Map(size + MALLOC_ALIGN, mapped, stripe, large);
+			CHECK(block) << Format("page allocator can not map %zu bytes, error %lu", size, GetLastError());
+			reserved.fetch_add(mapped, std::memory_order_relaxed);
+			mapped_requests.fetch_add(size, std::memory_order_relaxed);
+			blocks.fetch_add(1, std::memory_order_relaxed);
+			if (large) large_page_bytes.fetch_add(mapped, std::memory_order_relaxed);
+		}
+		else
+		{
+			block = (PageBlock*)chaos::FastMalloc(size + MALLOC_ALIGN);
+		}
+		block->size = size;
+		block->mapped = mapped;
+		block->stripe = stripe;
+		block->magic = page_magic;
+		block->large = large;
+
+		Counters& c = counters[std::min(SizeClass(size), PoolAllocator::num_classes - 1)];
+		c.mallocs.fetch_add(1, std::memory_order_relaxed);
+		c.in_use.fetch_add(size, std::memory_order_relaxed);
+		if (track_peak) RaisePeak(peak, in_use.fetch_add(size, std::memory_order_relaxed) + size);
+		return (uchar*)block + MALLOC_ALIGN;
 	}
 
-	UnlockedPoolAllocator::~UnlockedPoolAllocator()
+	void PageAllocator::FastFree(void* ptr)
+	{
+		if (not ptr)
+			return;
+
+		PageBlock* block = (PageBlock*)((uchar*)ptr - MALLOC_ALIGN);
+		CHECK_EQ(block->magic, page_magic) << Format("page allocator get wild %p", ptr);
+		Counters& c = counters[std::min(SizeClass(block->size), PoolAllocator::num_classes - 1)];
+		c.frees.fetch_add(1, std::memory_order_relaxed);
+		c.in_use.fetch_sub(block->size, std::memory_order_relaxed);
+		if (track_peak) in_use.fetch_sub(block->size, std::memory_order_relaxed);
+		if (block->mapped == 0)
+		{
+			chaos::FastFree(block);
+			return;
+		}
+
+		reserved.fetch_sub(block->mapped, std::memory_order_relaxed);
+		mapped_requests.fetch_sub(block->size, std::memory_order_relaxed);
+		blocks.fetch_sub(1, std::memory_order_relaxed);
+		if (block->large) large_page_bytes.fetch_sub(block->mapped, std::memory_order_relaxed);
+		// the header is in the first stripe, which goes last
+		for (size_t offset = block->stripe ? block->mapped - block->stripe : 0; offset > 0; offset -= block->stripe)
+			VirtualFree((uchar*)block + offset, 0, MEM_RELEASE);
+		VirtualFree(block, 0, MEM_RELEASE);
+	}
+
+	AllocatorStats PageAllocator::Snapshot() const
+	{
+		AllocatorStats stats;
+		for (const auto& c : counters)
+		{
+			stats.mallocs += c.mallocs.load(std::memory_order_relaxed);
+			stats.frees += c.frees.load(std::memory_order_relaxed);
+			stats.in_use += c.in_use.load(std::memory_order_relaxed);
+		}
+		RaisePeak(peak, stats.in_use);
+		stats.peak = peak.load(std::memory_order_relaxed);
+		stats.reserved = reserved.load(std::memory_order_relaxed);
+		stats.blocks = blocks.load(std::memory_order_relaxed);
+		stats.wasted = stats.reserved - std::min(stats.reserved, mapped_requests.load(std::memory_order_relaxed));
+		return stats;
+	}
+
+
+	// tells the allocators apart in the thread local entries, unlike the address which may be reused
+	static std::atomic<uint64> allocator_ids = 1;
+
+	/// <summary>
+	/// <para>The state of the calling thread in the allocator id, the last few allocators a thread used are found</para>
+	/// <para>without the lock, so a thread switching between the blob and the workspace allocators does not take it.</para>
+	/// </summary>
+	template<class State>
+	static State* ThreadState(uint64 id, std::mutex& lock, std::vector<State*>& states)
+	{
+		struct Entry { uint64 id = 0; State* state = nullptr; };
+		static constexpr int num_entries = 4;
+		thread_local Entry entries[num_entries];
+		thread_local int next = 0;
+		for (const Entry& entry : entries)
+		{
+			if (entry.id == id) return entry.state;
+		}
+
+		std::lock_guard<std::mutex> guard(lock);
+		auto thread = std::this_thread::get_id();
+		auto it = std::find_if(states.begin(), states.end(), [&](const State* state) { return state->thread == thread; });
+		if (it == states.end())
+		{
+			states.push_back(new State());
+			states.back()->thread = thread;
+			it = states.end() - 1;
+		}
+		entries[next] = { id, *it };
+		next = (next + 1) % num_entries;
+		return *it;
+	}
+
+	// the header in front of every block of the thread caches
+	struct CacheBlock
+	{
+		CacheBlock* next; // valid while the block is cached or in a batch
+		ThreadCache* owner;
+		int size_class; // -1 for a block which is not cached
+		uint magic;
+	};
+	static_assert(sizeof(CacheBlock) <= MALLOC_ALIGN, "the header has to fit in the alignment");
+	static constexpr uint cache_magic = 0xcac4eb10;
+
+	struct ThreadCache
+	{
+		std::thread::id thread;
+		CacheBlock* lists[PoolAllocator::num_classes] = { nullptr };
+		size_t cached = 0;
+		// the blocks the thread allocated less those it freed, the sum over the threads is the blocks in use
+		int64 in_use = 0;
+
+		// the blocks of this thread freed by the others, pushed a batch at a time and taken all at once
+		alignas(64) std::atomic<CacheBlock*> remote = nullptr;
+
+		// the blocks this thread freed for the others, by their owner
+		struct Batch
+		{
+			ThreadCache* owner = nullptr;
+			CacheBlock* head = nullptr;
+			CacheBlock* tail = nullptr;
+			int count = 0;
+		};
+		static constexpr int num_batches = 4;
+		alignas(64) Batch batches[num_batches];
+	};
+
+	ThreadCachingAllocator::ThreadCachingAllocator(Allocator* upstream, size_t max_cached) : upstream(upstream), max_cached(max_cached), id(allocator_ids++) {}
+
+	ThreadCachingAllocator::~ThreadCachingAllocator()
 	{
 		Clear();
 
-		if (not payouts.empty())
+		int64 count = 0;
+		for (ThreadCache* cache : caches)
 		{
-			LOG(ERROR) << "unlocked pool allocator destroyed too early";
-			for (const auto& [size, ptr] : payouts)
-			{
-				LOG(ERROR) << Format("%p still in use", ptr);
-			}
-			LOG(FATAL) << "unlocked pool allocator destroyed too early";
+			count += cache->in_use;
+			delete cache;
+		}
+		if (count != 0)
+		{
+			LOG(ERROR) << Format("%lld blocks still in use", count);
+			LOG(FATAL) << "thread caching allocator destroyed too early";
 		}
 	}
 
-	void UnlockedPoolAllocator::Clear()
+	ThreadCache* ThreadCachingAllocator::Local()
 	{
-		for (const auto& [size, ptr] : budgets)
+		return ThreadState(id, lock, caches);
+	}
+
+	void* ThreadCachingAllocator::FastMalloc(size_t size)
+	{
+		ThreadCache* cache = Local();
+		cache->in_use++;
+
+		int cls = SizeClass(size);
+		size_t bytes = ClassSize(cls);
+		if (bytes > max_cached / 8)
 		{
-			chaos::FastFree(ptr);
+			cls = -1;
+			bytes = size;
+		}
+		CacheBlock* block = cls < 0 ? nullptr : cache->lists[cls];
+		if (not block && cls >= 0 && cache->remote.load(std::memory_order_relaxed))
+		{
+			// the blocks back from the other threads, those beyond the bound go upstream
+			CacheBlock* remote = cache->remote.exchange(nullptr, std::memory_order_acquire);
+			while (remote)
+			{
+				CacheBlock* next = remote->next;
+				size_t remote_bytes = ClassSize(remote->size_class);
+				if (cache->cached + remote_bytes > max_cached)
+				{
+					if (upstream) upstream->FastFree(remote);
+					else chaos::FastFree(remote);
+				}
+				else
+				{
+					remote->next = cache->lists[remote->size_class];
+					cache->lists[remote->size_class] = remote;
+					cache->cached += remote_bytes;
+				}
+				remote = next;
+			}
+			block = cache->lists[cls];
 		}
-		budgets.clear();
+
+		if (block)
+		{
+			cache->lists[cls] = block->next;
+			cache->cached -= bytes;
+		}
+		else
+		{
+			block = (CacheBlock*)(upstream ? upstream->FastMalloc(MALLOC_ALIGN + bytes) : chaos::FastMalloc(MALLOC_ALIGN + bytes));
+			block->owner = cache;
+			block->size_class = cls;
+			block->magic = cache_magic;
+		}
+		block->next = nullptr;
+		return (uchar*)block + MALLOC_ALIGN;
 	}
 
-	void UnlockedPoolAllocator::SetSizeCompareRatio(float scr)
+	void ThreadCachingAllocator::FastFree(void* ptr)
 	{
-		CHECK_GE(scr, 0.f) << "invalid size compare ratio " << scr;
-		CHECK_LE(scr, 1.f) << "invalid size compare ratio " << scr;
+		if (not ptr)
+			return;
+
+		CacheBlock* block = (CacheBlock*)((uchar*)ptr - MALLOC_ALIGN);
+		CHECK_EQ(block->magic, cache_magic) << Format("thread caching allocator get wild %p", ptr);
+		ThreadCache* cache = Local();
+		cache->in_use--;
+
+		int cls = block->size_class;
+		if (block->owner == cache && cls >= 0 && cache->cached + ClassSize(cls) <= max_cached)
+		{
+			block->next = cache->lists[cls];
+			cache->lists[cls] = block;
+			cache->cached += ClassSize(cls);
+			return;
+		}
+		if (block->owner == cache || cls < 0)
+		{
+			if (upstream) upstream->FastFree(block);
+			else chaos::FastFree(block);
+			return;
+		}
 
-		_size_compare_ratio = static_cast<uint>(scr * 256.f);
+		// a batch per owner, a block of another owner sends the batch in the slot first
+		int slot = (int)(((uintptr_t)block->owner >> 6) % ThreadCache::num_batches);
+		ThreadCache::Batch& batch = cache->batches[slot];
+		if (batch.owner != block->owner)
+		{
+			if (batch.count) Send(cache, slot);
+			batch.owner = block->owner;
+		}
+		block->next = batch.head;
+		batch.head = block;
+		if (not batch.tail) batch.tail = block;
+		if (++batch.count == batch_size) Send(cache, slot);
 	}
 
-	void* UnlockedPoolAllocator::FastMalloc(size_t size)
+	void ThreadCachingAllocator::Send(ThreadCache* cache, int slot)
 	{
-		// find free budget
-		for (auto it = budgets.begin(); it != budgets.end(); ++it)
+		ThreadCache::Batch& batch = cache->batches[slot];
+		CacheBlock* top = batch.owner->remote.load(std::memory_order_relaxed);
+		do
 		{
-			size_t bs = it->first;
+			batch.tail->next = top;
+		} while (not batch.owner->remote.compare_exchange_weak(top, batch.head, std::memory_order_release, std::memory_order_relaxed));
+		batch.head = batch.tail = nullptr;
+		batch.count = 0;
+	}
 
-			// size_compare_ratio ~ 100%
-			if (bs >= size && ((bs * _size_compare_ratio) >> 8) <= size)
+	void ThreadCachingAllocator::Release(ThreadCache* cache)
+	{
+		for (int slot = 0; slot < ThreadCache::num_batches; slot++)
+		{
+			if (cache->batches[slot].count) Send(cache, slot);
+		}
+		auto release = [&](CacheBlock* block) {
+			while (block)
 			{
-				void* ptr = it->second;
-				budgets.erase(it);
-				payouts.push_back(std::make_pair(bs, ptr));
-				return ptr;
+				CacheBlock* next = block->next;
+				if (upstream) upstream->FastFree(block);
+				else chaos::FastFree(block);
+				block = next;
 			}
+		};
+		release(cache->remote.exchange(nullptr, std::memory_order_acquire));
+		for (auto& list : cache->lists)
+		{
+			release(list);
+			list = nullptr;
 		}
+		cache->cached = 0;
+	}
 
-		// new
-		void* ptr = chaos::FastMalloc(size);
-		payouts.push_back(std::make_pair(size, ptr));
-		return ptr;
+	void ThreadCachingAllocator::Flush()
+	{
+		Release(Local());
 	}
 
-	void UnlockedPoolAllocator::FastFree(void* ptr)
+	void ThreadCachingAllocator::Clear()
 	{
-		for (auto it = payouts.begin(); it != payouts.end(); ++it)
+		std::lock_guard<std::mutex> guard(lock);
+		// the batches first, they may hold the blocks of any cache
+		for (ThreadCache* cache : caches)
 		{
-			if (it->second == ptr)
+			for (int slot = 0; slot < ThreadCache::num_batches; slot++)
 			{
-				size_t size = it->first;
+				if (cache->batches[slot].count) Send(cache, slot);
+			}
+		}
+		for (ThreadCache* cache : caches) Release(cache);
+	}
+
+	size_t ThreadCachingAllocator::Cached()
+	{
+		return Local()->cached;
+	}
+
+
+	struct Arena
+	{
+		std::thread::id thread;
+		std::vector<std::pair<uchar*, size_t>> chunks;
+		size_t chunk = 0;
+		size_t offset = 0;
+	};
+
+	ArenaAllocator::ArenaAllocator(size_t chunk_size) : chunk_size(AlignSize(std::max<size_t>(chunk_size, MALLOC_ALIGN), MALLOC_ALIGN)), id(allocator_ids++) {}
+
+	ArenaAllocator::~ArenaAllocator()
+	{
+		for (Arena* arena : arenas)
+		{
+			for (auto& [data, size] : arena->chunks) chaos::FastFree(data);
+			delete arena;
+		}
+	}
 
-				payouts.erase(it);
+	Arena* ArenaAllocator::Local()
+	{
+		return ThreadState(id, lock, arenas);
+	}
+
+	void* ArenaAllocator::FastMalloc(size_t size)
+	{
+		Arena* arena = Local();
+		size = AlignSize(std::max<size_t>(size, 1), MALLOC_ALIGN);
+		if (arena->chunks.empty() || arena->offset + size > arena->chunks[arena->chunk].second)
+		{
+			// the chunks after the current one are free, take the next if it fits or replace them by a larger one
+			size_t next = arena->chunks.empty() ? 0 : arena->chunk + 1;
+			if (next >= arena->chunks.size() || size > arena->chunks[next].second)
+			{
+				size_t capacity = arena->chunks.empty() ? chunk_size : arena->chunks.back().second * 2;
+				for (size_t i = next; i < arena->chunks.size(); i++) chaos::FastFree(arena->chunks[i].first);
+				arena->chunks.resize(next);
+				capacity = std::max(capacity, size);
+				arena->chunks.push_back({ (uchar*)chaos::FastMalloc(capacity), capacity });
+			}
+			arena->chunk = next;
+			arena->offset = 0;
+		}
+		void* ptr = arena->chunks[arena->chunk].first + arena->offset;
+		arena->offset += size;
+		return ptr;
+	}
 
-				budgets.push_back(std::make_pair(size, ptr));
+	ArenaAllocator::Marker ArenaAllocator::Mark()
+	{
+		Arena* arena = Local();
+		return { arena->chunk, arena->offset };
+	}
 
-				return;
+	void ArenaAllocator::Rewind(const Marker& marker)
+	{
+		Arena* arena = Local();
+		CHECK(marker.chunk < arena->chunk || (marker.chunk == arena->chunk && marker.offset <= arena->offset)) << "rewind to a mark after the top of the arena";
+		arena->chunk = marker.chunk;
+		arena->offset = marker.offset;
+		if (marker.chunk == 0 && marker.offset == 0 && arena->chunks.size() > 1)
+		{
+			size_t capacity = 0;
+			for (auto& [data, size] : arena->chunks)
+			{
+				capacity += size;
+				chaos::FastFree(data);
 			}
+			arena->chunks.assign(1, { (uchar*)chaos::FastMalloc(capacity), capacity });
 		}
+	}
 
-		LOG(FATAL) << Format("unlocked pool allocator get wild %p", ptr);
-		chaos::FastFree(ptr);
+	size_t ArenaAllocator::Used()
+	{
+		Arena* arena = Local();
+		size_t used = arena->offset;
+		for (size_t i = 0; i < arena->chunk; i++) used += arena->chunks[i].second;
+		return used;
+	}
+
+	size_t ArenaAllocator::Capacity()
+	{
+		Arena* arena = Local();
+		size_t capacity = 0;
+		for (auto& [data, size] : arena->chunks) capacity += size;
+		return capacity;
+	}
+
+
+	static thread_local Allocator* current_workspace = nullptr;
+
+	WorkspaceScope::WorkspaceScope(Allocator* workspace) : previous(current_workspace)
+	{
+		current_workspace = workspace;
+	}
+
+	WorkspaceScope::~WorkspaceScope()
+	{
+		current_workspace = previous;
+	}
+
+	Allocator* WorkspaceScope::Current()
+	{
+		return current_workspace;
 	}
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 //#include <stdarg.h>
 #include <regex>
 #include <Windows.h>
+#include <intrin.h>
 
 namespace chaos
 {
@@ -68,4 +69,60 @@ namespace chaos
 		QueryPerformanceFrequency(&freq);
 		return static_cast<double>(freq.QuadPart);
 	}
+
+	class HardwareFeatures
+	{
+	public:
+		HardwareFeatures()
+		{
+			int info[4] = { 0 };
+			__cpuidex(info, 0, 0);
+			int max_leaf = info[0];
+
+			__cpuidex(info, 1, 0);
+			int ecx1 = info[2], edx1 = info[3];
+
+			int ebx7 = 0, ecx7 = 0, eax7_1 = 0;
+			if (max_leaf >= 7)
+			{
+				__cpuidex(info, 7, 0);
+				ebx7 = info[1]; ecx7 = info[2];
+				__cpuidex(info, 7, 1);
+				eax7_1 = info[0];
+			}
+
+			// the OS has to save the ymm/zmm registers on context switch
+			bool os_avx = false, os_avx512 = false;
+			if (ecx1 & (1 << 27)) // OSXSAVE
+			{
+				uint64 xcr0 = _xgetbv(0);
+				os_avx = (xcr0 & 0x6) == 0x6;
+				os_avx512 = (xcr0 & 0xe6) == 0xe6;
+			}
+
+			Set(CpuFeature::SSE2, edx1 & (1 << 26));
+			Set(CpuFeature::AVX, os_avx && (ecx1 & (1 << 28)));
+			Set(CpuFeature::FMA3, os_avx && (ecx1 & (1 << 12)));
+			Set(CpuFeature::F16C, os_avx && (ecx1 & (1 << 29)));
+			Set(CpuFeature::AVX2, os_avx && (ebx7 & (1 << 5)));
+			Set(CpuFeature::AVXVNNI, os_avx && (eax7_1 & (1 << 4)));
+			Set(CpuFeature::AVX512F, os_avx512 && (ebx7 & (1 << 16)));
+			Set(CpuFeature::AVX512BW, os_avx512 && (ebx7 & (1 << 30)));
+			Set(CpuFeature::AVX512VNNI, os_avx512 && (ecx7 & (1 << 11)));
+			Set(CpuFeature::AVX512BF16, os_avx512 && (eax7_1 & (1 << 5)));
+		}
+
+		bool Has(CpuFeature feature) const { return features[static_cast<int>(feature)]; }
+
+	private:
+		void Set(CpuFeature feature, bool has) { features[static_cast<int>(feature)] = has; }
+
+		bool features[16] = { false };
+	};
+
+	bool CheckHardwareSupport(CpuFeature feature)
+	{
+		static const HardwareFeatures features;
+		return features.Has(feature);
+	}
 }
\ No newline at end of file
@@ -1,10 +1,16 @@
 #include "core/tensor.hpp"
+#include "core/nd_iterator.hpp"
 
 #include "core/vulkan/vk_tensor.hpp"
 
 namespace chaos
 {
-	
+	// the reference counter takes a whole cache line in front of the data
+	static constexpr size_t control_block_size = 64;
+	static_assert(control_block_size % MALLOC_ALIGN == 0, "the data has to stay aligned");
+
+	// the bytes a thread copies at least
+	static constexpr size_t parallel_bytes = 1 << 18;
 
 	Tensor::Tensor(const Shape& shape, const Depth& depth, const Packing& packing, Allocator* allocator)
 	{
@@ -27,7 +33,7 @@ namespace chaos
 	Tensor::~Tensor() { Release(); }
 
 	Tensor::Tensor(const Tensor& t) :
-		data(t.data), allocator(t.allocator), ref_cnt(t.ref_cnt), shape(t.shape), depth(t.depth), packing(t.packing), steps(t.steps)
+		data(t.data), allocator(t.allocator), ref_cnt(t.ref_cnt), shape(t.shape), depth(t.depth), packing(t.packing), type(t.type), steps(t.steps)
 	{
 		if (ref_cnt) CHAOS_XADD(ref_cnt, 1);
 	}
@@ -46,14 +52,43 @@ namespace chaos
 		shape = t.shape;
 		depth = t.depth;
 		packing = t.packing;
+		type = t.type;
 		steps = t.steps;
 
 		return *this;
 	}
+	Tensor::Tensor(Tensor&& t) noexcept :
+		data(t.data), allocator(t.allocator), ref_cnt(t.ref_cnt), depth(t.depth), packing(t.packing), type(t.type), shape(std::move(t.shape)), steps(std::move(t.steps))
+	{
+		t.data = nullptr;
+		t.ref_cnt = nullptr;
+	}
+	Tensor& Tensor::operator=(Tensor&& t) noexcept
+	{
+		if (this == &t) return *this;
+
+		Release();
+
+		data = t.data;
+		ref_cnt = t.ref_cnt;
+		allocator = t.allocator;
+		t.data = nullptr;
+		t.ref_cnt = nullptr;
+
+		shape = std::move(t.shape);
+		depth = t.depth;
+		packing = t.packing;
+		type = t.type;
+		steps = std::move(t.steps);
+
+		return *this;
+	}
 
-	void Tensor::Create(const Shape& _shape, const Steps& _steps, const Depth& _depth, const Packing& _packing, Allocator* _allocator)
+	void Tensor::Create(const Shape& _shape, const Steps& _steps, const Depth& _depth, const Packing& _packing, Allocator* _allocator, ElemType _type)
 	{
-		if (_shape == shape && _steps == steps && _depth == depth && _packing == packing  && _allocator == allocator) return;
+		// the type only tells how the bytes are read, a buffer of the same layout is kept
+		type = _type;
+		if (data && _shape == shape && _steps == steps && _depth == depth && _packing == packing  && _allocator == allocator) return;
 
 		Release();
 
@@ -69,12 +104,12 @@ namespace chaos
 			size_t size = AlignSize(total * depth * packing, 4);
 
 			if (allocator)
-				data = allocator->FastMalloc(size + sizeof(*ref_cnt));
+				ref_cnt = (int*)allocator->FastMalloc(control_block_size + size);
 			else
-				data = FastMalloc(size + sizeof(*ref_cnt));
+				ref_cnt = (int*)FastMalloc(control_block_size + size);
 
-			ref_cnt = (int*)(((uchar*)data) + size);
 			*ref_cnt = 1;
+			data = (uchar*)ref_cnt + control_block_size;
 		}
 	}
 
@@ -88,9 +123,9 @@ namespace chaos
 		if (ref_cnt && CHAOS_XADD(ref_cnt, -1) == 1)
 		{
 			if (allocator)
-				allocator->FastFree(data);
+				allocator->FastFree(ref_cnt);
 			else
-				FastFree(data);
+				FastFree(ref_cnt);
 		}
 
 		data = nullptr;
@@ -99,33 +134,38 @@ namespace chaos
 
 	void Tensor::CopyTo(const OutputArray& arr, Allocator* allocator) const
 	{
-		if (arr.empty() || arr.shape() != shape) arr.Create(shape, shape.steps(), depth, packing, allocator);
+		if (arr.empty() || arr.shape() != shape) arr.Create(shape, shape.steps(), depth, packing, allocator, type);
 		Tensor& t = arr.GetTensorRef();
+		t.type = type;
 
 		size_t elem_size = 1 * depth * packing;
 		if (continua() && t.continua())
 		{
-			memcpy(t.data, data, total() * elem_size);
+			// a big copy is shared by the threads, for the bandwidth
+			const uchar* src = (const uchar*)data;
+			uchar* dst = (uchar*)t.data;
+			ParallelFor(0, total() * elem_size, parallel_bytes, [&](size_t b, size_t e) {
+				memcpy(dst + b, src + b, e - b);
+			});
 		}
 		else
 		{
-			size_t dims = shape.size();
-			size_t rows = shape.vol() / shape.back();
-			size_t len = shape[dims - 1] * elem_size; // row len
-			for (size_t r = 0; r < rows; r++)
-			{
-				size_t dst_offset = 0;
-				size_t src_offset = 0;
-				size_t idx = r * shape[dims - 1];
-				for (int64 j = dims - 1; j >= 0; j--)
+			// runs of the merged inner dims, a whole run when both are dense there
+			NdIterator<2> it(shape, { &t.steps, &steps });
+			bool dense = it.step(0) == 1 && it.step(1) == 1;
+			ParallelForEach(it, std::max(parallel_bytes / elem_size, (size_t)1), [&](const std::array<size_t, 2>& offsets, size_t n) {
+				uchar* dst = (uchar*)t.data + offsets[0] * elem_size;
+				const uchar* src = (const uchar*)data + offsets[1] * elem_size;
+				if (dense)
+				{
+					memcpy(dst, src, n * elem_size);
+				}
+				else
 				{
-					size_t k = idx % shape[j];
-					dst_offset += k * t.steps[j];
-					src_offset += k * steps[j];
-					idx /= shape[j];
+					for (size_t i = 0; i < n; i++)
+						memcpy(dst + i * it.step(0) * elem_size, src + i * it.step(1) * elem_size, elem_size);
 				}
-				memcpy((uchar*)t + dst_offset * elem_size, (uchar*)data + src_offset * elem_size, len);
-			}
+			});
 		}
 	}
 	Tensor Tensor::Clone(Allocator* allocator) const
@@ -170,11 +210,11 @@ namespace chaos
 
 	OutputArray::OutputArray() { Init(NONE, nullptr); }
 	OutputArray::OutputArray(Tensor& data) { Init(TENSOR, &data); }
-	void OutputArray::Create(const Shape& shape, const Steps& steps, const Depth& depth, const Packing& packing, Allocator* allocator) const
+	void OutputArray::Create(const Shape& shape, const Steps& steps, const Depth& depth, const Packing& packing, Allocator* allocator, ElemType type) const
 	{
 		if (flag == TENSOR)
 		{
-			return ((Tensor*)obj)->Create(shape, steps, depth, packing, allocator);
+			return ((Tensor*)obj)->Create(shape, steps, depth, packing, allocator, type);
 		}
 		if (flag == NONE)
 		{
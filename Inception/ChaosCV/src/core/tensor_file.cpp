@@ -0,0 +1,316 @@
+#include "core/tensor_file.hpp"
+
+#include <fstream>
+#include <Windows.h>
+
+namespace chaos
+{
+	//////////////////////////////////////// mapped file ////////////////////////////////////////////
+	Ptr<MappedFile> MappedFile::Open(const std::string& file)
+	{
+		HANDLE handle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		CHECK(handle != INVALID_HANDLE_VALUE) << "can not open \"" << file << "\"";
+		LARGE_INTEGER size;
+		CHECK(GetFileSizeEx(handle, &size)) << "can not get the size of \"" << file << "\"";
+
+		Ptr<MappedFile> mapped(new MappedFile());
+		mapped->length = (size_t)size.QuadPart;
+		// an empty file can not be mapped
+		if (mapped->length > 0)
+		{
+			HANDLE mapping = CreateFileMappingA(handle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+			CHECK(mapping != nullptr) << "can not map \"" << file << "\"";
+			mapped->base = (uchar*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+			// the view keeps the mapping and the file open
+			CloseHandle(mapping);
+			CHECK(mapped->base != nullptr) << "can not map \"" << file << "\"";
+		}
+		CloseHandle(handle);
+		return mapped;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (base) UnmapViewOfFile(base);
+	}
+
+	Tensor MappedFile::GetTensor(size_t offset, const Shape& shape, const Steps& steps, Depth depth, Packing packing)
+	{
+		CHECK_EQ(shape.size(), steps.size());
+		size_t bytes = shape.empty() ? 0 : (size_t)shape[0] * steps[0] * depth * packing;
+		CHECK(offset <= length && bytes <= length - offset) << Format("%zu bytes from %zu are out of the file of %zu", bytes, offset, length);
+
+		Tensor tensor(shape, depth, packing, base + offset, steps);
+		tensor.allocator = this;
+		tensor.ref_cnt = new int(1);
+		std::lock_guard guard(lock);
+		if (views++ == 0) self = shared_from_this();
+		return tensor;
+	}
+
+	void* MappedFile::FastMalloc(size_t size)
+	{
+		LOG(FATAL) << "a mapped file can not allocate";
+		return nullptr;
+	}
+
+	void MappedFile::FastFree(void* ptr)
+	{
+		delete (int*)ptr;
+		// the mapping may go with the last tensor, after the lock is released
+		Ptr<MappedFile> last;
+		std::lock_guard guard(lock);
+		if (--views == 0) last = std::move(self);
+	}
+
+	//////////////////////////////////////// container ////////////////////////////////////////////
+	static constexpr char magic[8] = { 'C', 'H', 'A', 'O', 'S', 'T', 'N', 'S' };
+	// version 2 adds the element type after the packing
+	static constexpr uint version = 2;
+	static constexpr int payload_align = 64;
+
+	struct FileHeader
+	{
+		char magic[8];
+		uint version;
+		uint num_tensors;
+		uint64 table_offset;
+		uint64 table_size;
+		uint64 meta_offset;
+		uint64 meta_size;
+		uint64 data_offset;
+		uint64 reserved;
+	};
+	static_assert(sizeof(FileHeader) == 64, "the header is 64 bytes");
+
+	template<class Type>
+	static void Append(std::string& buffer, const Type& value)
+	{
+		buffer.append((const char*)&value, sizeof(value));
+	}
+
+	// reads the table out of the mapped bytes, a read past the end is a truncated file
+	class Reader
+	{
+	public:
+		Reader(const uchar* data, size_t size) : ptr(data), end(data + size) {}
+
+		template<class Type>
+		Type Get()
+		{
+			Type value;
+			CHECK_LE(sizeof(Type), (size_t)(end - ptr)) << "the tensor file is truncated";
+			memcpy(&value, ptr, sizeof(Type));
+			ptr += sizeof(Type);
+			return value;
+		}
+
+		std::string GetString(size_t size)
+		{
+			CHECK_LE(size, (size_t)(end - ptr)) << "the tensor file is truncated";
+			std::string value((const char*)ptr, size);
+			ptr += size;
+			return value;
+		}
+
+	private:
+		const uchar* ptr;
+		const uchar* end;
+	};
+
+	static size_t TensorBytes(const Tensor& tensor)
+	{
+		return tensor.shape.empty() ? 0 : (size_t)tensor.shape[0] * tensor.steps[0] * tensor.depth * tensor.packing;
+	}
+
+	void SaveTensors(const std::string& file, const std::map<std::string, Tensor>& tensors, const std::string& meta)
+	{
+		// the table has a fixed size for each tensor, so the offsets are known before it is written
+		size_t table_size = 0;
+		for (const auto& [name, tensor] : tensors)
+			table_size += 4 + name.size() + 16 + 8 * tensor.shape.size() + 16;
+
+		FileHeader header = {};
+		memcpy(header.magic, magic, sizeof(magic));
+		header.version = version;
+		header.num_tensors = (uint)tensors.size();
+		header.table_offset = sizeof(FileHeader);
+		header.table_size = table_size;
+		header.meta_offset = header.table_offset + table_size;
+		header.meta_size = meta.size();
+		header.data_offset = AlignSize(header.meta_offset + meta.size(), payload_align);
+
+		std::string table;
+		uint64 offset = header.data_offset;
+		for (const auto& [name, tensor] : tensors)
+		{
+			CHECK_EQ(tensor.shape.size(), tensor.steps.size()) << "tensor " << name << " has no steps";
+			Append(table, (uint)name.size());
+			table.append(name);
+			Append(table, (uint)tensor.depth);
+			Append(table, (uint)tensor.packing);
+			Append(table, (uint)tensor.type);
+			Append(table, (uint)tensor.shape.size());
+			for (size_t i = 0; i < tensor.shape.size(); i++) Append(table, tensor.shape[i]);
+			for (size_t i = 0; i < tensor.steps.size(); i++) Append(table, tensor.steps[i]);
+			Append(table, offset);
+			Append(table, (uint64)TensorBytes(tensor));
+			offset = AlignSize(offset + TensorBytes(tensor), payload_align);
+		}
+
+		std::ofstream stream(file, std::ios::binary);
+		CHECK(stream.is_open()) << "can not open \"" << file << "\"";
+		const char zeros[payload_align] = {};
+		stream.write((const char*)&header, sizeof(header));
+		stream.write(table.data(), table.size());
+		stream.write(meta.data(), meta.size());
+		stream.write(zeros, header.data_offset - header.meta_offset - meta.size());
+		for (const auto& [name, tensor] : tensors)
+		{
+			size_t bytes = TensorBytes(tensor);
+			if (bytes > 0)
+			{
+				CHECK(tensor.data != nullptr) << "tensor " << name << " has no data";
+				stream.write((const char*)tensor.data, bytes);
+			}
+			stream.write(zeros, AlignSize(bytes, payload_align) - bytes);
+		}
+		CHECK(stream.good()) << "can not write \"" << file << "\"";
+	}
+
+	std::map<std::string, Tensor> LoadTensors(const std::string& file, std::string* meta, bool map)
+	{
+		Ptr<MappedFile> mapped = MappedFile::Open(file);
+		Reader reader(mapped->data(), mapped->size());
+		FileHeader header = reader.Get<FileHeader>();
+		CHECK(memcmp(header.magic, magic, sizeof(magic)) == 0) << "\"" << file << "\" is not a tensor file";
+		CHECK_LE(header.version, version) << Format("version %u of \"%s\" is newer than %u", header.version, file.c_str(), version);
+		CHECK(header.meta_offset <= mapped->size() && header.meta_size <= mapped->size() - header.meta_offset) << "the tensor file is truncated";
+		if (meta) *meta = std::string((const char*)mapped->data() + header.meta_offset, header.meta_size);
+
+		std::map<std::string, Tensor> tensors;
+		for (uint n = 0; n < header.num_tensors; n++)
+		{
+			std::string name = reader.GetString(reader.Get<uint>());
+			Depth depth = (Depth)reader.Get<uint>();
+			Packing packing = (Packing)reader.Get<uint>();
+			ElemType type = header.version >= 2 ? (ElemType)reader.Get<uint>() : ElemType::FLOAT;
+			uint dims = reader.Get<uint>();
+			Shape shape;
+			Steps steps;
+			shape.Resize(dims);
+			steps.Resize(dims);
+			for (uint i = 0; i < dims; i++) shape[i] = reader.Get<uint>();
+			for (uint i = 0; i < dims; i++) steps[i] = reader.Get<uint>();
+			uint64 offset = reader.Get<uint64>();
+			uint64 bytes = reader.Get<uint64>();
+
+			Tensor tensor = mapped->GetTensor(offset, shape, steps, depth, packing);
+			tensor.type = type;
+			CHECK_EQ(TensorBytes(tensor), bytes) << "the size of tensor " << name << " does not match its shape";
+			tensors[name] = map ? tensor : tensor.Clone();
+		}
+		return tensors;
+	}
+
+	//////////////////////////////////////// npy ////////////////////////////////////////////
+	// the value of key in the header dict, up to the next ',' or the closing ')' of a tuple
+	static std::string NpyValue(const std::string& header, const std::string& key)
+	{
+		size_t pos = header.find("'" + key + "'");
+		CHECK(pos != std::string::npos) << "the npy header has no " << key;
+		pos = header.find(':', pos);
+		size_t begin = header.find_first_not_of(" ", pos + 1);
+		size_t end = header[begin] == '(' ? header.find(')', begin) + 1 : header.find_first_of(",}", begin);
+		CHECK(begin != std::string::npos && end != std::string::npos) << "bad npy header " << header;
+		return header.substr(begin, end - begin);
+	}
+
+	Tensor LoadNpy(const std::string& file, bool map)
+	{
+		Ptr<MappedFile> mapped = MappedFile::Open(file);
+		Reader reader(mapped->data(), mapped->size());
+		CHECK(reader.GetString(6) == "\x93NUMPY") << "\"" << file << "\" is not a npy file";
+		uchar major = reader.Get<uchar>();
+		reader.Get<uchar>();
+		CHECK(major >= 1 && major <= 3) << Format("npy version %d is not supported", major);
+		size_t header_size = major == 1 ? reader.Get<uint16>() : reader.Get<uint>();
+		std::string header = reader.GetString(header_size);
+		size_t offset = (major == 1 ? 10 : 12) + header_size;
+
+		// '<f4', '|i1' ..., the byte order does not matter for a single byte
+		std::string descr = NpyValue(header, "descr");
+		CHECK(descr.size() >= 5) << "bad npy descr " << descr;
+		char order = descr[1], kind = descr[2];
+		int size = std::atoi(descr.substr(3).c_str());
+		CHECK(order != '>' || size == 1) << "big endian npy is not supported";
+		// the depth is read as float16, float and double, only the bytes of D1 may be integers
+		bool floats = kind == 'f' && (size == 2 || size == 4 || size == 8);
+		bool raw = std::string("iub").find(kind) != std::string::npos && size == 1;
+		CHECK(floats || raw) << "npy dtype " << descr << " is not supported, only float16/32/64 and the 1 byte int8, uint8 and bool";
+		CHECK(NpyValue(header, "fortran_order") == "False") << "fortran order npy is not supported";
+
+		std::string tuple = NpyValue(header, "shape");
+		Shape shape;
+		for (const auto& dim : Split(tuple.substr(1, tuple.size() - 2), ","))
+		{
+			if (dim.find_first_not_of(" ") == std::string::npos) continue;
+			shape.Insert(shape.size(), (uint)std::stoull(dim));
+		}
+		if (shape.empty()) shape = Shape(1);
+
+		Depth depth = (Depth)size;
+		if (map && offset % size == 0)
+			return mapped->GetTensor(offset, shape, shape.steps(), depth, Packing::CHW);
+
+		Tensor tensor(shape, depth);
+		size_t bytes = shape.vol() * size;
+		CHECK(offset <= mapped->size() && bytes <= mapped->size() - offset) << "the npy file is truncated";
+		if (bytes > 0) memcpy(tensor.data, mapped->data() + offset, bytes);
+		return tensor;
+	}
+
+	void SaveNpy(const std::string& file, const Tensor& _tensor)
+	{
+		static const char* descrs[] = { "", "|i1", "<f2", "", "<f4", "", "", "", "<f8" };
+		CHECK(not _tensor.empty()) << "can not save an empty tensor";
+		Tensor tensor = _tensor;
+		if (not tensor.continua())
+			tensor = _tensor.Clone();
+		// numpy has no bfloat16, it is widened to float32, which is exact
+		if (tensor.depth == Depth::D2 && tensor.type == ElemType::BFLOAT16)
+		{
+			Tensor wide(tensor.shape, Depth::D4, tensor.packing);
+			const uint16* src = tensor;
+			uint* dst = wide;
+			for (size_t i = 0; i < tensor.shape.vol() * tensor.packing; i++)
+				dst[i] = (uint)src[i] << 16;
+			tensor = wide;
+		}
+
+		std::string shape = "(";
+		for (size_t i = 0; i < tensor.shape.size(); i++)
+			shape += std::to_string(tensor.shape[i]) + ", ";
+		if (tensor.packing != Packing::CHW)
+			shape += std::to_string((int)tensor.packing) + ", ";
+		if (shape.size() > 1)
+			shape.resize(shape.size() - 1);
+		if (tensor.shape.size() + (tensor.packing != Packing::CHW) == 1)
+			shape.back() = ',';
+		shape += ")";
+
+		// the data starts on 64 bytes, the header ends with '\n'
+		std::string header = Format("{'descr': '%s', 'fortran_order': False, 'shape': %s, }", descrs[(int)tensor.depth], shape.c_str());
+		header.append(AlignSize(10 + header.size() + 1, 64) - 10 - header.size() - 1, ' ');
+		header += '\n';
+
+		std::ofstream stream(file, std::ios::binary);
+		CHECK(stream.is_open()) << "can not open \"" << file << "\"";
+		stream.write("\x93NUMPY\x01\x00", 8);
+		uint16 header_size = (uint16)header.size();
+		stream.write((const char*)&header_size, sizeof(header_size));
+		stream.write(header.data(), header.size());
+		stream.write((const char*)tensor.data, tensor.shape.vol() * tensor.depth * tensor.packing);
+		CHECK(stream.good()) << "can not write \"" << file << "\"";
+	}
+}
\ No newline at end of file
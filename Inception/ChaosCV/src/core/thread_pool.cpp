@@ -0,0 +1,346 @@
+#include "core/thread_pool.hpp"
+#include "core/core.hpp"
+
+#include <Windows.h>
+
+namespace chaos
+{
+	// the chunks [begin, end) left to a thread, packed to be taken by one CAS
+	struct alignas(64) ChunkRange
+	{
+		std::atomic<uint64> range = 0;
+	};
+
+	static inline uint64 Pack(uint64 begin, uint64 end) { return begin | (end << 32); }
+	static inline uint64 Begin(uint64 range) { return range & 0xffffffff; }
+	static inline uint64 End(uint64 range) { return range >> 32; }
+
+	struct ThreadPool::Job
+	{
+		const Function* func;
+		size_t begin;
+		size_t end;
+		size_t grain;
+		int num_threads;
+		ChunkRange* ranges;
+
+		std::atomic<size_t> remaining; // the chunks not done yet
+		std::atomic<int> refs = 0; // the workers holding the job
+		int next_id = 1; // the range a joining thread takes, under the lock of the pool
+
+		// the owner takes from the front
+		bool Pop(int id, size_t& chunk)
+		{
+			auto& own = ranges[id].range;
+			uint64 r = own.load(std::memory_order_relaxed);
+			while (Begin(r) < End(r))
+			{
+				if (own.compare_exchange_weak(r, Pack(Begin(r) + 1, End(r)), std::memory_order_acq_rel))
+				{
+					chunk = Begin(r);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// a thief takes the back half of another range and keeps the rest in its own
+		bool Steal(int id, size_t& chunk)
+		{
+			for (int i = 1; i < num_threads; i++)
+			{
+				auto& victim = ranges[(id + i) % num_threads].range;
+				uint64 r = victim.load(std::memory_order_relaxed);
+				while (Begin(r) < End(r))
+				{
+					uint64 mid = Begin(r) + (End(r) - Begin(r)) / 2;
+					if (victim.compare_exchange_weak(r, Pack(Begin(r), mid), std::memory_order_acq_rel))
+					{
+						// the own range is empty, a racing thief sees it changed and fails its CAS
+						ranges[id].range.store(Pack(mid + 1, End(r)), std::memory_order_release);
+						chunk = mid;
+						return true;
+					}
+				}
+			}
+			return false;
+		}
+
+		void Work(int id)
+		{
+			size_t chunk;
+			while (Pop(id, chunk) || Steal(id, chunk))
+			{
+				size_t b = begin + chunk * grain;
+				(*func)(b, std::min(b + grain, end));
+				remaining.fetch_sub(1, std::memory_order_acq_rel);
+			}
+		}
+	};
+
+	// set in the workers and inside a job, a nested ParallelFor runs serially unless a worker is idle
+	static thread_local bool in_parallel = false;
+	// the pool of the calling thread, set by the scopes, in the workers and inside a job
+	static thread_local ThreadPool* current_pool = nullptr;
+
+	// the chunk ranges of the jobs a thread publishes, an array per nesting level kept for its next jobs,
+	// so a ParallelFor allocates only the first time a thread goes that deep with that many threads
+	struct RangeStorage
+	{
+		std::unique_ptr<ChunkRange[]> ranges;
+		int size = 0;
+	};
+	static thread_local std::vector<RangeStorage> range_storage;
+	static thread_local size_t job_depth = 0;
+
+	static ChunkRange* AcquireRanges(int num_threads)
+	{
+		if (range_storage.size() <= job_depth) range_storage.resize(job_depth + 1);
+		RangeStorage& storage = range_storage[job_depth++];
+		if (storage.size < num_threads)
+		{
+			storage.ranges.reset(new ChunkRange[num_threads]);
+			storage.size = num_threads;
+		}
+		return storage.ranges.get();
+	}
+
+	// the logical processors of the node (all of them for -1) with their groups, a mask of one bit each
+	static std::vector<GROUP_AFFINITY> Processors(int node)
+	{
+		std::vector<GROUP_AFFINITY> processors;
+		ULONG highest = 0;
+		if (not GetNumaHighestNodeNumber(&highest)) highest = 0;
+		for (ULONG n = 0; n <= highest; n++)
+		{
+			GROUP_AFFINITY mask = {};
+			if ((node >= 0 && n != (ULONG)node) || not GetNumaNodeProcessorMaskEx((USHORT)n, &mask)) continue;
+			for (int bit = 0; bit < (int)sizeof(KAFFINITY) * 8; bit++)
+			{
+				if (not ((mask.Mask >> bit) & 1)) continue;
+				GROUP_AFFINITY processor = {};
+				processor.Group = mask.Group;
+				processor.Mask = (KAFFINITY)1 << bit;
+				processors.push_back(processor);
+			}
+		}
+		return processors;
+	}
+
+	ThreadPool::ThreadPool(int num_threads, bool affinity, int node) : numa_node(node)
+	{
+		std::vector<GROUP_AFFINITY> processors;
+		if (affinity || node >= 0) processors = Processors(node);
+		CHECK(node < 0 || not processors.empty()) << "no processor on the NUMA node " << node;
+		if (num_threads <= 0) num_threads = node >= 0 ? (int)processors.size() : GetNumCPUs();
+
+		// the workers of a node share its processors unless they are pinned one by one
+		GROUP_AFFINITY shared = {};
+		if (not processors.empty()) shared.Group = processors[0].Group;
+		for (const auto& processor : processors)
+		{
+			if (processor.Group == shared.Group) shared.Mask |= processor.Mask;
+		}
+		for (int i = 1; i < num_threads; i++)
+		{
+			workers.emplace_back(&ThreadPool::Loop, this);
+			if (processors.empty()) continue;
+			const GROUP_AFFINITY& mask = affinity ? processors[i % processors.size()] : shared;
+			SetThreadGroupAffinity((HANDLE)workers.back().native_handle(), &mask, nullptr);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stop = true;
+		}
+		cv.notify_all();
+		for (auto& worker : workers)
+			worker.join();
+	}
+
+	ThreadPool& ThreadPool::Global()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+
+	ThreadPool& ThreadPool::Current()
+	{
+		return current_pool ? *current_pool : Global();
+	}
+
+	// a job with a free range and chunks left, under the lock
+	ThreadPool::Job* ThreadPool::Join(int& id)
+	{
+		for (Job* j : jobs)
+		{
+			if (j->next_id < j->num_threads && j->remaining.load(std::memory_order_relaxed) != 0)
+			{
+				id = j->next_id++;
+				j->refs.fetch_add(1, std::memory_order_relaxed);
+				return j;
+			}
+		}
+		return nullptr;
+	}
+
+	void ThreadPool::Loop()
+	{
+		in_parallel = true;
+		current_pool = this;
+		for (;;)
+		{
+			Job* j;
+			int id;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				// the jobs published while this thread worked are joined before it sleeps
+				while (not stop && not (j = Join(id)))
+				{
+					uint64 seen = generation;
+					idle.fetch_add(1, std::memory_order_relaxed);
+					cv.wait(guard, [&]() { return stop || generation != seen; });
+					idle.fetch_sub(1, std::memory_order_relaxed);
+				}
+				if (stop) return;
+			}
+			j->Work(id);
+			j->refs.fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+	bool ThreadPool::Help()
+	{
+		Job* j;
+		int id;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			j = Join(id);
+		}
+		if (not j) return false;
+
+		bool nested = in_parallel;
+		ThreadPool* pool = current_pool;
+		in_parallel = true;
+		current_pool = this;
+		j->Work(id);
+		in_parallel = nested;
+		current_pool = pool;
+		j->refs.fetch_sub(1, std::memory_order_release);
+		return true;
+	}
+
+	void ThreadPool::HelpUntil(FunctionRef<bool()> done)
+	{
+		bool nested = in_parallel;
+		ThreadPool* pool = current_pool;
+		for (;;)
+		{
+			Job* j;
+			int id;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				while (not (j = Join(id)))
+				{
+					if (done()) return;
+					uint64 seen = generation;
+					idle.fetch_add(1, std::memory_order_relaxed);
+					cv.wait(guard, [&]() { return generation != seen; });
+					idle.fetch_sub(1, std::memory_order_relaxed);
+				}
+			}
+			in_parallel = true;
+			current_pool = this;
+			j->Work(id);
+			in_parallel = nested;
+			current_pool = pool;
+			j->refs.fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+	void ThreadPool::Notify()
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			generation++;
+		}
+		cv.notify_all();
+	}
+
+	void ThreadPool::ParallelFor(size_t begin, size_t end, size_t grain, const Function& func, int num_threads)
+	{
+		if (end <= begin) return;
+		grain = std::max(grain, (size_t)1);
+		size_t num_chunks = (end - begin + grain - 1) / grain;
+		CHECK_LT(num_chunks, (size_t)1 << 32) << "too many chunks, use a larger grain";
+
+		num_threads = num_threads <= 0 ? this->num_threads() : std::min(num_threads, this->num_threads());
+		num_threads = (int)std::min((size_t)num_threads, num_chunks);
+		// a nested job would only add the cost of publishing it when every worker is busy
+		if (num_threads <= 1 || (in_parallel && idle.load(std::memory_order_relaxed) == 0))
+		{
+			func(begin, end);
+			return;
+		}
+
+		Job j;
+		j.func = &func;
+		j.begin = begin;
+		j.end = end;
+		j.grain = grain;
+		j.num_threads = num_threads;
+		j.ranges = AcquireRanges(num_threads);
+		for (int i = 0; i < num_threads; i++)
+			j.ranges[i].range.store(Pack(num_chunks * i / num_threads, num_chunks * (i + 1) / num_threads), std::memory_order_relaxed);
+		j.remaining.store(num_chunks, std::memory_order_relaxed);
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			jobs.push_back(&j);
+			generation++;
+		}
+		cv.notify_all();
+
+		bool nested = in_parallel;
+		ThreadPool* pool = current_pool;
+		in_parallel = true;
+		current_pool = this;
+		j.Work(0);
+		in_parallel = nested;
+		current_pool = pool;
+		while (j.remaining.load(std::memory_order_acquire) != 0)
+			std::this_thread::yield();
+
+		// a late worker can not pick the job once it is gone, and the ones holding it are about to leave
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			jobs.erase(std::find(jobs.begin(), jobs.end(), &j));
+		}
+		while (j.refs.load(std::memory_order_acquire) != 0)
+			std::this_thread::yield();
+		job_depth--;
+	}
+
+	int GetNumCPUs()
+	{
+		static int num_cpus = std::max(1, (int)std::thread::hardware_concurrency());
+		return num_cpus;
+	}
+
+	void ParallelFor(size_t begin, size_t end, size_t grain, const ThreadPool::Function& func, int num_threads)
+	{
+		ThreadPool::Current().ParallelFor(begin, end, grain, func, num_threads);
+	}
+
+	ThreadPoolScope::ThreadPoolScope(ThreadPool* pool) : previous(current_pool)
+	{
+		current_pool = pool;
+	}
+
+	ThreadPoolScope::~ThreadPoolScope()
+	{
+		current_pool = previous;
+	}
+}
\ No newline at end of file
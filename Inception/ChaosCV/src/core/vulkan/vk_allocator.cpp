@@ -111,6 +111,22 @@ namespace chaos
 
 
 
+    // a buffer handed out and given back, by the counters of both allocators
+    static inline void Count(AllocatorStats& stats, const VkBufferMemory* ptr)
+    {
+        stats.mallocs++;
+        stats.in_use += ptr->size;
+        stats.wasted += ptr->capacity - ptr->size;
+        stats.peak = std::max(stats.peak, stats.in_use);
+    }
+
+    static inline void Uncount(AllocatorStats& stats, const VkBufferMemory* ptr)
+    {
+        stats.frees++;
+        stats.in_use -= ptr->size;
+        stats.wasted -= ptr->capacity - ptr->size;
+    }
+
     static inline size_t least_common_multiple(size_t a, size_t b)
     {
         if (a == b)
@@ -177,6 +193,8 @@ namespace chaos
             delete ptr;
         }
         buffer_blocks.clear();
+        stats.blocks = 0;
+        stats.reserved = 0;
 
         buffer_budgets.clear();
 
@@ -224,9 +242,12 @@ namespace chaos
                 ptr->offset = it->first;
                 ptr->memory = buffer_blocks[i]->memory;
                 ptr->capacity = aligned_size;
+                ptr->size = size;
                 ptr->mapped_data = buffer_blocks[i]->mapped_data;
                 ptr->access_flags = 0;
                 ptr->stage_flags = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+                stats.hits++;
+                Count(stats, ptr);
 
                 // adjust buffer_budgets
                 if (budget_size == aligned_size)
@@ -288,6 +309,9 @@ namespace chaos
         }
 
         buffer_blocks.push_back(block);
+        stats.misses++;
+        stats.blocks++;
+        stats.reserved += new_block_size;
 
         // return sub buffer
         VkBufferMemory* ptr = new VkBufferMemory;
@@ -296,9 +320,11 @@ namespace chaos
         ptr->offset = 0;
         ptr->memory = block->memory;
         ptr->capacity = aligned_size;
+        ptr->size = size;
         ptr->mapped_data = block->mapped_data;
         ptr->access_flags = 0;
         ptr->stage_flags = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        Count(stats, ptr);
 
         // adjust buffer_budgets
         std::list<std::pair<size_t, size_t> > budget;
@@ -335,6 +361,7 @@ namespace chaos
             delete data;
             return;
         }
+        Uncount(stats, data);
 
         // merge
         std::list<std::pair<size_t, size_t> >::iterator it_merge_left = buffer_budgets[block_index].end();
@@ -424,6 +451,8 @@ namespace chaos
             vkUnmapMemory(vkdev->GetDevice(), ptr->memory);
             vkDestroyBuffer(vkdev->GetDevice(), ptr->buffer, 0);
             vkFreeMemory(vkdev->GetDevice(), ptr->memory, 0);
+            stats.blocks--;
+            stats.reserved -= ptr->capacity;
 
             delete ptr;
         }
@@ -444,6 +473,9 @@ namespace chaos
             if (capacity >= size && ((capacity * size_compare_ratio) >> 8) <= size)
             {
                 buffer_budgets.erase(it);
+                ptr->size = size;
+                stats.hits++;
+                Count(stats, ptr);
                 return ptr;
             }
         }
@@ -473,14 +505,20 @@ namespace chaos
 
         vkMapMemory(vkdev->GetDevice(), ptr->memory, 0, size, 0, &ptr->mapped_data);
 
+        ptr->size = size;
         ptr->access_flags = 0;
         ptr->stage_flags = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        stats.misses++;
+        stats.blocks++;
+        stats.reserved += size;
+        Count(stats, ptr);
 
         return ptr;
     }
 
     void VkStagingAllocator::FastFree(VkBufferMemory* ptr)
     {
+        Uncount(stats, ptr);
         // return to buffer_budgets
         buffer_budgets.push_back(ptr);
     }
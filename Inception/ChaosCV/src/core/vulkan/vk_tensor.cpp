@@ -34,6 +34,31 @@ namespace chaos
 
         return *this;
     }
+    VkTensor::VkTensor(VkTensor&& t) noexcept :
+        data(t.data), allocator(t.allocator), ref_cnt(t.ref_cnt), shape(std::move(t.shape)), depth(t.depth), packing(t.packing), steps(std::move(t.steps))
+    {
+        t.data = nullptr;
+        t.ref_cnt = nullptr;
+    }
+    VkTensor& VkTensor::operator=(VkTensor&& t) noexcept
+    {
+        if (this == &t)  return *this;
+
+        Release();
+
+        data = t.data;
+        ref_cnt = t.ref_cnt;
+        allocator = t.allocator;
+        t.data = nullptr;
+        t.ref_cnt = nullptr;
+
+        shape = std::move(t.shape);
+        depth = t.depth;
+        packing = t.packing;
+        steps = std::move(t.steps);
+
+        return *this;
+    }
 
 	void VkTensor::Create(const Shape& _shape, const Steps& _steps, const Depth& _depth, const Packing& _packing, VkAllocator* _allocator)
 	{
@@ -0,0 +1,97 @@
+#include "dnn/calibrator.hpp"
+
+#include "math/quantize.hpp"
+
+#include <cmath>
+
+namespace chaos
+{
+	namespace dnn
+	{
+		static constexpr size_t num_bins = 2048;
+
+		Calibrator::Calibrator(const Ptr<Net>& _net, float _percentile) : net(_net), percentile(_percentile)
+		{
+			CHECK(net) << "no net to calibrate";
+			CHECK(percentile > 0.f && percentile <= 1.f) << Format("percentile %f is not in (0, 1]", percentile);
+			executor = net->BindExecutor();
+		}
+
+		void Calibrator::Feed(const std::map<std::string, Tensor>& inputs)
+		{
+			for (const auto& [name, data] : inputs) executor->SetLayerData(name, data);
+			executor->Forward();
+
+			Tensor blob;
+			for (const auto& name : net->GetBlobNames())
+			{
+				executor->GetLayerData(name, blob);
+				if (blob.depth != Depth::D4) continue;
+				histograms[name].Add(blob, blob.shape.vol());
+			}
+		}
+
+		std::map<std::string, float> Calibrator::GetScales() const
+		{
+			std::map<std::string, float> scales;
+			for (const auto& [name, histogram] : histograms)
+			{
+				scales[name] = histogram.Threshold(percentile) / 127.f;
+			}
+			return scales;
+		}
+
+		void Calibrator::Apply(const Ptr<Net>& target) const
+		{
+			auto scales = GetScales();
+			const auto& blob_names = target->GetBlobNames();
+			for (const auto& layer : target->GetLayers())
+			{
+				if (layer->bottoms_idx.size() != 1) continue;
+				auto it = scales.find(blob_names[layer->bottoms_idx[0]]);
+				if (it != scales.end() && it->second > 0.f) layer->Set("input_scale", it->second);
+			}
+		}
+
+		void Calibrator::Histogram::Add(const float* x, size_t n)
+		{
+			float max = AbsMax(x, n);
+			if (not std::isfinite(max)) LOG(FATAL) << "the blob has inf or nan";
+			if (bins.empty())
+			{
+				bins.assign(num_bins, 0.);
+				range = max > 0.f ? max : 1.f;
+			}
+			// double the range until it holds max, each bin takes two of the old ones
+			while (max > range)
+			{
+				for (size_t i = 0; i < num_bins / 2; i++) bins[i] = bins[2 * i] + bins[2 * i + 1];
+				std::fill(bins.begin() + num_bins / 2, bins.end(), 0.);
+				range *= 2.f;
+			}
+			const float scale = num_bins / range;
+			for (size_t i = 0; i < n; i++)
+			{
+				bins[std::min((size_t)(std::fabs(x[i]) * scale), num_bins - 1)] += 1.;
+			}
+		}
+
+		// the upper edge of the bin where the count reaches the percentile
+		float Calibrator::Histogram::Threshold(float percentile) const
+		{
+			double total = 0.;
+			for (double count : bins) total += count;
+			if (total == 0.) return 0.f;
+
+			double target = total * percentile, sum = 0.;
+			size_t last = 0;
+			for (size_t i = 0; i < num_bins; i++)
+			{
+				if (bins[i] > 0.) last = i;
+				sum += bins[i];
+				if (sum >= target) return (i + 1) * range / num_bins;
+			}
+			return (last + 1) * range / num_bins;
+		}
+	}
+}
\ No newline at end of file
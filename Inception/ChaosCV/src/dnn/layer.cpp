@@ -40,5 +40,12 @@ namespace chaos
 			LOG(FATAL) << "not implemented";
 		}
 
+		double Layer::Flops(const std::vector<Shape>& /*bottoms*/, const std::vector<Shape>& tops) const
+		{
+			double flops = 0.;
+			for (const auto& top : tops) flops += (double)top.vol();
+			return flops;
+		}
+
 	}
 }
\ No newline at end of file
@@ -4,6 +4,11 @@
 #define NAMESPACE_BEGIN namespace chaos { namespace dnn {
 #define NAMESPACE_END } }
 
+#include "dnn/layers/activation_layer.hpp"
+NAMESPACE_BEGIN
+REGISTER_LAYER("Activation", ActivationLayer);
+NAMESPACE_END
+
 #include "dnn/layers/binary_op.hpp"
 NAMESPACE_BEGIN
 REGISTER_LAYER("BinaryOp", BinaryOp);
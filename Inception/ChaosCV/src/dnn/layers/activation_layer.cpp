@@ -0,0 +1,61 @@
+#include "dnn/layers/activation_layer.hpp"
+#include "dnn/activation.hpp"
+
+#include "core/nd_iterator.hpp"
+
+namespace chaos
+{
+	namespace dnn
+	{
+		// the elements a thread takes at least
+		static constexpr size_t parallel_grain = 16384;
+
+		ActivationLayer::ActivationLayer() : Layer("Activation")
+		{
+			one_blob_only = true;
+			support_inplace = true;
+		}
+
+		void ActivationLayer::Set(const std::string& key, const ParamValue& value)
+		{
+			if (key == "activation_type")
+			{
+				activation_type = value;
+			}
+			if (key == "activation_params")
+			{
+				activation_params = value;
+			}
+		}
+
+		void ActivationLayer::Forward(Tensor& blob, const Option& opt) const
+		{
+			CHECK(blob.depth == Depth::D4) << "the activation " << name << " runs on a float blob";
+			const float* params = activation_params.empty() ? nullptr : (const float*)activation_params;
+
+			if (blob.empty()) return;
+
+			// the values of a packed element are one more dim
+			Shape shape = blob.shape;
+			Steps steps = blob.steps;
+			if (blob.packing != Packing::CHW)
+			{
+				uint packing = (uint)blob.packing;
+				for (size_t i = 0; i < steps.size(); i++) steps[i] *= packing;
+				shape.Insert(shape.size(), packing);
+				steps.Insert(steps.size(), 1u);
+			}
+			NdIterator<1> it(shape, { &steps });
+			size_t step = it.step(0);
+			DispatchActivation(activation_type, [&](auto act) {
+				ParallelForEach(it, parallel_grain, [&](const std::array<size_t, 1>& offsets, size_t n) {
+					float* y = (float*)blob + offsets[0];
+					if (step == 1)
+						return Activation<decltype(act)::value>::Run(y, n, params);
+					for (size_t i = 0; i < n; i++)
+						Activation<decltype(act)::value>::Run(y + i * step, 1, params);
+				}, opt.num_threads);
+			});
+		}
+	}
+}
\ No newline at end of file
@@ -1,71 +1,181 @@
 #include "dnn/layers/binary_op.hpp"
 
+#include "core/nd_iterator.hpp"
+
+#include "math/half.hpp"
+
+#include <immintrin.h>
+
 namespace chaos
 {
 	namespace dnn
 	{
+        // the elements a thread takes at least
+        static constexpr size_t parallel_grain = 16384;
+
+        // the ops on a float, 8 floats and 16 floats, the SIMD ones round like the scalar one
         struct BinaryAdd
         {
             float operator()(const float& x, const float& y) const { return x + y; }
+            __m256 operator()(__m256 x, __m256 y) const { return _mm256_add_ps(x, y); }
+            __m512 operator()(__m512 x, __m512 y) const { return _mm512_add_ps(x, y); }
         };
 
         struct BinarySub
         {
             float operator()(const float& x, const float& y) const { return x - y; }
+            __m256 operator()(__m256 x, __m256 y) const { return _mm256_sub_ps(x, y); }
+            __m512 operator()(__m512 x, __m512 y) const { return _mm512_sub_ps(x, y); }
         };
 
         struct BinaryMul
         {
             float operator()(const float& x, const float& y) const { return x * y; }
+            __m256 operator()(__m256 x, __m256 y) const { return _mm256_mul_ps(x, y); }
+            __m512 operator()(__m512 x, __m512 y) const { return _mm512_mul_ps(x, y); }
         };
 
         struct BinaryDiv
         {
             float operator()(const float& x, const float& y) const { return x / y; }
+            __m256 operator()(__m256 x, __m256 y) const { return _mm256_div_ps(x, y); }
+            __m512 operator()(__m512 x, __m512 y) const { return _mm512_div_ps(x, y); }
         };
 
-        template<typename Op>
-        static void Operator(const Tensor& a, const Tensor& b, Tensor& c, const Option& opt)
-        {
-            Op op;
+        // the elements of float, float16 and bfloat16 tensors as float, the half ones round to nearest even
+        static inline float Get(float x) { return x; }
+        static inline float Get(float16 x) { return ToFloat(x); }
+        static inline float Get(bfloat16 x) { return ToFloat(x); }
+        static inline void Put(float* p, float x) { *p = x; }
+        static inline void Put(float16* p, float x) { *p = ToFloat16(x); }
+        static inline void Put(bfloat16* p, float x) { *p = ToBFloat16(x); }
 
-            if (a.shape == b.shape)
+        struct AVX2
+        {
+            using Type = __m256;
+            static constexpr size_t width = 8;
+            static Type Load(const float* p) { return _mm256_loadu_ps(p); }
+            static Type Load(const float16* p) { return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)p)); }
+            static Type Load(const bfloat16* p)
+            {
+                return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p)), 16));
+            }
+            static Type Set(float x) { return _mm256_set1_ps(x); }
+            static void Store(float* p, Type x) { _mm256_storeu_ps(p, x); }
+            static void Store(float16* p, Type x) { _mm_storeu_si128((__m128i*)p, _mm256_cvtps_ph(x, _MM_FROUND_TO_NEAREST_INT)); }
+            // the rounding of ToBFloat16, a nan is kept quiet
+            static void Store(bfloat16* p, Type x)
             {
-                size_t n = a.shape.vol(); // (size_t)a.shape[0] * a.steps[0] / (1 * a.depth);
-                c.Create(a.shape, a.shape.steps(), a.depth, a.packing, opt.blob_allocator);
+                __m256i u = _mm256_castps_si256(x);
+                __m256i r = _mm256_add_epi32(u, _mm256_add_epi32(_mm256_set1_epi32(0x7FFF), _mm256_and_si256(_mm256_srli_epi32(u, 16), _mm256_set1_epi32(1))));
+                __m256i q = _mm256_or_si256(_mm256_srli_epi32(u, 16), _mm256_set1_epi32(0x40));
+                r = _mm256_blendv_epi8(_mm256_srli_epi32(r, 16), q, _mm256_castps_si256(_mm256_cmp_ps(x, x, _CMP_UNORD_Q)));
+                __m256i h = _mm256_permute4x64_epi64(_mm256_packus_epi32(r, r), 0x08);
+                _mm_storeu_si128((__m128i*)p, _mm256_castsi256_si128(h));
+            }
+        };
 
-                for (size_t i = 0; i < n; i++)
-                {
-                    c[i] = op(a[i], b[i]);
-                }
+        struct AVX512
+        {
+            using Type = __m512;
+            static constexpr size_t width = 16;
+            static Type Load(const float* p) { return _mm512_loadu_ps(p); }
+            static Type Load(const float16* p) { return _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)p)); }
+            static Type Load(const bfloat16* p)
+            {
+                return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)p)), 16));
             }
-            else
+            static Type Set(float x) { return _mm512_set1_ps(x); }
+            static void Store(float* p, Type x) { _mm512_storeu_ps(p, x); }
+            static void Store(float16* p, Type x) { _mm256_storeu_si256((__m256i*)p, _mm512_cvtps_ph(x, _MM_FROUND_TO_NEAREST_INT)); }
+            static void Store(bfloat16* p, Type x)
             {
-                // CHECK_EQ(a.shape.size(), b.shape.size());
-                CHECK_EQ(a.shape.size(), b.shape.size());
-                auto shape = a.shape.vol() > b.shape.vol() ? a.shape : b.shape;
-
-                c.Create(shape, shape.steps(), a.depth, a.packing, opt.blob_allocator);
-
-                size_t n = shape.vol();
-                size_t num_axes = shape.size();
-                for (size_t i = 0; i < n; i++)
-                {
-                    size_t a_idx = 0;
-                    size_t b_idx = 0;
-                    size_t c_idx = 0;
-                    size_t idx = i;
-                    for (int64 j = num_axes - 1; j >= 0; j--)
-                    {
-                        size_t k = idx % shape[j];
-                        a_idx += (k >= a.shape[j] ? 0 : k) * a.steps[j];
-                        b_idx += (k >= b.shape[j] ? 0 : k) * b.steps[j];
-                        c_idx += k * c.steps[j];
-                        idx /= shape[j];
-                    }
-                    c[c_idx] = op(a[a_idx], b[b_idx]);
-                }
+                __m512i u = _mm512_castps_si512(x);
+                __m512i r = _mm512_add_epi32(u, _mm512_add_epi32(_mm512_set1_epi32(0x7FFF), _mm512_and_si512(_mm512_srli_epi32(u, 16), _mm512_set1_epi32(1))));
+                __m512i q = _mm512_or_si512(_mm512_srli_epi32(u, 16), _mm512_set1_epi32(0x40));
+                r = _mm512_mask_blend_epi32(_mm512_cmp_ps_mask(x, x, _CMP_UNORD_Q), _mm512_srli_epi32(r, 16), q);
+                _mm256_storeu_si256((__m256i*)p, _mm512_cvtepi32_epi16(r));
             }
+        };
+
+        // a run of n elements of c, with its steps in a, b and c
+        template<class Type>
+        using RunFunc = void (*)(const Type* a, size_t sa, const Type* b, size_t sb, Type* c, size_t sc, size_t n);
+
+        // a dense run of c, a and b are dense (vec) or one element broadcast over the run
+        template<class Op, class Simd, bool a_vec, bool b_vec, class Element>
+        static void RunDense(const Element* a, size_t, const Element* b, size_t, Element* c, size_t, size_t n)
+        {
+            using Type = typename Simd::Type;
+            constexpr size_t w = Simd::width;
+            Op op;
+            const Type xa = Simd::Set(Get(*a)), xb = Simd::Set(Get(*b));
+            size_t i = 0;
+            for (; i + 2 * w <= n; i += 2 * w)
+            {
+                Type x0 = a_vec ? Simd::Load(a + i) : xa, x1 = a_vec ? Simd::Load(a + i + w) : xa;
+                Type y0 = b_vec ? Simd::Load(b + i) : xb, y1 = b_vec ? Simd::Load(b + i + w) : xb;
+                Simd::Store(c + i, op(x0, y0));
+                Simd::Store(c + i + w, op(x1, y1));
+            }
+            for (; i + w <= n; i += w)
+                Simd::Store(c + i, op(a_vec ? Simd::Load(a + i) : xa, b_vec ? Simd::Load(b + i) : xb));
+            for (; i < n; i++)
+                Put(c + i, op(Get(a_vec ? a[i] : *a), Get(b_vec ? b[i] : *b)));
+        }
+
+        template<class Op, class Element>
+        static void RunStrided(const Element* a, size_t sa, const Element* b, size_t sb, Element* c, size_t sc, size_t n)
+        {
+            Op op;
+            for (size_t i = 0; i < n; i++) Put(c + i * sc, op(Get(a[i * sa]), Get(b[i * sb])));
+        }
+
+        // the run of the innermost merged dim decides the kernel: the same shapes, a row broadcast over the rows and
+        // the outer product have dense runs, a scalar and a per channel operand are one element over the run
+        template<class Op, class Simd, class Element>
+        static RunFunc<Element> SelectSimdRun(size_t sa, size_t sb, size_t sc)
+        {
+            if (sc != 1 || sa > 1 || sb > 1) return RunStrided<Op, Element>;
+            if (sa == 1 && sb == 1) return RunDense<Op, Simd, true, true, Element>;
+            if (sa == 1) return RunDense<Op, Simd, true, false, Element>;
+            if (sb == 1) return RunDense<Op, Simd, false, true, Element>;
+            return RunStrided<Op, Element>;
+        }
+
+        template<class Op, class Element>
+        static RunFunc<Element> SelectRun(size_t sa, size_t sb, size_t sc)
+        {
+            static const bool avx512 = CheckHardwareSupport(CpuFeature::AVX512F);
+            static const bool avx2 = CheckHardwareSupport(CpuFeature::AVX2);
+            // the vectors of float16 need F16C
+            static const bool f16c = CheckHardwareSupport(CpuFeature::F16C);
+            if (std::is_same_v<Element, float16> && not f16c) return RunStrided<Op, Element>;
+            if (avx512) return SelectSimdRun<Op, AVX512, Element>(sa, sb, sc);
+            if (avx2) return SelectSimdRun<Op, AVX2, Element>(sa, sb, sc);
+            return RunStrided<Op, Element>;
+        }
+
+        // a and b come with the steps of c's shape, 0 on the broadcast dims
+        template<typename Op, class Element>
+        static void Operator(const Element* a, const Steps& a_steps, const Element* b, const Steps& b_steps, Tensor& c, const Option& opt)
+        {
+            NdIterator<3> it(c.shape, { &c.steps, &a_steps, &b_steps });
+            size_t sc = it.step(0), sa = it.step(1), sb = it.step(2);
+            RunFunc<Element> run = SelectRun<Op, Element>(sa, sb, sc);
+            ParallelForEach(it, parallel_grain, [&](const std::array<size_t, 3>& offsets, size_t n) {
+                run(a + offsets[1], sa, b + offsets[2], sb, (Element*)c + offsets[0], sc, n);
+            }, opt.num_threads);
+        }
+
+        template<typename Op>
+        static void Operator(const Tensor& a, const Steps& a_steps, const Tensor& b, const Steps& b_steps, Tensor& c, const Option& opt)
+        {
+            if (a.depth == Depth::D4)
+                return Operator<Op>((const float*)a, a_steps, (const float*)b, b_steps, c, opt);
+            if (a.type == ElemType::BFLOAT16)
+                return Operator<Op>((const bfloat16*)a, a_steps, (const bfloat16*)b, b_steps, c, opt);
+            Operator<Op>((const float16*)a, a_steps, (const float16*)b, b_steps, c, opt);
         }
 
         BinaryOp::BinaryOp() : Layer("BinaryOp") { op_type = ADD; }
@@ -79,49 +189,43 @@ namespace chaos
         {
             const Tensor& a = bottoms[0];
             const Tensor& b = bottoms[1];
+            // the half tensors are computed in float, float16 or bfloat16 by their type
+            CHECK(a.depth == b.depth && (a.depth == Depth::D4 || a.depth == Depth::D2)) << "only float and half are supported";
+            CHECK(a.type == b.type) << "can not mix float16 and bfloat16";
 
             Tensor& c = tops[0];
 
-            auto a_shape = a.shape;
-            auto b_shape = b.shape;
-            auto a_steps = a.steps;
-            auto b_steps = b.steps;
-            // to insert 
-            if (a_shape.size() > b_shape.size())
-            {
-                for (int i = 0; i < a_shape.size() - b_shape.size(); i++)
-                {
-                    b_steps.Insert(0, b_steps[0] * b_steps[0]);
-                    b_shape.Insert(0, 1);
-                }
-            }
-            else
+            // align the dims to the right, the missing leading dims are 1
+            size_t dims = std::max(a.shape.size(), b.shape.size());
+            Shape shape = a.shape.size() == dims ? a.shape : b.shape;
+            Steps a_steps(dims), b_steps(dims);
+            for (size_t i = 0; i < dims; i++)
             {
-                for (int i = 0; i < b_shape.size() - a_shape.size(); i++)
-                {
-                    a_steps.Insert(0, a_steps[0] * b_steps[0]);
-                    a_shape.Insert(0, 1);
-                }
+                int64 ia = (int64)(i + a.shape.size()) - (int64)dims;
+                int64 ib = (int64)(i + b.shape.size()) - (int64)dims;
+                uint na = ia < 0 ? 1 : a.shape[ia];
+                uint nb = ib < 0 ? 1 : b.shape[ib];
+                CHECK(na == nb || na == 1 || nb == 1) << "can not broadcast on " 
+                    << i << " dims (" << na << " vs " << nb << ")";
+
+                shape[i] = std::max(na, nb);
+                // a broadcast dim does not move
+                a_steps[i] = na == 1 ? 0 : a.steps[ia];
+                b_steps[i] = nb == 1 ? 0 : b.steps[ib];
             }
 
-            size_t dims = a_shape.size();
-            // to chekc the shape
-            for (int i = 0; i < dims; i++)
-            {
-                CHECK(a_shape[i] == b_shape[i] || (a_shape[i] == 1 || b_shape[i] == 1)) << "can not broadcast on " 
-                    << i << " dims (" << a_shape[i] << " vs " << b_shape[i] << ")";
-            }
-
-            CHECK_EQ(a_shape.vol(), a.shape.vol());
-            CHECK_EQ(b_shape.vol(), b.shape.vol());
-
-            Tensor _a = Tensor(a_shape, Depth::D4, Packing::CHW, a.data, a_steps);
-            Tensor _b = Tensor(b_shape, Depth::D4, Packing::CHW, b.data, b_steps);
-
-            if (ADD == op_type) return Operator<BinaryAdd>(_a, _b, c, opt);
-            if (SUB == op_type) return Operator<BinarySub>(_a, _b, c, opt);
-            if (MUL == op_type) return Operator<BinaryMul>(_a, _b, c, opt);
-            if (DIV == op_type) return Operator<BinaryDiv>(_a, _b, c, opt);
+            // c on the data of a (or b) with its shape and steps is written in place, every element of c
+            // is read from the same position before it is written
+            bool inplace = false;
+            for (const Tensor* x : { &a, &b })
+                inplace |= c.data && c.data == x->data && c.shape == shape && x->shape == shape && c.steps == x->steps;
+            if (not inplace)
+                c.Create(shape, shape.steps(), a.depth, a.packing, opt.blob_allocator, a.type);
+
+            if (ADD == op_type) return Operator<BinaryAdd>(a, a_steps, b, b_steps, c, opt);
+            if (SUB == op_type) return Operator<BinarySub>(a, a_steps, b, b_steps, c, opt);
+            if (MUL == op_type) return Operator<BinaryMul>(a, a_steps, b, b_steps, c, opt);
+            if (DIV == op_type) return Operator<BinaryDiv>(a, a_steps, b, b_steps, c, opt);
         }
 	}
 }
\ No newline at end of file
@@ -1,27 +1,120 @@
 #include "dnn/layers/innerproduct.hpp"
+#include "dnn/layers/activation_layer.hpp"
+#include "dnn/layers/binary_op.hpp"
+#include "dnn/activation.hpp"
+
+#include "core/thread_pool.hpp"
+
+#include "math/gemm.hpp"
+#include "math/half.hpp"
+#include "math/quantize.hpp"
 
 namespace chaos
 {
 	namespace dnn
 	{
-		inline void CalcRowOffsets(const Shape& shape, const Steps& steps, uint* offsets)
-		{
-			size_t dims = shape.size();
-			uint cols = shape.back();
-			uint rows = (uint)shape.vol() / cols;
+		// the multiply-adds below which a forward stays on one thread
+		static constexpr size_t parallel_work = 1 << 16;
+		// the tile of y a thread takes
+		static constexpr size_t tile_m = 128;
+		static constexpr size_t tile_n = 256;
 
-			for (size_t r = 1; r < rows; r++)
-			{
-				size_t idx = r * cols;
-				size_t offset = 0;
-				for (int64 j = dims - 1; j >= 0; j--)
+		// func(i0, i1, j0, j1) on the tiles of the inh x outw y the threads take, one thread takes all of y to pack x and w once
+		template<class Function>
+		static void ParallelTiles(size_t inh, size_t outw, int num_threads, const Function& func)
+		{
+			size_t tm = num_threads == 1 ? inh : tile_m;
+			size_t tn = num_threads == 1 ? outw : tile_n;
+			size_t tiles_m = (inh + tm - 1) / tm;
+			size_t tiles_n = (outw + tn - 1) / tn;
+			ParallelFor(0, tiles_m * tiles_n, 1, [&](size_t t0, size_t t1) {
+				for (size_t t = t0; t < t1; t++)
 				{
-					size_t k = idx % shape[j];
-					offset += k * steps[j];
-					idx /= shape[j];
+					size_t i0 = t / tiles_n * tm, j0 = t % tiles_n * tn;
+					func(i0, std::min(i0 + tm, inh), j0, std::min(j0 + tn, outw));
 				}
-				offsets[r] = (uint)offset;
-			}
+			}, num_threads);
+		}
+
+		// a finished row of y to an int8 (by output_scale) or a half top, float16 or bfloat16 by its type
+		static void StoreRow(const float* y, Tensor& top, size_t offset, size_t n, float output_scale)
+		{
+			if (top.depth == Depth::D1)
+				Quantize(y, (int8_t*)top + offset, n, output_scale);
+			else if (top.type == ElemType::BFLOAT16)
+				Cast(y, (bfloat16*)top + offset, n);
+			else
+				Cast(y, (float16*)top + offset, n);
+		}
+
+		// the tiles of y = x * w^t with the bias and activation fused into the gemm as the epilogue of each panel,
+		// py is the float y, the top itself unless the top is half, which the epilogue then converts to,
+		// ldb is the row step of the bias, 0 for a row broadcast over y
+		template<bool has_bias, ActiveType type>
+		static void ForwardTiles(const float* px, size_t ldx, int inw, const Tensor& weight, const PackedMatrix& packed, 
+			const float* pb, size_t ldb, const float* params, float* py, Tensor& top, int num_threads)
+		{
+			size_t inh = top.shape.vol() / top.shape.back();
+			size_t outw = top.shape.back();
+			const float* pw = weight;
+			bool half = top.depth == Depth::D2;
+			size_t ldw = weight.empty() ? 0 : weight.steps[0];
+			ParallelTiles(inh, outw, num_threads, [&](size_t i0, size_t i1, size_t j0, size_t j1) {
+				// c is the block (i, j) of the tile while it is still in cache, the gemm only references the lambda
+				auto epilogue = [&](float* c, size_t ldc, int i, int j, int m, int n) {
+					for (int r = 0; r < m; r++, c += ldc)
+					{
+						if constexpr (has_bias)
+						{
+							const float* b = pb + (i0 + i + r) * ldb + j0 + j;
+							for (int k = 0; k < n; k++) c[k] += b[k];
+						}
+						Activation<type>::Run(c, n, params);
+						if (half) StoreRow(c, top, (i0 + i + r) * outw + j0 + j, n, 0.f);
+					}
+				};
+				// the tiles start on the panels of the packed weight, tile_n is a multiple of every nr
+				if (packed.empty())
+					Gemm(false, true, (int)(i1 - i0), (int)(j1 - j0), inw, 1.f, px + i0 * ldx, ldx, pw + j0 * ldw, ldw,
+						0.f, py + i0 * outw + j0, outw, epilogue);
+				else
+					Gemm(false, (int)(i1 - i0), (int)(j1 - j0), 1.f, px + i0 * ldx, ldx, packed, (int)j0,
+						0.f, py + i0 * outw + j0, outw, epilogue);
+			});
+		}
+
+		// the int8 tiles, y = sx[i] * sw[j] * (qx * qw^t) + b is dequantized in the epilogue of the int8 gemm,
+		// and requantized by output_scale for an int8 top
+		template<bool has_bias, ActiveType type>
+		static void ForwardTilesInt8(const int8_t* qx, size_t ldx, const float* sx, const PackedMatrix& packed, 
+			const float* pb, size_t ldb, const float* params, float output_scale, Tensor& top, int num_threads)
+		{
+			size_t inh = top.shape.vol() / top.shape.back();
+			size_t outw = top.shape.back();
+			const float* sw = packed.scales;
+			bool direct = top.depth == Depth::D4;
+			ParallelTiles(inh, outw, num_threads, [&](size_t i0, size_t i1, size_t j0, size_t j1) {
+				// a block is at most a panel wide, the row of a half or int8 top stays on the stack
+				WorkBuffer<float> row(direct ? 0 : packed.nr);
+				GemmInt8((int)(i1 - i0), (int)(j1 - j0), qx + i0 * ldx, ldx, packed, (int)j0, 
+					[&](const int32_t* c, size_t ldc, int i, int j, int m, int n) {
+						for (int r = 0; r < m; r++, c += ldc)
+						{
+							size_t offset = (i0 + i + r) * outw + j0 + j;
+							float* y = direct ? (float*)top + offset : row.data();
+							float s = sx[i0 + i + r];
+							const float* w = sw + j0 + j;
+							for (int k = 0; k < n; k++) y[k] = c[k] * s * w[k];
+							if constexpr (has_bias)
+							{
+								const float* b = pb + (i0 + i + r) * ldb + j0 + j;
+								for (int k = 0; k < n; k++) y[k] += b[k];
+							}
+							Activation<type>::Run(y, n, params);
+							if (not direct) StoreRow(y, top, offset, n, output_scale);
+						}
+					});
+			});
 		}
 
 		InnerProduct::InnerProduct() : Layer("InnerProduct")
@@ -40,72 +133,189 @@ namespace chaos
 			{
 				bias = value;
 			}
+			if (key == "activation_type")
+			{
+				activation_type = value;
+			}
+			if (key == "activation_params")
+			{
+				activation_params = value;
+			}
+			if (key == "input_scale")
+			{
+				input_scale = value;
+			}
+			if (key == "output_scale")
+			{
+				output_scale = value;
+			}
+		}
+
+		void InnerProduct::CreatePipeline(const Option& opt)
+		{
+			if (weight.empty())
+				return;
+			PackedMatrix::Format format = PackedMatrix::FP32;
+			if (opt.use_int8_inference && opt.use_int8_arithmetic)
+				format = PackedMatrix::INT8_DOT;
+			else if (opt.use_int8_storage)
+				format = PackedMatrix::INT8;
+			else if (opt.use_bf16_storage)
+				format = PackedMatrix::BF16;
+			else if (opt.use_fp16_storage && CheckHardwareSupport(CpuFeature::F16C))
+				format = PackedMatrix::FP16;
+			packed_weight = PackedMatrix(true, weight.shape[1], weight.shape[0], weight, weight.steps[0], format, opt.weight_allocator);
+			if (opt.light_mode && not opt.use_vulkan_compute)
+				weight.Release();
+		}
+
+		void InnerProduct::DestroyPipeline(const Option& opt)
+		{
+			packed_weight.Release();
 		}
 
 		void InnerProduct::Forward(const Tensor& bottom, Tensor& top, const Option& opt) const
 		{
-			bool use_bias = not bias.empty();
+			ForwardBias(bottom, bias, top, activation_type, opt);
+		}
+
+		void InnerProduct::Forward(const std::vector<Tensor>& bottoms, std::vector<Tensor>& tops, const Option& opt) const
+		{
+			CHECK(bottoms.size() == 2 && bias.empty()) << "the second bottom of " << name << " is its bias, in place of the bias param";
+			const Tensor& bottom = bottoms[0];
+			const Tensor& b = bottoms[1];
+
+			// the gemm adds a row of y in no more dims than y, or a dense tensor of the shape of y
+			Shape out_shape = bottom.shape;
+			if (not out_shape.empty()) out_shape.back() = packed_weight.empty() ? weight.shape[0] : packed_weight.n;
+			bool row = not b.shape.empty() && not out_shape.empty() && b.shape.size() <= out_shape.size()
+				&& b.shape.back() == out_shape.back() && b.shape.vol() == out_shape.back() && b.continua();
+			bool full = b.shape == out_shape && b.steps == out_shape.steps();
+			if (row || full) return ForwardBias(bottom, b, tops[0], activation_type, opt);
+
+			// any other broadcast of the folded BinaryOp ADD is added to y as the BinaryOp would, then the activation
+			std::vector<Tensor> y(1);
+			ForwardBias(bottom, Tensor(), y[0], NONE, opt);
+			BinaryOp add;
+			add.Forward({ y[0], b }, tops, opt);
+			if (activation_type == NONE) return;
+			ActivationLayer activation;
+			activation.activation_type = activation_type;
+			activation.activation_params = activation_params;
+			activation.Forward(tops[0], opt);
+		}
+
+		double InnerProduct::Flops(const std::vector<Shape>& bottoms, const std::vector<Shape>& tops) const
+		{
+			if (bottoms.empty() || tops.empty() || bottoms[0].empty()) return 0.;
+			double per_element = 2. * bottoms[0].back();
+			if (not bias.empty() || bottoms.size() > 1) per_element += 1.;
+			if (activation_type != NONE) per_element += 1.;
+			return per_element * tops[0].vol();
+		}
+
+		void InnerProduct::ForwardBias(const Tensor& bottom, const Tensor& _bias, Tensor& top, int activation_type, const Option& opt) const
+		{
+			bool use_bias = not _bias.empty();
 			size_t in_dims = bottom.shape.size();
 			uint inw = bottom.shape.back();
 			uint inh = (uint)bottom.shape.vol() / inw;
-			CHECK_EQ(inw, weight.shape[1]) << Format("expect %d, but got %d)", weight.shape.back(), inw);
-			
-			AutoBuffer<uint, 8> in_offsets(inh);
-			CalcRowOffsets(bottom.shape, bottom.steps, in_offsets.data());
+			uint weight_k = packed_weight.empty() ? weight.shape[1] : packed_weight.k;
+			uint weight_n = packed_weight.empty() ? weight.shape[0] : packed_weight.n;
+			CHECK_EQ(inw, weight_k) << Format("expect %d, but got %d)", weight_k, inw);
+
+			bool int8 = not packed_weight.empty() && packed_weight.format == PackedMatrix::INT8_DOT;
+			CHECK(bottom.depth == Depth::D4 || bottom.depth == Depth::D2 || (bottom.depth == Depth::D1 && int8 && input_scale > 0.f)) 
+				<< "an int8 bottom needs the int8 weight and the input_scale";
+
+			// the gemm needs the rows of x with a uniform step, which holds unless the leading dims are padded,
+			// a half x is widened to float
+			Tensor x = bottom;
+			size_t ldx = in_dims > 1 ? bottom.steps[in_dims - 2] : inw;
+			for (size_t i = 0; i + 2 < in_dims; i++)
+			{
+				if (bottom.steps[i] != bottom.steps[i + 1] * bottom.shape[i + 1])
+				{
+					// CopyTo keeps a destination of the same shape, x has to let go of the bottom first
+					x = Tensor();
+					bottom.CopyTo(x, opt.workspace_allocator);
+					ldx = inw;
+					break;
+				}
+			}
+			if (bottom.depth == Depth::D2)
+			{
+				x = Tensor();
+				x.Create(bottom.shape, bottom.shape.steps(), Depth::D4, Packing::CHW, opt.workspace_allocator);
+				ToFloat(bottom, x, opt.num_threads);
+				ldx = inw;
+			}
 
+			// a half bottom gives a half top of its type
 			Shape out_shape = bottom.shape;
-			uint outw = out_shape.back() = weight.shape[0];
-			top.Create(out_shape, out_shape.steps(), Depth::D4, Packing::CHW, opt.blob_allocator);
+			uint outw = out_shape.back() = weight_n;
+			Depth depth = int8 && output_scale > 0.f ? Depth::D1 : bottom.depth == Depth::D2 ? Depth::D2 : Depth::D4;
+			top.Create(out_shape, out_shape.steps(), depth, Packing::CHW, opt.blob_allocator, depth == Depth::D2 ? bottom.type : ElemType::FLOAT);
+			// the bias has the shape of y or is a row of it, a half bias of a half net is widened
+			Tensor b = _bias;
+			size_t ldb = outw;
 			if (use_bias)
 			{
-				CHECK_EQ(top.shape, bias.shape);
-				CHECK_EQ(top.steps, bias.steps);
+				CHECK(b.shape == top.shape || (b.shape.vol() == outw && b.continua())) << Format("the bias of %s is not a row or the shape of the top", name.c_str());
+				if (b.shape.vol() == outw) ldb = 0;
+				if (b.depth == Depth::D2)
+				{
+					b = Tensor();
+					b.Create(_bias.shape, _bias.steps, Depth::D4, Packing::CHW, opt.workspace_allocator);
+					ToFloat(_bias, b, opt.num_threads);
+				}
+				CHECK(b.depth == Depth::D4 && (ldb == 0 || b.steps == top.steps)) << Format("the bias of %s is not a float tensor of the steps of the top", name.c_str());
 			}
 
-			AutoBuffer<uint, 8> out_offsets(inh);
-			CalcRowOffsets(top.shape, top.steps, out_offsets.data());
-
-			for (size_t r = 0; r < inh; r++)
+			// y = x * w^t + b, the threads take tiles of y and pack only their rows of x and w
+			int num_threads = (size_t)inh * outw * inw < parallel_work ? 1 : opt.num_threads;
+			if (num_threads <= 0) num_threads = ThreadPool::Current().num_threads();
+			const float* params = activation_params.empty() ? nullptr : (const float*)activation_params;
+			if (not int8)
 			{
-				const float* x = (const float*)bottom + in_offsets[r];
-				for (size_t c = 0; c < outw; c++)
+				Tensor y = top;
+				if (depth == Depth::D2)
 				{
-					const float* w = (const float*)weight + c * weight.steps[0];
-
-					size_t offset = out_offsets[r] + c; //r * outw + c;
-					float b = use_bias ? bias[offset] : 0.f;
-					float y = std::inner_product(x, x + inw, w, b);
+					y = Tensor();
+					y.Create(out_shape, out_shape.steps(), Depth::D4, Packing::CHW, opt.workspace_allocator);
+				}
+				DispatchBool(use_bias, [&](auto has_bias) {
+					DispatchActivation(activation_type, [&](auto act) {
+						ForwardTiles<decltype(has_bias)::value, decltype(act)::value>(x, ldx, inw, weight, packed_weight, b, ldb, params,
+							y, top, num_threads);
+					});
+				});
+				return;
+			}
 
-					if (activation_type == 1)
-					{
-						y = std::max(0.f, y);
-					}
-					if (activation_type == 2)
-					{
-						float slope = activation_params[0];
-						y = y > 0.f ? y : y * slope;
-					}
-					if (activation_type == 3)
-					{
-						float min = activation_params[0];
-						float max = activation_params[1];
-						if (y < min)
-							y = min;
-						if (y > max)
-							y = max;
-					}
-					if (activation_type == 4)
-					{
-						y = 1.f / (1.f + std::exp(-y));
-					}
-					if (activation_type == 5)
+			// quantize a float x, each row by its own max unless the scale is calibrated
+			Tensor sx(Shape(inh), Depth::D4, Packing::CHW, opt.workspace_allocator);
+			std::fill((float*)sx, (float*)sx + inh, input_scale);
+			Tensor qx = x;
+			if (x.depth == Depth::D4)
+			{
+				qx.Create(Shape(inh, inw), Shape(inh, inw).steps(), Depth::D1, Packing::CHW, opt.workspace_allocator);
+				ParallelFor(0, inh, 64, [&](size_t i0, size_t i1) {
+					for (size_t i = i0; i < i1; i++)
 					{
-						y = y * std::tanh(std::log(std::exp(y) + 1.f));
+						const float* row = (const float*)x + i * ldx;
+						if (input_scale == 0.f) sx[i] = AbsMax(row, inw) / 127.f;
+						Quantize(row, (int8_t*)qx + i * inw, inw, sx[i]);
 					}
-					
-					top[offset] = y;
-				}
+				}, num_threads);
+				ldx = inw;
 			}
+			DispatchBool(use_bias, [&](auto has_bias) {
+				DispatchActivation(activation_type, [&](auto act) {
+					ForwardTilesInt8<decltype(has_bias)::value, decltype(act)::value>(qx, ldx, sx, packed_weight, b, ldb, params,
+						output_scale, top, num_threads);
+				});
+			});
 		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,768 @@
+#include "dnn/net.hpp"
+#include "dnn/layer_factory.hpp"
+#include "dnn/optimizer.hpp"
+
+#include "core/thread_pool.hpp"
+#include "core/tensor_file.hpp"
+
+#include <map>
+#include <numeric>
+#include <cstdint>
+#include <sstream>
+
+namespace chaos
+{
+	namespace dnn
+	{
+		/// <summary>
+		/// <para>Blob allocator of the executor</para>
+		/// <para>The first Forward is recorded, every FastMalloc gets a slot with its size and its lifetime</para>
+		/// <para>(the logical time between malloc and free). Then the slots are packed into one arena, slots</para>
+		/// <para>whose lifetimes do not overlap share the memory. The following Forwards replay the plan,</para>
+		/// <para>the n-th FastMalloc returns the n-th slot, so no memory is requested from the upstream.</para>
+		/// <para>If the replay deviates from the plan (eg. the input shape changed), the next Forward records again.</para>
+		/// </summary>
+		class PlannedAllocator : public Allocator
+		{
+		public:
+			PlannedAllocator(Allocator* upstream) : upstream(upstream) {}
+			~PlannedAllocator()
+			{
+				ReleaseArena();
+			}
+
+			virtual void* FastMalloc(size_t size) override
+			{
+				void* ptr = nullptr;
+				// after a miss the blobs no longer line up with the slots, the rest of the Forward goes upstream
+				if (replay && not deviated && cursor < slots.size() && size <= slots[cursor].size)
+				{
+					stats.hits++;
+					ptr = arena + slots[cursor++].offset;
+				}
+				else
+				{
+					deviated = replay;
+					stats.misses++;
+					ptr = UpstreamMalloc(size);
+					if (not replay) slots.push_back({ AlignSize(size, 64), 0, clock++, INT64_MAX, ptr });
+				}
+				Count(ptr, size);
+				return ptr;
+			}
+
+			virtual void FastFree(void* ptr) override
+			{
+				Uncount(ptr);
+				if (arena && ptr >= arena && ptr < arena + arena_size) return;
+
+				if (not replay)
+				{
+					for (auto it = slots.rbegin(); it != slots.rend(); ++it)
+					{
+						if (it->ptr == ptr && it->death == INT64_MAX)
+						{
+							it->death = clock++;
+							break;
+						}
+					}
+				}
+				UpstreamFree(ptr);
+			}
+
+			/// <summary>Called before Forward, all blobs of the last Forward must be released</summary>
+			void Begin()
+			{
+				if (replay and not deviated)
+				{
+					cursor = 0;
+					return;
+				}
+
+				ReleaseArena();
+				slots.clear();
+				replay = false;
+				deviated = false;
+				clock = 0;
+			}
+
+			/// <summary>Called after Forward, build the plan after the recorded Forward</summary>
+			void End()
+			{
+				if (replay) return;
+
+				// sort by size and place each slot at the lowest offset
+				// which is not used by the placed slots living at the same time
+				std::vector<size_t> order(slots.size());
+				std::iota(order.begin(), order.end(), 0);
+				std::stable_sort(order.begin(), order.end(), [&](size_t i, size_t j) { return slots[i].size > slots[j].size; });
+
+				std::vector<size_t> placed;
+				std::vector<std::pair<size_t, size_t>> ranges;
+				arena_size = 0;
+				for (size_t i : order)
+				{
+					Slot& slot = slots[i];
+
+					ranges.clear();
+					for (size_t j : placed)
+					{
+						const Slot& other = slots[j];
+						if (other.birth < slot.death && slot.birth < other.death)
+							ranges.push_back({ other.offset, other.offset + other.size });
+					}
+					std::sort(ranges.begin(), ranges.end());
+
+					size_t offset = 0;
+					for (const auto& [begin, end] : ranges)
+					{
+						if (offset + slot.size <= begin) break;
+						offset = std::max(offset, end);
+					}
+					slot.offset = offset;
+					arena_size = std::max(arena_size, offset + slot.size);
+					placed.push_back(i);
+				}
+
+				if (arena_size > 0) arena = (uchar*)UpstreamMalloc(arena_size);
+				replay = true;
+				cursor = 0;
+			}
+
+			/// <summary>A hit is a blob served by the plan, the arena is the one reserved block</summary>
+			virtual AllocatorStats Snapshot() const override
+			{
+				AllocatorStats snapshot = stats;
+				snapshot.reserved = arena_size;
+				snapshot.blocks = arena ? 1 : 0;
+				return snapshot;
+			}
+
+		private:
+			struct Slot
+			{
+				size_t size;
+				size_t offset;
+				int64 birth;
+				int64 death;
+				void* ptr; // upstream memory while recording
+			};
+
+			void* UpstreamMalloc(size_t size) { return upstream ? upstream->FastMalloc(size) : chaos::FastMalloc(size); }
+			void UpstreamFree(void* ptr) { if (upstream) upstream->FastFree(ptr); else chaos::FastFree(ptr); }
+
+			// the requests in use, few at a time
+			void Count(void* ptr, size_t size)
+			{
+				live.push_back({ ptr, size });
+				stats.mallocs++;
+				stats.in_use += size;
+				stats.peak = std::max(stats.peak, stats.in_use);
+			}
+
+			void Uncount(void* ptr)
+			{
+				auto it = std::find_if(live.rbegin(), live.rend(), [&](const auto& block) { return block.first == ptr; });
+				if (it == live.rend()) return;
+				stats.frees++;
+				stats.in_use -= it->second;
+				live.erase(std::next(it).base());
+			}
+
+			void ReleaseArena()
+			{
+				if (arena) UpstreamFree(arena);
+				arena = nullptr;
+				arena_size = 0;
+			}
+
+			Allocator* upstream;
+
+			bool replay = false;
+			bool deviated = false;
+			int64 clock = 0;
+			size_t cursor = 0;
+			std::vector<Slot> slots;
+
+			uchar* arena = nullptr;
+			size_t arena_size = 0;
+			std::vector<std::pair<void*, size_t>> live;
+			AllocatorStats stats;
+		};
+
+
+		class NetImpl : public Net, public std::enable_shared_from_this<NetImpl>
+		{
+		public:
+			NetImpl() = default;
+			~NetImpl()
+			{
+				if (prepared)
+				{
+					for (auto& layer : layers) layer->DestroyPipeline(opt);
+				}
+			}
+
+			virtual Ptr<Executor> BindExecutor() const override;
+
+			virtual Ptr<Layer> AddLayer(const std::string& type, const std::string& name,
+				const std::vector<std::string>& bottoms, const std::vector<std::string>& tops) override
+			{
+				CHECK(not prepared) << "can not add layer " << name << " after BindExecutor";
+
+				Ptr<Layer> layer = LayerRegistry::CreateLayer(type);
+				layer->name = name;
+
+				int layer_idx = (int)layers.size();
+				for (const auto& bottom : bottoms)
+				{
+					layer->bottoms_idx.push_back(GetBlobIndex(bottom, true));
+				}
+				for (const auto& top : tops)
+				{
+					int idx = GetBlobIndex(top, true);
+					CHECK_EQ(producers[idx], -1) << "blob " << top << " is produced by more than one layer";
+					producers[idx] = layer_idx;
+					layer->tops_idx.push_back(idx);
+				}
+
+				layers.push_back(layer);
+				return layer;
+			}
+
+			virtual void SetOption(const Option& _opt) override
+			{
+				CHECK(not prepared) << "can not set option after BindExecutor";
+				opt = _opt;
+			}
+
+			virtual std::vector<std::string> Optimize() override
+			{
+				CHECK(not prepared) << "can not optimize after BindExecutor";
+				auto report = GraphOptimizer(layers, blob_names, opt).Run();
+
+				producers.assign(blob_names.size(), -1);
+				for (size_t i = 0; i < layers.size(); i++)
+				{
+					for (int idx : layers[i]->tops_idx) producers[idx] = (int)i;
+				}
+				return report;
+			}
+
+			virtual const std::vector<Ptr<Layer>>& GetLayers() const override { return layers; }
+			virtual const std::vector<std::string>& GetBlobNames() const override { return blob_names; }
+
+			int GetBlobIndex(const std::string& name, bool create = false) const
+			{
+				auto it = blob_index.find(name);
+				if (it != blob_index.end()) return it->second;
+				CHECK(create) << "can not find blob " << name;
+
+				auto self = const_cast<NetImpl*>(this);
+				int idx = (int)blob_names.size();
+				self->blob_index[name] = idx;
+				self->blob_names.push_back(name);
+				self->producers.push_back(-1);
+				return idx;
+			}
+
+			/// <summary>Sort the layers, analyze blob liveness and create the pipelines, only once</summary>
+			void Prepare() const
+			{
+				std::lock_guard lock(prepare_lock);
+				if (prepared) return;
+				const_cast<NetImpl*>(this)->PrepareImpl();
+			}
+
+			// layer index in execution order
+			std::vector<int> order;
+			// the step (position in order) after which the blob is no more used, -1 for the blobs which are never consumed
+			std::vector<int> last_use;
+			// inputs of the net, which are read but not produced by any layer
+			std::vector<int> inputs;
+			// the layers reading each blob, a layer reading it twice is there twice
+			std::vector<std::vector<int>> consumers;
+			// the bottoms of each layer produced by the layers
+			std::vector<int> waits;
+			// the most layers in a level of the graph, the independent branches
+			int max_width = 1;
+
+			std::vector<Ptr<Layer>> layers;
+			std::vector<std::string> blob_names;
+			std::map<std::string, int> blob_index;
+			// layer index which produces the blob, -1 for input
+			std::vector<int> producers;
+
+			Option opt;
+
+		private:
+			void PrepareImpl()
+			{
+				if (opt.use_graph_optimization)
+				{
+					for (const auto& change : Optimize()) LOG(INFO) << change;
+				}
+
+				size_t num_layers = layers.size();
+				size_t num_blobs = blob_names.size();
+
+				// Kahn's algorithm, keep the adding order for the layers which are ready at the same time
+				waits.assign(num_layers, 0);
+				consumers.assign(num_blobs, {});
+				for (size_t i = 0; i < num_layers; i++)
+				{
+					for (int idx : layers[i]->bottoms_idx)
+					{
+						consumers[idx].push_back((int)i);
+						if (producers[idx] >= 0) waits[i]++;
+					}
+				}
+				std::vector<int> pending = waits;
+
+				std::vector<int> ready;
+				for (size_t i = 0; i < num_layers; i++)
+				{
+					if (pending[i] == 0) ready.push_back((int)i);
+				}
+				order.clear();
+				while (not ready.empty())
+				{
+					auto it = std::min_element(ready.begin(), ready.end());
+					int i = *it;
+					ready.erase(it);
+					order.push_back(i);
+					for (int idx : layers[i]->tops_idx)
+					{
+						for (int consumer : consumers[idx])
+						{
+							if (--pending[consumer] == 0) ready.push_back(consumer);
+						}
+					}
+				}
+				CHECK_EQ(order.size(), num_layers) << "the net has a cycle";
+
+				// the layers of a level depend only on the levels before, so they may run at once
+				std::vector<int> levels(num_layers, 0), widths(num_layers + 1, 0);
+				for (int i : order)
+				{
+					for (int idx : layers[i]->bottoms_idx)
+					{
+						if (producers[idx] >= 0) levels[i] = std::max(levels[i], levels[producers[idx]] + 1);
+					}
+					widths[levels[i]]++;
+				}
+				max_width = *std::max_element(widths.begin(), widths.end());
+
+				last_use.assign(num_blobs, -1);
+				for (size_t step = 0; step < num_layers; step++)
+				{
+					for (int idx : layers[order[step]]->bottoms_idx) last_use[idx] = (int)step;
+				}
+
+				// the blobs fused away by the optimizer are neither produced nor read
+				inputs.clear();
+				for (size_t idx = 0; idx < num_blobs; idx++)
+				{
+					if (producers[idx] == -1 && not consumers[idx].empty()) inputs.push_back((int)idx);
+				}
+
+				for (auto& layer : layers) layer->CreatePipeline(opt);
+
+				prepared = true;
+			}
+
+			mutable std::mutex prepare_lock;
+			bool prepared = false;
+		};
+
+
+		class ExecutorImpl : public Executor
+		{
+		public:
+			ExecutorImpl(Ptr<const NetImpl> _net) : net(_net), allocator(_net->opt.blob_allocator)
+			{
+				opt = net->opt;
+				thread_pool = opt.thread_pool;
+				// the order of the allocations of concurrent layers changes, so there is no plan to replay
+				branches = opt.use_inter_op_parallel && net->max_width > 1;
+				if (not branches) opt.blob_allocator = &allocator;
+				// the requests of the layers are counted before the memory plan serves them
+				blob_counter.upstream = opt.blob_allocator;
+				workspace_counter.upstream = opt.workspace_allocator;
+				profile_opt = opt;
+				profile_opt.blob_allocator = &blob_counter;
+				profile_opt.workspace_allocator = &workspace_counter;
+				arena = dynamic_cast<ArenaAllocator*>(opt.workspace_allocator);
+				reads = std::vector<std::atomic<int>>(net->blob_names.size());
+				pending = std::vector<std::atomic<int>>(net->layers.size());
+
+				blobs.resize(net->blob_names.size());
+				bottoms.resize(net->layers.size());
+				tops.resize(net->layers.size());
+				for (size_t i = 0; i < net->layers.size(); i++)
+				{
+					bottoms[i].resize(net->layers[i]->bottoms_idx.size());
+					tops[i].resize(net->layers[i]->tops_idx.size());
+				}
+			}
+			~ExecutorImpl()
+			{
+				// blobs must go back to the allocator before it is destroyed
+				ReleaseBlobs();
+			}
+
+			virtual void SetLayerData(const std::string& name, const Tensor& data) const override
+			{
+				int idx = net->GetBlobIndex(name);
+				CHECK_EQ(net->producers[idx], -1) << "blob " << name << " is not an input";
+				blobs[idx] = data;
+			}
+
+			virtual void GetLayerData(const std::string& name, Tensor& data) const override
+			{
+				int idx = net->GetBlobIndex(name);
+				CHECK(not blobs[idx].empty()) << "blob " << name << " is empty, "
+					<< "intermediate blobs are recycled in light mode";
+				blobs[idx].CopyTo(data);
+			}
+
+			virtual void SetProfiler(Profiler* _profiler) const override
+			{
+				profiler = _profiler;
+			}
+
+			virtual void SetThreadPool(ThreadPool* pool) const override
+			{
+				thread_pool = pool ? pool : opt.thread_pool;
+			}
+
+			virtual void Forward() const override
+			{
+				for (int idx : net->inputs)
+				{
+					CHECK(not blobs[idx].empty()) << "input " << net->blob_names[idx] << " is not set";
+				}
+
+				// the layers and the math routines they call run on the pool of the executor
+				ThreadPoolScope pool(thread_pool);
+				// the memory of the last Forward may be replanned
+				ReleaseBlobs();
+				if (branches)
+				{
+					ForwardBranches();
+				}
+				else
+				{
+					allocator.Begin();
+					for (size_t step = 0; step < net->order.size(); step++)
+					{
+						RunLayer(net->order[step], step);
+					}
+					allocator.End();
+				}
+
+				if (opt.log_allocator_stats)
+				{
+					if (not branches) LOG(INFO) << "memory plan: " << allocator.Snapshot().ToString();
+					if (net->opt.blob_allocator) LOG(INFO) << "blob allocator: " << net->opt.blob_allocator->Snapshot().ToString();
+					if (opt.workspace_allocator) LOG(INFO) << "workspace allocator: " << opt.workspace_allocator->Snapshot().ToString();
+				}
+			}
+
+		private:
+			/// <summary>
+			/// <para>Run the layers on a team of threads of the pool, a layer is dispatched once its producers are done.</para>
+			/// <para>A thread without a ready layer waits in the pool as an idle worker and helps the ParallelFor of the running</para>
+			/// <para>ones, so the layers of independent branches share the cores with their own intra-op parallelism instead</para>
+			/// <para>of adding threads, and a narrow chain after a wide fork still runs on the whole team.</para>
+			/// </summary>
+			void ForwardBranches() const
+			{
+				size_t num_layers = net->layers.size();
+				for (size_t idx = 0; idx < reads.size(); idx++) reads[idx].store((int)net->consumers[idx].size(), std::memory_order_relaxed);
+				for (size_t i = 0; i < num_layers; i++) pending[i].store(net->waits[i], std::memory_order_relaxed);
+
+				std::mutex ready_lock;
+				std::vector<int> ready;
+				for (size_t i = 0; i < num_layers; i++)
+				{
+					if (net->waits[i] == 0) ready.push_back((int)i);
+				}
+				// the size of ready, read by the waiting threads under the lock of the pool
+				std::atomic<size_t> num_ready = ready.size();
+				std::atomic<size_t> done = 0;
+
+				ThreadPool& pool = ThreadPool::Current();
+				int num_threads = opt.num_threads > 0 ? std::min(opt.num_threads, pool.num_threads()) : pool.num_threads();
+				int team = std::min(num_threads, net->max_width);
+				pool.ParallelFor(0, team, 1, [&](size_t, size_t) {
+					while (done.load(std::memory_order_acquire) < num_layers)
+					{
+						// the first added of the ready layers, as the serial order
+						int layer_idx = -1;
+						{
+							std::lock_guard<std::mutex> guard(ready_lock);
+							if (not ready.empty())
+							{
+								auto it = std::min_element(ready.begin(), ready.end());
+								layer_idx = *it;
+								ready.erase(it);
+								num_ready.fetch_sub(1, std::memory_order_relaxed);
+							}
+						}
+						if (layer_idx < 0)
+						{
+							pool.HelpUntil([&]() {
+								return num_ready.load(std::memory_order_acquire) > 0 || done.load(std::memory_order_acquire) == num_layers;
+							});
+							continue;
+						}
+
+						RunLayer(layer_idx, 0);
+						for (int idx : net->layers[layer_idx]->tops_idx)
+						{
+							for (int consumer : net->consumers[idx])
+							{
+								if (pending[consumer].fetch_sub(1, std::memory_order_acq_rel) != 1) continue;
+								std::lock_guard<std::mutex> guard(ready_lock);
+								ready.push_back(consumer);
+								num_ready.fetch_add(1, std::memory_order_release);
+							}
+						}
+						// this thread takes the next ready layer itself, the waiting ones are woken for the others
+						// or to leave after the last one, so they stay idle for the ParallelFor of a narrow chain
+						if (done.fetch_add(1, std::memory_order_release) + 1 == num_layers || num_ready.load(std::memory_order_relaxed) > 1)
+							pool.Notify();
+					}
+				}, team);
+			}
+
+			// no layer after this step reads the blob, with the branches no other layer is left to read it
+			bool IsLastRead(int idx, size_t step) const
+			{
+				return branches ? reads[idx].load(std::memory_order_acquire) == 1 : net->last_use[idx] == (int)step;
+			}
+
+			// the layer is done with the blob, with the branches the last reader releases it in light mode
+			void EndRead(int idx, size_t step) const
+			{
+				bool last = branches ? reads[idx].fetch_sub(1, std::memory_order_acq_rel) == 1 : net->last_use[idx] == (int)step;
+				if (opt.light_mode && last && net->producers[idx] != -1) blobs[idx].Release();
+			}
+
+			// the workspaces of a layer die in its Forward, so the arena of the thread goes back to where it was after it
+			void RunLayer(int layer_idx, size_t step) const
+			{
+				ArenaAllocator::Marker mark;
+				if (arena) mark = arena->Mark();
+				if (profiler) ProfileLayer(layer_idx, step);
+				else ForwardLayer(layer_idx, step, opt);
+				if (arena) arena->Rewind(mark);
+			}
+
+			// the blobs are read before the in-place layers release them, the tops are there until their consumers run
+			void ProfileLayer(int layer_idx, size_t step) const
+			{
+				const Layer* layer = net->layers[layer_idx].get();
+				LayerProfile profile;
+				profile.name = layer->name;
+				profile.type = layer->type;
+				profile.layer_idx = layer_idx;
+				for (int idx : layer->bottoms_idx)
+				{
+					const Tensor& blob = blobs[idx];
+					profile.bottoms_shapes.push_back(blob.shape);
+					profile.bytes += blob.shape.vol() * blob.depth * blob.packing;
+				}
+
+				ProfilingAllocator::Attach(&profile);
+				profile.begin = GetTickCount();
+				ForwardLayer(layer_idx, step, profile_opt);
+				profile.end = GetTickCount();
+				ProfilingAllocator::Attach(nullptr);
+
+				for (int idx : layer->tops_idx)
+				{
+					const Tensor& blob = blobs[idx];
+					profile.tops_shapes.push_back(blob.shape);
+					profile.bytes += blob.shape.vol() * blob.depth * blob.packing;
+				}
+				profile.flops = layer->Flops(profile.bottoms_shapes, profile.tops_shapes);
+				profiler->Record(std::move(profile));
+			}
+
+			void ForwardLayer(int layer_idx, size_t step, const Option& layer_opt) const
+			{
+				const Layer* layer = net->layers[layer_idx].get();
+				// the scratch of the math routines called by the layer
+				WorkspaceScope workspace(layer_opt.workspace_allocator);
+
+				if (layer_opt.light_mode && layer->support_inplace && CanForwardInplace(layer, step))
+				{
+					if (layer->one_blob_only)
+					{
+						Tensor& blob = blobs[layer->bottoms_idx[0]];
+						layer->Forward(blob, layer_opt);
+						blobs[layer->tops_idx[0]] = blob;
+						blob.Release();
+						if (branches) reads[layer->bottoms_idx[0]].fetch_sub(1, std::memory_order_acq_rel);
+					}
+					else
+					{
+						std::vector<Tensor>& _blobs = tops[layer_idx];
+						for (size_t i = 0; i < _blobs.size(); i++) _blobs[i] = blobs[layer->bottoms_idx[i]];
+						for (int idx : layer->bottoms_idx) blobs[idx].Release();
+						layer->Forward(_blobs, layer_opt);
+						for (size_t i = 0; i < _blobs.size(); i++)
+						{
+							blobs[layer->tops_idx[i]] = _blobs[i];
+							_blobs[i].Release();
+						}
+						for (int idx : layer->bottoms_idx)
+						{
+							if (branches) reads[idx].fetch_sub(1, std::memory_order_acq_rel);
+						}
+					}
+					return;
+				}
+
+				if (layer->one_blob_only)
+				{
+					Tensor& top = tops[layer_idx][0];
+					layer->Forward(blobs[layer->bottoms_idx[0]], top, layer_opt);
+					blobs[layer->tops_idx[0]] = top;
+					top.Release();
+				}
+				else
+				{
+					std::vector<Tensor>& _bottoms = bottoms[layer_idx];
+					std::vector<Tensor>& _tops = tops[layer_idx];
+					for (size_t i = 0; i < _bottoms.size(); i++) _bottoms[i] = blobs[layer->bottoms_idx[i]];
+					layer->Forward(_bottoms, _tops, layer_opt);
+					for (size_t i = 0; i < _tops.size(); i++)
+					{
+						blobs[layer->tops_idx[i]] = _tops[i];
+						_tops[i].Release();
+					}
+					for (auto& bottom : _bottoms) bottom.Release();
+				}
+
+				for (int idx : layer->bottoms_idx) EndRead(idx, step);
+			}
+
+			// the bottoms die here and nobody else holds their memory
+			bool CanForwardInplace(const Layer* layer, size_t step) const
+			{
+				if (layer->bottoms_idx.size() != layer->tops_idx.size()) return false;
+				for (int idx : layer->bottoms_idx)
+				{
+					const Tensor& blob = blobs[idx];
+					if (net->producers[idx] == -1 || not IsLastRead(idx, step)) return false;
+					if (blob.ref_cnt == nullptr || *blob.ref_cnt != 1) return false;
+				}
+				return true;
+			}
+
+			void ReleaseBlobs() const
+			{
+				for (size_t idx = 0; idx < blobs.size(); idx++)
+				{
+					if (net->producers[idx] != -1) blobs[idx].Release();
+				}
+			}
+
+			Ptr<const NetImpl> net;
+			mutable PlannedAllocator allocator;
+			Option opt;
+
+			// the layers run concurrently by ForwardBranches
+			bool branches = false;
+			// the pool of the Forwards, Option::thread_pool unless SetThreadPool
+			mutable ThreadPool* thread_pool = nullptr;
+
+			// the layers are recorded into the profiler with the allocators of profile_opt
+			mutable Profiler* profiler = nullptr;
+			mutable ProfilingAllocator blob_counter;
+			mutable ProfilingAllocator workspace_counter;
+			Option profile_opt;
+			// the workspace allocator when it is an arena
+			ArenaAllocator* arena = nullptr;
+			// the readers left of each blob and the producers left of each layer in ForwardBranches
+			mutable std::vector<std::atomic<int>> reads;
+			mutable std::vector<std::atomic<int>> pending;
+
+			mutable std::vector<Tensor> blobs;
+			// per layer arguments, reused to avoid the allocation in Forward
+			mutable std::vector<std::vector<Tensor>> bottoms;
+			mutable std::vector<std::vector<Tensor>> tops;
+		};
+
+		Ptr<Executor> NetImpl::BindExecutor() const
+		{
+			Prepare();
+			return std::make_shared<ExecutorImpl>(shared_from_this());
+		}
+
+
+		Ptr<Net> Net::CreateNet()
+		{
+			return std::make_shared<NetImpl>();
+		}
+
+		// the blobs of a layer in the graph text, '-' for none
+		static std::vector<std::string> ParseBlobs(const std::string& blobs)
+		{
+			if (blobs == "-") return {};
+			return Split(blobs, ",");
+		}
+
+		Ptr<Net> Net::LoadNet(const std::string& file, const Option& opt)
+		{
+			std::string graph;
+			auto tensors = LoadTensors(file, &graph);
+
+			Ptr<Net> net = CreateNet();
+			net->SetOption(opt);
+			std::istringstream lines(graph);
+			std::string line;
+			for (int num = 1; std::getline(lines, line); num++)
+			{
+				line = line.substr(0, line.find('#'));
+				std::istringstream words(line);
+				std::string type, name, bottoms, tops;
+				if (not (words >> type)) continue;
+				CHECK(words >> name >> bottoms >> tops) << Format("line %d of the graph: \"%s\" has no name, bottoms or tops", num, line.c_str());
+
+				Ptr<Layer> layer = net->AddLayer(type, name, ParseBlobs(bottoms), ParseBlobs(tops));
+				for (std::string param; words >> param;)
+				{
+					size_t eq = param.find('=');
+					CHECK(eq != std::string::npos && eq > 0) << Format("line %d of the graph: \"%s\" is not key=value", num, param.c_str());
+					std::string key = param.substr(0, eq), value = param.substr(eq + 1);
+					char* end = nullptr;
+					long ivalue = std::strtol(value.c_str(), &end, 10);
+					if (not value.empty() && *end == '\0')
+					{
+						layer->Set(key, (int)ivalue);
+						continue;
+					}
+					float fvalue = std::strtof(value.c_str(), &end);
+					if (not value.empty() && *end == '\0')
+					{
+						layer->Set(key, fvalue);
+						continue;
+					}
+					if (not value.empty() && value[0] == '@')
+					{
+						auto tensor = tensors.find(value.substr(1));
+						CHECK(tensor != tensors.end()) << Format("line %d of the graph: no tensor %s in \"%s\"", num, value.c_str() + 1, file.c_str());
+						layer->Set(key, tensor->second);
+						continue;
+					}
+					layer->Set(key, value);
+				}
+			}
+			return net;
+		}
+	}
+}
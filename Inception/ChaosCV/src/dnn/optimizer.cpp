@@ -0,0 +1,191 @@
+#include "dnn/optimizer.hpp"
+
+#include "dnn/layers/activation_layer.hpp"
+#include "dnn/layers/binary_op.hpp"
+#include "dnn/layers/innerproduct.hpp"
+#include "dnn/layers/permute.hpp"
+
+#include <algorithm>
+
+namespace chaos
+{
+	namespace dnn
+	{
+		GraphOptimizer::GraphOptimizer(std::vector<Ptr<Layer>>& layers, const std::vector<std::string>& blob_names, const Option& opt)
+			: layers(layers), blob_names(blob_names), opt(opt) {}
+
+		std::vector<std::string> GraphOptimizer::Run()
+		{
+			report.clear();
+			Analyze();
+			// a change may enable the others, eg. the activation after a folded add
+			while (RemoveNoop() || MergePermute() || FuseBinaryOp() || FuseActivation());
+			return report;
+		}
+
+		void GraphOptimizer::Analyze()
+		{
+			producers.assign(blob_names.size(), -1);
+			consumers.assign(blob_names.size(), {});
+			for (size_t i = 0; i < layers.size(); i++)
+			{
+				for (int idx : layers[i]->bottoms_idx) consumers[idx].push_back((int)i);
+				for (int idx : layers[i]->tops_idx) producers[idx] = (int)i;
+			}
+		}
+
+		// the layer which reads the blob, -1 unless there is exactly one
+		int GraphOptimizer::GetConsumer(int blob) const
+		{
+			return consumers[blob].size() == 1 ? consumers[blob][0] : -1;
+		}
+
+		void GraphOptimizer::RemoveLayer(int layer)
+		{
+			layers.erase(layers.begin() + layer);
+			Analyze();
+		}
+
+		bool GraphOptimizer::FuseBinaryOp()
+		{
+			// the vulkan pipeline has only the bias param
+			if (opt.use_vulkan_compute) return false;
+			for (int l = 0; l < (int)layers.size(); l++)
+			{
+				auto op = dynamic_cast<BinaryOp*>(layers[l].get());
+				if (not op || op->op_type != ADD || op->bottoms_idx.size() != 2 || op->tops_idx.size() != 1) continue;
+				for (int k = 0; k < 2; k++)
+				{
+					int blob = op->bottoms_idx[k], other = op->bottoms_idx[1 - k];
+					int p = producers[blob];
+					if (p < 0 || blob == other || GetConsumer(blob) != l) continue;
+					// y = f(x * w^t) + b can not take b before f
+					auto ip = dynamic_cast<InnerProduct*>(layers[p].get());
+					if (not ip || not ip->bias.empty() || ip->activation_type != NONE || ip->bottoms_idx.size() != 1) continue;
+
+					report.push_back(Format("fold BinaryOp %s into InnerProduct %s as its bias %s, without %s",
+						op->name.c_str(), ip->name.c_str(), blob_names[other].c_str(), blob_names[blob].c_str()));
+					ip->bottoms_idx.push_back(other);
+					ip->tops_idx[0] = op->tops_idx[0];
+					ip->one_blob_only = false;
+					RemoveLayer(l);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool GraphOptimizer::FuseActivation()
+		{
+			if (opt.use_vulkan_compute) return false;
+			for (int l = 0; l < (int)layers.size(); l++)
+			{
+				auto act = dynamic_cast<ActivationLayer*>(layers[l].get());
+				if (not act || act->bottoms_idx.size() != 1 || act->tops_idx.size() != 1) continue;
+				int blob = act->bottoms_idx[0];
+				int p = producers[blob];
+				if (p < 0 || GetConsumer(blob) != l) continue;
+				auto ip = dynamic_cast<InnerProduct*>(layers[p].get());
+				if (not ip || ip->activation_type != NONE) continue;
+
+				report.push_back(Format("fold Activation %s into InnerProduct %s, without %s",
+					act->name.c_str(), ip->name.c_str(), blob_names[blob].c_str()));
+				ip->activation_type = act->activation_type;
+				ip->activation_params = act->activation_params;
+				ip->tops_idx[0] = act->tops_idx[0];
+				RemoveLayer(l);
+				return true;
+			}
+			return false;
+		}
+
+		bool GraphOptimizer::MergePermute()
+		{
+			for (int l = 0; l < (int)layers.size(); l++)
+			{
+				auto second = dynamic_cast<Permute*>(layers[l].get());
+				if (not second || second->bottoms_idx.size() != 1 || second->tops_idx.size() != 1) continue;
+
+				// the orders which cancel, y = x
+				bool identity = true;
+				for (size_t i = 0; i < second->orders.size(); i++) identity &= second->orders[i] == i;
+				if (identity)
+				{
+					std::string name = second->name;
+					if (Bypass(l))
+					{
+						report.push_back(Format("remove Permute %s of the identity orders", name.c_str()));
+						return true;
+					}
+				}
+
+				// y[i] = t[b[i]] = x[a[b[i]]]
+				int blob = second->bottoms_idx[0];
+				int p = producers[blob];
+				if (p < 0 || GetConsumer(blob) != l) continue;
+				auto first = dynamic_cast<Permute*>(layers[p].get());
+				if (not first || first->orders.size() != second->orders.size()) continue;
+
+				Vec<uint> orders = first->orders;
+				for (size_t i = 0; i < orders.size(); i++) orders[i] = first->orders[second->orders[i]];
+				report.push_back(Format("merge Permute %s into Permute %s, without %s",
+					second->name.c_str(), first->name.c_str(), blob_names[blob].c_str()));
+				first->orders = orders;
+				first->tops_idx[0] = second->tops_idx[0];
+				RemoveLayer(l);
+				return true;
+			}
+			return false;
+		}
+
+		bool GraphOptimizer::RemoveNoop()
+		{
+			for (int l = 0; l < (int)layers.size(); l++)
+			{
+				auto act = dynamic_cast<ActivationLayer*>(layers[l].get());
+				if (layers[l]->type != "Noop" && not (act && act->activation_type == NONE)) continue;
+				std::string type = layers[l]->type, name = layers[l]->name;
+				if (Bypass(l))
+				{
+					report.push_back(Format("remove %s %s", type.c_str(), name.c_str()));
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool GraphOptimizer::Bypass(int l)
+		{
+			const Layer* layer = layers[l].get();
+			const auto& bottoms = layer->bottoms_idx;
+			const auto& tops = layer->tops_idx;
+			if (bottoms.size() != tops.size()) return false;
+
+			// the producer of a bottom read only here writes the top, which keeps its name,
+			// else the readers of the top read the bottom, a top which nobody reads is an output and stays
+			std::vector<bool> rename(bottoms.size());
+			for (size_t i = 0; i < bottoms.size(); i++)
+			{
+				int bottom = bottoms[i];
+				rename[i] = producers[bottom] >= 0 && GetConsumer(bottom) == l;
+				if (not rename[i] && consumers[tops[i]].empty()) return false;
+			}
+			for (size_t i = 0; i < bottoms.size(); i++)
+			{
+				if (rename[i])
+				{
+					auto& producer_tops = layers[producers[bottoms[i]]]->tops_idx;
+					*std::find(producer_tops.begin(), producer_tops.end(), bottoms[i]) = tops[i];
+					continue;
+				}
+				for (int c : consumers[tops[i]])
+				{
+					auto& consumer_bottoms = layers[c]->bottoms_idx;
+					std::replace(consumer_bottoms.begin(), consumer_bottoms.end(), tops[i], bottoms[i]);
+				}
+			}
+			RemoveLayer(l);
+			return true;
+		}
+	}
+}
\ No newline at end of file
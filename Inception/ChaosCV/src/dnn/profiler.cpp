@@ -0,0 +1,141 @@
+#include "dnn/profiler.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace chaos
+{
+	namespace dnn
+	{
+		void Profiler::Clear()
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			profiles.clear();
+		}
+
+		void Profiler::Record(LayerProfile&& profile)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			auto thread = threads.emplace(std::this_thread::get_id(), (int)threads.size()).first;
+			profile.thread = thread->second;
+			profiles.push_back(std::move(profile));
+		}
+
+		// the names go into JSON strings
+		static std::string Escape(const std::string& text)
+		{
+			std::string escaped;
+			for (char c : text)
+			{
+				if (c == '"' || c == '\\') escaped += '\\';
+				if ((uchar)c < 0x20) escaped += Format("\\u%04x", c);
+				else escaped += c;
+			}
+			return escaped;
+		}
+
+		static std::string ToString(const std::vector<Shape>& shapes)
+		{
+			std::ostringstream stream;
+			for (size_t i = 0; i < shapes.size(); i++) stream << (i ? " " : "") << shapes[i];
+			return stream.str();
+		}
+
+		std::string Profiler::ChromeTrace() const
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			int64 origin = INT64_MAX;
+			for (const auto& profile : profiles) origin = std::min(origin, profile.begin);
+			double us = 1e6 / GetTickFrequency();
+
+			std::ostringstream json;
+			json << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+			for (size_t i = 0; i < profiles.size(); i++)
+			{
+				const LayerProfile& profile = profiles[i];
+				json << (i ? ",\n" : "\n") << Format("{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,",
+					Escape(profile.name).c_str(), Escape(profile.type).c_str(), profile.thread,
+					(profile.begin - origin) * us, (profile.end - profile.begin) * us);
+				json << Format("\"args\":{\"layer\":%d,\"bottoms\":\"%s\",\"tops\":\"%s\",\"bytes\":%zu,\"flops\":%.0f,\"mallocs\":%zu,\"malloc_bytes\":%zu,\"frees\":%zu}}",
+					profile.layer_idx, ToString(profile.bottoms_shapes).c_str(), ToString(profile.tops_shapes).c_str(),
+					profile.bytes, profile.flops, profile.mallocs, profile.malloc_bytes, profile.frees);
+			}
+			json << "\n]}";
+			return json.str();
+		}
+
+		void Profiler::SaveChromeTrace(const std::string& file) const
+		{
+			std::ofstream stream(file, std::ios::binary);
+			CHECK(stream.is_open()) << "can not open \"" << file << "\"";
+			stream << ChromeTrace();
+		}
+
+		std::string Profiler::Summary() const
+		{
+			struct Total
+			{
+				const LayerProfile* first;
+				size_t runs = 0;
+				double ms = 0., bytes = 0., flops = 0.;
+				size_t mallocs = 0;
+			};
+			std::lock_guard<std::mutex> guard(lock);
+			std::map<int, Total> totals;
+			double ms_per_tick = 1e3 / GetTickFrequency(), sum = 0.;
+			for (const auto& profile : profiles)
+			{
+				Total& total = totals.emplace(profile.layer_idx, Total{ &profile }).first->second;
+				double ms = (profile.end - profile.begin) * ms_per_tick;
+				total.runs++;
+				total.ms += ms;
+				total.bytes += (double)profile.bytes;
+				total.flops += profile.flops;
+				total.mallocs += profile.mallocs;
+				sum += ms;
+			}
+			std::vector<const Total*> order;
+			for (const auto& [idx, total] : totals) order.push_back(&total);
+			std::stable_sort(order.begin(), order.end(), [](const Total* a, const Total* b) { return a->ms > b->ms; });
+
+			std::string summary = Format("%-24s %-14s %6s %10s %10s %7s %9s %9s %8s\n",
+				"layer", "type", "runs", "total ms", "mean ms", "%", "GFLOP/s", "GB/s", "mallocs");
+			for (const Total* total : order)
+			{
+				// flops per ms to GFLOP/s and bytes per ms to GB/s
+				double scale = total->ms > 0. ? 1e-6 / total->ms : 0.;
+				summary += Format("%-24s %-14s %6zu %10.3f %10.3f %6.1f%% %9.2f %9.2f %8zu\n",
+					total->first->name.c_str(), total->first->type.c_str(), total->runs, total->ms, total->ms / total->runs,
+					sum > 0. ? 100. * total->ms / sum : 0., total->flops * scale, total->bytes * scale, total->mallocs);
+			}
+			return summary;
+		}
+
+
+		// the layer of the calling thread
+		static thread_local LayerProfile* attached = nullptr;
+
+		void ProfilingAllocator::Attach(LayerProfile* profile)
+		{
+			attached = profile;
+		}
+
+		void* ProfilingAllocator::FastMalloc(size_t size)
+		{
+			if (attached)
+			{
+				attached->mallocs++;
+				attached->malloc_bytes += size;
+			}
+			return upstream ? upstream->FastMalloc(size) : chaos::FastMalloc(size);
+		}
+
+		void ProfilingAllocator::FastFree(void* ptr)
+		{
+			if (attached) attached->frees++;
+			if (upstream) upstream->FastFree(ptr);
+			else chaos::FastFree(ptr);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,1013 @@
+#include "math/gemm.hpp"
+#include "math/half.hpp"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace chaos
+{
+    // Blocking follows the usual Goto/BLIS scheme, a KC x NR panel of B stays in L1,
+    // the MC x KC block of A in L2 and the KC x NC block of B in L3
+    static constexpr int KC = 256;
+    static constexpr int MC = 128;
+    static constexpr int NC = 2048;
+
+    using MicroKernel = void (*)(int kc, const float* a, const float* b, float* c, size_t ldc, float alpha, float beta);
+
+    // grows only, one per thread, so the steady state does not allocate
+    class PackBuffer
+    {
+    public:
+        ~PackBuffer() { FastFree(data); }
+
+        float* Get(size_t size)
+        {
+            if (size > capacity)
+            {
+                FastFree(data);
+                data = (float*)FastMalloc(size * sizeof(float));
+                capacity = size;
+            }
+            return data;
+        }
+
+    private:
+        float* data = nullptr;
+        size_t capacity = 0;
+    };
+
+    static void Scale(int m, int n, float beta, float* C, size_t ldc)
+    {
+        for (int i = 0; i < m; i++, C += ldc)
+        {
+            for (int j = 0; j < n; j++)
+                C[j] = beta == 0.f ? 0.f : C[j] * beta;
+        }
+    }
+
+    //////////////////////////////////////// packing ////////////////////////////////////////////
+    // A block (mc x kc) is packed into MR row panels, k major: pa[(i / MR) * kc * MR + k * MR + i % MR]
+    // the last panel is padded by zeros
+    template<int MR>
+    static void PackA(bool trans, const float* A, size_t lda, int mc, int kc, float* pa)
+    {
+        for (int i = 0; i < mc; i += MR, pa += MR * kc)
+        {
+            int mr = std::min(MR, mc - i);
+            if (trans)
+            {
+                for (int k = 0; k < kc; k++)
+                {
+                    const float* a = A + k * lda + i;
+                    for (int r = 0; r < mr; r++)
+                        pa[k * MR + r] = a[r];
+                    for (int r = mr; r < MR; r++)
+                        pa[k * MR + r] = 0.f;
+                }
+            }
+            else
+            {
+                for (int r = 0; r < mr; r++)
+                {
+                    const float* a = A + (i + r) * lda;
+                    for (int k = 0; k < kc; k++)
+                        pa[k * MR + r] = a[k];
+                }
+                for (int r = mr; r < MR; r++)
+                {
+                    for (int k = 0; k < kc; k++)
+                        pa[k * MR + r] = 0.f;
+                }
+            }
+        }
+    }
+
+    // B block (kc x nc) is packed into NR column panels, k major: pb[(j / NR) * kc * NR + k * NR + j % NR]
+    template<int NR>
+    static void PackB(bool trans, const float* B, size_t ldb, int kc, int nc, float* pb)
+    {
+        for (int j = 0; j < nc; j += NR, pb += NR * kc)
+        {
+            int nr = std::min(NR, nc - j);
+            if (trans)
+            {
+                for (int c = 0; c < nr; c++)
+                {
+                    const float* b = B + (j + c) * ldb;
+                    for (int k = 0; k < kc; k++)
+                        pb[k * NR + c] = b[k];
+                }
+                for (int c = nr; c < NR; c++)
+                {
+                    for (int k = 0; k < kc; k++)
+                        pb[k * NR + c] = 0.f;
+                }
+            }
+            else
+            {
+                for (int k = 0; k < kc; k++)
+                {
+                    const float* b = B + k * ldb + j;
+                    for (int c = 0; c < nr; c++)
+                        pb[k * NR + c] = b[c];
+                    for (int c = nr; c < NR; c++)
+                        pb[k * NR + c] = 0.f;
+                }
+            }
+        }
+    }
+
+    //////////////////////////////////////// micro kernels ////////////////////////////////////////////
+    // c[MR x NR] = alpha * a * b + beta * c, a and b are the packed panels
+    template<int MR, int NR>
+    static void KernelScalar(int kc, const float* a, const float* b, float* c, size_t ldc, float alpha, float beta)
+    {
+        float acc[MR][NR] = { 0 };
+        for (int p = 0; p < kc; p++, a += MR, b += NR)
+        {
+            for (int r = 0; r < MR; r++)
+            {
+                for (int j = 0; j < NR; j++)
+                    acc[r][j] += a[r] * b[j];
+            }
+        }
+        for (int r = 0; r < MR; r++, c += ldc)
+        {
+            for (int j = 0; j < NR; j++)
+                c[j] = beta == 0.f ? alpha * acc[r][j] : alpha * acc[r][j] + beta * c[j];
+        }
+    }
+
+    static inline void StoreAVX2(float* c, __m256 acc, __m256 valpha, __m256 vbeta, bool use_beta)
+    {
+        acc = _mm256_mul_ps(acc, valpha);
+        if (use_beta)
+            acc = _mm256_fmadd_ps(vbeta, _mm256_loadu_ps(c), acc);
+        _mm256_storeu_ps(c, acc);
+    }
+
+    // 6x16, 12 accumulators + 2 b + 1 a of the 16 ymm registers
+    static void KernelAVX2(int kc, const float* a, const float* b, float* c, size_t ldc, float alpha, float beta)
+    {
+        __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+        __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+        __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+        __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+        __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+        __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+
+#define GEMM_AVX2_ROW(r) \
+        { \
+            __m256 ar = _mm256_broadcast_ss(a + r); \
+            c##r##0 = _mm256_fmadd_ps(ar, b0, c##r##0); \
+            c##r##1 = _mm256_fmadd_ps(ar, b1, c##r##1); \
+        }
+
+        for (int p = 0; p < kc; p++, a += 6, b += 16)
+        {
+            __m256 b0 = _mm256_loadu_ps(b);
+            __m256 b1 = _mm256_loadu_ps(b + 8);
+            GEMM_AVX2_ROW(0);
+            GEMM_AVX2_ROW(1);
+            GEMM_AVX2_ROW(2);
+            GEMM_AVX2_ROW(3);
+            GEMM_AVX2_ROW(4);
+            GEMM_AVX2_ROW(5);
+        }
+#undef GEMM_AVX2_ROW
+
+        __m256 valpha = _mm256_set1_ps(alpha), vbeta = _mm256_set1_ps(beta);
+        bool use_beta = beta != 0.f;
+        StoreAVX2(c, c00, valpha, vbeta, use_beta); StoreAVX2(c + 8, c01, valpha, vbeta, use_beta); c += ldc;
+        StoreAVX2(c, c10, valpha, vbeta, use_beta); StoreAVX2(c + 8, c11, valpha, vbeta, use_beta); c += ldc;
+        StoreAVX2(c, c20, valpha, vbeta, use_beta); StoreAVX2(c + 8, c21, valpha, vbeta, use_beta); c += ldc;
+        StoreAVX2(c, c30, valpha, vbeta, use_beta); StoreAVX2(c + 8, c31, valpha, vbeta, use_beta); c += ldc;
+        StoreAVX2(c, c40, valpha, vbeta, use_beta); StoreAVX2(c + 8, c41, valpha, vbeta, use_beta); c += ldc;
+        StoreAVX2(c, c50, valpha, vbeta, use_beta); StoreAVX2(c + 8, c51, valpha, vbeta, use_beta);
+    }
+
+    static inline void StoreAVX512(float* c, __m512 acc, __m512 valpha, __m512 vbeta, bool use_beta)
+    {
+        acc = _mm512_mul_ps(acc, valpha);
+        if (use_beta)
+            acc = _mm512_fmadd_ps(vbeta, _mm512_loadu_ps(c), acc);
+        _mm512_storeu_ps(c, acc);
+    }
+
+    // 8x32, 16 accumulators + 2 b + 1 a of the 32 zmm registers
+    static void KernelAVX512(int kc, const float* a, const float* b, float* c, size_t ldc, float alpha, float beta)
+    {
+        __m512 c00 = _mm512_setzero_ps(), c01 = _mm512_setzero_ps();
+        __m512 c10 = _mm512_setzero_ps(), c11 = _mm512_setzero_ps();
+        __m512 c20 = _mm512_setzero_ps(), c21 = _mm512_setzero_ps();
+        __m512 c30 = _mm512_setzero_ps(), c31 = _mm512_setzero_ps();
+        __m512 c40 = _mm512_setzero_ps(), c41 = _mm512_setzero_ps();
+        __m512 c50 = _mm512_setzero_ps(), c51 = _mm512_setzero_ps();
+        __m512 c60 = _mm512_setzero_ps(), c61 = _mm512_setzero_ps();
+        __m512 c70 = _mm512_setzero_ps(), c71 = _mm512_setzero_ps();
+
+#define GEMM_AVX512_ROW(r) \
+        { \
+            __m512 ar = _mm512_set1_ps(a[r]); \
+            c##r##0 = _mm512_fmadd_ps(ar, b0, c##r##0); \
+            c##r##1 = _mm512_fmadd_ps(ar, b1, c##r##1); \
+        }
+
+        for (int p = 0; p < kc; p++, a += 8, b += 32)
+        {
+            __m512 b0 = _mm512_loadu_ps(b);
+            __m512 b1 = _mm512_loadu_ps(b + 16);
+            GEMM_AVX512_ROW(0);
+            GEMM_AVX512_ROW(1);
+            GEMM_AVX512_ROW(2);
+            GEMM_AVX512_ROW(3);
+            GEMM_AVX512_ROW(4);
+            GEMM_AVX512_ROW(5);
+            GEMM_AVX512_ROW(6);
+            GEMM_AVX512_ROW(7);
+        }
+#undef GEMM_AVX512_ROW
+
+        __m512 valpha = _mm512_set1_ps(alpha), vbeta = _mm512_set1_ps(beta);
+        bool use_beta = beta != 0.f;
+        StoreAVX512(c, c00, valpha, vbeta, use_beta); StoreAVX512(c + 16, c01, valpha, vbeta, use_beta); c += ldc;
+        StoreAVX512(c, c10, valpha, vbeta, use_beta); StoreAVX512(c + 16, c11, valpha, vbeta, use_beta); c += ldc;
+        StoreAVX512(c, c20, valpha, vbeta, use_beta); StoreAVX512(c + 16, c21, valpha, vbeta, use_beta); c += ldc;
+        StoreAVX512(c, c30, valpha, vbeta, use_beta); StoreAVX512(c + 16, c31, valpha, vbeta, use_beta); c += ldc;
+        StoreAVX512(c, c40, valpha, vbeta, use_beta); StoreAVX512(c + 16, c41, valpha, vbeta, use_beta); c += ldc;
+        StoreAVX512(c, c50, valpha, vbeta, use_beta); StoreAVX512(c + 16, c51, valpha, vbeta, use_beta); c += ldc;
+        StoreAVX512(c, c60, valpha, vbeta, use_beta); StoreAVX512(c + 16, c61, valpha, vbeta, use_beta); c += ldc;
+        StoreAVX512(c, c70, valpha, vbeta, use_beta); StoreAVX512(c + 16, c71, valpha, vbeta, use_beta);
+    }
+
+    //////////////////////////////////////// packed gemm ////////////////////////////////////////////
+    // the NR panels of a kc x nc block of B, the panel of the column j of the block at b + j / NR * step
+    struct PanelsB
+    {
+        const float* b;
+        size_t step;
+    };
+
+    // get_b(jc, pc, kc, nc) gives the panels of each block of B
+    template<int MR, int NR, MicroKernel Kernel, class GetB>
+    static void GemmBlocked(bool trans_a, int m, int n, int k, float alpha, const float* A, size_t lda, 
+        const GetB& get_b, float beta, float* C, size_t ldc, const GemmEpilogue* epilogue)
+    {
+        constexpr int mc_max = MC / MR * MR;
+        constexpr int nc_max = NC / NR * NR;
+
+        thread_local PackBuffer abuf;
+        float* pa = abuf.Get((size_t)std::min((m + MR - 1) / MR * MR, mc_max) * std::min(k, KC));
+
+        for (int jc = 0; jc < n; jc += nc_max)
+        {
+            int nc = std::min(nc_max, n - jc);
+            for (int pc = 0; pc < k; pc += KC)
+            {
+                int kc = std::min(KC, k - pc);
+                PanelsB pb = get_b(jc, pc, kc, nc);
+
+                // accumulate into C after the first k block
+                float _beta = pc == 0 ? beta : 1.f;
+                for (int ic = 0; ic < m; ic += mc_max)
+                {
+                    int mc = std::min(mc_max, m - ic);
+                    PackA<MR>(trans_a, trans_a ? A + pc * lda + ic : A + ic * lda + pc, lda, mc, kc, pa);
+
+                    for (int jr = 0; jr < nc; jr += NR)
+                    {
+                        int nr = std::min(NR, nc - jr);
+                        const float* b = pb.b + jr / NR * pb.step;
+                        for (int ir = 0; ir < mc; ir += MR)
+                        {
+                            int mr = std::min(MR, mc - ir);
+                            float* c = C + (ic + ir) * ldc + jc + jr;
+                            if (mr == MR && nr == NR)
+                            {
+                                Kernel(kc, pa + ir * kc, b, c, ldc, alpha, _beta);
+                                continue;
+                            }
+                            // partial tile, compute the full tile aside and copy the valid part
+                            alignas(64) float tile[MR * NR];
+                            Kernel(kc, pa + ir * kc, b, tile, NR, alpha, 0.f);
+                            for (int r = 0; r < mr; r++, c += ldc)
+                            {
+                                for (int j = 0; j < nr; j++)
+                                    c[j] = _beta == 0.f ? tile[r * NR + j] : tile[r * NR + j] + _beta * c[j];
+                            }
+                        }
+                        // the column panel is final after the last k block and still in L1
+                        if (epilogue && pc + kc == k)
+                            (*epilogue)(C + ic * ldc + jc + jr, ldc, ic, jc + jr, mc, nr);
+                    }
+                }
+            }
+        }
+    }
+
+    template<int MR, int NR, MicroKernel Kernel>
+    static void GemmPacked(bool trans_a, bool trans_b, int m, int n, int k, float alpha,
+        const float* A, size_t lda, const float* B, size_t ldb, float beta, float* C, size_t ldc, const GemmEpilogue* epilogue)
+    {
+        thread_local PackBuffer bbuf;
+        float* pb = bbuf.Get((size_t)std::min((n + NR - 1) / NR * NR, NC / NR * NR) * std::min(k, KC));
+        GemmBlocked<MR, NR, Kernel>(trans_a, m, n, k, alpha, A, lda, [&](int jc, int pc, int kc, int nc) {
+            PackB<NR>(trans_b, trans_b ? B + jc * ldb + pc : B + pc * ldb + jc, ldb, kc, nc, pb);
+            return PanelsB{ pb, (size_t)kc * NR };
+        }, beta, C, ldc, epilogue);
+    }
+
+    //////////////////////////////////////// gemv ////////////////////////////////////////////
+    // A few rows of A (batch 1 inner product) are bound by reading B once,
+    // packing B would double the memory traffic, so the rows are computed directly from B
+    static void GemvScalar(bool trans_b, int n, int k, float alpha, const float* x, const float* B, size_t ldb, float beta, float* y)
+    {
+        if (trans_b)
+        {
+            for (int j = 0; j < n; j++)
+            {
+                const float* b = B + j * ldb;
+                float s = 0.f;
+                for (int p = 0; p < k; p++)
+                    s += x[p] * b[p];
+                y[j] = beta == 0.f ? alpha * s : alpha * s + beta * y[j];
+            }
+        }
+        else
+        {
+            for (int j = 0; j < n; j++)
+            {
+                float s = 0.f;
+                for (int p = 0; p < k; p++)
+                    s += x[p] * B[p * ldb + j];
+                y[j] = beta == 0.f ? alpha * s : alpha * s + beta * y[j];
+            }
+        }
+    }
+
+    static inline float HorizontalSum(__m256 v)
+    {
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        return _mm_cvtss_f32(s);
+    }
+
+    static void GemvAVX2(bool trans_b, int n, int k, float alpha, const float* x, const float* B, size_t ldb, float beta, float* y)
+    {
+        int j = 0;
+        if (trans_b)
+        {
+            // 4 rows of B at once, x is loaded once for them
+            for (; j + 4 <= n; j += 4)
+            {
+                const float* b0 = B + j * ldb;
+                const float* b1 = b0 + ldb;
+                const float* b2 = b1 + ldb;
+                const float* b3 = b2 + ldb;
+                __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+                __m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+                int p = 0;
+                for (; p + 8 <= k; p += 8)
+                {
+                    __m256 xv = _mm256_loadu_ps(x + p);
+                    s0 = _mm256_fmadd_ps(xv, _mm256_loadu_ps(b0 + p), s0);
+                    s1 = _mm256_fmadd_ps(xv, _mm256_loadu_ps(b1 + p), s1);
+                    s2 = _mm256_fmadd_ps(xv, _mm256_loadu_ps(b2 + p), s2);
+                    s3 = _mm256_fmadd_ps(xv, _mm256_loadu_ps(b3 + p), s3);
+                }
+                float s[4] = { HorizontalSum(s0), HorizontalSum(s1), HorizontalSum(s2), HorizontalSum(s3) };
+                for (; p < k; p++)
+                {
+                    s[0] += x[p] * b0[p];
+                    s[1] += x[p] * b1[p];
+                    s[2] += x[p] * b2[p];
+                    s[3] += x[p] * b3[p];
+                }
+                for (int q = 0; q < 4; q++)
+                    y[j + q] = beta == 0.f ? alpha * s[q] : alpha * s[q] + beta * y[j + q];
+            }
+        }
+        else
+        {
+            // 32 columns of y are kept in registers while the rows of B stream by
+            __m256 valpha = _mm256_set1_ps(alpha), vbeta = _mm256_set1_ps(beta);
+            for (; j + 32 <= n; j += 32)
+            {
+                __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+                __m256 s2 = _mm256_setzero_ps(), s3 = _mm256_setzero_ps();
+                const float* b = B + j;
+                for (int p = 0; p < k; p++, b += ldb)
+                {
+                    __m256 xv = _mm256_broadcast_ss(x + p);
+                    s0 = _mm256_fmadd_ps(xv, _mm256_loadu_ps(b), s0);
+                    s1 = _mm256_fmadd_ps(xv, _mm256_loadu_ps(b + 8), s1);
+                    s2 = _mm256_fmadd_ps(xv, _mm256_loadu_ps(b + 16), s2);
+                    s3 = _mm256_fmadd_ps(xv, _mm256_loadu_ps(b + 24), s3);
+                }
+                StoreAVX2(y + j, s0, valpha, vbeta, beta != 0.f);
+                StoreAVX2(y + j + 8, s1, valpha, vbeta, beta != 0.f);
+                StoreAVX2(y + j + 16, s2, valpha, vbeta, beta != 0.f);
+                StoreAVX2(y + j + 24, s3, valpha, vbeta, beta != 0.f);
+            }
+            for (; j + 8 <= n; j += 8)
+            {
+                __m256 s0 = _mm256_setzero_ps();
+                const float* b = B + j;
+                for (int p = 0; p < k; p++, b += ldb)
+                    s0 = _mm256_fmadd_ps(_mm256_broadcast_ss(x + p), _mm256_loadu_ps(b), s0);
+                StoreAVX2(y + j, s0, valpha, vbeta, beta != 0.f);
+            }
+        }
+        GemvScalar(trans_b, n - j, k, alpha, x, trans_b ? B + j * ldb : B + j, ldb, beta, y + j);
+    }
+
+    //////////////////////////////////////// prepacked B ////////////////////////////////////////////
+    // B is packed into NR column panels over the whole of k: panels[(j / NR) * k * NR + p * NR + j % NR],
+    // so a kc block of a panel is contiguous, the FP32 panels are read in place by the kernels
+
+    // the kc rows from pc of a FP16, BF16 or INT8 panel widened to float
+    template<int NR, bool avx2>
+    static void UnpackPanel(const PackedMatrix& B, int panel, int pc, int kc, float* dst)
+    {
+        size_t offset = ((size_t)panel * B.k + pc) * NR;
+        size_t size = (size_t)kc * NR;
+        if (B.format == PackedMatrix::FP16)
+            return Cast((const float16*)B.panels + offset, dst, size);
+        if (B.format == PackedMatrix::BF16)
+            return Cast((const bfloat16*)B.panels + offset, dst, size);
+
+        const int8_t* src = (const int8_t*)B.panels + offset;
+        const float* scale = (const float*)B.scales + (size_t)panel * NR;
+        for (size_t i = 0; i < size; i += NR)
+        {
+            if constexpr (avx2)
+            {
+                for (int j = 0; j < NR; j += 8)
+                {
+                    __m256 q = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)(src + i + j))));
+                    _mm256_storeu_ps(dst + i + j, _mm256_mul_ps(q, _mm256_loadu_ps(scale + j)));
+                }
+            }
+            else
+            {
+                for (int j = 0; j < NR; j++)
+                    dst[i + j] = src[i + j] * scale[j];
+            }
+        }
+    }
+
+    // 8 elements of a FP32, FP16, BF16 or INT8 panel widened to float
+    static inline __m256 LoadPanel(const float* p) { return _mm256_loadu_ps(p); }
+    static inline __m256 LoadPanel(const float16* p) { return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)p)); }
+    static inline __m256 LoadPanel(const bfloat16* p)
+    {
+        return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p)), 16));
+    }
+    static inline __m256 LoadPanel(const int8_t* p) { return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)p))); }
+
+    static inline float PanelValue(float v) { return v; }
+    static inline float PanelValue(float16 v) { return _cvtsh_ss(v.bits); }
+    static inline float PanelValue(bfloat16 v) { return ToFloat(v); }
+    static inline float PanelValue(int8_t v) { return v; }
+
+    // acc[g][0 : NR] += x[0 : kc] * b[g] for G panels widened in registers, b[g] is a kc x NR block of a panel,
+    // a single core reads memory faster as several streams than as one
+    template<int NR, int G, bool avx2, class Type>
+    static void GemvPanels(int kc, const float* x, const Type* const* b, float (*acc)[NR])
+    {
+        if constexpr (avx2)
+        {
+            constexpr int V = NR / 8;
+            __m256 s[G][V];
+            for (int g = 0; g < G; g++)
+            {
+                for (int c = 0; c < V; c++)
+                    s[g][c] = _mm256_loadu_ps(acc[g] + 8 * c);
+            }
+            for (int p = 0; p < kc; p++)
+            {
+                __m256 xv = _mm256_broadcast_ss(x + p);
+                for (int g = 0; g < G; g++)
+                {
+                    for (int c = 0; c < V; c++)
+                        s[g][c] = _mm256_fmadd_ps(xv, LoadPanel(b[g] + p * NR + 8 * c), s[g][c]);
+                }
+            }
+            for (int g = 0; g < G; g++)
+            {
+                for (int c = 0; c < V; c++)
+                    _mm256_storeu_ps(acc[g] + 8 * c, s[g][c]);
+            }
+        }
+        else
+        {
+            for (int g = 0; g < G; g++)
+            {
+                for (int p = 0; p < kc; p++)
+                {
+                    for (int c = 0; c < NR; c++)
+                        acc[g][c] += x[p] * PanelValue(b[g][p * NR + c]);
+                }
+            }
+        }
+    }
+
+    // the m <= 2 rows x of C, they are bound by reading B once so the panels are read in place,
+    // INT8 sums are scaled at the end
+    template<int NR, bool avx2, class Type>
+    static void GemvPrepacked(int m, int n, float alpha, const float* const* x, const PackedMatrix& B, int j0, 
+        float beta, float* C, size_t ldc)
+    {
+        constexpr int G = 4;
+        int k = B.k;
+        size_t panel_size = (size_t)k * NR;
+        const Type* panels = (const Type*)B.panels + j0 / NR * panel_size;
+        const float* scales = B.format == PackedMatrix::INT8 ? (const float*)B.scales + j0 : nullptr;
+        for (int j = 0; j < n; j += G * NR)
+        {
+            int g = std::min(G, (n - j + NR - 1) / NR);
+            alignas(64) float acc[2][G][NR] = {};
+            for (int pc = 0; pc < k; pc += KC)
+            {
+                int kc = std::min(KC, k - pc);
+                const Type* b[G];
+                for (int q = 0; q < g; q++)
+                    b[q] = panels + (j / NR + q) * panel_size + pc * NR;
+                for (int i = 0; i < m; i++)
+                {
+                    if (g == G)
+                    {
+                        GemvPanels<NR, G, avx2>(kc, x[i] + pc, b, acc[i]);
+                        continue;
+                    }
+                    for (int q = 0; q < g; q++)
+                        GemvPanels<NR, 1, avx2>(kc, x[i] + pc, b + q, acc[i] + q);
+                }
+            }
+            int cols = std::min(G * NR, n - j);
+            for (int i = 0; i < m; i++)
+            {
+                const float* a = acc[i][0];
+                float* y = C + i * ldc + j;
+                for (int c = 0; c < cols; c++)
+                {
+                    float s = scales ? alpha * a[c] * scales[j + c] : alpha * a[c];
+                    y[c] = beta == 0.f ? s : s + beta * y[c];
+                }
+            }
+        }
+    }
+
+    template<int MR, int NR, MicroKernel Kernel, bool avx2>
+    static void GemmPrepacked(bool trans_a, int m, int n, float alpha, const float* A, size_t lda, 
+        const PackedMatrix& B, int j0, float beta, float* C, size_t ldc, const GemmEpilogue* epilogue)
+    {
+        int k = B.k;
+        if (m > 2)
+        {
+            size_t panel_size = (size_t)k * NR;
+            const float* panels = B.format == PackedMatrix::FP32 ? (const float*)B.panels + j0 / NR * panel_size : nullptr;
+            thread_local PackBuffer bbuf;
+            float* pb = panels ? nullptr : bbuf.Get((size_t)std::min((n + NR - 1) / NR * NR, NC / NR * NR) * std::min(k, KC));
+            GemmBlocked<MR, NR, Kernel>(trans_a, m, n, k, alpha, A, lda, [&](int jc, int pc, int kc, int nc) {
+                if (panels)
+                    return PanelsB{ panels + jc / NR * panel_size + pc * NR, panel_size };
+                for (int j = 0; j < nc; j += NR)
+                    UnpackPanel<NR, avx2>(B, (j0 + jc + j) / NR, pc, kc, pb + j * kc);
+                return PanelsB{ pb, (size_t)kc * NR };
+            }, beta, C, ldc, epilogue);
+            return;
+        }
+
+        thread_local PackBuffer xbuf;
+        const float* x[2] = { A, A + lda };
+        if (trans_a) // gather the columns of A
+        {
+            float* _x = xbuf.Get((size_t)m * k);
+            for (int i = 0; i < m; i++)
+            {
+                for (int p = 0; p < k; p++)
+                    _x[i * k + p] = A[p * lda + i];
+                x[i] = _x + i * k;
+            }
+        }
+        if (B.format == PackedMatrix::FP32)
+            GemvPrepacked<NR, avx2, float>(m, n, alpha, x, B, j0, beta, C, ldc);
+        else if (B.format == PackedMatrix::FP16)
+            GemvPrepacked<NR, avx2, float16>(m, n, alpha, x, B, j0, beta, C, ldc);
+        else if (B.format == PackedMatrix::BF16)
+            GemvPrepacked<NR, avx2, bfloat16>(m, n, alpha, x, B, j0, beta, C, ldc);
+        else
+            GemvPrepacked<NR, avx2, int8_t>(m, n, alpha, x, B, j0, beta, C, ldc);
+        for (int i = 0; i < m && epilogue; i++)
+            (*epilogue)(C + i * ldc, ldc, i, 0, 1, n);
+    }
+
+    //////////////////////////////////////// dispatch ////////////////////////////////////////////
+    using GemmFunc = void (*)(bool, bool, int, int, int, float, const float*, size_t, const float*, size_t, float, float*, size_t, const GemmEpilogue*);
+    using GemvFunc = void (*)(bool, int, int, float, const float*, const float*, size_t, float, float*);
+
+    static bool UseAVX2()
+    {
+        static const bool avx2 = CheckHardwareSupport(CpuFeature::AVX2) && CheckHardwareSupport(CpuFeature::FMA3);
+        return avx2;
+    }
+
+    static GemmFunc SelectGemm()
+    {
+        if (CheckHardwareSupport(CpuFeature::AVX512F))
+            return GemmPacked<8, 32, KernelAVX512>;
+        if (UseAVX2())
+            return GemmPacked<6, 16, KernelAVX2>;
+        return GemmPacked<4, 8, KernelScalar<4, 8>>;
+    }
+
+    using PrepackedFunc = void (*)(bool, int, int, float, const float*, size_t, const PackedMatrix&, int, float, float*, size_t, const GemmEpilogue*);
+
+    struct PrepackedKernel
+    {
+        int nr;
+        PrepackedFunc func;
+    };
+
+    // the panels are as wide as the kernel selected the same way as SelectGemm
+    static const PrepackedKernel& GetPrepacked()
+    {
+        static const PrepackedKernel kernel = CheckHardwareSupport(CpuFeature::AVX512F) ? PrepackedKernel{ 32, GemmPrepacked<8, 32, KernelAVX512, true> } :
+            UseAVX2() ? PrepackedKernel{ 16, GemmPrepacked<6, 16, KernelAVX2, true> } : PrepackedKernel{ 8, GemmPrepacked<4, 8, KernelScalar<4, 8>, false> };
+        return kernel;
+    }
+
+    static void GemmImpl(bool trans_a, bool trans_b, int m, int n, int k, float alpha,
+        const float* A, size_t lda, const float* B, size_t ldb, float beta, float* C, size_t ldc, const GemmEpilogue* epilogue)
+    {
+        CHECK(m >= 0 && n >= 0 && k >= 0);
+        if (m == 0 || n == 0)
+            return;
+        if (k == 0 || alpha == 0.f)
+        {
+            Scale(m, n, beta, C, ldc);
+            if (epilogue) (*epilogue)(C, ldc, 0, 0, m, n);
+            return;
+        }
+
+        if (m <= 2)
+        {
+            static const GemvFunc gemv = UseAVX2() ? GemvAVX2 : GemvScalar;
+            thread_local PackBuffer xbuf;
+            for (int i = 0; i < m; i++)
+            {
+                const float* x = A + i * lda;
+                if (trans_a) // gather the column of A
+                {
+                    float* _x = xbuf.Get(k);
+                    for (int p = 0; p < k; p++)
+                        _x[p] = A[p * lda + i];
+                    x = _x;
+                }
+                gemv(trans_b, n, k, alpha, x, B, ldb, beta, C + i * ldc);
+                if (epilogue) (*epilogue)(C + i * ldc, ldc, i, 0, 1, n);
+            }
+        }
+        else
+        {
+            static const GemmFunc gemm = SelectGemm();
+            gemm(trans_a, trans_b, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc, epilogue);
+        }
+
+        if (UseAVX2())
+            _mm256_zeroupper();
+    }
+
+    void Gemm(bool trans_a, bool trans_b, int m, int n, int k, float alpha,
+        const float* A, size_t lda, const float* B, size_t ldb, float beta, float* C, size_t ldc)
+    {
+        GemmImpl(trans_a, trans_b, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc, nullptr);
+    }
+
+    void Gemm(bool trans_a, bool trans_b, int m, int n, int k, float alpha,
+        const float* A, size_t lda, const float* B, size_t ldb, float beta, float* C, size_t ldc, GemmEpilogue epilogue)
+    {
+        GemmImpl(trans_a, trans_b, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc, &epilogue);
+    }
+
+    PackedMatrix::PackedMatrix(bool trans_b, int _k, int _n, const float* B, size_t ldb, Format _format, Allocator* allocator) : 
+        k(_k), n(_n), nr(GetPrepacked().nr), format(_format)
+    {
+        CHECK(k >= 0 && n >= 0);
+        CHECK(format != FP16 || CheckHardwareSupport(CpuFeature::F16C)) << "FP16 panels need F16C";
+
+        uint num_panels = (n + nr - 1) / nr;
+        if (num_panels == 0 || k == 0)
+            return;
+        size_t cols = (size_t)num_panels * nr;
+        // the INT8_DOT rows are padded by zeros to the groups of 4
+        int rows = format == INT8_DOT ? (k + 3) / 4 * 4 : k;
+        Shape shape(num_panels, (uint)rows, (uint)nr);
+        Depth depth = format == FP32 ? Depth::D4 : format == FP16 || format == BF16 ? Depth::D2 : Depth::D1;
+        panels.Create(shape, shape.steps(), depth, Packing::CHW, allocator);
+
+        // the element (p, j) of op(B), 0 in the padding
+        auto get = [&](int p, size_t j) { return j >= (size_t)n || p >= k ? 0.f : trans_b ? B[j * ldb + p] : B[p * ldb + j]; };
+        if (format == INT8 || format == INT8_DOT)
+        {
+            scales.Create(Shape((uint)cols), Shape((uint)cols).steps(), Depth::D4, Packing::CHW, allocator);
+            for (size_t j = 0; j < cols; j++)
+            {
+                float max = 0.f;
+                for (int p = 0; p < k; p++)
+                    max = std::max(max, std::abs(get(p, j)));
+                scales[j] = max / 127.f;
+            }
+        }
+        if (format == INT8_DOT)
+            sums.Create(Shape((uint)cols), Shape((uint)cols).steps(), Depth::D4, Packing::CHW, allocator);
+
+        for (size_t j = 0; j < cols; j++)
+        {
+            size_t panel = j / nr * rows * nr;
+            int32_t sum = 0;
+            for (int p = 0; p < rows; p++)
+            {
+                float v = get(p, j);
+                if (format == FP32)
+                {
+                    ((float*)panels)[panel + p * nr + j % nr] = v;
+                    continue;
+                }
+                if (format == FP16)
+                {
+                    ((float16*)panels)[panel + p * nr + j % nr] = ToFloat16(v);
+                    continue;
+                }
+                if (format == BF16)
+                {
+                    ((bfloat16*)panels)[panel + p * nr + j % nr] = ToBFloat16(v);
+                    continue;
+                }
+                int8_t q = scales[j] == 0.f ? 0 : (int8_t)std::clamp(std::lrint(v / scales[j]), -127L, 127L);
+                if (format == INT8)
+                    ((int8_t*)panels)[panel + p * nr + j % nr] = q;
+                else
+                    ((int8_t*)panels)[panel + (p / 4 * nr + j % nr) * 4 + p % 4] = q;
+                sum += q;
+            }
+            if (format == INT8_DOT)
+                ((int32_t*)sums)[j] = sum;
+        }
+    }
+
+    void PackedMatrix::Release()
+    {
+        panels.Release();
+        scales.Release();
+        sums.Release();
+        k = n = nr = 0;
+    }
+
+    void Gemm(bool trans_a, int m, int n, float alpha, const float* A, size_t lda, const PackedMatrix& B, int j0,
+        float beta, float* C, size_t ldc, GemmEpilogue epilogue)
+    {
+        const PrepackedKernel& kernel = GetPrepacked();
+        CHECK(m >= 0 && n >= 0 && j0 >= 0 && j0 + n <= B.n);
+        CHECK(B.nr == kernel.nr && j0 % B.nr == 0) << Format("the columns from %d are not on a panel of %d", j0, B.nr);
+        CHECK(B.format != PackedMatrix::INT8_DOT) << "INT8_DOT is only for GemmInt8";
+        const GemmEpilogue* _epilogue = epilogue ? &epilogue : nullptr;
+        if (m == 0 || n == 0)
+            return;
+        if (B.k == 0 || alpha == 0.f)
+        {
+            Scale(m, n, beta, C, ldc);
+            if (_epilogue) (*_epilogue)(C, ldc, 0, 0, m, n);
+            return;
+        }
+
+        kernel.func(trans_a, m, n, alpha, A, lda, B, j0, beta, C, ldc, _epilogue);
+
+        if (UseAVX2())
+            _mm256_zeroupper();
+    }
+
+    //////////////////////////////////////// int8 gemm ////////////////////////////////////////////
+    // INT8_DOT panels keep 4 k of a column side by side: panels[(j / nr) * kq * nr * 4 + (p / 4) * nr * 4 + j % nr * 4 + p % 4],
+    // kq = ceil(k / 4), one 32 bit lane of a vector is the dot product of 4 k of a column.
+    // A is packed the same way into MR row panels, 4 k of a row are broadcast to all the lanes.
+    // The VNNI kernels take A unsigned, it is offset by 128 (the sign bit flipped) and 128 * the column sums are subtracted.
+
+    // c[MR x NRK] = a * b, astep and bstep are the bytes from a group of 4 k to the next
+    using MicroKernelInt8 = void (*)(int kq, const int8_t* a, size_t astep, const int8_t* b, size_t bstep, int32_t* c, size_t ldc);
+
+    static void PackAInt8(int MR, const int8_t* A, size_t lda, int mc, int k, int8_t* pa, bool offset)
+    {
+        int kq = (k + 3) / 4;
+        uint8_t flip = offset ? 0x80 : 0;
+        for (int i = 0; i < mc; i += MR, pa += (size_t)kq * MR * 4)
+        {
+            int mr = std::min(MR, mc - i);
+            for (int r = 0; r < MR; r++)
+            {
+                const int8_t* a = r < mr ? A + (i + r) * lda : nullptr;
+                for (int p = 0; p < kq * 4; p++)
+                    pa[(p / 4 * MR + r) * 4 + p % 4] = (int8_t)((a && p < k ? (uint8_t)a[p] : 0) ^ flip);
+            }
+        }
+    }
+
+    template<int MR, int NRK>
+    static void KernelInt8Scalar(int kq, const int8_t* a, size_t astep, const int8_t* b, size_t bstep, int32_t* c, size_t ldc)
+    {
+        int32_t acc[MR][NRK] = {};
+        for (int g = 0; g < kq; g++, a += astep, b += bstep)
+        {
+            for (int r = 0; r < MR; r++)
+            {
+                for (int j = 0; j < NRK; j++)
+                {
+                    for (int t = 0; t < 4; t++)
+                        acc[r][j] += a[r * 4 + t] * b[j * 4 + t];
+                }
+            }
+        }
+        for (int r = 0; r < MR; r++, c += ldc)
+        {
+            for (int j = 0; j < NRK; j++)
+                c[j] = acc[r][j];
+        }
+    }
+
+    // 16 columns, vpmaddubsw takes |a| and b with the sign of a, the pairs stay under 2 * 127 * 127 and never saturate
+    template<int MR>
+    static void KernelInt8AVX2(int kq, const int8_t* a, size_t astep, const int8_t* b, size_t bstep, int32_t* c, size_t ldc)
+    {
+        const __m256i ones = _mm256_set1_epi16(1);
+        __m256i acc[MR][2];
+        for (int r = 0; r < MR; r++)
+            acc[r][0] = acc[r][1] = _mm256_setzero_si256();
+        for (int g = 0; g < kq; g++, a += astep, b += bstep)
+        {
+            __m256i b0 = _mm256_loadu_si256((const __m256i*)b);
+            __m256i b1 = _mm256_loadu_si256((const __m256i*)(b + 32));
+            for (int r = 0; r < MR; r++)
+            {
+                int32_t a4;
+                memcpy(&a4, a + r * 4, sizeof(a4));
+                __m256i av = _mm256_set1_epi32(a4);
+                __m256i ua = _mm256_abs_epi8(av);
+                acc[r][0] = _mm256_add_epi32(acc[r][0], _mm256_madd_epi16(_mm256_maddubs_epi16(ua, _mm256_sign_epi8(b0, av)), ones));
+                acc[r][1] = _mm256_add_epi32(acc[r][1], _mm256_madd_epi16(_mm256_maddubs_epi16(ua, _mm256_sign_epi8(b1, av)), ones));
+            }
+        }
+        for (int r = 0; r < MR; r++, c += ldc)
+        {
+            _mm256_storeu_si256((__m256i*)c, acc[r][0]);
+            _mm256_storeu_si256((__m256i*)(c + 8), acc[r][1]);
+        }
+    }
+
+    // 16 columns, a is offset to unsigned
+    template<int MR>
+    static void KernelInt8AVXVNNI(int kq, const int8_t* a, size_t astep, const int8_t* b, size_t bstep, int32_t* c, size_t ldc)
+    {
+        __m256i acc[MR][2];
+        for (int r = 0; r < MR; r++)
+            acc[r][0] = acc[r][1] = _mm256_setzero_si256();
+        for (int g = 0; g < kq; g++, a += astep, b += bstep)
+        {
+            __m256i b0 = _mm256_loadu_si256((const __m256i*)b);
+            __m256i b1 = _mm256_loadu_si256((const __m256i*)(b + 32));
+            for (int r = 0; r < MR; r++)
+            {
+                int32_t a4;
+                memcpy(&a4, a + r * 4, sizeof(a4));
+                __m256i av = _mm256_set1_epi32(a4);
+                acc[r][0] = _mm256_dpbusd_avx_epi32(acc[r][0], av, b0);
+                acc[r][1] = _mm256_dpbusd_avx_epi32(acc[r][1], av, b1);
+            }
+        }
+        for (int r = 0; r < MR; r++, c += ldc)
+        {
+            _mm256_storeu_si256((__m256i*)c, acc[r][0]);
+            _mm256_storeu_si256((__m256i*)(c + 8), acc[r][1]);
+        }
+    }
+
+    // 32 columns, a is offset to unsigned
+    template<int MR>
+    static void KernelInt8VNNI512(int kq, const int8_t* a, size_t astep, const int8_t* b, size_t bstep, int32_t* c, size_t ldc)
+    {
+        __m512i acc[MR][2];
+        for (int r = 0; r < MR; r++)
+            acc[r][0] = acc[r][1] = _mm512_setzero_si512();
+        for (int g = 0; g < kq; g++, a += astep, b += bstep)
+        {
+            __m512i b0 = _mm512_loadu_si512(b);
+            __m512i b1 = _mm512_loadu_si512(b + 64);
+            for (int r = 0; r < MR; r++)
+            {
+                int32_t a4;
+                memcpy(&a4, a + r * 4, sizeof(a4));
+                __m512i av = _mm512_set1_epi32(a4);
+                acc[r][0] = _mm512_dpbusd_epi32(acc[r][0], av, b0);
+                acc[r][1] = _mm512_dpbusd_epi32(acc[r][1], av, b1);
+            }
+        }
+        for (int r = 0; r < MR; r++, c += ldc)
+        {
+            _mm512_storeu_si512(c, acc[r][0]);
+            _mm512_storeu_si512(c + 16, acc[r][1]);
+        }
+    }
+
+    struct Int8Kernel
+    {
+        // the rows of the full kernel
+        int mr;
+        // the columns of a call, a panel takes nr / nrk calls
+        int nrk;
+        // A is offset to unsigned
+        bool offset;
+        MicroKernelInt8 full;
+        // a single row, for the last rows and the gemv
+        MicroKernelInt8 row;
+    };
+
+    // the panels are as wide as the float kernel, AVX-512 splits them into two AVX2 calls without VNNI
+    static const Int8Kernel& GetInt8Kernel()
+    {
+        static const Int8Kernel kernel = []() {
+            int nr = GetPrepacked().nr;
+            if (nr == 32 && CheckHardwareSupport(CpuFeature::AVX512VNNI))
+                return Int8Kernel{ 8, 32, true, KernelInt8VNNI512<8>, KernelInt8VNNI512<1> };
+            if (nr >= 16 && CheckHardwareSupport(CpuFeature::AVXVNNI))
+                return Int8Kernel{ 6, 16, true, KernelInt8AVXVNNI<6>, KernelInt8AVXVNNI<1> };
+            if (nr >= 16)
+                return Int8Kernel{ 4, 16, false, KernelInt8AVX2<4>, KernelInt8AVX2<1> };
+            return Int8Kernel{ 4, 8, false, KernelInt8Scalar<4, 8>, KernelInt8Scalar<1, 8> };
+        }();
+        return kernel;
+    }
+
+    void GemmInt8(int m, int n, const int8_t* A, size_t lda, const PackedMatrix& B, int j0, GemmInt8Epilogue epilogue)
+    {
+        const Int8Kernel& kernel = GetInt8Kernel();
+        CHECK(B.format == PackedMatrix::INT8_DOT) << "GemmInt8 takes INT8_DOT panels";
+        CHECK(m >= 0 && n >= 0 && j0 >= 0 && j0 + n <= B.n);
+        CHECK(B.nr == GetPrepacked().nr && j0 % B.nr == 0) << Format("the columns from %d are not on a panel of %d", j0, B.nr);
+        CHECK(epilogue) << "the int8 gemm only gives C to its epilogue";
+        if (m == 0 || n == 0)
+            return;
+
+        int k = B.k, nr = B.nr, kq = (k + 3) / 4, mr = kernel.mr;
+        int mc_max = MC / mr * mr;
+        size_t panel_size = (size_t)kq * nr * 4;
+        const int8_t* panels = (const int8_t*)B.panels + j0 / nr * panel_size;
+        const int32_t* sums = (const int32_t*)B.sums + j0;
+
+        // the buffers hold floats, A takes 4 of its bytes a float
+        thread_local PackBuffer abuf, cbuf;
+        int8_t* pa = (int8_t*)abuf.Get((size_t)(std::min(m, mc_max) + mr - 1) / mr * mr * kq);
+        int32_t* pc = (int32_t*)cbuf.Get((size_t)mc_max * nr);
+
+        for (int ic = 0; ic < m; ic += mc_max)
+        {
+            int mc = std::min(mc_max, m - ic);
+            PackAInt8(mr, A + ic * lda, lda, mc, k, pa, kernel.offset);
+            for (int j = 0; j < n; j += nr)
+            {
+                const int8_t* b = panels + j / nr * panel_size;
+                int cols = std::min(nr, n - j);
+                for (int s = 0; s < cols; s += kernel.nrk)
+                {
+                    for (int ir = 0; ir < mc; ir += mr)
+                    {
+                        const int8_t* a = pa + (size_t)ir * kq * 4;
+                        int32_t* c = pc + ir * nr + s;
+                        if (ir + mr <= mc)
+                        {
+                            kernel.full(kq, a, mr * 4, b + s * 4, nr * 4, c, nr);
+                            continue;
+                        }
+                        for (int r = 0; r < mc - ir; r++)
+                            kernel.row(kq, a + r * 4, mr * 4, b + s * 4, nr * 4, c + r * nr, nr);
+                    }
+                }
+                if (kernel.offset)
+                {
+                    for (int r = 0; r < mc; r++)
+                    {
+                        for (int q = 0; q < cols; q++)
+                            pc[r * nr + q] -= 128 * sums[j + q];
+                    }
+                }
+                epilogue(pc, nr, ic, j, mc, cols);
+            }
+        }
+
+        if (UseAVX2())
+            _mm256_zeroupper();
+    }
+}
\ No newline at end of file
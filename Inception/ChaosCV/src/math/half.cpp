@@ -0,0 +1,278 @@
+#include "math/half.hpp"
+
+#include "core/thread_pool.hpp"
+#include "core/nd_iterator.hpp"
+
+#include <immintrin.h>
+
+#include <cstring>
+
+namespace chaos
+{
+    // the elements a thread converts at least
+    static constexpr size_t parallel_elems = 1 << 16;
+
+    static uint32_t FloatBits(float x)
+    {
+        uint32_t u;
+        memcpy(&u, &x, sizeof(u));
+        return u;
+    }
+
+    static float BitsFloat(uint32_t u)
+    {
+        float x;
+        memcpy(&x, &u, sizeof(x));
+        return x;
+    }
+
+    static bool UseF16C()
+    {
+        static const bool f16c = CheckHardwareSupport(CpuFeature::F16C);
+        return f16c;
+    }
+
+    static bool UseAVX512()
+    {
+        static const bool avx512 = CheckHardwareSupport(CpuFeature::AVX512F) && CheckHardwareSupport(CpuFeature::AVX512BW);
+        return avx512;
+    }
+
+    static bool UseAVX2()
+    {
+        static const bool avx2 = CheckHardwareSupport(CpuFeature::AVX2);
+        return avx2;
+    }
+
+    static bool UseBF16()
+    {
+        static const bool bf16 = UseAVX512() && CheckHardwareSupport(CpuFeature::AVX512BF16);
+        return bf16;
+    }
+
+    ///////////////////////////////////////// scalar //////////////////////////////////////////
+    // without F16C, the float arithmetic does the rounding of the mantissa and of the subnormals
+    static uint16 FloatToHalfBits(float x)
+    {
+        uint32_t w = FloatBits(x);
+        uint32_t shl1 = w + w, sign = w & 0x80000000u;
+        // scaled so the 13 low bits of the mantissa round away, and the overflows become inf
+        float base = std::fabs(x) * 0x1.0p+112f * 0x1.0p-110f;
+        uint32_t bias = std::max(shl1 & 0xFF000000u, 0x71000000u);
+        base = BitsFloat((bias >> 1) + 0x07800000u) + base;
+        uint32_t bits = FloatBits(base);
+        uint32_t nonsign = ((bits >> 13) & 0x7C00u) + (bits & 0x0FFFu);
+        return (uint16)((sign >> 16) | (shl1 > 0xFF000000u ? 0x7E00u : nonsign));
+    }
+
+    static float HalfBitsToFloat(uint16 h)
+    {
+        uint32_t w = (uint32_t)h << 16;
+        uint32_t sign = w & 0x80000000u, two_w = w + w;
+        float normalized = BitsFloat((two_w >> 4) + (0xE0u << 23)) * 0x1.0p-112f;
+        float subnormal = BitsFloat((two_w >> 17) | (126u << 23)) - 0.5f;
+        return BitsFloat(sign | FloatBits(two_w < (1u << 27) ? subnormal : normalized));
+    }
+
+    float16 ToFloat16(float x)
+    {
+        if (UseF16C())
+            return { (uint16)_cvtss_sh(x, _MM_FROUND_TO_NEAREST_INT) };
+        return { FloatToHalfBits(x) };
+    }
+
+    bfloat16 ToBFloat16(float x)
+    {
+        uint32_t u = FloatBits(x);
+        // a quiet nan, the rounding could carry it to inf
+        if ((u & 0x7FFFFFFFu) > 0x7F800000u)
+            return { (uint16)((u >> 16) | 0x40) };
+        return { (uint16)((u + 0x7FFFu + ((u >> 16) & 1)) >> 16) };
+    }
+
+    float ToFloat(float16 x)
+    {
+        if (UseF16C())
+            return _cvtsh_ss(x.bits);
+        return HalfBitsToFloat(x.bits);
+    }
+
+    float ToFloat(bfloat16 x)
+    {
+        return BitsFloat((uint32_t)x.bits << 16);
+    }
+
+    ///////////////////////////////////////// vectors //////////////////////////////////////////
+    // each returns the elements it converted, the scalar functions take the tail
+
+    static size_t CastF16C(const float* x, float16* y, size_t n)
+    {
+        size_t i = 0;
+        if (UseAVX512())
+        {
+            for (; i + 16 <= n; i += 16)
+                _mm256_storeu_si256((__m256i*)(y + i), _mm512_cvtps_ph(_mm512_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT));
+        }
+        for (; i + 8 <= n; i += 8)
+            _mm_storeu_si128((__m128i*)(y + i), _mm256_cvtps_ph(_mm256_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT));
+        _mm256_zeroupper();
+        return i;
+    }
+
+    static size_t CastF16C(const float16* x, float* y, size_t n)
+    {
+        size_t i = 0;
+        if (UseAVX512())
+        {
+            for (; i + 16 <= n; i += 16)
+                _mm512_storeu_ps(y + i, _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)(x + i))));
+        }
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(y + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(x + i))));
+        _mm256_zeroupper();
+        return i;
+    }
+
+    // vcvtneps2bf16 rounds to nearest even and keeps the nans
+    static size_t CastBF16(const float* x, bfloat16* y, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            __m256bh h = _mm512_cvtneps_pbh(_mm512_loadu_ps(x + i));
+            memcpy(y + i, &h, sizeof(h));
+        }
+        _mm256_zeroupper();
+        return i;
+    }
+
+    // the rounding of ToBFloat16 on the integer lanes
+    static size_t CastAVX2(const float* x, bfloat16* y, size_t n)
+    {
+        const __m256i one = _mm256_set1_epi32(1), round = _mm256_set1_epi32(0x7FFF), quiet = _mm256_set1_epi32(0x40);
+        auto convert = [&](const float* p) {
+            __m256 v = _mm256_loadu_ps(p);
+            __m256i u = _mm256_castps_si256(v);
+            __m256i r = _mm256_add_epi32(u, _mm256_add_epi32(round, _mm256_and_si256(_mm256_srli_epi32(u, 16), one)));
+            __m256i nan = _mm256_castps_si256(_mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+            __m256i q = _mm256_or_si256(_mm256_srli_epi32(u, 16), quiet);
+            return _mm256_blendv_epi8(_mm256_srli_epi32(r, 16), q, nan);
+        };
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            // the pack interleaves the 128 bit lanes
+            __m256i h = _mm256_packus_epi32(convert(x + i), convert(x + i + 8));
+            _mm256_storeu_si256((__m256i*)(y + i), _mm256_permute4x64_epi64(h, 0xD8));
+        }
+        _mm256_zeroupper();
+        return i;
+    }
+
+    static size_t CastAVX2(const bfloat16* x, float* y, size_t n)
+    {
+        size_t i = 0;
+        if (UseAVX512())
+        {
+            for (; i + 16 <= n; i += 16)
+            {
+                __m512i u = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)(x + i)));
+                _mm512_storeu_ps(y + i, _mm512_castsi512_ps(_mm512_slli_epi32(u, 16)));
+            }
+        }
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256i u = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(x + i)));
+            _mm256_storeu_ps(y + i, _mm256_castsi256_ps(_mm256_slli_epi32(u, 16)));
+        }
+        _mm256_zeroupper();
+        return i;
+    }
+
+    void Cast(const float* x, float16* y, size_t n)
+    {
+        size_t i = UseF16C() ? CastF16C(x, y, n) : 0;
+        for (; i < n; i++)
+            y[i] = ToFloat16(x[i]);
+    }
+
+    void Cast(const float* x, bfloat16* y, size_t n)
+    {
+        size_t i = UseBF16() ? CastBF16(x, y, n) : UseAVX2() ? CastAVX2(x, y, n) : 0;
+        for (; i < n; i++)
+            y[i] = ToBFloat16(x[i]);
+    }
+
+    void Cast(const float16* x, float* y, size_t n)
+    {
+        size_t i = UseF16C() ? CastF16C(x, y, n) : 0;
+        for (; i < n; i++)
+            y[i] = ToFloat(x[i]);
+    }
+
+    void Cast(const bfloat16* x, float* y, size_t n)
+    {
+        size_t i = UseAVX2() ? CastAVX2(x, y, n) : 0;
+        for (; i < n; i++)
+            y[i] = ToFloat(x[i]);
+    }
+
+    ///////////////////////////////////////// tensors //////////////////////////////////////////
+    // the dense runs in bulk, a strided run element by element
+    template<class Src, class Dst>
+    static void CastTensor(const Tensor& src, const OutputArray& _dst, Depth depth, ElemType type, int num_threads)
+    {
+        // a dst on the data of src gets a new buffer, src keeps the old one alive
+        if (not _dst.empty() && _dst.GetTensorRef().data == src.data)
+            _dst.Release();
+        if (_dst.empty() || not (_dst.GetTensorRef().shape == src.shape) || _dst.GetTensorRef().depth != depth || _dst.GetTensorRef().packing != src.packing)
+            _dst.Create(src.shape, src.shape.steps(), depth, src.packing, src.allocator, type);
+        Tensor& dst = _dst.GetTensorRef();
+        dst.type = type;
+        if (src.shape.vol() == 0) return;
+
+        // the values of a packed element are one more dim
+        Shape shape = src.shape;
+        Steps ssteps = src.steps, dsteps = dst.steps;
+        if (src.packing != Packing::CHW)
+        {
+            uint packing = (uint)src.packing;
+            for (size_t i = 0; i < shape.size(); i++)
+            {
+                ssteps[i] *= packing;
+                dsteps[i] *= packing;
+            }
+            shape.Insert(shape.size(), packing);
+            ssteps.Insert(ssteps.size(), 1u);
+            dsteps.Insert(dsteps.size(), 1u);
+        }
+        NdIterator<2> it(shape, { &dsteps, &ssteps });
+        size_t sd = it.step(0), ss = it.step(1);
+        ParallelForEach(it, parallel_elems, [&](const std::array<size_t, 2>& offsets, size_t n) {
+            Dst* y = (Dst*)dst + offsets[0];
+            const Src* x = (const Src*)src + offsets[1];
+            if (sd == 1 && ss == 1)
+                return Cast(x, y, n);
+            for (size_t i = 0; i < n; i++)
+                Cast(x + i * ss, y + i * sd, 1);
+        }, num_threads);
+    }
+
+    void ToHalf(const InputArray& _src, const OutputArray& dst, bool bf16, int num_threads)
+    {
+        Tensor src = _src.GetTensor();
+        CHECK(src.depth == Depth::D4) << "expect a float tensor";
+        if (bf16)
+            return CastTensor<float, bfloat16>(src, dst, Depth::D2, ElemType::BFLOAT16, num_threads);
+        CastTensor<float, float16>(src, dst, Depth::D2, ElemType::FLOAT, num_threads);
+    }
+
+    void ToFloat(const InputArray& _src, const OutputArray& dst, int num_threads)
+    {
+        Tensor src = _src.GetTensor();
+        CHECK(src.depth == Depth::D2) << "expect a half tensor";
+        if (src.type == ElemType::BFLOAT16)
+            return CastTensor<bfloat16, float>(src, dst, Depth::D4, ElemType::FLOAT, num_threads);
+        CastTensor<float16, float>(src, dst, Depth::D4, ElemType::FLOAT, num_threads);
+    }
+}
\ No newline at end of file
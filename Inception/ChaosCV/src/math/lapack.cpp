@@ -317,7 +317,7 @@ namespace chaos
         }
 
         size_t esz = 1 * src.depth, astep = AlignSize(n * esz, 16) / esz;
-        AutoBuffer<uchar> buf(n * (astep + 5ULL) * esz + 32); // n * astep * esz + n * 5LL * esz + 32
+        WorkBuffer<uchar> buf(n * (astep + 5ULL) * esz + 32); // n * astep * esz + n * 5LL * esz + 32
         uchar* ptr = AlignPtr(buf.data(), 16);
         Tensor a({ n, n }, src.depth, src.packing, ptr, { astep,  1ULL }), w({ n, 1 }, src.depth, src.packing, ptr + astep * esz * n);
         ptr += (astep + 1) * esz * n;
@@ -390,7 +390,7 @@ namespace chaos
             int m, int n, int n1, double minval, Type eps)
     {
         //VBLAS<Type> vblas;
-        AutoBuffer<double> Wbuf(n);
+        WorkBuffer<double> Wbuf(n);
         double* W = Wbuf.data();
         int i, j, k, iter, max_iter = std::max(m, 30);
         Type c, s;
@@ -703,7 +703,7 @@ namespace chaos
         
         int urows = full_uv ? m : n;
         size_t esz = 1 * src.depth, astep = AlignSize(m * esz, 16) / esz, vstep = AlignSize(n * esz, 16) / esz;
-        AutoBuffer<uchar> _buf((urows * astep + n * vstep + n) * esz + 32); // urows * astep * esz + n * vstep * esz + n * esz + 32
+        WorkBuffer<uchar> _buf((urows * astep + n * vstep + n) * esz + 32); // urows * astep * esz + n * vstep * esz + n * esz + 32
         uchar* buf = AlignPtr(_buf.data(), 16);
         Tensor temp_a(Shape(n, m), Depth::D4, Packing::CHW, buf, { astep, 1ULL });
         Tensor temp_w(Shape(n, 1), Depth::D4, Packing::CHW, buf + urows * astep * esz);
@@ -757,7 +757,7 @@ namespace chaos
 
         uint m = u.shape[0], n = vt.shape[1], nb = rhs.empty() ? m : rhs.shape[1], nm = std::min(m, n);
         size_t wstep = w.shape[0] == 1 ? 1ULL : w.shape[1] == 1 ? (size_t)w.steps[0] : (size_t)w.steps[0] + 1;
-        AutoBuffer<uchar> buffer(nb * sizeof(double) + 16);
+        WorkBuffer<uchar> buffer(nb * sizeof(double) + 16);
 
         CHECK(w.depth == u.depth && u.depth == vt.depth && u.data && vt.data && w.data);
         CHECK(u.shape[1] >= nm && vt.shape[0] >= nm &&
@@ -786,7 +786,7 @@ namespace chaos
         {
             int nm = std::min(m, n);
 
-            AutoBuffer<uchar> _buf((m * nm + nm + nm * n) * esz + sizeof(double));
+            WorkBuffer<uchar> _buf((m * nm + nm + nm * n) * esz + sizeof(double));
             uchar* buf = AlignPtr((uchar*)_buf.data(), (int)esz);
             Tensor u({ m, nm }, depth, packing, buf);
             Tensor w({ nm, 1 }, depth, packing, (uchar*)u.data + esz * m * nm);
@@ -807,7 +807,7 @@ namespace chaos
 
         if (method == DECOMP_EIG)
         {
-            AutoBuffer<uchar> _buf((n * n * 2LL + n) * esz + sizeof(double));
+            WorkBuffer<uchar> _buf((n * n * 2LL + n) * esz + sizeof(double));
             uchar* buf = AlignPtr((uchar*)_buf.data(), (int)esz);
             Tensor u({ n, n }, depth, packing, buf);
             Tensor w({ n, 1 }, depth, packing, (uchar*)u.data + n * n * esz);
@@ -901,7 +901,7 @@ namespace chaos
             return result;
         }
 
-        AutoBuffer<uchar> buf(esz * n * n);
+        WorkBuffer<uchar> buf(esz * n * n);
         Tensor src1({ n, n }, depth, packing,  buf.data());
         src.CopyTo(src1);
         SetIdentity(dst);
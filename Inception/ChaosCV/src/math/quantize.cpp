@@ -0,0 +1,81 @@
+#include "math/quantize.hpp"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace chaos
+{
+    static bool UseAVX2()
+    {
+        static const bool avx2 = CheckHardwareSupport(CpuFeature::AVX2);
+        return avx2;
+    }
+
+    static float AbsMaxAVX2(const float* x, size_t n)
+    {
+        const __m256 sign = _mm256_set1_ps(-0.f);
+        __m256 m0 = _mm256_setzero_ps(), m1 = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            m0 = _mm256_max_ps(m0, _mm256_andnot_ps(sign, _mm256_loadu_ps(x + i)));
+            m1 = _mm256_max_ps(m1, _mm256_andnot_ps(sign, _mm256_loadu_ps(x + i + 8)));
+        }
+        m0 = _mm256_max_ps(m0, m1);
+        __m128 m = _mm_max_ps(_mm256_castps256_ps128(m0), _mm256_extractf128_ps(m0, 1));
+        m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+        m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+        float max = _mm_cvtss_f32(m);
+        for (; i < n; i++)
+            max = std::max(max, std::abs(x[i]));
+        _mm256_zeroupper();
+        return max;
+    }
+
+    // 32 floats to int8 at a time, clamped before the conversion so the packs never saturate
+    static size_t QuantizeAVX2(const float* x, int8_t* y, size_t n, float inv)
+    {
+        const __m256 vinv = _mm256_set1_ps(inv);
+        const __m256 lower = _mm256_set1_ps(-127.f), upper = _mm256_set1_ps(127.f);
+        // the packs interleave the 128 bit lanes
+        const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        auto convert = [&](const float* p) {
+            return _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(p), vinv), lower), upper));
+        };
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32)
+        {
+            __m256i q01 = _mm256_packs_epi32(convert(x + i), convert(x + i + 8));
+            __m256i q23 = _mm256_packs_epi32(convert(x + i + 16), convert(x + i + 24));
+            __m256i q = _mm256_permutevar8x32_epi32(_mm256_packs_epi16(q01, q23), order);
+            _mm256_storeu_si256((__m256i*)(y + i), q);
+        }
+        _mm256_zeroupper();
+        return i;
+    }
+
+    float AbsMax(const float* x, size_t n)
+    {
+        if (UseAVX2())
+            return AbsMaxAVX2(x, n);
+        float max = 0.f;
+        for (size_t i = 0; i < n; i++)
+            max = std::max(max, std::abs(x[i]));
+        return max;
+    }
+
+    void Quantize(const float* x, int8_t* y, size_t n, float scale)
+    {
+        if (scale == 0.f)
+        {
+            std::fill(y, y + n, (int8_t)0);
+            return;
+        }
+        float inv = 1.f / scale;
+        size_t i = UseAVX2() ? QuantizeAVX2(x, y, n, inv) : 0;
+        for (; i < n; i++)
+            y[i] = (int8_t)std::nearbyint(std::clamp(x[i] * inv, -127.f, 127.f));
+    }
+}
\ No newline at end of file
@@ -0,0 +1,554 @@
+#include "math/tensor_op.hpp"
+
+#include "core/thread_pool.hpp"
+#include "core/nd_iterator.hpp"
+
+#include <array>
+#include <utility>
+#include <vector>
+#include <immintrin.h>
+
+namespace chaos
+{
+    // An element is depth * packing bytes and moves as a whole. The matrix is cut into
+    // blocks which fit in L1 with their transposed copy, the blocks into register tiles
+
+    // the elements below which a transpose stays on one thread
+    static constexpr size_t parallel_elems = 1 << 16;
+
+    // the block side in elements, a block is at most 16KB
+    static int BlockSize(size_t esz)
+    {
+        return esz <= 4 ? 64 : esz <= 16 ? 32 : 16;
+    }
+    static constexpr size_t max_block_bytes = 16384;
+
+    template<size_t esz>
+    struct Element
+    {
+        uchar bytes[esz];
+    };
+
+    //////////////////////////////////////// kernels ////////////////////////////////////////////
+    using TileKernel = void (*)(const uchar* src, size_t sstep, uchar* dst, size_t dstep);
+
+    // the rows of the tile, x[i] = row i, become its columns after log2(K) rounds of interleaving
+    // the row pairs (i, i + K/2), every round rotates the bits of the element address by one.
+    // The index sequence unrolls the round, so the tile stays in registers
+    template<class Unpack, size_t... I>
+    static inline void InterleaveRound(const __m128i* x, __m128i* y, std::index_sequence<I...>)
+    {
+        constexpr size_t half = sizeof...(I);
+        ((y[2 * I] = Unpack::Lo(x[I], x[I + half]), y[2 * I + 1] = Unpack::Hi(x[I], x[I + half])), ...);
+    }
+
+    struct Unpack8
+    {
+        static inline __m128i Lo(__m128i a, __m128i b) { return _mm_unpacklo_epi8(a, b); }
+        static inline __m128i Hi(__m128i a, __m128i b) { return _mm_unpackhi_epi8(a, b); }
+    };
+
+    struct Unpack16
+    {
+        static inline __m128i Lo(__m128i a, __m128i b) { return _mm_unpacklo_epi16(a, b); }
+        static inline __m128i Hi(__m128i a, __m128i b) { return _mm_unpackhi_epi16(a, b); }
+    };
+
+    template<size_t... I>
+    static inline void LoadRows(const uchar* src, size_t sstep, __m128i* x, std::index_sequence<I...>)
+    {
+        ((x[I] = _mm_loadu_si128((const __m128i*)(src + I * sstep))), ...);
+    }
+
+    template<size_t... I>
+    static inline void StoreRows(uchar* dst, size_t dstep, const __m128i* x, std::index_sequence<I...>)
+    {
+        (_mm_storeu_si128((__m128i*)(dst + I * dstep), x[I]), ...);
+    }
+
+    // 16x16 bytes
+    static void Kernel16x16SSE2(const uchar* src, size_t sstep, uchar* dst, size_t dstep)
+    {
+        __m128i x[16], y[16];
+        LoadRows(src, sstep, x, std::make_index_sequence<16>());
+        InterleaveRound<Unpack8>(x, y, std::make_index_sequence<8>());
+        InterleaveRound<Unpack8>(y, x, std::make_index_sequence<8>());
+        InterleaveRound<Unpack8>(x, y, std::make_index_sequence<8>());
+        InterleaveRound<Unpack8>(y, x, std::make_index_sequence<8>());
+        StoreRows(dst, dstep, x, std::make_index_sequence<16>());
+    }
+
+    // 8x8 of 2 bytes
+    static void Kernel8x8SSE2(const uchar* src, size_t sstep, uchar* dst, size_t dstep)
+    {
+        __m128i x[8], y[8];
+        LoadRows(src, sstep, x, std::make_index_sequence<8>());
+        InterleaveRound<Unpack16>(x, y, std::make_index_sequence<4>());
+        InterleaveRound<Unpack16>(y, x, std::make_index_sequence<4>());
+        InterleaveRound<Unpack16>(x, y, std::make_index_sequence<4>());
+        StoreRows(dst, dstep, y, std::make_index_sequence<8>());
+    }
+
+    // 4x4 of 4 bytes
+    static void Kernel4x4SSE2(const uchar* src, size_t sstep, uchar* dst, size_t dstep)
+    {
+        __m128 r0 = _mm_loadu_ps((const float*)(src));
+        __m128 r1 = _mm_loadu_ps((const float*)(src + sstep));
+        __m128 r2 = _mm_loadu_ps((const float*)(src + 2 * sstep));
+        __m128 r3 = _mm_loadu_ps((const float*)(src + 3 * sstep));
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _mm_storeu_ps((float*)(dst), r0);
+        _mm_storeu_ps((float*)(dst + dstep), r1);
+        _mm_storeu_ps((float*)(dst + 2 * dstep), r2);
+        _mm_storeu_ps((float*)(dst + 3 * dstep), r3);
+    }
+
+    // 8x8 of 4 bytes
+    static void Kernel8x8AVX(const uchar* src, size_t sstep, uchar* dst, size_t dstep)
+    {
+        __m256 r0 = _mm256_loadu_ps((const float*)(src));
+        __m256 r1 = _mm256_loadu_ps((const float*)(src + sstep));
+        __m256 r2 = _mm256_loadu_ps((const float*)(src + 2 * sstep));
+        __m256 r3 = _mm256_loadu_ps((const float*)(src + 3 * sstep));
+        __m256 r4 = _mm256_loadu_ps((const float*)(src + 4 * sstep));
+        __m256 r5 = _mm256_loadu_ps((const float*)(src + 5 * sstep));
+        __m256 r6 = _mm256_loadu_ps((const float*)(src + 6 * sstep));
+        __m256 r7 = _mm256_loadu_ps((const float*)(src + 7 * sstep));
+
+        __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+        __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+        __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+        __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+        __m256 t4 = _mm256_unpacklo_ps(r4, r5);
+        __m256 t5 = _mm256_unpackhi_ps(r4, r5);
+        __m256 t6 = _mm256_unpacklo_ps(r6, r7);
+        __m256 t7 = _mm256_unpackhi_ps(r6, r7);
+
+        r0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        r1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        r2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        r3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+        r4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+        r5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+        r6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+        r7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+        _mm256_storeu_ps((float*)(dst), _mm256_permute2f128_ps(r0, r4, 0x20));
+        _mm256_storeu_ps((float*)(dst + dstep), _mm256_permute2f128_ps(r1, r5, 0x20));
+        _mm256_storeu_ps((float*)(dst + 2 * dstep), _mm256_permute2f128_ps(r2, r6, 0x20));
+        _mm256_storeu_ps((float*)(dst + 3 * dstep), _mm256_permute2f128_ps(r3, r7, 0x20));
+        _mm256_storeu_ps((float*)(dst + 4 * dstep), _mm256_permute2f128_ps(r0, r4, 0x31));
+        _mm256_storeu_ps((float*)(dst + 5 * dstep), _mm256_permute2f128_ps(r1, r5, 0x31));
+        _mm256_storeu_ps((float*)(dst + 6 * dstep), _mm256_permute2f128_ps(r2, r6, 0x31));
+        _mm256_storeu_ps((float*)(dst + 7 * dstep), _mm256_permute2f128_ps(r3, r7, 0x31));
+    }
+
+    // 2x2 of 8 bytes
+    static void Kernel2x2SSE2(const uchar* src, size_t sstep, uchar* dst, size_t dstep)
+    {
+        __m128i r0 = _mm_loadu_si128((const __m128i*)(src));
+        __m128i r1 = _mm_loadu_si128((const __m128i*)(src + sstep));
+        _mm_storeu_si128((__m128i*)(dst), _mm_unpacklo_epi64(r0, r1));
+        _mm_storeu_si128((__m128i*)(dst + dstep), _mm_unpackhi_epi64(r0, r1));
+    }
+
+    // 4x4 of 8 bytes
+    static void Kernel4x4AVX(const uchar* src, size_t sstep, uchar* dst, size_t dstep)
+    {
+        __m256d r0 = _mm256_loadu_pd((const double*)(src));
+        __m256d r1 = _mm256_loadu_pd((const double*)(src + sstep));
+        __m256d r2 = _mm256_loadu_pd((const double*)(src + 2 * sstep));
+        __m256d r3 = _mm256_loadu_pd((const double*)(src + 3 * sstep));
+        __m256d t0 = _mm256_unpacklo_pd(r0, r1);
+        __m256d t1 = _mm256_unpackhi_pd(r0, r1);
+        __m256d t2 = _mm256_unpacklo_pd(r2, r3);
+        __m256d t3 = _mm256_unpackhi_pd(r2, r3);
+        _mm256_storeu_pd((double*)(dst), _mm256_permute2f128_pd(t0, t2, 0x20));
+        _mm256_storeu_pd((double*)(dst + dstep), _mm256_permute2f128_pd(t1, t3, 0x20));
+        _mm256_storeu_pd((double*)(dst + 2 * dstep), _mm256_permute2f128_pd(t0, t2, 0x31));
+        _mm256_storeu_pd((double*)(dst + 3 * dstep), _mm256_permute2f128_pd(t1, t3, 0x31));
+    }
+
+    // any element size, a tile of one element
+    template<size_t esz>
+    static void Kernel1x1(const uchar* src, size_t, uchar* dst, size_t)
+    {
+        *(Element<esz>*)dst = *(const Element<esz>*)src;
+    }
+
+    //////////////////////////////////////// blocks ////////////////////////////////////////////
+    // transpose the rows [i0, i1) of dst, which are the columns of src, height is the rows of src
+    using TransposeFunc = void (*)(const uchar* src, size_t sstep, uchar* dst, size_t dstep, int i0, int i1, int height);
+
+    template<size_t esz, int K, TileKernel Kernel>
+    static void TransposeBlocked(const uchar* src, size_t sstep, uchar* dst, size_t dstep, int i0, int i1, int height)
+    {
+        using Type = Element<esz>;
+        // fewer columns in dst than a tile, a column at a time over a few rows which stay in L1
+        if (height < K)
+        {
+            for (int ib = i0; ib < i1; ib += 256)
+            {
+                int ie = std::min(ib + 256, i1);
+                for (int j = 0; j < height; j++)
+                {
+                    const Type* s = (const Type*)(src + j * sstep);
+                    uchar* d = dst + j * esz;
+                    for (int i = ib; i < ie; i++)
+                        *(Type*)(d + i * dstep) = s[i];
+                }
+            }
+            return;
+        }
+        const int block = BlockSize(esz);
+        for (int ib = i0; ib < i1; ib += block)
+        {
+            int ie = std::min(ib + block, i1);
+            for (int jb = 0; jb < height; jb += block)
+            {
+                int je = std::min(jb + block, height);
+                int i = ib;
+                for (; i + K <= ie; i += K)
+                {
+                    int j = jb;
+                    for (; j + K <= je; j += K)
+                        Kernel(src + j * sstep + i * esz, sstep, dst + i * dstep + j * esz, dstep);
+                    for (; j < je; j++)
+                    {
+                        const Type* s = (const Type*)(src + j * sstep) + i;
+                        for (int k = 0; k < K; k++)
+                            ((Type*)(dst + (i + k) * dstep))[j] = s[k];
+                    }
+                }
+                for (; i < ie; i++)
+                {
+                    Type* d = (Type*)(dst + i * dstep);
+                    for (int j = jb; j < je; j++)
+                        d[j] = ((const Type*)(src + j * sstep))[i];
+                }
+            }
+        }
+    }
+
+    static TransposeFunc SelectTranspose(size_t esz)
+    {
+        bool avx = CheckHardwareSupport(CpuFeature::AVX);
+        switch (esz)
+        {
+        case 1: return TransposeBlocked<1, 16, Kernel16x16SSE2>;
+        case 2: return TransposeBlocked<2, 8, Kernel8x8SSE2>;
+        case 3: return TransposeBlocked<3, 1, Kernel1x1<3>>;
+        case 4: return avx ? TransposeBlocked<4, 8, Kernel8x8AVX> : TransposeBlocked<4, 4, Kernel4x4SSE2>;
+        case 6: return TransposeBlocked<6, 1, Kernel1x1<6>>;
+        case 8: return avx ? TransposeBlocked<8, 4, Kernel4x4AVX> : TransposeBlocked<8, 2, Kernel2x2SSE2>;
+        case 12: return TransposeBlocked<12, 1, Kernel1x1<12>>;
+        case 16: return TransposeBlocked<16, 1, Kernel1x1<16>>;
+        case 24: return TransposeBlocked<24, 1, Kernel1x1<24>>;
+        case 32: return TransposeBlocked<32, 1, Kernel1x1<32>>;
+        case 64: return TransposeBlocked<64, 1, Kernel1x1<64>>;
+        default: return nullptr;
+        }
+    }
+
+    static TransposeFunc FindTranspose(size_t esz)
+    {
+        // every depth * packing, 1 to 64 bytes
+        static const auto funcs = []() {
+            std::array<TransposeFunc, 65> table = {};
+            for (size_t i = 1; i < table.size(); i++) table[i] = SelectTranspose(i);
+            return table;
+        }();
+        return esz < funcs.size() ? funcs[esz] : nullptr;
+    }
+
+    static TransposeFunc GetTranspose(size_t esz)
+    {
+        TransposeFunc func = FindTranspose(esz);
+        CHECK(func) << Format("transpose of %zu bytes elements is not supported", esz);
+        return func;
+    }
+
+    // leave the upper halves clean for the SSE code after the AVX kernels
+    static void ZeroUpper()
+    {
+        static const bool avx = CheckHardwareSupport(CpuFeature::AVX);
+        if (avx) _mm256_zeroupper();
+    }
+
+    //////////////////////////////////////// in place ////////////////////////////////////////////
+    // the square matrix swaps the block (bi, bj) with (bj, bi) through a buffer
+    static void TransposeSquare(TransposeFunc func, uchar* data, size_t step, int n, size_t esz)
+    {
+        const int block = BlockSize(esz);
+        const int blocks = (n + block - 1) / block;
+        const size_t tstep = block * esz;
+        ParallelFor(0, blocks, 1, [&](size_t b0, size_t b1) {
+            alignas(64) uchar tmp[max_block_bytes];
+            for (int bi = (int)b0; bi < (int)b1; bi++)
+            {
+                int i0 = bi * block, hi = std::min(block, n - i0);
+                for (int bj = bi; bj < blocks; bj++)
+                {
+                    int j0 = bj * block, hj = std::min(block, n - j0);
+                    uchar* a = data + i0 * step + j0 * esz; // hi x hj
+                    uchar* c = data + j0 * step + i0 * esz; // hj x hi
+                    // a^t to the buffer, c^t to a and the buffer to c
+                    func(a, step, tmp, tstep, 0, hj, hi);
+                    if (bi != bj)
+                        func(c, step, a, step, 0, hi, hj);
+                    for (int r = 0; r < hj; r++)
+                        memcpy(c + r * step, tmp + r * tstep, hi * esz);
+                }
+            }
+            ZeroUpper();
+        }, (size_t)n * n < parallel_elems ? 1 : 0);
+    }
+
+    // a dense rows x cols matrix becomes cols x rows in the same memory by following the cycles
+    // of the permutation, the element at k < size - 1 goes to k * rows mod (size - 1)
+    static void TransposeCycles(uchar* data, int rows, int cols, size_t esz)
+    {
+        size_t size = (size_t)rows * cols;
+        if (size < 3) return;
+        size_t last = size - 1;
+        std::vector<bool> moved(size);
+        uchar carry[64], next[64];
+        for (size_t start = 1; start < last; start++)
+        {
+            if (moved[start]) continue;
+            memcpy(carry, data + start * esz, esz);
+            size_t k = start;
+            do
+            {
+                k = k * rows % last;
+                memcpy(next, data + k * esz, esz);
+                memcpy(data + k * esz, carry, esz);
+                memcpy(carry, next, esz);
+                moved[k] = true;
+            } while (k != start);
+        }
+    }
+
+    void Transpose(const InputArray& _src, const OutputArray& _dst)
+    {
+        Tensor src = _src.GetTensor();
+        CHECK_EQ(src.shape.size(), 2) << "only the matrix can be transposed";
+
+        size_t esz = 1 * src.depth * src.packing;
+        TransposeFunc func = GetTranspose(esz);
+        int rows = src.shape[0], cols = src.shape[1];
+
+        if (not _dst.empty() && _dst.GetTensorRef().data == src.data)
+        {
+            Tensor& dst = _dst.GetTensorRef();
+            if (rows == cols)
+            {
+                TransposeSquare(func, dst, dst.steps[0] * esz, rows, esz);
+            }
+            else
+            {
+                CHECK(src.continua()) << "the in place transpose of a non-square matrix needs it dense";
+                TransposeCycles(dst, rows, cols, esz);
+                dst.shape = Shape(cols, rows);
+                dst.steps = dst.shape.steps();
+            }
+            return;
+        }
+
+        // a dst is kept only with the layout of the elements it gets
+        if (_dst.empty() || not (_dst.GetTensorRef().shape == Shape(src.shape[1], src.shape[0])) || _dst.GetTensorRef().depth != src.depth || _dst.GetTensorRef().packing != src.packing)
+            _dst.Create(/*shape=*/{ src.shape[1], src.shape[0] }, /*steps=*/{ src.shape[0],(uint)1 }, src.depth, src.packing, src.allocator, src.type);
+        Tensor& dst = _dst.GetTensorRef();
+        dst.type = src.type;
+
+        // the threads take blocks of the rows of dst
+        const uchar* s = src;
+        uchar* d = dst;
+        size_t sstep = src.steps[0] * esz, dstep = dst.steps[0] * esz;
+        int block = BlockSize(esz);
+        ParallelFor(0, (cols + block - 1) / block, 1, [&](size_t b0, size_t b1) {
+            func(s, sstep, d, dstep, (int)b0 * block, std::min((int)b1 * block, cols), rows);
+            ZeroUpper();
+        }, (size_t)rows * cols < parallel_elems ? 1 : 0);
+    }
+
+    ////////////////////////////////////// permute /////////////////////////////////////////
+    // an axis of dst, with its steps in elements in dst and in src
+    struct PermuteAxis
+    {
+        size_t size;
+        size_t dstep;
+        size_t sstep;
+    };
+
+    // the axes of dst innermost first, without the ones of size 1 and with the neighbours which are
+    // adjacent in both dst and src merged, NCHW -> NHWC becomes N transposes of (C, HW) to (HW, C)
+    static std::vector<PermuteAxis> FuseAxes(const Shape& shape, const Steps& dsteps, const Steps& ssteps)
+    {
+        std::vector<PermuteAxis> axes;
+        for (int64 i = shape.size() - 1; i >= 0; i--)
+        {
+            if (shape[i] == 1) continue;
+            if (not axes.empty())
+            {
+                PermuteAxis& inner = axes.back();
+                if (dsteps[i] == inner.dstep * inner.size && ssteps[i] == inner.sstep * inner.size)
+                {
+                    inner.size *= shape[i];
+                    continue;
+                }
+            }
+            axes.push_back({ shape[i], dsteps[i], ssteps[i] });
+        }
+        if (axes.empty()) axes.push_back({ 1, 0, 0 });
+        return axes;
+    }
+
+    // an NdIterator over the axes, outermost first as a Shape, a single element without any
+    static NdIterator<2> IterateAxes(const std::vector<PermuteAxis>& axes)
+    {
+        size_t n = std::max(axes.size(), (size_t)1);
+        Shape shape;
+        shape.Resize(n);
+        Steps dsteps(n), ssteps(n);
+        shape[0] = 1; dsteps[0] = 0; ssteps[0] = 0;
+        for (size_t i = 0; i < axes.size(); i++)
+        {
+            shape[n - 1 - i] = (uint)axes[i].size;
+            dsteps[n - 1 - i] = (uint)axes[i].dstep;
+            ssteps[n - 1 - i] = (uint)axes[i].sstep;
+        }
+        return NdIterator<2>(shape, { &dsteps, &ssteps });
+    }
+
+    template<size_t esz>
+    static void CopyStrided(const uchar* src, uchar* dst, const NdIterator<2>& it, int num_threads)
+    {
+        using Type = Element<esz>;
+        size_t sd = it.step(0), ss = it.step(1);
+        ParallelForEach(it, parallel_elems / 4, [&](const std::array<size_t, 2>& offsets, size_t n) {
+            Type* d = (Type*)dst + offsets[0];
+            const Type* s = (const Type*)src + offsets[1];
+            for (size_t i = 0; i < n; i++)
+                d[i * sd] = s[i * ss];
+        }, num_threads);
+    }
+
+    // the runs of the innermost axis, copied as rows when they are dense on both sides
+    static void PermuteRuns(const uchar* src, uchar* dst, const std::vector<PermuteAxis>& axes, size_t esz, int num_threads)
+    {
+        NdIterator<2> it = IterateAxes(axes);
+        if (it.step(0) == 1 && it.step(1) == 1)
+        {
+            ParallelForEach(it, parallel_elems / 4, [&](const std::array<size_t, 2>& offsets, size_t n) {
+                memcpy(dst + offsets[0] * esz, src + offsets[1] * esz, n * esz);
+            }, num_threads);
+            return;
+        }
+        switch (esz)
+        {
+        case 1: return CopyStrided<1>(src, dst, it, num_threads);
+        case 2: return CopyStrided<2>(src, dst, it, num_threads);
+        case 4: return CopyStrided<4>(src, dst, it, num_threads);
+        case 8: return CopyStrided<8>(src, dst, it, num_threads);
+        case 16: return CopyStrided<16>(src, dst, it, num_threads);
+        default:
+            ParallelForEach(it, parallel_elems / 4, [&](const std::array<size_t, 2>& offsets, size_t n) {
+                for (size_t i = 0; i < n; i++)
+                    memcpy(dst + (offsets[0] + i * it.step(0)) * esz, src + (offsets[1] + i * it.step(1)) * esz, esz);
+            }, num_threads);
+        }
+    }
+
+    // the axis 0 of dst is dense in dst and the axis p is dense in src, the two make a matrix of
+    // (axes[0].size, axes[p].size) in src transposed to dst for each index of the other axes.
+    // The threads take the tiles of dst of all the matrices
+    static void PermuteTransposes(const uchar* src, uchar* dst, const std::vector<PermuteAxis>& axes, size_t p, size_t esz, int num_threads)
+    {
+        std::vector<PermuteAxis> batch;
+        for (size_t i = 1; i < axes.size(); i++)
+            if (i != p) batch.push_back(axes[i]);
+        NdIterator<2> it = IterateAxes(batch);
+
+        TransposeFunc func = GetTranspose(esz);
+        const int rows = (int)axes[p].size, height = (int)axes[0].size;
+        const size_t dstep = axes[p].dstep * esz, sstep = axes[0].sstep * esz;
+        // a tile is block x 16 blocks, longer on the other side when one side of the matrix is short
+        const int block = BlockSize(esz);
+        const int tile_rows = block * std::max(1, block * 16 / std::max(height, 1));
+        const int span = block * 16 * std::max(1, block / std::max(rows, 1));
+        const size_t row_tiles = (rows + tile_rows - 1) / tile_rows, col_tiles = (height + span - 1) / span;
+        const size_t tiles = row_tiles * col_tiles;
+        const size_t num_batches = it.size() * it.runs();
+
+        ParallelFor(0, num_batches * tiles, 1, [&](size_t t0, size_t t1) {
+            // walk the matrices of the tiles in order, the iterator moves to the next one on the way
+            NdIterator<2> local = it;
+            size_t b = t0 / tiles, n = local.size();
+            local.Seek(b / n);
+            size_t k = b % n;
+            for (size_t t = t0; t < t1; t++)
+            {
+                if (t / tiles != b)
+                {
+                    b++;
+                    if (++k == n)
+                    {
+                        k = 0;
+                        local.Next();
+                    }
+                }
+                const uchar* s = src + (local.offset(1) + k * local.step(1)) * esz;
+                uchar* d = dst + (local.offset(0) + k * local.step(0)) * esz;
+                size_t tile = t % tiles;
+                int i0 = (int)(tile / col_tiles) * tile_rows, j0 = (int)(tile % col_tiles) * span;
+                int i1 = std::min(i0 + tile_rows, rows), j1 = std::min(j0 + span, height);
+                func(s + j0 * sstep, sstep, d + j0 * esz, dstep, i0, i1, j1 - j0);
+            }
+            ZeroUpper();
+        }, num_threads);
+    }
+
+    void Permute(const InputArray& _src, const OutputArray& _dst, const Vec<uint>& orders, int num_threads)
+    {
+        Tensor src = _src.GetTensor();
+        size_t num_axes = src.shape.size();
+        CHECK_EQ(orders.size(), num_axes) << Format("expect %zu orders, got %zu", num_axes, orders.size());
+
+        Shape shape = src.shape;
+        Steps ssteps(num_axes);
+        std::vector<bool> used(num_axes, false);
+        for (size_t i = 0; i < num_axes; i++)
+        {
+            CHECK(orders[i] < num_axes && not used[orders[i]]) << "orders is not a permutation of the axes";
+            used[orders[i]] = true;
+            shape[i] = src.shape[orders[i]];
+            ssteps[i] = src.steps[orders[i]];
+        }
+
+        // a dst on the data of src gets a new buffer, src keeps the old one alive
+        if (not _dst.empty() && _dst.GetTensorRef().data == src.data)
+            _dst.Release();
+        if (_dst.empty() || not (_dst.GetTensorRef().shape == shape) || _dst.GetTensorRef().depth != src.depth || _dst.GetTensorRef().packing != src.packing)
+            _dst.Create(shape, shape.steps(), src.depth, src.packing, src.allocator, src.type);
+        Tensor& dst = _dst.GetTensorRef();
+        dst.type = src.type;
+        if (shape.vol() == 0) return;
+
+        size_t esz = 1 * src.depth * src.packing;
+        if (shape.vol() < parallel_elems) num_threads = 1;
+        std::vector<PermuteAxis> axes = FuseAxes(shape, dst.steps, ssteps);
+
+        // dst and src dense on different axes, a batch of 2D transposes
+        if (axes[0].dstep == 1 && axes[0].sstep != 1 && FindTranspose(esz) != nullptr)
+        {
+            for (size_t p = 1; p < axes.size(); p++)
+            {
+                if (axes[p].sstep == 1)
+                    return PermuteTransposes(src, dst, axes, p, esz, num_threads);
+            }
+        }
+        // the runs are rows, or there is no dense axis to tile
+        PermuteRuns(src, dst, axes, esz, num_threads);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,296 @@
+#include "math/vmath.hpp"
+
+#include <cmath>
+#include <immintrin.h>
+
+namespace chaos
+{
+    // The functions are written once on the vector types below. exp and log are the range reductions
+    // and the minimax polynomials of Cephes, the others are built on exp
+
+    //////////////////////////////////////// vectors ////////////////////////////////////////////
+    struct AVX2
+    {
+        using Type = __m256;
+        using Mask = __m256;
+        static constexpr size_t width = 8;
+
+        static inline Type Load(const float* p) { return _mm256_loadu_ps(p); }
+        static inline void Store(float* p, Type x) { _mm256_storeu_ps(p, x); }
+        // the tail through a buffer
+        static inline Type Load(const float* p, size_t n)
+        {
+            alignas(32) float buf[width] = {};
+            for (size_t i = 0; i < n; i++) buf[i] = p[i];
+            return _mm256_load_ps(buf);
+        }
+        static inline void Store(float* p, Type x, size_t n)
+        {
+            alignas(32) float buf[width];
+            _mm256_store_ps(buf, x);
+            for (size_t i = 0; i < n; i++) p[i] = buf[i];
+        }
+
+        static inline Type Set(float x) { return _mm256_set1_ps(x); }
+        static inline Type Add(Type a, Type b) { return _mm256_add_ps(a, b); }
+        static inline Type Sub(Type a, Type b) { return _mm256_sub_ps(a, b); }
+        static inline Type Mul(Type a, Type b) { return _mm256_mul_ps(a, b); }
+        static inline Type Div(Type a, Type b) { return _mm256_div_ps(a, b); }
+        // a * b + c
+        static inline Type Fma(Type a, Type b, Type c) { return _mm256_fmadd_ps(a, b, c); }
+        static inline Type Max(Type a, Type b) { return _mm256_max_ps(a, b); }
+        static inline Type Min(Type a, Type b) { return _mm256_min_ps(a, b); }
+        static inline Type Abs(Type x) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), x); }
+        // the magnitude of x with the sign of s
+        static inline Type CopySign(Type x, Type s) { return _mm256_or_ps(Abs(x), _mm256_and_ps(_mm256_set1_ps(-0.f), s)); }
+        static inline Type Round(Type x) { return _mm256_round_ps(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+
+        static inline Mask Lt(Type a, Type b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+        static inline Mask Gt(Type a, Type b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+        static inline Mask Eq(Type a, Type b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+        static inline Mask IsNan(Type x) { return _mm256_cmp_ps(x, x, _CMP_UNORD_Q); }
+        // m ? a : b
+        static inline Type Select(Mask m, Type a, Type b) { return _mm256_blendv_ps(b, a, m); }
+
+        // x * 2^n by the exponent bits, n an integral float
+        static inline Type Scale(Type x, Type n)
+        {
+            __m256i e = _mm256_slli_epi32(_mm256_cvtps_epi32(n), 23);
+            return _mm256_castsi256_ps(_mm256_add_epi32(_mm256_castps_si256(x), e));
+        }
+        // x = m * 2^e with m in [0.5, 1), x positive and normal
+        static inline Type Frexp(Type x, Type& e)
+        {
+            __m256i bits = _mm256_castps_si256(x);
+            e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+            bits = _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f000000));
+            return _mm256_castsi256_ps(bits);
+        }
+    };
+
+    struct AVX512
+    {
+        using Type = __m512;
+        using Mask = __mmask16;
+        static constexpr size_t width = 16;
+
+        static inline Type Load(const float* p) { return _mm512_loadu_ps(p); }
+        static inline void Store(float* p, Type x) { _mm512_storeu_ps(p, x); }
+        static inline Type Load(const float* p, size_t n) { return _mm512_maskz_loadu_ps((__mmask16)((1u << n) - 1), p); }
+        static inline void Store(float* p, Type x, size_t n) { _mm512_mask_storeu_ps(p, (__mmask16)((1u << n) - 1), x); }
+
+        static inline Type Set(float x) { return _mm512_set1_ps(x); }
+        static inline Type Add(Type a, Type b) { return _mm512_add_ps(a, b); }
+        static inline Type Sub(Type a, Type b) { return _mm512_sub_ps(a, b); }
+        static inline Type Mul(Type a, Type b) { return _mm512_mul_ps(a, b); }
+        static inline Type Div(Type a, Type b) { return _mm512_div_ps(a, b); }
+        static inline Type Fma(Type a, Type b, Type c) { return _mm512_fmadd_ps(a, b, c); }
+        static inline Type Max(Type a, Type b) { return _mm512_max_ps(a, b); }
+        static inline Type Min(Type a, Type b) { return _mm512_min_ps(a, b); }
+        static inline Type Abs(Type x) { return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(x), _mm512_set1_epi32(0x7fffffff))); }
+        static inline Type CopySign(Type x, Type s)
+        {
+            __m512i sign = _mm512_and_si512(_mm512_castps_si512(s), _mm512_set1_epi32(0x80000000));
+            return _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(Abs(x)), sign));
+        }
+        static inline Type Round(Type x) { return _mm512_roundscale_ps(x, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+
+        static inline Mask Lt(Type a, Type b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+        static inline Mask Gt(Type a, Type b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+        static inline Mask Eq(Type a, Type b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+        static inline Mask IsNan(Type x) { return _mm512_cmp_ps_mask(x, x, _CMP_UNORD_Q); }
+        static inline Type Select(Mask m, Type a, Type b) { return _mm512_mask_blend_ps(m, b, a); }
+
+        static inline Type Scale(Type x, Type n)
+        {
+            __m512i e = _mm512_slli_epi32(_mm512_cvtps_epi32(n), 23);
+            return _mm512_castsi512_ps(_mm512_add_epi32(_mm512_castps_si512(x), e));
+        }
+        static inline Type Frexp(Type x, Type& e)
+        {
+            __m512i bits = _mm512_castps_si512(x);
+            e = _mm512_cvtepi32_ps(_mm512_sub_epi32(_mm512_srli_epi32(bits, 23), _mm512_set1_epi32(126)));
+            bits = _mm512_or_si512(_mm512_and_si512(bits, _mm512_set1_epi32(0x007fffff)), _mm512_set1_epi32(0x3f000000));
+            return _mm512_castsi512_ps(bits);
+        }
+    };
+
+    //////////////////////////////////////// functions ////////////////////////////////////////////
+    static constexpr float exp_hi = 88.72283905f; // log(FLT_MAX)
+    static constexpr float exp_lo = -87.33654475f; // log(FLT_MIN)
+
+    template<class V>
+    struct ExpOp
+    {
+        using Type = typename V::Type;
+        static inline Type Run(Type x)
+        {
+            // x = n * ln2 + r, |r| <= ln2 / 2, e^x = 2^n * e^r
+            Type c = V::Min(V::Max(x, V::Set(exp_lo)), V::Set(exp_hi));
+            Type n = V::Round(V::Mul(c, V::Set(1.44269504088896341f)));
+            Type r = V::Fma(n, V::Set(-0.693359375f), c);
+            r = V::Fma(n, V::Set(2.12194440e-4f), r);
+
+            Type p = V::Set(1.9875691500E-4f);
+            p = V::Fma(p, r, V::Set(1.3981999507E-3f));
+            p = V::Fma(p, r, V::Set(8.3334519073E-3f));
+            p = V::Fma(p, r, V::Set(4.1665795894E-2f));
+            p = V::Fma(p, r, V::Set(1.6666665459E-1f));
+            p = V::Fma(p, r, V::Set(5.0000001201E-1f));
+            p = V::Fma(p, V::Mul(r, r), V::Add(r, V::Set(1.f)));
+
+            // e^r is in [0.7, 1.5), 2^128 * e^r overflows to inf by itself
+            Type y = V::Scale(p, n);
+            y = V::Select(V::Lt(x, V::Set(exp_lo)), V::Set(0.f), y);
+            y = V::Select(V::Gt(x, V::Set(exp_hi)), V::Set(INFINITY), y);
+            return V::Select(V::IsNan(x), x, y);
+        }
+    };
+
+    template<class V>
+    struct LogOp
+    {
+        using Type = typename V::Type;
+        static inline Type Run(Type x)
+        {
+            // the subnormals are scaled to normals first
+            Type bias = V::Select(V::Lt(x, V::Set(FLT_MIN)), V::Set(-23.f), V::Set(0.f));
+            Type s = V::Select(V::Lt(x, V::Set(FLT_MIN)), V::Mul(x, V::Set(8388608.f)), x);
+            Type e;
+            Type m = V::Frexp(s, e);
+            e = V::Add(e, bias);
+
+            // m in [sqrt(0.5), sqrt(2)) - 1
+            auto lo = V::Lt(m, V::Set(0.707106781186547524f));
+            e = V::Sub(e, V::Select(lo, V::Set(1.f), V::Set(0.f)));
+            m = V::Sub(V::Select(lo, V::Add(m, m), m), V::Set(1.f));
+
+            Type z = V::Mul(m, m);
+            Type p = V::Set(7.0376836292E-2f);
+            p = V::Fma(p, m, V::Set(-1.1514610310E-1f));
+            p = V::Fma(p, m, V::Set(1.1676998740E-1f));
+            p = V::Fma(p, m, V::Set(-1.2420140846E-1f));
+            p = V::Fma(p, m, V::Set(1.4249322787E-1f));
+            p = V::Fma(p, m, V::Set(-1.6668057665E-1f));
+            p = V::Fma(p, m, V::Set(2.0000714765E-1f));
+            p = V::Fma(p, m, V::Set(-2.4999993993E-1f));
+            p = V::Fma(p, m, V::Set(3.3333331174E-1f));
+            Type y = V::Mul(V::Mul(p, m), z);
+            y = V::Fma(e, V::Set(-2.12194440e-4f), y);
+            y = V::Fma(z, V::Set(-0.5f), y);
+            y = V::Add(m, y);
+            y = V::Fma(e, V::Set(0.693359375f), y);
+
+            y = V::Select(V::Eq(x, V::Set(INFINITY)), x, y);
+            y = V::Select(V::Eq(x, V::Set(0.f)), V::Set(-INFINITY), y);
+            return V::Select(V::Lt(x, V::Set(0.f)), V::Set(NAN), V::Select(V::IsNan(x), x, y));
+        }
+    };
+
+    template<class V>
+    struct TanhOp
+    {
+        using Type = typename V::Type;
+        static inline Type Run(Type x)
+        {
+            Type a = V::Abs(x);
+            // 1 - 2 / (e^2|x| + 1), which is 1 once e^2|x| is inf
+            Type e = ExpOp<V>::Run(V::Add(a, a));
+            Type large = V::Sub(V::Set(1.f), V::Div(V::Set(2.f), V::Add(e, V::Set(1.f))));
+            large = V::CopySign(large, x);
+
+            // |x| < 0.625, x + x^3 * P(x^2)
+            Type z = V::Mul(x, x);
+            Type p = V::Set(-5.70498872745E-3f);
+            p = V::Fma(p, z, V::Set(2.06390887954E-2f));
+            p = V::Fma(p, z, V::Set(-5.37397155531E-2f));
+            p = V::Fma(p, z, V::Set(1.33314422036E-1f));
+            p = V::Fma(p, z, V::Set(-3.33332819422E-1f));
+            Type small = V::Fma(V::Mul(x, z), p, x);
+            return V::Select(V::Lt(a, V::Set(0.625f)), small, large);
+        }
+    };
+
+    template<class V>
+    struct SigmoidOp
+    {
+        using Type = typename V::Type;
+        static inline Type Run(Type x)
+        {
+            Type e = ExpOp<V>::Run(V::Sub(V::Set(0.f), x));
+            return V::Div(V::Set(1.f), V::Add(V::Set(1.f), e));
+        }
+    };
+
+    template<class V>
+    struct MishOp
+    {
+        using Type = typename V::Type;
+        static inline Type Run(Type x)
+        {
+            // tanh(log(1 + u)) = n / (n + 2) with u = e^x and n = u * (u + 2), which is 1 in float above 20
+            Type u = ExpOp<V>::Run(V::Min(x, V::Set(20.f)));
+            Type n = V::Mul(u, V::Add(u, V::Set(2.f)));
+            Type y = V::Div(V::Mul(x, n), V::Add(n, V::Set(2.f)));
+            return V::Select(V::Gt(x, V::Set(20.f)), x, y);
+        }
+    };
+
+    //////////////////////////////////////// arrays ////////////////////////////////////////////
+    template<template<class> class Op, class V>
+    static void Apply(const float* x, float* y, size_t n)
+    {
+        constexpr size_t w = V::width;
+        size_t i = 0;
+        for (; i + 2 * w <= n; i += 2 * w)
+        {
+            typename V::Type x0 = V::Load(x + i), x1 = V::Load(x + i + w);
+            V::Store(y + i, Op<V>::Run(x0));
+            V::Store(y + i + w, Op<V>::Run(x1));
+        }
+        for (; i + w <= n; i += w)
+            V::Store(y + i, Op<V>::Run(V::Load(x + i)));
+        if (i < n)
+            V::Store(y + i, Op<V>::Run(V::Load(x + i, n - i)), n - i);
+    }
+
+    template<template<class> class Op, class Function>
+    static void Dispatch(const float* x, float* y, size_t n, const Function& scalar)
+    {
+        static const bool avx512 = CheckHardwareSupport(CpuFeature::AVX512F);
+        static const bool avx2 = CheckHardwareSupport(CpuFeature::AVX2) && CheckHardwareSupport(CpuFeature::FMA3);
+        if (avx512 || avx2)
+        {
+            if (avx512) Apply<Op, AVX512>(x, y, n);
+            else Apply<Op, AVX2>(x, y, n);
+            _mm256_zeroupper();
+            return;
+        }
+        for (size_t i = 0; i < n; i++) y[i] = scalar(x[i]);
+    }
+
+    void Exp(const float* x, float* y, size_t n)
+    {
+        Dispatch<ExpOp>(x, y, n, [](float v) { return std::exp(v); });
+    }
+
+    void Log(const float* x, float* y, size_t n)
+    {
+        Dispatch<LogOp>(x, y, n, [](float v) { return std::log(v); });
+    }
+
+    void Tanh(const float* x, float* y, size_t n)
+    {
+        Dispatch<TanhOp>(x, y, n, [](float v) { return std::tanh(v); });
+    }
+
+    void Sigmoid(const float* x, float* y, size_t n)
+    {
+        Dispatch<SigmoidOp>(x, y, n, [](float v) { return 1.f / (1.f + std::exp(-v)); });
+    }
+
+    void Mish(const float* x, float* y, size_t n)
+    {
+        Dispatch<MishOp>(x, y, n, [](float v) { return v * std::tanh(std::log1p(std::exp(v))); });
+    }
+}
\ No newline at end of file
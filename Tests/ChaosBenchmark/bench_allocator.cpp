@@ -0,0 +1,214 @@
+#include "benchmark.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
+namespace chaos
+{
+	// the previous PoolAllocator, two std::list scanned under two mutexes
+	class ListPoolAllocator : public Allocator
+	{
+	public:
+		~ListPoolAllocator()
+		{
+			for (const auto& [size, ptr] : budgets)
+				chaos::FastFree(ptr);
+		}
+
+		virtual void* FastMalloc(size_t size) override
+		{
+			budgets_lock.lock();
+			for (auto it = budgets.begin(); it != budgets.end(); ++it)
+			{
+				size_t bs = it->first;
+				if (bs >= size && ((bs * 192) >> 8) <= size)
+				{
+					void* ptr = it->second;
+					budgets.erase(it);
+					budgets_lock.unlock();
+					payouts_lock.lock();
+					payouts.push_back(std::make_pair(bs, ptr));
+					payouts_lock.unlock();
+					return ptr;
+				}
+			}
+			budgets_lock.unlock();
+
+			void* ptr = chaos::FastMalloc(size);
+			payouts_lock.lock();
+			payouts.push_back(std::make_pair(size, ptr));
+			payouts_lock.unlock();
+			return ptr;
+		}
+
+		virtual void FastFree(void* ptr) override
+		{
+			payouts_lock.lock();
+			for (auto it = payouts.begin(); it != payouts.end(); ++it)
+			{
+				if (it->second == ptr)
+				{
+					size_t size = it->first;
+					payouts.erase(it);
+					payouts_lock.unlock();
+					budgets_lock.lock();
+					budgets.push_back(std::make_pair(size, ptr));
+					budgets_lock.unlock();
+					return;
+				}
+			}
+			payouts_lock.unlock();
+		}
+
+	private:
+		std::mutex budgets_lock;
+		std::mutex payouts_lock;
+		std::list<std::pair<size_t, void*>> budgets;
+		std::list<std::pair<size_t, void*>> payouts;
+	};
+
+	class SystemAllocator : public Allocator
+	{
+	public:
+		virtual void* FastMalloc(size_t size) override { return chaos::FastMalloc(size); }
+		virtual void FastFree(void* ptr) override { chaos::FastFree(ptr); }
+	};
+
+	// every thread keeps live tensors sized like the blobs of a small net and replaces one per step
+	static void AllocatorWorkload(Allocator* allocator, int threads, int steps)
+	{
+		auto worker = [=](int seed) {
+			constexpr int live = 64;
+			void* ptrs[live] = { nullptr };
+			uint state = 2166136261u ^ seed;
+			for (int i = 0; i < steps; i++)
+			{
+				state = state * 1664525u + 1013904223u;
+				int slot = (state >> 8) % live;
+				size_t size = (size_t)64 << ((state >> 20) % 12); // 64B ~ 128KB
+				allocator->FastFree(ptrs[slot]);
+				ptrs[slot] = allocator->FastMalloc(size);
+			}
+			for (void* ptr : ptrs)
+				allocator->FastFree(ptr);
+		};
+
+		std::vector<std::thread> pool;
+		for (int t = 0; t < threads; t++)
+			pool.emplace_back(worker, t);
+		for (auto& t : pool)
+			t.join();
+	}
+
+	BENCHMARK(PoolAllocatorThreads)
+	{
+		constexpr int steps = 100000;
+		printf("%8s %14s %14s %14s %14s\n", "threads", "system Mops", "list pool Mops", "pool Mops", "unlocked Mops");
+		for (int threads : { 1, 2, 4, 8 })
+		{
+			SystemAllocator system;
+			ListPoolAllocator list_pool;
+			PoolAllocator pool;
+			UnlockedPoolAllocator unlocked;
+
+			double ops = 2. * steps * threads;
+			double sys = bench::Measure([&]() { AllocatorWorkload(&system, threads, steps); }, 3);
+			double list = bench::Measure([&]() { AllocatorWorkload(&list_pool, threads, steps); }, 3);
+			double lock_free = bench::Measure([&]() { AllocatorWorkload(&pool, threads, steps); }, 3);
+			printf("%8d %14.2f %14.2f %14.2f", threads, ops / (sys * 1e3), ops / (list * 1e3), ops / (lock_free * 1e3));
+			if (threads == 1)
+			{
+				double single = bench::Measure([&]() { AllocatorWorkload(&unlocked, threads, steps); }, 3);
+				printf(" %14.2f", ops / (single * 1e3));
+			}
+			printf("\n");
+		}
+	}
+
+	BENCHMARK(ThreadCacheThreads)
+	{
+		constexpr int steps = 100000;
+		printf("%8s %14s %14s %14s\n", "threads", "pool Mops", "cached Mops", "system cached");
+		for (int threads : { 1, 2, 4, 8 })
+		{
+			PoolAllocator pool;
+			ThreadCachingAllocator cached(&pool), system_cached;
+			double ops = 2. * steps * threads;
+			double lock_free = bench::Measure([&]() { AllocatorWorkload(&pool, threads, steps); }, 3);
+			double local = bench::Measure([&]() { AllocatorWorkload(&cached, threads, steps); }, 3);
+			double system = bench::Measure([&]() { AllocatorWorkload(&system_cached, threads, steps); }, 3);
+			printf("%8d %14.2f %14.2f %14.2f\n", threads, ops / (lock_free * 1e3), ops / (local * 1e3), ops / (system * 1e3));
+		}
+	}
+
+	// a producer allocates the tensors of a stage and the consumer frees them, through a bounded queue
+	static void PipelineWorkload(Allocator* allocator, int items)
+	{
+		std::mutex lock;
+		std::condition_variable ready;
+		std::deque<void*> queue;
+		std::thread consumer([&]() {
+			for (int i = 0; i < items; i++)
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				ready.wait(guard, [&]() { return not queue.empty(); });
+				void* ptr = queue.front();
+				queue.pop_front();
+				guard.unlock();
+				ready.notify_one();
+				allocator->FastFree(ptr);
+			}
+		});
+		for (int i = 0; i < items; i++)
+		{
+			void* ptr = allocator->FastMalloc((size_t)4096 << (i % 4));
+			std::unique_lock<std::mutex> guard(lock);
+			ready.wait(guard, [&]() { return queue.size() < 64; });
+			queue.push_back(ptr);
+			guard.unlock();
+			ready.notify_one();
+		}
+		consumer.join();
+	}
+
+	BENCHMARK(ThreadCachePipeline)
+	{
+		constexpr int items = 100000;
+		SystemAllocator system;
+		PoolAllocator pool;
+		ThreadCachingAllocator cached(&pool);
+		double sys = bench::Measure([&]() { PipelineWorkload(&system, items); }, 3);
+		double lock_free = bench::Measure([&]() { PipelineWorkload(&pool, items); }, 3);
+		double local = bench::Measure([&]() { PipelineWorkload(&cached, items); }, 3);
+		printf("%14s %14s %14s\n", "system ns", "pool ns", "cached ns");
+		printf("%14.1f %14.1f %14.1f\n", sys * 1e6 / items, lock_free * 1e6 / items, local * 1e6 / items);
+	}
+
+	// the scratch of a layer, a few buffers taken and given back in order, against an arena rewound after the layer
+	BENCHMARK(ArenaWorkspace)
+	{
+		constexpr int layers = 100000;
+		size_t sizes[] = { 4096, 65536, 256, 16384 };
+		auto workload = [&](Allocator* allocator, ArenaAllocator* arena) {
+			for (int l = 0; l < layers; l++)
+			{
+				ArenaAllocator::Marker mark;
+				if (arena) mark = arena->Mark();
+				void* ptrs[4];
+				for (int i = 0; i < 4; i++) ptrs[i] = allocator->FastMalloc(sizes[(l + i) % 4]);
+				for (int i = 3; i >= 0; i--) allocator->FastFree(ptrs[i]);
+				if (arena) arena->Rewind(mark);
+			}
+		};
+		SystemAllocator system;
+		UnlockedPoolAllocator unlocked;
+		ArenaAllocator arena;
+		double ops = 8. * layers;
+		double sys = bench::Measure([&]() { workload(&system, nullptr); }, 3);
+		double pool = bench::Measure([&]() { workload(&unlocked, nullptr); }, 3);
+		double bump = bench::Measure([&]() { workload(&arena, &arena); }, 3);
+		printf("%14s %14s %14s\n", "system Mops", "unlocked Mops", "arena Mops");
+		printf("%14.2f %14.2f %14.2f\n", ops / (sys * 1e3), ops / (pool * 1e3), ops / (bump * 1e3));
+	}
+}
\ No newline at end of file
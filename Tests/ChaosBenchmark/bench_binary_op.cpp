@@ -0,0 +1,96 @@
+#include "benchmark.hpp"
+
+#include "core/nd_iterator.hpp"
+#include "dnn/layer.hpp"
+#include "dnn/layer_factory.hpp"
+#include "math/half.hpp"
+
+namespace chaos
+{
+	// the previous kernel, a scalar loop on every run of c
+	static void ScalarAdd(const Tensor& a, const Tensor& b, Tensor& c)
+	{
+		size_t dims = c.shape.size();
+		Steps a_steps(dims), b_steps(dims);
+		for (size_t i = 0; i < dims; i++)
+		{
+			size_t ia = i + a.shape.size() - dims, ib = i + b.shape.size() - dims;
+			a_steps[i] = i + a.shape.size() < dims || a.shape[ia] == 1 ? 0 : a.steps[ia];
+			b_steps[i] = i + b.shape.size() < dims || b.shape[ib] == 1 ? 0 : b.steps[ib];
+		}
+		NdIterator<3> it(c.shape, { &c.steps, &a_steps, &b_steps });
+		size_t sc = it.step(0), sa = it.step(1), sb = it.step(2);
+		do
+		{
+			float* pc = (float*)c + it.offset(0);
+			const float* pa = (const float*)a + it.offset(1);
+			const float* pb = (const float*)b + it.offset(2);
+			for (size_t i = 0; i < it.size(); i++) pc[i * sc] = pa[i * sa] + pb[i * sb];
+		} while (it.Next());
+	}
+
+	static void Compare(const char* name, const Shape& sa, const Shape& sb)
+	{
+		Tensor a = Tensor(sa, Depth::D4, Packing::CHW), b = Tensor(sb, Depth::D4, Packing::CHW);
+		for (size_t i = 0; i < sa.vol(); i++) a[i] = (float)(i % 13);
+		for (size_t i = 0; i < sb.vol(); i++) b[i] = (float)(i % 7);
+
+		auto layer = dnn::LayerRegistry::CreateLayer("BinaryOp");
+		layer->Set("op", dnn::BinOpType::ADD);
+		std::vector<Tensor> tops(1);
+		layer->Forward({ a,b }, tops, dnn::Option());
+		Tensor& c = tops[0];
+
+		dnn::Option one;
+		one.num_threads = 1;
+		double scalar = bench::Measure([&]() { ScalarAdd(a, b, c); }, 10);
+		double simd = bench::Measure([&]() { layer->Forward({ a,b }, tops, one); }, 10);
+		double all = bench::Measure([&]() { layer->Forward({ a,b }, tops, dnn::Option()); }, 10);
+		printf("%-10s %10.3f ms %10.3f ms %10.3f ms %8.2f GB/s\n", name, scalar, simd, all,
+			(sa.vol() + sb.vol() + c.shape.vol()) * sizeof(float) / (all * 1e6));
+	}
+
+	BENCHMARK(BinaryOp)
+	{
+		printf("%-10s %13s %13s %13s %13s\n", "add", "scalar", "1 thread", "threads", "threads");
+		Compare("same", Shape(1, 64, 56, 56), Shape(1, 64, 56, 56));
+		Compare("scalar", Shape(1, 64, 56, 56), Shape(1));
+		Compare("row", Shape(1, 3136, 64), Shape(64));
+		Compare("channel", Shape(1, 64, 56, 56), Shape(64, 1, 1));
+		Compare("outer", Shape(1024, 1), Shape(1, 1024));
+		Compare("bias", Shape(1, 256, 14, 14), Shape(256, 1, 1));
+	}
+	// the same adds on float16 and bfloat16 tensors, half of the bytes
+	BENCHMARK(BinaryOpHalf)
+	{
+		Shape shapes[][2] = { { Shape(1, 64, 56, 56), Shape(1, 64, 56, 56) }, { Shape(1, 3136, 64), Shape(64) }, { Shape(16, 1024, 1024), Shape(1024) } };
+		const char* names[] = { "same", "row", "large" };
+		printf("%-10s %13s %13s %13s %13s\n", "add", "fp32", "fp16", "bf16", "bf16");
+		for (int s = 0; s < 3; s++)
+		{
+			Tensor a = Tensor(shapes[s][0], Depth::D4, Packing::CHW), b = Tensor(shapes[s][1], Depth::D4, Packing::CHW);
+			for (size_t i = 0; i < a.shape.vol(); i++) a[i] = (float)(i % 13);
+			for (size_t i = 0; i < b.shape.vol(); i++) b[i] = (float)(i % 7);
+			auto layer = dnn::LayerRegistry::CreateLayer("BinaryOp");
+			layer->Set("op", dnn::BinOpType::ADD);
+			std::vector<Tensor> tops(1);
+
+			double ms[3];
+			for (int t = 0; t < 3; t++)
+			{
+				dnn::Option opt;
+				opt.use_bf16_storage = t == 2;
+				Tensor x = a, y = b;
+				if (t > 0)
+				{
+					ToHalf(a, x, t == 2);
+					ToHalf(b, y, t == 2);
+				}
+				tops[0].Release();
+				ms[t] = bench::Measure([&]() { layer->Forward({ x,y }, tops, opt); }, 10);
+			}
+			size_t bytes = (a.shape.vol() + b.shape.vol() + a.shape.vol()) * sizeof(uint16);
+			printf("%-10s %10.3f ms %10.3f ms %10.3f ms %8.2f GB/s\n", names[s], ms[0], ms[1], ms[2], bytes / (ms[2] * 1e6));
+		}
+	}
+}
\ No newline at end of file
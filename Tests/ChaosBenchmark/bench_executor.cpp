@@ -0,0 +1,50 @@
+#include "benchmark.hpp"
+
+#include "dnn/net.hpp"
+
+namespace chaos
+{
+	// branches InnerProducts on the same input summed by a chain of adds, one layer at a time and as independent branches
+	static void Compare(const char* name, int branches, uint m, uint k, uint n)
+	{
+		Tensor x(Shape(m, k), Depth::D4), w(Shape(n, k), Depth::D4);
+		for (size_t i = 0; i < x.shape.vol(); i++) x[i] = (float)(i % 13) / 13.f;
+		for (size_t i = 0; i < w.shape.vol(); i++) w[i] = (float)(i % 7) / 7.f - 0.5f;
+
+		double ms[2];
+		for (int inter_op = 0; inter_op < 2; inter_op++)
+		{
+			dnn::Option opt;
+			opt.light_mode = true;
+			opt.use_inter_op_parallel = inter_op;
+			auto net = dnn::Net::CreateNet();
+			net->SetOption(opt);
+			std::string sum;
+			for (int b = 0; b < branches; b++)
+			{
+				std::string fc = Format("fc%d", b);
+				net->AddLayer("InnerProduct", Format("ip%d", b), { "data" }, { fc })->Set("weight", w);
+				if (b == 0)
+				{
+					sum = fc;
+					continue;
+				}
+				std::string top = b + 1 == branches ? "out" : Format("sum%d", b);
+				net->AddLayer("BinaryOp", Format("add%d", b), { sum, fc }, { top })->Set("op", dnn::BinOpType::ADD);
+				sum = top;
+			}
+			auto executor = net->BindExecutor();
+			executor->SetLayerData("data", x);
+			ms[inter_op] = bench::Measure([&]() { executor->Forward(); }, 20);
+		}
+		printf("%-16s %10.3f ms %10.3f ms %8.2f x\n", name, ms[0], ms[1], ms[0] / ms[1]);
+	}
+
+	BENCHMARK(InterOpExecutor)
+	{
+		printf("%-16s %13s %13s\n", "", "serial", "branches");
+		Compare("4 x 8x256x256", 4, 8, 256, 256);
+		Compare("8 x 8x256x256", 8, 8, 256, 256);
+		Compare("4 x 256x256x256", 4, 256, 256, 256);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,134 @@
+#include "benchmark.hpp"
+
+#include "math/gemm.hpp"
+#include "math/quantize.hpp"
+#include "math/tensor_op.hpp"
+
+#include <numeric>
+#include <random>
+
+namespace chaos
+{
+	// the previous InnerProduct::Forward, one std::inner_product per output
+	static void InnerProductReference(int m, int n, int k, const float* x, const float* w, float* y)
+	{
+		for (int r = 0; r < m; r++)
+		{
+			for (int c = 0; c < n; c++)
+				y[r * n + c] = std::inner_product(x + r * k, x + (r + 1) * k, w + c * k, 0.f);
+		}
+	}
+
+	static std::vector<float> RandomVector(size_t size)
+	{
+		std::mt19937 rng(0);
+		std::uniform_real_distribution<float> dist(-1.f, 1.f);
+		std::vector<float> data(size);
+		for (auto& v : data) v = dist(rng);
+		return data;
+	}
+
+	static double GFlops(int m, int n, int k, double ms)
+	{
+		return 2. * m * n * k / (ms * 1e6);
+	}
+
+	// y = x * w^t, the InnerProduct shapes, m is the batch
+	BENCHMARK(GemmInnerProduct)
+	{
+		int shapes[][3] = { {1,1000,2048}, {1,4096,4096}, {8,1000,2048}, {64,1024,1024}, {256,256,256}, {512,512,512}, {1024,1024,1024} };
+		printf("%6s %6s %6s %16s %16s %8s\n", "m", "n", "k", "reference GFLOPS", "gemm GFLOPS", "speedup");
+		for (auto& s : shapes)
+		{
+			int m = s[0], n = s[1], k = s[2];
+			auto x = RandomVector((size_t)m * k), w = RandomVector((size_t)n * k);
+			std::vector<float> y((size_t)m * n);
+
+			int runs = (double)m * n * k > 1e8 ? 3 : 10;
+			double ref = bench::Measure([&]() { InnerProductReference(m, n, k, x.data(), w.data(), y.data()); }, runs);
+			double gemm = bench::Measure([&]() { Gemm(false, true, m, n, k, 1.f, x.data(), k, w.data(), k, 0.f, y.data(), n); }, runs);
+			printf("%6d %6d %6d %16.2f %16.2f %7.1fx\n", m, n, k, GFlops(m, n, k, ref), GFlops(m, n, k, gemm), ref / gemm);
+		}
+	}
+
+	// y = x * w^t with w packed once, as InnerProduct after CreatePipeline
+	BENCHMARK(GemmPrepacked)
+	{
+		int shapes[][3] = { {1,1000,2048}, {1,4096,4096}, {8,1000,2048}, {64,1024,1024}, {512,512,512} };
+		printf("%6s %6s %6s %14s %14s %14s %14s %14s\n", "m", "n", "k", "packing GFLOPS", "fp32 GFLOPS", "fp16 GFLOPS", "bf16 GFLOPS", "int8 GFLOPS");
+		for (auto& s : shapes)
+		{
+			int m = s[0], n = s[1], k = s[2];
+			auto x = RandomVector((size_t)m * k), w = RandomVector((size_t)n * k);
+			std::vector<float> y((size_t)m * n);
+
+			int runs = (double)m * n * k > 1e8 ? 3 : 10;
+			double gemm = bench::Measure([&]() { Gemm(false, true, m, n, k, 1.f, x.data(), k, w.data(), k, 0.f, y.data(), n); }, runs);
+			printf("%6d %6d %6d %14.2f", m, n, k, GFlops(m, n, k, gemm));
+			for (int f = 0; f <= PackedMatrix::INT8; f++)
+			{
+				auto format = (PackedMatrix::Format)f;
+				if (format == PackedMatrix::FP16 && not CheckHardwareSupport(CpuFeature::F16C)) continue;
+				PackedMatrix packed(true, k, n, w.data(), k, format);
+				double ms = bench::Measure([&]() { Gemm(false, m, n, 1.f, x.data(), k, packed, 0, 0.f, y.data(), n); }, runs);
+				printf(" %14.2f", GFlops(m, n, k, ms));
+			}
+			printf("\n");
+		}
+	}
+
+	// the int8 gemm of the int8 inference against the packed fp32 weights, x quantized up front
+	BENCHMARK(GemmInt8)
+	{
+		int shapes[][3] = { {1,1000,2048}, {1,4096,4096}, {8,1000,2048}, {64,1024,1024}, {512,512,512} };
+		printf("%6s %6s %6s %14s %14s %8s\n", "m", "n", "k", "fp32 GFLOPS", "int8 GOPS", "speedup");
+		for (auto& s : shapes)
+		{
+			int m = s[0], n = s[1], k = s[2];
+			auto x = RandomVector((size_t)m * k), w = RandomVector((size_t)n * k);
+			std::vector<float> y((size_t)m * n);
+			std::vector<int8_t> qx((size_t)m * k);
+			Quantize(x.data(), qx.data(), qx.size(), 1.f / 127);
+
+			int runs = (double)m * n * k > 1e8 ? 3 : 10;
+			PackedMatrix fp32(true, k, n, w.data(), k, PackedMatrix::FP32);
+			PackedMatrix int8(true, k, n, w.data(), k, PackedMatrix::INT8_DOT);
+			double ms = bench::Measure([&]() { Gemm(false, m, n, 1.f, x.data(), k, fp32, 0, 0.f, y.data(), n); }, runs);
+			// the epilogue dequantizes as the layer does
+			const float* sw = int8.scales;
+			double ms8 = bench::Measure([&]() {
+				GemmInt8(m, n, qx.data(), k, int8, 0, [&](const int32_t* c, size_t ldc, int i, int j, int bm, int bn) {
+					for (int r = 0; r < bm; r++)
+					{
+						float* py = y.data() + (size_t)(i + r) * n + j;
+						for (int q = 0; q < bn; q++) py[q] = c[r * ldc + q] * sw[j + q];
+					}
+				});
+			}, runs);
+			printf("%6d %6d %6d %14.2f %14.2f %8.2f\n", m, n, k, GFlops(m, n, k, ms), GFlops(m, n, k, ms8), ms / ms8);
+		}
+	}
+
+	// c = a * b, the previous Dot transposed b and ran the InnerProduct
+	BENCHMARK(GemmDot)
+	{
+		int sizes[] = { 64, 128, 256, 512, 1024 };
+		printf("%6s %16s %16s %8s\n", "n", "reference GFLOPS", "gemm GFLOPS", "speedup");
+		for (int n : sizes)
+		{
+			auto a = RandomVector((size_t)n * n), b = RandomVector((size_t)n * n);
+			Tensor A = Tensor(Shape(n, n), Depth::D4, Packing::CHW, a.data());
+			Tensor B = Tensor(Shape(n, n), Depth::D4, Packing::CHW, b.data());
+			Tensor C, BT;
+
+			int runs = n >= 512 ? 3 : 10;
+			double ref = bench::Measure([&]() {
+				Transpose(B, BT);
+				C.Create(Shape(n, n), Shape(n, n).steps(), Depth::D4, Packing::CHW, nullptr);
+				InnerProductReference(n, n, n, a.data(), BT, C);
+				}, runs);
+			double gemm = bench::Measure([&]() { Dot(A, B, C); }, runs);
+			printf("%6d %16.2f %16.2f %7.1fx\n", n, GFlops(n, n, n, ref), GFlops(n, n, n, gemm), ref / gemm);
+		}
+	}
+}
@@ -0,0 +1,61 @@
+#include "benchmark.hpp"
+
+#include "dnn/layer.hpp"
+#include "dnn/layer_factory.hpp"
+
+namespace chaos
+{
+	// the previous permute, the index of every element decomposed by % and /
+	static void DivModPermute(const Tensor& src, const uint* orders, Tensor& dst)
+	{
+		size_t count = dst.shape.vol();
+		size_t num_axes = dst.shape.size();
+		const float* s = src;
+		float* d = dst;
+		for (size_t i = 0; i < count; i++)
+		{
+			size_t src_idx = 0;
+			size_t dst_idx = 0;
+			size_t idx = i;
+			for (int64 j = num_axes - 1; j >= 0; j--)
+			{
+				size_t k = idx % dst.shape[j];
+				dst_idx += k * dst.steps[j];
+				src_idx += k * src.steps[orders[j]];
+				idx /= dst.shape[j];
+			}
+			d[dst_idx] = s[src_idx];
+		}
+	}
+
+	BENCHMARK(NdIterator)
+	{
+		Tensor x = Tensor(Shape(1, 64, 56, 56), Depth::D4, Packing::CHW);
+		for (size_t i = 0; i < x.shape.vol(); i++) x[i] = (float)(i % 101);
+		Tensor y = Tensor(Shape(1, 64, 1, 1), Depth::D4, Packing::CHW);
+		for (size_t i = 0; i < y.shape.vol(); i++) y[i] = (float)i;
+
+		// nchw to nhwc
+		uint orders[] = { 0,2,3,1 };
+		float forders[] = { 0,2,3,1 };
+		Tensor p = Tensor(Shape(1, 56, 56, 64), Depth::D4, Packing::CHW);
+		auto permute = dnn::LayerRegistry::CreateLayer("Permute");
+		permute->Set("orders", Tensor(Shape(4), Depth::D4, Packing::CHW, forders));
+		double div_mod = bench::Measure([&]() { DivModPermute(x, orders, p); }, 10);
+		double iter = bench::Measure([&]() { permute->Forward(x, p, dnn::Option()); }, 10);
+		printf("%-28s %10.3f ms (div/mod %.3f ms)\n", "Permute 64x56x56 to nhwc", iter, div_mod);
+
+		// the channel bias broadcast of a 1x1 conv
+		std::vector<Tensor> tops(1);
+		auto add = dnn::LayerRegistry::CreateLayer("BinaryOp");
+		add->Set("op", dnn::BinOpType::ADD);
+		double bin = bench::Measure([&]() { add->Forward({ x,y }, tops, dnn::Option()); }, 10);
+		printf("%-28s %10.3f ms\n", "BinaryOp add 64x56x56 + 64", bin);
+
+		// a column slice
+		Tensor v = Tensor(Shape(64, 56, 28), Depth::D4, Packing::CHW, x.data, { 56 * 56,56,2 });
+		Tensor c;
+		double copy = bench::Measure([&]() { v.CopyTo(c); }, 10);
+		printf("%-28s %10.3f ms\n", "CopyTo 64x56x28 stride 2", copy);
+	}
+}
@@ -0,0 +1,202 @@
+#include "benchmark.hpp"
+
+#include "core/thread_pool.hpp"
+#include "dnn/layer_factory.hpp"
+#include "math/base.hpp"
+#include "math/half.hpp"
+
+namespace chaos
+{
+	// the sweeps of the kernels, the lines go to the json of ChaosBenchmark Kernel --json file
+	static const char* depth_names[] = { "", "D1", "D2", "", "D4", "", "", "", "D8" };
+
+	static Tensor Filled(const Shape& shape, Depth depth)
+	{
+		Tensor t = Tensor(shape, depth, Packing::CHW);
+		if (depth == Depth::D4)
+		{
+			for (size_t i = 0; i < shape.vol(); i++) t[i] = (float)(i % 13) / 13.f - 0.5f;
+		}
+		else
+		{
+			memset(t.data, 1, shape.vol() * depth);
+		}
+		return t;
+	}
+
+	// 1 and all the threads of the global pool
+	static std::vector<int> ThreadCounts()
+	{
+		int all = ThreadPool::Global().num_threads();
+		if (all == 1) return { 1 };
+		return { 1, all };
+	}
+
+	BENCHMARK(KernelTranspose)
+	{
+		bench::ReportHeader();
+		int sizes[][2] = { {64,64}, {1000,1000}, {512,4096} };
+		for (auto& s : sizes)
+		{
+			for (Depth depth : { Depth::D1, Depth::D2, Depth::D4, Depth::D8 })
+			{
+				Tensor a = Filled(Shape(s[0], s[1]), depth), b = Filled(Shape(s[1], s[0]), depth);
+				auto stats = bench::Sample([&]() { Transpose(a, b); }, 10);
+				bench::Report(Format("Transpose %s %dx%d", depth_names[(int)depth], s[0], s[1]), 1, stats, 0., 2. * a.shape.vol() * depth);
+			}
+		}
+	}
+
+	// a symmetric positive definite matrix, b * b^t + n * I
+	static Tensor Spd(int n)
+	{
+		Tensor b = Filled(Shape(n, n), Depth::D4), t = Tensor(Shape(n, n), Depth::D4), a;
+		Transpose(b, t);
+		Dot(b, t, a);
+		for (int i = 0; i < n; i++) a[i * n + i] += (float)n;
+		return a;
+	}
+
+	BENCHMARK(KernelDecomposition)
+	{
+		// the textbook flops of the direct methods, SVD and Eigen iterate so they have no rate
+		bench::ReportHeader();
+		for (int n : { 16, 64, 256 })
+		{
+			Tensor a = Spd(n), work = a.Clone(), inv = Tensor(Shape(n, n), Depth::D4);
+			Tensor w = Tensor(Shape(n, 1), Depth::D4), u = Tensor(Shape(n, n), Depth::D4), vt = Tensor(Shape(n, n), Depth::D4);
+			double cube = (double)n * n * n;
+			size_t bytes = (size_t)n * n * sizeof(float);
+			// the factorizations are in place, so each run restores the matrix first
+			auto stats = bench::Sample([&]() { memcpy(work.data, a.data, bytes); LU(work, n, n, nullptr, 0, 0); }, 10);
+			bench::Report(Format("LU %dx%d", n, n), 1, stats, 2. / 3. * cube, 0.);
+			stats = bench::Sample([&]() { memcpy(work.data, a.data, bytes); Cholesky(work, n, n, nullptr, 0, 0); }, 10);
+			bench::Report(Format("Cholesky %dx%d", n, n), 1, stats, cube / 3., 0.);
+			stats = bench::Sample([&]() { Invert(a, inv, DECOMP_LU); }, 10);
+			bench::Report(Format("Invert LU %dx%d", n, n), 1, stats, 2. * cube, 0.);
+			stats = bench::Sample([&]() { Invert(a, inv, DECOMP_CHOLESKY); }, 10);
+			bench::Report(Format("Invert Cholesky %dx%d", n, n), 1, stats, cube, 0.);
+			int runs = n < 256 ? 10 : 3;
+			stats = bench::Sample([&]() { SVD::Compute(a, w, u, vt); }, runs);
+			bench::Report(Format("SVD::Compute %dx%d", n, n), 1, stats, 0., 0.);
+			stats = bench::Sample([&]() { Eigen(a, w, u); }, runs);
+			bench::Report(Format("Eigen %dx%d", n, n), 1, stats, 0., 0.);
+		}
+	}
+
+	BENCHMARK(KernelBinaryOp)
+	{
+		bench::ReportHeader();
+		Shape shapes[][2] = { { Shape(1, 64, 56, 56), Shape(1, 64, 56, 56) }, { Shape(1, 3136, 64), Shape(64) }, { Shape(1, 64, 56, 56), Shape(64, 1, 1) } };
+		const char* names[] = { "same", "row", "channel" };
+		bench::CountingAllocator allocator;
+		auto layer = dnn::LayerRegistry::CreateLayer("BinaryOp");
+		layer->Set("op", dnn::BinOpType::ADD);
+		for (int s = 0; s < 3; s++)
+		{
+			Tensor a = Filled(shapes[s][0], Depth::D4), b = Filled(shapes[s][1], Depth::D4);
+			for (int half = 0; half < 2; half++)
+			{
+				if (half && not CheckHardwareSupport(CpuFeature::F16C)) continue;
+				Tensor x = a, y = b;
+				if (half)
+				{
+					ToHalf(a, x);
+					ToHalf(b, y);
+				}
+				for (int threads : ThreadCounts())
+				{
+					dnn::Option opt;
+					opt.num_threads = threads;
+					opt.blob_allocator = &allocator;
+					std::vector<Tensor> tops(1);
+					auto stats = bench::Sample([&]() { layer->Forward({ x, y }, tops, opt); }, 10);
+					size_t vol = tops[0].shape.vol();
+					bench::Report(Format("BinaryOp add %s %s", names[s], depth_names[(int)x.depth]), threads, stats,
+						(double)vol, (double)(x.shape.vol() + y.shape.vol() + vol) * x.depth);
+				}
+			}
+		}
+	}
+
+	BENCHMARK(KernelPermute)
+	{
+		bench::ReportHeader();
+		struct Case { Shape shape; Vec<uint> orders; const char* name; };
+		Case cases[] = {
+			{ Shape(64, 56, 56), { 2, 0, 1 }, "64x56x56 (2,0,1)" },
+			{ Shape(64, 56, 56), { 0, 2, 1 }, "64x56x56 (0,2,1)" },
+			{ Shape(8, 64, 32, 32), { 0, 2, 3, 1 }, "8x64x32x32 (0,2,3,1)" },
+		};
+		for (const auto& c : cases)
+		{
+			for (Depth depth : { Depth::D1, Depth::D4 })
+			{
+				Tensor src = Filled(c.shape, depth), dst;
+				for (int threads : ThreadCounts())
+				{
+					auto stats = bench::Sample([&]() { Permute(src, dst, c.orders, threads); }, 10);
+					bench::Report(Format("Permute %s %s", c.name, depth_names[(int)depth]), threads, stats, 0., 2. * src.shape.vol() * depth);
+				}
+			}
+		}
+	}
+
+	BENCHMARK(KernelInnerProduct)
+	{
+		bench::ReportHeader();
+		uint sizes[][3] = { {1,1024,1024}, {64,512,512}, {256,1024,1024} };
+		const char* formats[] = { "fp32", "fp16", "bf16", "int8" };
+		// the bytes of a weight element in each format
+		double weight_bytes[] = { 4., 2., 2., 1. };
+		bench::CountingAllocator allocator;
+		for (auto& s : sizes)
+		{
+			uint m = s[0], k = s[1], n = s[2];
+			Tensor x = Filled(Shape(m, k), Depth::D4), w = Filled(Shape(n, k), Depth::D4);
+			for (int f = 0; f < 4; f++)
+			{
+				if (f == 1 && not CheckHardwareSupport(CpuFeature::F16C)) continue;
+				dnn::Option opt;
+				opt.light_mode = true;
+				opt.use_fp16_storage = f == 1;
+				opt.use_bf16_storage = f == 2;
+				opt.use_int8_storage = f == 3;
+				opt.blob_allocator = &allocator;
+				opt.workspace_allocator = &allocator;
+				auto layer = dnn::LayerRegistry::CreateLayer("InnerProduct");
+				layer->Set("weight", w);
+				layer->CreatePipeline(opt);
+				for (int threads : ThreadCounts())
+				{
+					opt.num_threads = threads;
+					Tensor y;
+					auto stats = bench::Sample([&]() { layer->Forward(x, y, opt); }, m < 256 ? 20 : 5);
+					double bytes = (double)m * k * 4 + (double)n * k * weight_bytes[f] + (double)m * n * 4;
+					bench::Report(Format("InnerProduct %ux%ux%u %s", m, k, n, formats[f]), threads, stats, 2. * m * n * k, bytes);
+				}
+				layer->DestroyPipeline(opt);
+			}
+		}
+	}
+
+	BENCHMARK(KernelCopyTo)
+	{
+		bench::ReportHeader();
+		bench::CountingAllocator allocator;
+		for (Depth depth : { Depth::D1, Depth::D4 })
+		{
+			Shape shape = Shape(64, 56, 56);
+			Tensor dense = Filled(shape, depth);
+			// the rows padded to 64 elements
+			Tensor padded_buffer = Filled(Shape(64, 56, 64), depth);
+			Tensor padded = Tensor(shape, depth, Packing::CHW, padded_buffer.data, Steps({ 56 * 64, 64, 1 }));
+			for (const Tensor* src : { &dense, &padded })
+			{
+				Tensor dst;
+				auto stats = bench::Sample([&]() { src->CopyTo(dst, &allocator); }, 20);
+				bench::Report(Format("CopyTo 64x56x56 %s %s", src == &dense ? "dense" : "padded", depth_names[(int)depth]), 1, stats, 0., 2. * shape.vol() * depth);
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include "benchmark.hpp"
+
+#include "dnn/net.hpp"
+
+#include <chrono>
+#include <thread>
+
+namespace chaos
+{
+	using Clock = std::chrono::steady_clock;
+
+	// blocks of a token mixer on a tokens x features input: an InnerProduct over the features, one over the tokens
+	// between two Permutes, and a BinaryOp adding the input of the block back
+	static Ptr<dnn::Net> CreateMixer(int blocks, uint tokens, uint features, int num_threads, Allocator* weight_allocator)
+	{
+		Tensor wf(Shape(features, features), Depth::D4), wt(Shape(tokens, tokens), Depth::D4);
+		for (size_t i = 0; i < wf.shape.vol(); i++) wf[i] = (float)(i % 7) / (7.f * features) - 0.5f / features;
+		for (size_t i = 0; i < wt.shape.vol(); i++) wt[i] = (float)(i % 5) / (5.f * tokens) - 0.5f / tokens;
+
+		dnn::Option opt;
+		opt.light_mode = true;
+		opt.num_threads = num_threads;
+		opt.weight_allocator = weight_allocator;
+		float transpose[] = { 1, 0 };
+		Tensor orders(Shape(2), Depth::D4, Packing::CHW, transpose);
+		auto net = dnn::Net::CreateNet();
+		net->SetOption(opt);
+		std::string x = "data";
+		for (int b = 0; b < blocks; b++)
+		{
+			auto name = [&](const char* layer) { return Format("%s%d", layer, b); };
+			auto ipf = net->AddLayer("InnerProduct", name("ipf"), { x }, { name("f") });
+			ipf->Set("weight", wf);
+			ipf->Set("activation_type", (int)dnn::RELU);
+			net->AddLayer("Permute", name("to_tokens"), { name("f") }, { name("ft") })->Set("orders", orders);
+			net->AddLayer("InnerProduct", name("ipt"), { name("ft") }, { name("t") })->Set("weight", wt);
+			net->AddLayer("Permute", name("to_features"), { name("t") }, { name("tf") })->Set("orders", orders);
+			std::string top = b + 1 == blocks ? "out" : name("x");
+			net->AddLayer("BinaryOp", name("add"), { name("tf"), x }, { top })->Set("op", dnn::BinOpType::ADD);
+			x = top;
+		}
+		return net;
+	}
+
+	// the nearest rank percentile of the sorted latencies
+	static double Percentile(const std::vector<double>& sorted, double p)
+	{
+		size_t rank = (size_t)std::ceil(p * sorted.size());
+		return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+	}
+
+	/// <summary>
+	/// <para>Drive the net from clients threads, each with its own executor, for the seconds.</para>
+	/// <para>Closed loop (qps = 0) a client starts a Forward when the last one returns. At a fixed qps the requests</para>
+	/// <para>are due every clients / qps seconds per client, and the latency runs from the due time, so a late start</para>
+	/// <para>counts against it instead of hiding the queueing (the coordinated omission).</para>
+	/// </summary>
+	/// <return>The achieved requests per second</return>
+	static double Load(const Ptr<dnn::Net>& net, const Tensor& x, int clients, double qps, double seconds, int num_threads)
+	{
+		std::vector<std::vector<double>> latencies(clients);
+		std::vector<std::thread> threads;
+		// the executors are bound and warmed up before the clock starts
+		std::vector<Ptr<dnn::Executor>> executors;
+		for (int c = 0; c < clients; c++)
+		{
+			executors.push_back(net->BindExecutor());
+			executors.back()->SetLayerData("data", x);
+			executors.back()->Forward();
+		}
+		auto start = Clock::now() + std::chrono::milliseconds(10);
+		auto stop = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+		auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(qps > 0. ? clients / qps : 0.));
+		for (int c = 0; c < clients; c++)
+		{
+			threads.emplace_back([&, c]() {
+				auto& executor = executors[c];
+				auto& latency = latencies[c];
+				latency.reserve(100000);
+				// the clients of a fixed qps are spread over the interval
+				auto due = start + interval * c / clients;
+				std::this_thread::sleep_until(start);
+				while (true)
+				{
+					if (qps > 0.)
+					{
+						if (due >= stop) break;
+						std::this_thread::sleep_until(due);
+					}
+					else
+					{
+						due = Clock::now();
+						if (due >= stop) break;
+					}
+					executor->Forward();
+					latency.push_back(std::chrono::duration<double, std::milli>(Clock::now() - due).count());
+					due += interval;
+				}
+			});
+		}
+		for (auto& thread : threads) thread.join();
+		double elapsed = std::chrono::duration<double>(std::max(Clock::now(), stop) - start).count();
+
+		std::vector<double> sorted;
+		for (const auto& latency : latencies) sorted.insert(sorted.end(), latency.begin(), latency.end());
+		CHECK(not sorted.empty()) << "no request finished in " << seconds << " s";
+		std::sort(sorted.begin(), sorted.end());
+		double achieved = sorted.size() / elapsed, mean = 0.;
+		for (double l : sorted) mean += l / sorted.size();
+
+		bench::Stats stats;
+		stats.min = sorted.front();
+		stats.median = Percentile(sorted, 0.5);
+		std::string mode = qps > 0. ? Format("%.0f qps", qps) : std::string("closed loop");
+		std::string name = Format("%s %d client%s", mode.c_str(), clients, clients > 1 ? "s" : "");
+		double rss = bench::PeakRss() / 1048576.;
+		bench::Results().push_back({ bench::BenchmarkRegistry::Current(), name, num_threads, stats, 0., 0., {
+			{ "qps", achieved }, { "requests", (double)sorted.size() }, { "mean_ms", mean },
+			{ "p50_ms", stats.median }, { "p90_ms", Percentile(sorted, 0.9) }, { "p99_ms", Percentile(sorted, 0.99) },
+			{ "p999_ms", Percentile(sorted, 0.999) }, { "max_ms", sorted.back() }, { "peak_rss_mb", rss } } });
+		printf("%-24s %8.1f %9.3f ms %9.3f ms %9.3f ms %9.3f ms %9.3f ms %9.3f ms %8.1f MB\n", name.c_str(), achieved, mean,
+			stats.median, Percentile(sorted, 0.9), Percentile(sorted, 0.99), Percentile(sorted, 0.999), sorted.back(), rss);
+		return achieved;
+	}
+
+	/// <summary>
+	/// <para>ChaosBenchmark InferenceLoad [--clients n] [--qps q] [--seconds s] [--threads t] [--blocks b] [--tokens n] [--features n] [--pages bytes]</para>
+	/// <para>Without clients and qps it sweeps closed loops of 1, 2 and 4 clients, then loads 4 clients at 50% and 90%</para>
+	/// <para>of the best closed loop throughput. threads is Option::num_threads of each Forward, 0 for the whole pool.</para>
+	/// <para>With pages the packed weights from that many bytes up are mapped by a PageAllocator, interleaved over the nodes</para>
+	/// <para>on the large pages when the process may lock them.</para>
+	/// </summary>
+	BENCHMARK(InferenceLoad)
+	{
+		int blocks = (int)bench::Argument("blocks", 4);
+		uint tokens = (uint)bench::Argument("tokens", 64), features = (uint)bench::Argument("features", 256);
+		double seconds = bench::Argument("seconds", 2.);
+		int num_threads = (int)bench::Argument("threads", 0);
+		size_t pages = (size_t)bench::Argument("pages", 0.);
+		// declared before the net, which keeps its weights until it is destroyed
+		PageAllocator weight_pages(pages, PageAllocator::INTERLEAVE);
+		auto net = CreateMixer(blocks, tokens, features, num_threads, pages ? &weight_pages : nullptr);
+		Tensor x(Shape(tokens, features), Depth::D4);
+		for (size_t i = 0; i < x.shape.vol(); i++) x[i] = (float)(i % 13) / 13.f;
+
+		printf("%d blocks of %ux%u, %d threads per Forward\n", blocks, tokens, features, num_threads);
+		if (pages)
+		{
+			// the weights are packed when the net is prepared by its first executor
+			net->BindExecutor();
+			printf("weights from %zu bytes on %d nodes: %.1f MB mapped, %.1f MB on %zu KB large pages\n", pages, PageAllocator::NumNodes(),
+				weight_pages.Snapshot().reserved / 1048576., weight_pages.LargePageBytes() / 1048576., PageAllocator::LargePageSize() >> 10);
+		}
+		printf("%-24s %8s %12s %12s %12s %12s %12s %12s %11s\n", "", "qps", "mean", "p50", "p90", "p99", "p999", "max", "peak rss");
+		if (bench::Arguments().count("clients") || bench::Arguments().count("qps"))
+		{
+			Load(net, x, (int)bench::Argument("clients", 1), bench::Argument("qps", 0.), seconds, num_threads);
+			return;
+		}
+		double best = 0.;
+		for (int clients : { 1, 2, 4 })
+		{
+			best = std::max(best, Load(net, x, clients, 0., seconds, num_threads));
+		}
+		for (double load : { 0.5, 0.9 })
+		{
+			Load(net, x, 4, load * best, seconds, num_threads);
+		}
+	}
+}
\ No newline at end of file
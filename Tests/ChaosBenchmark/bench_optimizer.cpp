@@ -0,0 +1,42 @@
+#include "benchmark.hpp"
+
+#include "dnn/net.hpp"
+
+namespace chaos
+{
+	// y = relu(x * w^t + r) as three layers and as the one InnerProduct of the graph optimizer
+	static void Compare(const char* name, uint m, uint k, uint n, bool light_mode)
+	{
+		Tensor x(Shape(m, k), Depth::D4), w(Shape(n, k), Depth::D4), r(Shape(m, n), Depth::D4);
+		for (size_t i = 0; i < x.shape.vol(); i++) x[i] = (float)(i % 13) / 13.f;
+		for (size_t i = 0; i < w.shape.vol(); i++) w[i] = (float)(i % 7) / 7.f - 0.5f;
+		for (size_t i = 0; i < r.shape.vol(); i++) r[i] = (float)(i % 5) - 2.f;
+
+		double ms[2];
+		for (int optimize = 0; optimize < 2; optimize++)
+		{
+			dnn::Option opt;
+			opt.light_mode = light_mode;
+			opt.use_graph_optimization = optimize;
+			auto net = dnn::Net::CreateNet();
+			net->SetOption(opt);
+			net->AddLayer("InnerProduct", "ip", { "data" }, { "fc" })->Set("weight", w);
+			net->AddLayer("BinaryOp", "add", { "fc", "res" }, { "sum" })->Set("op", dnn::BinOpType::ADD);
+			net->AddLayer("Activation", "relu", { "sum" }, { "out" })->Set("activation_type", (int)dnn::RELU);
+			auto executor = net->BindExecutor();
+			executor->SetLayerData("data", x);
+			executor->SetLayerData("res", r);
+			ms[optimize] = bench::Measure([&]() { executor->Forward(); }, 20);
+		}
+		printf("%-16s %10.3f ms %10.3f ms %8.2f x\n", name, ms[0], ms[1], ms[0] / ms[1]);
+	}
+
+	BENCHMARK(GraphOptimizer)
+	{
+		printf("%-16s %13s %13s\n", "", "layers", "fused");
+		Compare("64x256x256", 64, 256, 256, true);
+		Compare("256x64x1024", 256, 64, 1024, true);
+		Compare("1024x64x1024", 1024, 64, 1024, true);
+		Compare("1024x64x1024 kept", 1024, 64, 1024, false);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include "benchmark.hpp"
+
+#include "core/nd_iterator.hpp"
+#include "math/tensor_op.hpp"
+
+namespace chaos
+{
+	// the previous permute, an element by element walk of dst with the permuted steps of src
+	template<class Type>
+	static void StridedPermute(const Tensor& src, const Vec<uint>& orders, Tensor& dst)
+	{
+		Steps src_steps(orders.size());
+		for (size_t i = 0; i < orders.size(); i++) src_steps[i] = src.steps[orders[i]];
+
+		NdIterator<2> it(dst.shape, { &dst.steps, &src_steps });
+		size_t sd = it.step(0), ss = it.step(1);
+		do
+		{
+			Type* d = (Type*)dst + it.offset(0);
+			const Type* s = (const Type*)src + it.offset(1);
+			for (size_t i = 0; i < it.size(); i++)
+				d[i * sd] = s[i * ss];
+		} while (it.Next());
+	}
+
+	template<class Type>
+	static void Compare(const char* name, const Shape& shape, const Vec<uint>& orders, Depth depth)
+	{
+		Shape permuted = shape;
+		for (size_t i = 0; i < shape.size(); i++) permuted[i] = shape[orders[i]];
+		Tensor a = Tensor(shape, depth, Packing::CHW);
+		Tensor b = Tensor(permuted, depth, Packing::CHW);
+		memset(a.data, 1, shape.vol() * sizeof(Type));
+
+		double strided = bench::Measure([&]() { StridedPermute<Type>(a, orders, b); }, 5);
+		double one = bench::Measure([&]() { Permute(a, b, orders, 1); }, 5);
+		double all = bench::Measure([&]() { Permute(a, b, orders); }, 5);
+		printf("%-6s %-14s %-10s %10.3f ms %10.3f ms %10.3f ms %8.2f GB/s\n", name, Format("%ux%ux%u", shape[1], shape[2], shape[3]).c_str(),
+			Format("%u%u%u%u", orders[0], orders[1], orders[2], orders[3]).c_str(), strided, one, all, 2. * shape.vol() * sizeof(Type) / (all * 1e6));
+	}
+
+	BENCHMARK(Permute)
+	{
+		printf("%-6s %-14s %-10s %13s %13s %13s %13s\n", "depth", "shape", "orders", "strided", "1 thread", "threads", "threads");
+		Vec<uint> to_nhwc = { 0,2,3,1 }, to_nchw = { 0,3,1,2 }, swap_hw = { 0,1,3,2 };
+		// feature maps and an image
+		Shape shapes[] = { Shape(1, 64, 56, 56), Shape(1, 256, 14, 14), Shape(1, 3, 640, 640) };
+		for (const Shape& shape : shapes)
+		{
+			Compare<float>("D4", shape, to_nhwc, Depth::D4);
+			Compare<float>("D4", Shape(shape[0], shape[2], shape[3], shape[1]), to_nchw, Depth::D4);
+			Compare<float>("D4", shape, swap_hw, Depth::D4);
+			Compare<uchar>("D1", shape, to_nhwc, Depth::D1);
+			Compare<uint16>("D2", shape, to_nhwc, Depth::D2);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+#include "benchmark.hpp"
+
+#include "dnn/net.hpp"
+
+namespace chaos
+{
+	// a chain of InnerProducts with relus, without the profiler and recording every layer
+	static void Compare(const char* name, int layers, uint m, uint k)
+	{
+		Tensor x(Shape(m, k), Depth::D4), w(Shape(k, k), Depth::D4);
+		for (size_t i = 0; i < x.shape.vol(); i++) x[i] = (float)(i % 13) / 13.f;
+		for (size_t i = 0; i < w.shape.vol(); i++) w[i] = (float)(i % 7) / 7.f - 0.5f;
+
+		dnn::Option opt;
+		opt.light_mode = true;
+		auto net = dnn::Net::CreateNet();
+		net->SetOption(opt);
+		for (int i = 0; i < layers; i++)
+		{
+			auto ip = net->AddLayer("InnerProduct", Format("ip%d", i), { i ? Format("fc%d", i - 1) : "data" }, { Format("fc%d", i) });
+			ip->Set("weight", w);
+			ip->Set("activation_type", (int)dnn::RELU);
+		}
+		auto executor = net->BindExecutor();
+		executor->SetLayerData("data", x);
+
+		dnn::Profiler profiler;
+		double off = bench::Measure([&]() { executor->Forward(); }, 50);
+		executor->SetProfiler(&profiler);
+		double on = bench::Measure([&]() { executor->Forward(); }, 50);
+		executor->SetProfiler(nullptr);
+		printf("%-16s %10.4f ms %10.4f ms %8.2f %%\n", name, off, on, 100. * (on - off) / off);
+	}
+
+	BENCHMARK(Profiler)
+	{
+		printf("%-16s %13s %13s %10s\n", "", "off", "recording", "overhead");
+		Compare("64 x 1x64", 64, 1, 64);
+		Compare("64 x 16x256", 64, 16, 256);
+		Compare("16 x 256x256", 16, 256, 256);
+	}
+}
\ No newline at end of file
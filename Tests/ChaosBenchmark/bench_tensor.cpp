@@ -0,0 +1,31 @@
+#include "benchmark.hpp"
+
+namespace chaos
+{
+	template<class Function>
+	static void Report(const char* name, Function&& func, int iters)
+	{
+		size_t before = bench::Allocations();
+		double ms = bench::Measure([&]() { for (int i = 0; i < iters; i++) func(); }, 5);
+		size_t count = bench::Allocations() - before;
+		// Measure calls the function 6 times
+		printf("%-24s %10.2f ns/op %10.2f allocs/op\n", name, ms * 1e6 / iters, count / (6. * iters));
+	}
+
+	BENCHMARK(ShapeTensorCopy)
+	{
+		constexpr int iters = 100000;
+		Shape shape = Shape(1, 64, 56, 56);
+		Tensor t = Tensor(shape, Depth::D4, Packing::CHW);
+		float buf[16];
+
+		volatile size_t sink = 0;
+		Report("Shape copy", [&]() { Shape s = shape; sink += s[0]; }, iters);
+		Report("Shape::steps", [&]() { Steps s = shape.steps(); sink += s[0]; }, iters);
+		Report("Shape Insert", [&]() { Shape s = Shape(2, 3); s.Insert(0, 1); sink += s[0]; }, iters);
+		Report("Tensor copy", [&]() { Tensor c = t; sink += c.shape[0]; }, iters);
+		Report("Tensor move", [&]() { Tensor c = t; Tensor d = std::move(c); sink += d.shape[0]; }, iters);
+		Report("Tensor view", [&]() { Tensor v = Tensor(Shape(4, 4), Depth::D4, Packing::CHW, buf); sink += v.shape[0]; }, iters);
+		Report("Tensor create", [&]() { Tensor c = Tensor(Shape(4, 4), Depth::D4, Packing::CHW); sink += c.shape[0]; }, iters);
+	}
+}
@@ -0,0 +1,41 @@
+#include "benchmark.hpp"
+
+#include "core/tensor_file.hpp"
+
+#include <filesystem>
+
+namespace chaos
+{
+	BENCHMARK(TensorFileLoad)
+	{
+		// 64 MB of weights in the page cache, the cold start without the disk
+		std::string file = (std::filesystem::temp_directory_path() / "chaos_bench_weights.bin").string();
+		std::map<std::string, Tensor> tensors;
+		for (int i = 0; i < 16; i++)
+		{
+			Tensor t(Shape(1024, 1024), Depth::D4);
+			for (size_t j = 0; j < t.total(); j++) t[j] = (float)j;
+			tensors[Format("layer%d.weight", i)] = t;
+		}
+		SaveTensors(file, tensors);
+		tensors.clear();
+
+		float sum = 0.f;
+		// the first touch of every page, what a forward does to the mapped weights
+		auto touch = [&](const std::map<std::string, Tensor>& loaded) {
+			for (const auto& [name, t] : loaded)
+			{
+				for (size_t j = 0; j < t.total(); j += 1024) sum += t[j];
+			}
+		};
+		double copy = bench::Measure([&]() { LoadTensors(file, nullptr, false); }, 5);
+		double map = bench::Measure([&]() { LoadTensors(file); }, 5);
+		double map_touch = bench::Measure([&]() { touch(LoadTensors(file)); }, 5);
+		printf("%-24s %10.3f ms\n", "copy", copy);
+		printf("%-24s %10.3f ms\n", "map", map);
+		printf("%-24s %10.3f ms\n", "map + touch", map_touch);
+		printf("%-24s %10.1f x\n", "speedup", copy / map);
+		if (sum < 0.f) printf("%f\n", sum);
+		std::filesystem::remove(file);
+	}
+}
\ No newline at end of file
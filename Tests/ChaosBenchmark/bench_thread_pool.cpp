@@ -0,0 +1,47 @@
+#include "benchmark.hpp"
+
+#include "core/thread_pool.hpp"
+#include "math/tensor_op.hpp"
+#include "dnn/layer.hpp"
+#include "dnn/layer_factory.hpp"
+
+namespace chaos
+{
+	// the layers on 1 to N threads of the global pool
+	BENCHMARK(ThreadScaling)
+	{
+		Tensor x = Tensor(Shape(256, 1024), Depth::D4, Packing::CHW);
+		Tensor w = Tensor(Shape(1024, 1024), Depth::D4, Packing::CHW);
+		for (size_t i = 0; i < x.shape.vol(); i++) x[i] = (float)(i % 13) / 13;
+		for (size_t i = 0; i < w.shape.vol(); i++) w[i] = (float)(i % 7) / 7;
+		auto ip = dnn::LayerRegistry::CreateLayer("InnerProduct");
+		ip->Set("weight", w);
+
+		Tensor a = Tensor(Shape(64, 112, 112), Depth::D4, Packing::CHW);
+		Tensor b = Tensor(Shape(64, 1, 1), Depth::D4, Packing::CHW);
+		for (size_t i = 0; i < a.shape.vol(); i++) a[i] = (float)(i % 5);
+		for (size_t i = 0; i < b.shape.vol(); i++) b[i] = (float)i;
+		auto add = dnn::LayerRegistry::CreateLayer("BinaryOp");
+		add->Set("op", dnn::BinOpType::ADD);
+		float forders[] = { 1,2,0 };
+		auto permute = dnn::LayerRegistry::CreateLayer("Permute");
+		permute->Set("orders", Tensor(Shape(3), Depth::D4, Packing::CHW, forders));
+
+		int max_threads = ThreadPool::Global().num_threads();
+		printf("%8s %14s %14s %14s\n", "threads", "ip ms", "add ms", "permute ms");
+		std::vector<int> counts;
+		for (int threads = 1; threads < max_threads; threads *= 2) counts.push_back(threads);
+		counts.push_back(max_threads);
+		for (int threads : counts)
+		{
+			dnn::Option opt;
+			opt.num_threads = threads;
+			Tensor y, c, p;
+			std::vector<Tensor> tops(1);
+			double t_ip = bench::Measure([&]() { ip->Forward(x, y, opt); }, 5);
+			double t_add = bench::Measure([&]() { add->Forward({ a,b }, tops, opt); }, 5);
+			double t_permute = bench::Measure([&]() { permute->Forward(a, p, opt); }, 5);
+			printf("%8d %14.3f %14.3f %14.3f\n", threads, t_ip, t_add, t_permute);
+		}
+	}
+}
@@ -0,0 +1,71 @@
+#include "benchmark.hpp"
+
+#include "math/tensor_op.hpp"
+
+namespace chaos
+{
+	// the previous transpose, a scalar 4x4 unroll over the whole matrix
+	template<typename Type>
+	static void ScalarTranspose(const uchar* src, size_t sstep, uchar* dst, size_t dstep, int width, int height)
+	{
+		int i = 0, j, m = width, n = height;
+		for (; i <= m - 4; i += 4)
+		{
+			Type* d0 = (Type*)(dst + dstep * i);
+			Type* d1 = (Type*)(dst + dstep * (i + 1LL));
+			Type* d2 = (Type*)(dst + dstep * (i + 2LL));
+			Type* d3 = (Type*)(dst + dstep * (i + 3LL));
+			for (j = 0; j <= n - 4; j += 4)
+			{
+				const Type* s0 = (const Type*)(src + i * sizeof(Type) + sstep * j);
+				const Type* s1 = (const Type*)(src + i * sizeof(Type) + sstep * (j + 1LL));
+				const Type* s2 = (const Type*)(src + i * sizeof(Type) + sstep * (j + 2LL));
+				const Type* s3 = (const Type*)(src + i * sizeof(Type) + sstep * (j + 3LL));
+				d0[j] = s0[0]; d0[j + 1] = s1[0]; d0[j + 2] = s2[0]; d0[j + 3] = s3[0];
+				d1[j] = s0[1]; d1[j + 1] = s1[1]; d1[j + 2] = s2[1]; d1[j + 3] = s3[1];
+				d2[j] = s0[2]; d2[j + 1] = s1[2]; d2[j + 2] = s2[2]; d2[j + 3] = s3[2];
+				d3[j] = s0[3]; d3[j + 1] = s1[3]; d3[j + 2] = s2[3]; d3[j + 3] = s3[3];
+			}
+			for (; j < n; j++)
+			{
+				const Type* s0 = (const Type*)(src + i * sizeof(Type) + j * sstep);
+				d0[j] = s0[0]; d1[j] = s0[1]; d2[j] = s0[2]; d3[j] = s0[3];
+			}
+		}
+		for (; i < m; i++)
+		{
+			Type* d0 = (Type*)(dst + dstep * i);
+			for (j = 0; j < n; j++)
+				d0[j] = *(const Type*)(src + i * sizeof(Type) + j * sstep);
+		}
+	}
+
+	template<typename Type>
+	static void Compare(const char* name, int rows, int cols, Depth depth)
+	{
+		Tensor a = Tensor(Shape(rows, cols), depth, Packing::CHW);
+		Tensor b = Tensor(Shape(cols, rows), depth, Packing::CHW);
+		memset(a.data, 1, (size_t)rows * cols * sizeof(Type));
+
+		double scalar = bench::Measure([&]() {
+			ScalarTranspose<Type>(a, cols * sizeof(Type), b, rows * sizeof(Type), cols, rows);
+		}, 5);
+		double tiled = bench::Measure([&]() { Transpose(a, b); }, 5);
+		double inplace = rows == cols ? bench::Measure([&]() { Transpose(a, a); }, 5) : 0.;
+		double gbs = 2. * rows * cols * sizeof(Type) / (tiled * 1e6);
+		printf("%-6s %5dx%-5d %10.3f ms %10.3f ms %8.2f GB/s %10.3f ms\n", name, rows, cols, scalar, tiled, gbs, inplace);
+	}
+
+	BENCHMARK(Transpose)
+	{
+		printf("%-6s %11s %13s %13s %13s %13s\n", "depth", "size", "scalar", "tiled", "tiled", "in place");
+		int sizes[][2] = { {64,64}, {1000,1000}, {512,4096}, {4096,4096} };
+		for (auto& s : sizes)
+		{
+			Compare<uchar>("D1", s[0], s[1], Depth::D1);
+			Compare<uint16>("D2", s[0], s[1], Depth::D2);
+			Compare<float>("D4", s[0], s[1], Depth::D4);
+			Compare<double>("D8", s[0], s[1], Depth::D8);
+		}
+	}
+}
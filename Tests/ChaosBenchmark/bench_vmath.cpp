@@ -0,0 +1,51 @@
+#include "benchmark.hpp"
+
+#include "math/vmath.hpp"
+
+#include <cmath>
+#include <random>
+
+namespace chaos
+{
+	// the largest error in ulps against the double precision function
+	template<class Ref>
+	static double MaxUlp(const std::vector<float>& x, const std::vector<float>& y, const Ref& ref)
+	{
+		double worst = 0.;
+		for (size_t i = 0; i < x.size(); i++)
+		{
+			double r = ref((double)x[i]);
+			if (std::fabs(r) < FLT_MIN) continue;
+			int e;
+			std::frexp(r, &e);
+			worst = std::max(worst, std::fabs(y[i] - r) / std::ldexp(1., e - 24));
+		}
+		return worst;
+	}
+
+	template<class Func, class Lib, class Ref>
+	static void Compare(const char* name, float lo, float hi, const Func& func, const Lib& lib, const Ref& ref)
+	{
+		std::mt19937 rng(0);
+		std::uniform_real_distribution<float> dist(lo, hi);
+		std::vector<float> x(1 << 16), y(x.size()), z(x.size());
+		for (auto& v : x) v = dist(rng);
+
+		double simd = bench::Measure([&]() { func(x.data(), y.data(), x.size()); }, 20);
+		double libm = bench::Measure([&]() { for (size_t i = 0; i < x.size(); i++) z[i] = lib(x[i]); }, 20);
+		printf("%-8s %10.1f %10.1f M/s %10.3f %10.3f ulp\n", name, x.size() / (simd * 1e3), x.size() / (libm * 1e3),
+			MaxUlp(x, y, ref), MaxUlp(x, z, ref));
+	}
+
+	BENCHMARK(VMath)
+	{
+		printf("%-8s %10s %14s %10s %14s\n", "", "simd", "libm", "simd", "libm");
+		Compare("exp", -80.f, 80.f, Exp, [](float v) { return std::exp(v); }, [](double v) { return std::exp(v); });
+		Compare("log", 1e-30f, 1e30f, Log, [](float v) { return std::log(v); }, [](double v) { return std::log(v); });
+		Compare("tanh", -10.f, 10.f, Tanh, [](float v) { return std::tanh(v); }, [](double v) { return std::tanh(v); });
+		Compare("sigmoid", -20.f, 20.f, Sigmoid, [](float v) { return 1.f / (1.f + std::exp(-v)); },
+			[](double v) { return 1. / (1. + std::exp(-v)); });
+		Compare("mish", -20.f, 20.f, Mish, [](float v) { return v * std::tanh(std::log(std::exp(v) + 1.f)); },
+			[](double v) { return v * std::tanh(std::log1p(std::exp(v))); });
+	}
+}
\ No newline at end of file
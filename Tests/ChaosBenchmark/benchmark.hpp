@@ -0,0 +1,186 @@
+#pragma once
+
+#include "core/core.hpp"
+#include "core/tensor.hpp"
+
+#include <map>
+#include <atomic>
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+namespace chaos
+{
+	namespace bench
+	{
+		class BenchmarkRegistry
+		{
+		public:
+			using Function = std::function<void()>;
+			using FunctionRegistry = std::map<std::string, Function>;
+
+			static FunctionRegistry& Registry()
+			{
+				static FunctionRegistry registry;
+				return registry;
+			}
+
+			static void AddBenchmark(const std::string& name, Function func)
+			{
+				FunctionRegistry& registry = Registry();
+				CHECK_EQ(registry.count(name), 0) << "Benchmark " << name << " already registered.";
+				registry[name] = func;
+			}
+
+			/// <summary>Run the benchmarks whose name contains the filter</summary>
+			static void Run(const std::string& filter)
+			{
+				for (const auto& [name, func] : Registry())
+				{
+					if (name.find(filter) == std::string::npos) continue;
+					printf("[%s]\n", name.c_str());
+					Current() = name;
+					func();
+				}
+				Current().clear();
+			}
+
+			/// <summary>The name of the running benchmark</summary>
+			static std::string& Current()
+			{
+				static std::string current;
+				return current;
+			}
+
+			BenchmarkRegistry() = delete;
+		};
+
+		class BenchmarkRegisterer
+		{
+		public:
+			BenchmarkRegisterer(const std::string& name, const BenchmarkRegistry::Function& func)
+			{
+				BenchmarkRegistry::AddBenchmark(name, func);
+			}
+		};
+
+		/// <summary>
+		/// <para>Time a function in ms, the minimum of the runs after a warm up call.</para>
+		/// <para>The minimum is the least disturbed by the other processes.</para>
+		/// </summary>
+		template<class Function>
+		double Measure(Function&& func, int runs = 10)
+		{
+			func();
+			double best = std::numeric_limits<double>::max();
+			for (int i = 0; i < runs; i++)
+			{
+				int64 start = GetTickCount();
+				func();
+				best = std::min(best, (GetTickCount() - start) * 1000. / GetTickFrequency());
+			}
+			return best;
+		}
+
+		/// <summary>The heap allocations so far, by the operator new of this module (main.cpp) and the CountingAllocators</summary>
+		size_t Allocations();
+
+		/// <summary>FastMalloc counted by Allocations, for the blobs, workspaces and outputs of the kernels</summary>
+		class CountingAllocator : public Allocator
+		{
+		public:
+			virtual void* FastMalloc(size_t size) override
+			{
+				count.fetch_add(1, std::memory_order_relaxed);
+				return chaos::FastMalloc(size);
+			}
+			virtual void FastFree(void* ptr) override { chaos::FastFree(ptr); }
+
+			static inline std::atomic<size_t> count = 0;
+		};
+
+		struct Stats
+		{
+			double min = 0.;    // ms
+			double median = 0.; // ms
+			double allocs = 0.; // per run
+		};
+
+		/// <summary>Time a function in ms after a warm up call, the median is what a caller sees and the min what the kernel can do</summary>
+		template<class Function>
+		Stats Sample(Function&& func, int runs = 10)
+		{
+			func();
+			std::vector<double> times(runs);
+			size_t allocations = Allocations();
+			for (int i = 0; i < runs; i++)
+			{
+				int64 start = GetTickCount();
+				func();
+				times[i] = (GetTickCount() - start) * 1000. / GetTickFrequency();
+			}
+			Stats stats;
+			stats.allocs = (double)(Allocations() - allocations) / runs;
+			std::sort(times.begin(), times.end());
+			stats.min = times[0];
+			stats.median = runs % 2 ? times[runs / 2] : (times[runs / 2 - 1] + times[runs / 2]) / 2.;
+			return stats;
+		}
+
+		/// <summary>The peak resident set of the process in bytes</summary>
+		size_t PeakRss();
+
+		/// <summary>The --key value arguments of ChaosBenchmark</summary>
+		inline std::map<std::string, std::string>& Arguments()
+		{
+			static std::map<std::string, std::string> arguments;
+			return arguments;
+		}
+
+		/// <summary>The number of an argument, value if it is not given</summary>
+		inline double Argument(const std::string& key, double value)
+		{
+			auto it = Arguments().find(key);
+			return it == Arguments().end() ? value : std::stod(it->second);
+		}
+
+		/// <summary>A line of a benchmark, written as JSON by ChaosBenchmark --json file</summary>
+		struct Result
+		{
+			std::string benchmark;
+			std::string name;
+			int threads;
+			Stats stats;
+			double gflops;
+			double gbps;
+			// the other numbers of the line, eg. the latency percentiles of a load
+			std::vector<std::pair<std::string, double>> metrics = {};
+		};
+
+		inline std::vector<Result>& Results()
+		{
+			static std::vector<Result> results;
+			return results;
+		}
+
+		/// <summary>Print and record a sampled kernel with its rates from the median, 0 flops or bytes for no rate</summary>
+		inline void Report(const std::string& name, int threads, const Stats& stats, double flops, double bytes)
+		{
+			double gflops = flops / (stats.median * 1e6), gbps = bytes / (stats.median * 1e6);
+			Results().push_back({ BenchmarkRegistry::Current(), name, threads, stats, gflops, gbps });
+			std::string rates = (flops > 0. ? Format("%9.2f GFLOP/s", gflops) : Format("%17s", "")) + (bytes > 0. ? Format("%9.2f GB/s", gbps) : Format("%14s", ""));
+			printf("%-36s %3d %10.4f ms %10.4f ms %s %8.1f\n", name.c_str(), threads, stats.median, stats.min, rates.c_str(), stats.allocs);
+		}
+
+		/// <summary>The header of the Report lines</summary>
+		inline void ReportHeader()
+		{
+			printf("%-36s %3s %13s %13s %31s %8s\n", "", "thr", "median", "min", "rate", "allocs");
+		}
+	}
+}
+
+#define BENCHMARK(name) \
+static void Benchmark##name(); \
+static chaos::bench::BenchmarkRegisterer benchmark_##name(#name, Benchmark##name); \
+static void Benchmark##name()
\ No newline at end of file
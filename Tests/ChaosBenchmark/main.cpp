@@ -0,0 +1,78 @@
+#include "benchmark.hpp"
+
+#include <fstream>
+#include <new>
+
+#include <Windows.h>
+#include <Psapi.h>
+#pragma comment(lib, "Psapi.lib")
+
+// counts the heap allocations made by the code of this module, that is the inline
+// Shape/Steps paths; the copies inside ChaosCV.dll go through its own operator new
+static std::atomic<size_t> allocations = 0;
+
+void* operator new(size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* ptr = malloc(size ? size : 1)) return ptr;
+	throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete[](void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { free(ptr); }
+
+namespace chaos
+{
+	namespace bench
+	{
+		size_t Allocations()
+		{
+			return allocations.load(std::memory_order_relaxed) + CountingAllocator::count.load(std::memory_order_relaxed);
+		}
+
+		size_t PeakRss()
+		{
+			PROCESS_MEMORY_COUNTERS counters = {};
+			GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+			return counters.PeakWorkingSetSize;
+		}
+
+		// the Report lines, one object per line so two runs diff line by line
+		static void WriteJson(const std::string& file)
+		{
+			std::ofstream stream(file);
+			CHECK(stream.is_open()) << "can not open \"" << file << "\"";
+			stream << "{\"results\":[";
+			const auto& results = Results();
+			for (size_t i = 0; i < results.size(); i++)
+			{
+				const Result& r = results[i];
+				stream << (i ? ",\n" : "\n") << Format("{\"benchmark\":\"%s\",\"name\":\"%s\",\"threads\":%d,\"median_ms\":%.6f,\"min_ms\":%.6f,"
+					"\"gflops\":%.3f,\"gbps\":%.3f,\"allocs\":%.2f", r.benchmark.c_str(), r.name.c_str(), r.threads,
+					r.stats.median, r.stats.min, r.gflops, r.gbps, r.stats.allocs);
+				for (const auto& [key, value] : r.metrics) stream << Format(",\"%s\":%.6g", key.c_str(), value);
+				stream << "}";
+			}
+			stream << "\n]}\n";
+		}
+	}
+}
+
+// ChaosBenchmark [filter] [--json file] [--key value ...], runs the benchmarks whose name contains the filter,
+// the lines of bench::Report go to the json file, the other keys are the bench::Arguments
+int main(int argc, char** argv)
+{
+	std::string filter;
+	auto& arguments = chaos::bench::Arguments();
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg.rfind("--", 0) == 0 && i + 1 < argc) arguments[arg.substr(2)] = argv[++i];
+		else filter = arg;
+	}
+	chaos::bench::BenchmarkRegistry::Run(filter);
+	if (arguments.count("json")) chaos::bench::WriteJson(arguments["json"]);
+	return 0;
+}
\ No newline at end of file
@@ -7,4 +7,18 @@
 
 #include "CppUnitTest.h"
 
-using namespace Microsoft::VisualStudio::CppUnitTestFramework;
\ No newline at end of file
+#include <random>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace chaos
+{
+	// a dense float tensor of uniform values in [low, high)
+	inline Tensor Random(const Shape& shape, std::mt19937& rng, float low = -1.f, float high = 1.f)
+	{
+		std::uniform_real_distribution<float> dist(low, high);
+		Tensor t(shape, Depth::D4);
+		for (size_t i = 0; i < shape.vol(); i++) t[i] = dist(rng);
+		return t;
+	}
+}
\ No newline at end of file
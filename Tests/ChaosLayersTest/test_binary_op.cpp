@@ -1,5 +1,10 @@
 #include "core.hpp"
 
+#include "math/tensor_op.hpp"
+#include "math/half.hpp"
+
+#include <random>
+
 namespace chaos
 {
 	TEST_CLASS(BinaryOpTest)
@@ -27,6 +32,156 @@ namespace chaos
 			}
 		}
 
+		TEST_METHOD(BroadcastRank)
+		{
+			// (2,2,3) - (3), a is a view with padded rows
+			float abuf[] = { 1,2,3,0, 4,5,6,0, 7,8,9,0, 10,11,12,0 };
+			float bbuf[] = { 1,2,3 };
+			Tensor A = Tensor(Shape(2, 2, 3), Depth::D4, Packing::CHW, abuf, { 8,4,1 });
+			Tensor B = Tensor(Shape(3), Depth::D4, Packing::CHW, bbuf);
+			std::vector<Tensor> tops(1);
+			layer->Set("op", dnn::BinOpType::SUB);
+			layer->Forward({ A,B }, tops, dnn::Option());
+			Tensor& C = tops[0];
+			Assert::IsTrue(Shape(2, 2, 3) == C.shape);
+			float expected[] = { 0,0,0, 3,3,3, 6,6,6, 9,9,9 };
+			for (int i = 0; i < 12; i++)
+			{
+				Assert::AreEqual(expected[i], C[i], FLT_EPSILON * 10);
+			}
+		}
+
+		TEST_METHOD(BroadcastBoth)
+		{
+			// (2,1) * (1,3)
+			float abuf[] = { 2,3 };
+			float bbuf[] = { 1,2,3 };
+			Tensor A = Tensor(Shape(2, 1), Depth::D4, Packing::CHW, abuf);
+			Tensor B = Tensor(Shape(1, 3), Depth::D4, Packing::CHW, bbuf);
+			std::vector<Tensor> tops(1);
+			layer->Set("op", dnn::BinOpType::MUL);
+			layer->Forward({ A,B }, tops, dnn::Option());
+			Tensor& C = tops[0];
+			Assert::IsTrue(Shape(2, 3) == C.shape);
+			float expected[] = { 2,4,6, 3,6,9 };
+			for (int i = 0; i < 6; i++)
+			{
+				Assert::AreEqual(expected[i], C[i], FLT_EPSILON * 10);
+			}
+		}
+
+		// the element of x at the index of c, the dims aligned to the right and broadcast when of size 1
+		static float At(const Tensor& x, const Shape& shape, size_t idx)
+		{
+			size_t offset = 0;
+			for (int64 i = shape.size() - 1, j = x.shape.size() - 1; j >= 0; i--, j--)
+			{
+				size_t k = idx % shape[i];
+				idx /= shape[i];
+				if (x.shape[j] != 1) offset += k * x.steps[j];
+			}
+			return ((const float*)x.data)[offset];
+		}
+
+		TEST_METHOD(BroadcastPatterns)
+		{
+			std::mt19937 rng(0);
+			// same, scalar, row, channel, outer and a mixed one, with the SIMD tails and the threads
+			Shape shapes[][2] = {
+				{ Shape(3, 37, 41), Shape(3, 37, 41) },
+				{ Shape(1, 1, 1), Shape(5, 67) },
+				{ Shape(4, 33, 100), Shape(100) },
+				{ Shape(1, 64, 56, 56), Shape(64, 1, 1) },
+				{ Shape(300, 1), Shape(1, 257) },
+				{ Shape(2, 1, 9, 1), Shape(3, 1, 7) },
+			};
+			int ops[] = { dnn::BinOpType::ADD, dnn::BinOpType::SUB, dnn::BinOpType::MUL, dnn::BinOpType::DIV };
+			for (auto& s : shapes)
+			{
+				for (int swap = 0; swap < 2; swap++)
+				{
+					// the values stay away from 0 for the division
+					Tensor A = Random(s[swap], rng, 0.5f, 2.f), B = Random(s[1 - swap], rng, 0.5f, 2.f);
+					for (int op : ops)
+					{
+						std::vector<Tensor> tops(1);
+						layer->Set("op", op);
+						layer->Forward({ A,B }, tops, dnn::Option());
+						Tensor& C = tops[0];
+						for (size_t i = 0; i < C.shape.vol(); i++)
+						{
+							float x = At(A, C.shape, i), y = At(B, C.shape, i);
+							float expected = op == dnn::ADD ? x + y : op == dnn::SUB ? x - y : op == dnn::MUL ? x * y : x / y;
+							Assert::AreEqual(expected, C[i]);
+						}
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(HalfPatterns)
+		{
+			// the half operands are computed in float and rounded once, as the scalar conversions do
+			std::mt19937 rng(2);
+			Shape shapes[][2] = {
+				{ Shape(3, 37, 41), Shape(3, 37, 41) },
+				{ Shape(1, 1, 1), Shape(5, 67) },
+				{ Shape(4, 33, 100), Shape(100) },
+				{ Shape(2, 1, 9, 1), Shape(3, 1, 7) },
+			};
+			int ops[] = { dnn::BinOpType::ADD, dnn::BinOpType::SUB, dnn::BinOpType::MUL, dnn::BinOpType::DIV };
+			for (int bf16 = 0; bf16 < 2; bf16++)
+			{
+				// the operands tell float16 from bfloat16
+				dnn::Option opt;
+				for (auto& s : shapes)
+				{
+					Tensor A, B, FA, FB;
+					ToHalf(Random(s[0], rng, 0.5f, 2.f), A, bf16);
+					ToHalf(Random(s[1], rng, 0.5f, 2.f), B, bf16);
+					ToFloat(A, FA);
+					ToFloat(B, FB);
+					for (int op : ops)
+					{
+						std::vector<Tensor> tops(1);
+						layer->Set("op", op);
+						layer->Forward({ A,B }, tops, opt);
+						Tensor& C = tops[0];
+						Assert::IsTrue(Depth::D2 == C.depth && A.type == C.type);
+						for (size_t i = 0; i < C.shape.vol(); i++)
+						{
+							float x = At(FA, C.shape, i), y = At(FB, C.shape, i);
+							float expected = op == dnn::ADD ? x + y : op == dnn::SUB ? x - y : op == dnn::MUL ? x * y : x / y;
+							if (bf16)
+								Assert::AreEqual(ToFloat(ToBFloat16(expected)), ToFloat(((const bfloat16*)C)[i]));
+							else
+								Assert::AreEqual(ToFloat(ToFloat16(expected)), ToFloat(((const float16*)C)[i]));
+						}
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(Inplace)
+		{
+			std::mt19937 rng(1);
+			Tensor A = Random(Shape(16, 1000), rng, 0.5f, 2.f), B = Random(Shape(1000), rng, 0.5f, 2.f);
+			Tensor R = A.Clone();
+
+			// the top on a is written in place
+			std::vector<Tensor> tops = { A };
+			layer->Set("op", dnn::BinOpType::MUL);
+			layer->Forward({ A,B }, tops, dnn::Option());
+			Assert::IsTrue(tops[0].data == A.data);
+			for (size_t i = 0; i < A.shape.vol(); i++)
+				Assert::AreEqual(R[i] * B[i % 1000], A[i]);
+
+			// and by the free functions
+			Add(A, A, A);
+			for (size_t i = 0; i < A.shape.vol(); i++)
+				Assert::AreEqual(2 * (R[i] * B[i % 1000]), A[i]);
+		}
+
 		Ptr<dnn::Layer> layer;
 	};
 }
\ No newline at end of file
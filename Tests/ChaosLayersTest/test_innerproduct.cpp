@@ -0,0 +1,217 @@
+#include "core.hpp"
+
+#include "dnn/layers/innerproduct.hpp"
+#include "math/half.hpp"
+#include "math/quantize.hpp"
+
+#include <cmath>
+#include <random>
+
+namespace chaos
+{
+	TEST_CLASS(InnerProductTest)
+	{
+	public:
+		InnerProductTest() {}
+
+		static double Activate(int type, double y, const float* params)
+		{
+			switch (type)
+			{
+			case dnn::RELU: return std::max(0., y);
+			case dnn::LEAKYRELU: return y > 0. ? y : y * params[0];
+			case dnn::CLIP: return std::min(std::max(y, (double)params[0]), (double)params[1]);
+			case dnn::SIGMOID: return 1. / (1. + std::exp(-y));
+			case dnn::MISH: return y * std::tanh(std::log1p(std::exp(y)));
+			default: return y;
+			}
+		}
+
+		// y = f(x * w^t + b) against the double precision sums, for every activation with and without the bias,
+		// the weight packed by CreatePipeline(pipeline) has errors up to weight_error
+		static void Check(uint m, uint n, uint k, std::mt19937& rng, const dnn::Option* pipeline = nullptr, float weight_error = 0.f)
+		{
+			Tensor x = Random(Shape(m, k), rng);
+			Tensor w = Random(Shape(n, k), rng);
+			Tensor b = Random(Shape(m, n), rng);
+			float params[] = { 0.1f, 0.25f };
+			for (int use_bias = 0; use_bias < 2; use_bias++)
+			{
+				for (int type = dnn::NONE; type <= dnn::MISH; type++)
+				{
+					auto layer = dnn::LayerRegistry::CreateLayer("InnerProduct");
+					layer->Set("weight", w);
+					if (use_bias) layer->Set("bias", b);
+					layer->Set("activation_type", type);
+					layer->Set("activation_params", Tensor(Shape(2), Depth::D4, Packing::CHW, params));
+					if (pipeline)
+					{
+						layer->CreatePipeline(*pipeline);
+						auto ip = std::dynamic_pointer_cast<dnn::InnerProduct>(layer);
+						Assert::IsFalse(ip->packed_weight.empty());
+						Assert::AreEqual(pipeline->light_mode, ip->weight.empty());
+					}
+
+					Tensor y;
+					layer->Forward(x, y, dnn::Option());
+					Assert::IsTrue(Shape(m, n) == y.shape);
+					for (uint i = 0; i < m; i++)
+					{
+						for (uint j = 0; j < n; j++)
+						{
+							double s = use_bias ? b[i * n + j] : 0.;
+							for (uint p = 0; p < k; p++) s += (double)x[i * k + p] * w[j * k + p];
+							double ref = Activate(type, s, params);
+							float eps = 1e-5f * (k + 1) * std::max(1.f, (float)std::fabs(ref)) + 1.1f * k * weight_error;
+							Assert::AreEqual((float)ref, y[i * n + j], eps);
+						}
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(Epilogues)
+		{
+			std::mt19937 rng(0);
+			// the gemv rows, a single panel, and tiles crossing the panels of the threads
+			uint sizes[][3] = { {1,37,19}, {2,64,30}, {3,5,7}, {37,65,300}, {130,270,40} };
+			for (auto& s : sizes)
+			{
+				Check(s[0], s[1], s[2], rng);
+			}
+		}
+
+		TEST_METHOD(PackedWeight)
+		{
+			std::mt19937 rng(1);
+			uint sizes[][3] = { {1,37,19}, {2,64,30}, {37,65,300}, {130,270,40} };
+			dnn::Option fp32, fp16, bf16, int8;
+			fp32.light_mode = true;
+			fp16.use_fp16_storage = true;
+			bf16.use_bf16_storage = true;
+			int8.use_int8_storage = true;
+			int8.light_mode = true;
+			for (auto& s : sizes)
+			{
+				Check(s[0], s[1], s[2], rng, &fp32, 0.f);
+				if (CheckHardwareSupport(CpuFeature::F16C)) Check(s[0], s[1], s[2], rng, &fp16, 1.f / 2048);
+				Check(s[0], s[1], s[2], rng, &bf16, 1.f / 256);
+				Check(s[0], s[1], s[2], rng, &int8, 1.f / 254);
+			}
+		}
+
+		TEST_METHOD(PageWeights)
+		{
+			std::mt19937 rng(4);
+			// the panels of 300x65 are mapped, interleaved over the nodes
+			PageAllocator pages(1 << 14, PageAllocator::INTERLEAVE, 0, true, true);
+			dnn::Option fp32, int8;
+			fp32.weight_allocator = &pages;
+			int8.use_int8_storage = true;
+			int8.weight_allocator = &pages;
+			Check(37, 65, 300, rng, &fp32, 0.f);
+			Check(37, 65, 300, rng, &int8, 1.f / 254);
+
+			// the layers gave the weights back
+			AllocatorStats stats = pages.Snapshot();
+			Assert::IsTrue(stats.mallocs >= 2 * 12);
+			Assert::AreEqual(stats.mallocs, stats.frees);
+			Assert::IsTrue(stats.peak >= 300 * 65 * sizeof(float));
+			Assert::AreEqual(size_t(0), stats.reserved);
+		}
+
+		TEST_METHOD(HalfBlobs)
+		{
+			// a half x gives a half y of the float layer within the rounding of x, w and y
+			std::mt19937 rng(4);
+			uint sizes[][3] = { {1,37,19}, {3,64,30}, {130,270,40} };
+			for (int bf16 = 0; bf16 < 2; bf16++)
+			{
+				if (not bf16 && not CheckHardwareSupport(CpuFeature::F16C)) continue;
+				dnn::Option opt;
+				opt.use_fp16_storage = not bf16;
+				opt.use_bf16_storage = bf16;
+				float error = bf16 ? 1.f / 256 : 1.f / 2048;
+				for (auto& s : sizes)
+				{
+					uint m = s[0], n = s[1], k = s[2];
+					Tensor x = Random(Shape(m, k), rng), w = Random(Shape(n, k), rng), b = Random(Shape(m, n), rng);
+					auto layer = dnn::LayerRegistry::CreateLayer("InnerProduct");
+					layer->Set("weight", w);
+					layer->Set("bias", b);
+					layer->CreatePipeline(opt);
+
+					Tensor hx, hy, y;
+					ToHalf(x, hx, bf16);
+					layer->Forward(hx, hy, opt);
+					Assert::IsTrue(Depth::D2 == hy.depth && hx.type == hy.type && Shape(m, n) == hy.shape);
+					ToFloat(hy, y);
+					for (uint i = 0; i < m; i++)
+					{
+						for (uint j = 0; j < n; j++)
+						{
+							double ref = b[i * n + j];
+							for (uint p = 0; p < k; p++) ref += (double)x[i * k + p] * w[j * k + p];
+							float eps = 1e-5f * (k + 1) + 2.1f * k * error + (float)std::fabs(ref) * error;
+							Assert::AreEqual((float)ref, y[i * n + j], eps);
+						}
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(Int8Arithmetic)
+		{
+			// x is quantized per row, so it adds the error of the weight once more
+			std::mt19937 rng(2);
+			uint sizes[][3] = { {1,37,19}, {2,64,30}, {37,65,300}, {130,270,40} };
+			dnn::Option int8;
+			int8.use_int8_arithmetic = true;
+			for (auto& s : sizes)
+			{
+				Check(s[0], s[1], s[2], rng, &int8, 2.f / 254);
+			}
+		}
+
+		TEST_METHOD(Int8Chain)
+		{
+			// a calibrated int8 top feeding an int8 bottom against the float layers
+			std::mt19937 rng(3);
+			uint m = 9, k = 70, n = 40, o = 33;
+			Tensor x = Random(Shape(m, k), rng);
+			Tensor w1 = Random(Shape(n, k), rng);
+			Tensor w2 = Random(Shape(o, n), rng);
+			dnn::Option int8;
+			int8.use_int8_arithmetic = true;
+
+			auto create = [&](const Tensor& w, bool quantized) {
+				auto layer = dnn::LayerRegistry::CreateLayer("InnerProduct");
+				layer->Set("weight", w);
+				layer->Set("activation_type", (int)dnn::RELU);
+				layer->CreatePipeline(quantized ? int8 : dnn::Option());
+				return layer;
+			};
+			Tensor h, y;
+			create(w1, false)->Forward(x, h, dnn::Option());
+			create(w2, false)->Forward(h, y, dnn::Option());
+
+			float scale_x = AbsMax(x, x.shape.vol()) / 127.f;
+			float scale_h = AbsMax(h, h.shape.vol()) / 127.f;
+			auto l1 = create(w1, true), l2 = create(w2, true);
+			l1->Set("input_scale", scale_x);
+			l1->Set("output_scale", scale_h);
+			l2->Set("input_scale", scale_h);
+			Tensor qh, qy;
+			l1->Forward(x, qh, dnn::Option());
+			Assert::IsTrue(Depth::D1 == qh.depth);
+			l2->Forward(qh, qy, dnn::Option());
+			Assert::IsTrue(Depth::D4 == qy.depth && Shape(m, o) == qy.shape);
+
+			float max = AbsMax(y, y.shape.vol());
+			for (uint i = 0; i < m * o; i++)
+			{
+				Assert::AreEqual(y[i], qy[i], 0.05f * max);
+			}
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,418 @@
+#include "core.hpp"
+
+#include "dnn/net.hpp"
+#include "dnn/calibrator.hpp"
+#include "core/tensor_file.hpp"
+#include "core/thread_pool.hpp"
+
+#include <filesystem>
+#include <set>
+
+namespace chaos
+{
+	class CountingAllocator : public Allocator
+	{
+	public:
+		virtual void* FastMalloc(size_t size) override { count++; return chaos::FastMalloc(size); }
+		virtual void FastFree(void* ptr) override { chaos::FastFree(ptr); }
+
+		size_t count = 0;
+	};
+
+	class CountingArena : public ArenaAllocator
+	{
+	public:
+		virtual void* FastMalloc(size_t size) override { count++; return ArenaAllocator::FastMalloc(size); }
+
+		std::atomic<size_t> count = 0;
+	};
+
+	// an in-place layer which records the most threads its ParallelFor ran on
+	class SpreadLayer : public dnn::Layer
+	{
+	public:
+		SpreadLayer() : Layer("Spread") { support_inplace = true; }
+
+		virtual void Forward(Tensor& blob, const dnn::Option& opt) const override { Spread(); }
+		virtual void Forward(std::vector<Tensor>& blobs, const dnn::Option& opt) const override { Spread(); }
+
+		mutable std::atomic<size_t> threads = 0;
+
+	private:
+		void Spread() const
+		{
+			// the other threads of the team find no ready layer and wait meanwhile
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			std::mutex lock;
+			std::set<std::thread::id> ids;
+			ParallelFor(0, 16, 1, [&](size_t, size_t) {
+				std::this_thread::sleep_for(std::chrono::microseconds(500));
+				std::lock_guard<std::mutex> guard(lock);
+				ids.insert(std::this_thread::get_id());
+			});
+			if (ids.size() > threads) threads = ids.size();
+		}
+	};
+
+	TEST_CLASS(NetTest)
+	{
+	public:
+		NetTest()
+		{
+			float xbuf[] = { 1,2,3,4, 5,6,7,8 };
+			float w1buf[] = { 1,0,0,0, 0,1,0,0, 0,0,1,1 };
+			float w2buf[] = { 1,1,1,1, 0,0,0,1, 2,0,0,0 };
+			X = Tensor(Shape(2, 4), Depth::D4, Packing::CHW, xbuf).Clone();
+			W1 = Tensor(Shape(3, 4), Depth::D4, Packing::CHW, w1buf).Clone();
+			W2 = Tensor(Shape(3, 4), Depth::D4, Packing::CHW, w2buf).Clone();
+		}
+
+		// out = x * (w1 + w2)^t, two branches joined by BinaryOp
+		Ptr<dnn::Net> CreateNet(const dnn::Option& opt)
+		{
+			auto net = dnn::Net::CreateNet();
+			net->SetOption(opt);
+			// add the layers out of order, the net should sort them
+			net->AddLayer("BinaryOp", "add", { "fc1", "fc2" }, { "sum" })->Set("op", dnn::BinOpType::ADD);
+			net->AddLayer("InnerProduct", "ip1", { "data" }, { "fc1" })->Set("weight", W1);
+			net->AddLayer("InnerProduct", "ip2", { "data" }, { "fc2" })->Set("weight", W2);
+			net->AddLayer("Noop", "noop", { "sum" }, { "out" });
+			return net;
+		}
+
+		void Check(const Tensor& out)
+		{
+			float expected[] = { 11,6,9, 31,14,25 };
+			Assert::AreEqual(size_t(6), out.shape.vol());
+			for (int i = 0; i < 6; i++)
+			{
+				Assert::AreEqual(expected[i], out[i], FLT_EPSILON * 10);
+			}
+		}
+
+		TEST_METHOD(Forward)
+		{
+			auto net = CreateNet(dnn::Option());
+			auto executor = net->BindExecutor();
+			executor->SetLayerData("data", X);
+			executor->Forward();
+
+			Tensor out;
+			executor->GetLayerData("out", out);
+			Check(out);
+
+			// intermediate blobs are kept without light mode
+			Tensor fc1;
+			executor->GetLayerData("fc1", fc1);
+			float expected[] = { 1,2,7, 5,6,15 };
+			for (int i = 0; i < 6; i++)
+			{
+				Assert::AreEqual(expected[i], fc1[i], FLT_EPSILON);
+			}
+		}
+
+		TEST_METHOD(StaticMemoryPlan)
+		{
+			CountingAllocator allocator;
+			dnn::Option opt;
+			opt.light_mode = true;
+			opt.blob_allocator = &allocator;
+
+			auto net = CreateNet(opt);
+			{
+				auto executor = net->BindExecutor();
+				executor->SetLayerData("data", X);
+
+				Tensor out;
+				executor->Forward(); // record
+				executor->GetLayerData("out", out);
+				Check(out);
+
+				size_t count = allocator.count;
+				for (int i = 0; i < 3; i++)
+				{
+					executor->Forward(); // replay
+					executor->GetLayerData("out", out);
+					Check(out);
+				}
+				// the arena is allocated once, after the recorded forward
+				Assert::AreEqual(count, allocator.count);
+			}
+
+			// a replay with a larger batch misses on the wide a, the blobs after it must not take
+			// the slots recorded for the ones before them: c took the slot of a, so d would overwrite fc
+			Tensor w1 = Tensor(Shape(64, 8), Depth::D4), w2 = Tensor(Shape(8, 64), Depth::D4), w3 = Tensor(Shape(8, 8), Depth::D4);
+			for (Tensor* w : { &w1, &w2, &w3 })
+			{
+				for (size_t i = 0; i < w->shape.vol(); i++) (*w)[i] = (float)(i % 5) / 8.f;
+			}
+			net = dnn::Net::CreateNet();
+			net->SetOption(opt);
+			net->AddLayer("InnerProduct", "ip1", { "data" }, { "a" })->Set("weight", w1);
+			net->AddLayer("InnerProduct", "ip2", { "a" }, { "fc" })->Set("weight", w2);
+			net->AddLayer("InnerProduct", "ip3", { "data" }, { "c" })->Set("weight", w3);
+			net->AddLayer("BinaryOp", "add1", { "fc", "c" }, { "d" })->Set("op", dnn::BinOpType::ADD);
+			net->AddLayer("BinaryOp", "add2", { "d", "fc" }, { "out" })->Set("op", dnn::BinOpType::ADD);
+			Tensor x1 = Tensor(Shape(1, 8), Depth::D4), x2 = Tensor(Shape(2, 8), Depth::D4);
+			for (int i = 0; i < 16; i++) x2[i] = (float)(i % 7) / 7.f;
+			for (int i = 0; i < 8; i++) x1[i] = x2[i];
+
+			Tensor expected, out;
+			auto reference = net->BindExecutor();
+			reference->SetLayerData("data", x2);
+			reference->Forward();
+			reference->GetLayerData("out", expected);
+
+			auto executor = net->BindExecutor();
+			executor->SetLayerData("data", x1);
+			executor->Forward(); // record
+			for (int i = 0; i < 2; i++)
+			{
+				executor->SetLayerData("data", x2);
+				executor->Forward(); // deviates, then records again
+				executor->GetLayerData("out", out);
+				for (int j = 0; j < 16; j++)
+				{
+					Assert::AreEqual(expected[j], out[j], FLT_EPSILON * 10);
+				}
+			}
+		}
+
+		TEST_METHOD(AllocatorSnapshot)
+		{
+			PoolAllocator pool;
+			{
+				dnn::Option opt;
+				opt.light_mode = true;
+				opt.blob_allocator = &pool;
+				opt.log_allocator_stats = true;
+				auto executor = CreateNet(opt)->BindExecutor();
+				executor->SetLayerData("data", X);
+				executor->Forward(); // record
+				executor->Forward(); // replay
+				AllocatorStats stats = pool.Snapshot();
+				// the arena of the plan is the one block in use
+				Assert::AreEqual(stats.mallocs, stats.frees + 1);
+				Assert::IsTrue(stats.in_use > 0);
+				Assert::IsTrue(stats.peak >= stats.in_use);
+
+				executor->Forward();
+				Tensor out;
+				executor->GetLayerData("out", out);
+				Check(out);
+				Assert::AreEqual(stats.mallocs, pool.Snapshot().mallocs);
+			}
+			Assert::AreEqual(size_t(0), pool.Snapshot().in_use);
+		}
+
+		TEST_METHOD(NodePool)
+		{
+			// an executor on the pool of a node, its blobs from the pages of that node
+			ThreadPool pool(2, false, 0);
+			PageAllocator pages(1, PageAllocator::LOCAL);
+			for (bool inter_op : { false, true })
+			{
+				dnn::Option opt;
+				opt.light_mode = true;
+				opt.use_inter_op_parallel = inter_op;
+				opt.blob_allocator = &pages;
+				auto executor = CreateNet(opt)->BindExecutor();
+				executor->SetThreadPool(&pool);
+				executor->SetLayerData("data", X);
+				for (int r = 0; r < 3; r++)
+				{
+					executor->Forward();
+					Tensor out;
+					executor->GetLayerData("out", out);
+					Check(out);
+				}
+				Assert::IsTrue(pages.Snapshot().blocks > 0);
+			}
+			Assert::AreEqual(size_t(0), pages.Snapshot().reserved);
+		}
+
+		TEST_METHOD(ArenaWorkspace)
+		{
+			// the batch of a padded 1x2x4 input is copied to the workspace by the InnerProducts
+			Tensor buffer = Tensor(Shape(1, 4, 4), Depth::D4);
+			Tensor x = Tensor(Shape(1, 2, 4), Depth::D4, Packing::CHW, buffer.data, Steps({ 16, 4, 1 }));
+			for (int i = 0; i < 8; i++) buffer[i] = X[i];
+			for (bool inter_op : { false, true })
+			{
+				CountingArena arena;
+				dnn::Option opt;
+				opt.light_mode = true;
+				opt.use_inter_op_parallel = inter_op;
+				opt.workspace_allocator = &arena;
+				auto executor = CreateNet(opt)->BindExecutor();
+				executor->SetLayerData("data", x);
+				size_t capacity = 0;
+				for (int r = 0; r < 3; r++)
+				{
+					executor->Forward();
+					Tensor out;
+					executor->GetLayerData("out", out);
+					Check(out);
+					// each layer gives its workspace back, the arena does not grow after the first Forward
+					Assert::AreEqual(size_t(0), arena.Used());
+					if (r == 0) capacity = arena.Capacity();
+					if (not inter_op) Assert::AreEqual(capacity, arena.Capacity());
+				}
+				Assert::AreEqual(size_t(6), arena.count);
+			}
+		}
+
+		TEST_METHOD(InterOpParallel)
+		{
+			// ip1 and ip2 are independent, in light mode the last reader of a blob releases it
+			for (bool light_mode : { false, true })
+			{
+				dnn::Option opt;
+				opt.light_mode = light_mode;
+				opt.use_inter_op_parallel = true;
+				auto executor = CreateNet(opt)->BindExecutor();
+				executor->SetLayerData("data", X);
+				for (int r = 0; r < 20; r++)
+				{
+					executor->Forward();
+					Tensor out;
+					executor->GetLayerData("out", out);
+					Check(out);
+				}
+			}
+		}
+
+		TEST_METHOD(WideInterOpParallel)
+		{
+			// a tree of 16 branches summed pairwise against the serial executor
+			auto create = [&](const dnn::Option& opt) {
+				auto net = dnn::Net::CreateNet();
+				net->SetOption(opt);
+				std::vector<std::string> level;
+				for (int i = 0; i < 16; i++)
+				{
+					level.push_back(Format("fc%d", i));
+					net->AddLayer("InnerProduct", Format("ip%d", i), { "data" }, { level.back() })->Set("weight", i % 2 ? W1 : W2);
+				}
+				for (int n = 0; level.size() > 1; n++)
+				{
+					std::vector<std::string> next;
+					for (size_t i = 0; i < level.size(); i += 2)
+					{
+						next.push_back(Format("sum%d_%d", n, (int)i));
+						net->AddLayer("BinaryOp", next.back(), { level[i], level[i + 1] }, { next.back() })->Set("op", dnn::BinOpType::ADD);
+					}
+					level = next;
+				}
+				net->AddLayer("Noop", "noop", { level[0] }, { "out" });
+				return net->BindExecutor();
+			};
+			auto serial = create(dnn::Option());
+			serial->SetLayerData("data", X);
+			serial->Forward();
+			Tensor expected;
+			serial->GetLayerData("out", expected);
+
+			dnn::Option opt;
+			opt.light_mode = true;
+			opt.use_inter_op_parallel = true;
+			auto parallel = create(opt);
+			parallel->SetLayerData("data", X);
+			for (int r = 0; r < 20; r++)
+			{
+				parallel->Forward();
+				Tensor out;
+				parallel->GetLayerData("out", out);
+				for (int i = 0; i < 6; i++)
+				{
+					Assert::AreEqual(expected[i], out[i]);
+				}
+			}
+		}
+
+		TEST_METHOD(NarrowAfterFork)
+		{
+			// the team of the fork of ip1 and ip2 covers the pool, the layer after the join still runs on all of it
+			// as the other member waits for a ready layer
+			dnn::LayerRegistry::AddCreator("Spread", []() { return Ptr<dnn::Layer>(new SpreadLayer()); });
+			ThreadPool pool(2);
+			auto net = dnn::Net::CreateNet();
+			dnn::Option opt;
+			opt.use_inter_op_parallel = true;
+			net->SetOption(opt);
+			net->AddLayer("InnerProduct", "ip1", { "data" }, { "fc1" })->Set("weight", W1);
+			net->AddLayer("InnerProduct", "ip2", { "data" }, { "fc2" })->Set("weight", W2);
+			net->AddLayer("BinaryOp", "add", { "fc1", "fc2" }, { "sum" })->Set("op", dnn::BinOpType::ADD);
+			auto spread = std::dynamic_pointer_cast<SpreadLayer>(net->AddLayer("Spread", "spread", { "sum" }, { "out" }));
+			auto executor = net->BindExecutor();
+			executor->SetThreadPool(&pool);
+			executor->SetLayerData("data", X);
+			for (int r = 0; r < 20; r++)
+			{
+				executor->Forward();
+				Tensor out;
+				executor->GetLayerData("out", out);
+				Check(out);
+			}
+			Assert::AreEqual(size_t(2), spread->threads.load());
+		}
+
+		TEST_METHOD(Calibrate)
+		{
+			dnn::Calibrator calibrator(CreateNet(dnn::Option()));
+			calibrator.Feed({ { "data", X } });
+			auto scales = calibrator.GetScales();
+			// the max of each blob up to a bin of the histogram
+			std::pair<const char*, float> maxes[] = { { "data", 8.f }, { "fc1", 15.f }, { "fc2", 26.f }, { "sum", 31.f } };
+			for (auto& [name, max] : maxes)
+			{
+				Assert::AreEqual(max / 127.f, scales[name], max / 127.f / 512);
+			}
+
+			// the int8 net quantizes data by the calibrated scale
+			dnn::Option opt;
+			opt.use_int8_arithmetic = true;
+			auto net = CreateNet(opt);
+			calibrator.Apply(net);
+			auto executor = net->BindExecutor();
+			executor->SetLayerData("data", X);
+			executor->Forward();
+			Tensor out;
+			executor->GetLayerData("out", out);
+			float expected[] = { 11,6,9, 31,14,25 };
+			for (int i = 0; i < 6; i++)
+			{
+				Assert::AreEqual(expected[i], out[i], 0.5f);
+			}
+		}
+
+		TEST_METHOD(LoadNet)
+		{
+			// the net of CreateNet as a graph text, the weights are mapped from the file
+			std::string file = (std::filesystem::temp_directory_path() / "chaos_net.bin").string();
+			std::string graph =
+				"# out = x * (w1 + w2)^t\n"
+				"BinaryOp add fc1,fc2 sum op=0\n"
+				"InnerProduct ip1 data fc1 weight=@ip1.weight\n"
+				"\n"
+				"InnerProduct ip2 data fc2 weight=@ip2.weight # the second branch\n"
+				"Noop noop sum out\n";
+			SaveTensors(file, { { "ip1.weight", W1 }, { "ip2.weight", W2 } }, graph);
+			{
+				auto net = dnn::Net::LoadNet(file);
+				Assert::AreEqual(size_t(4), net->GetLayers().size());
+				auto executor = net->BindExecutor();
+				executor->SetLayerData("data", X);
+				executor->Forward();
+				Tensor out;
+				executor->GetLayerData("out", out);
+				Check(out);
+			}
+			std::filesystem::remove(file);
+		}
+
+		Tensor X;
+		Tensor W1;
+		Tensor W2;
+	};
+}
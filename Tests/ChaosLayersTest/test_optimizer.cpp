@@ -0,0 +1,159 @@
+#include "core.hpp"
+
+#include "dnn/net.hpp"
+
+#include <random>
+
+namespace chaos
+{
+	TEST_CLASS(GraphOptimizerTest)
+	{
+	public:
+		GraphOptimizerTest()
+		{
+			std::mt19937 rng(0);
+			X = Random(Shape(2, 3, 4), rng);
+			R = Random(Shape(2, 3, 5), rng);
+			B = Random(Shape(5), rng);
+			W1 = Random(Shape(5, 4), rng);
+			W2 = Random(Shape(5, 4), rng);
+		}
+
+		static Tensor Orders(std::vector<float> orders)
+		{
+			return Tensor(Shape((uint)orders.size()), Depth::D4, Packing::CHW, orders.data()).Clone();
+		}
+
+		// every pass has a chance, the layers are added out of order
+		Ptr<dnn::Net> CreateNet(const dnn::Option& opt)
+		{
+			float clip[] = { -0.5f, 0.5f };
+			auto net = dnn::Net::CreateNet();
+			net->SetOption(opt);
+			// permutes which cancel in front of ip1
+			net->AddLayer("Permute", "p1", { "data" }, { "t1" })->Set("orders", Orders({ 1,0,2 }));
+			net->AddLayer("Permute", "p2", { "t1" }, { "t2" })->Set("orders", Orders({ 1,0,2 }));
+			// out = relu(t2 * w1^t + res)
+			net->AddLayer("BinaryOp", "add1", { "fc1", "res" }, { "sum1" })->Set("op", dnn::BinOpType::ADD);
+			net->AddLayer("InnerProduct", "ip1", { "t2" }, { "fc1" })->Set("weight", W1);
+			net->AddLayer("Activation", "relu", { "sum1" }, { "act1" })->Set("activation_type", (int)dnn::RELU);
+			net->AddLayer("Noop", "noop", { "act1" }, { "out" });
+			// out2 = clip(row + data * w2^t)
+			net->AddLayer("InnerProduct", "ip2", { "data" }, { "fc2" })->Set("weight", W2);
+			net->AddLayer("BinaryOp", "add2", { "row", "fc2" }, { "sum2" })->Set("op", dnn::BinOpType::ADD);
+			auto act = net->AddLayer("Activation", "clip", { "sum2" }, { "out2" });
+			act->Set("activation_type", (int)dnn::CLIP);
+			act->Set("activation_params", Tensor(Shape(2), Depth::D4, Packing::CHW, clip).Clone());
+			// two permutes which compose to { 2,0,1 }
+			net->AddLayer("Permute", "p3", { "data" }, { "t3" })->Set("orders", Orders({ 0,2,1 }));
+			net->AddLayer("Permute", "p4", { "t3" }, { "perm" })->Set("orders", Orders({ 1,0,2 }));
+			return net;
+		}
+
+		std::vector<Tensor> Run(const Ptr<dnn::Net>& net)
+		{
+			auto executor = net->BindExecutor();
+			executor->SetLayerData("data", X);
+			executor->SetLayerData("res", R);
+			executor->SetLayerData("row", B);
+			executor->Forward();
+			std::vector<Tensor> outs(3);
+			executor->GetLayerData("out", outs[0]);
+			executor->GetLayerData("out2", outs[1]);
+			executor->GetLayerData("perm", outs[2]);
+			return outs;
+		}
+
+		TEST_METHOD(Fusions)
+		{
+			auto expected = Run(CreateNet(dnn::Option()));
+
+			auto net = CreateNet(dnn::Option());
+			auto report = net->Optimize();
+			// p1 + p2, the identity, add1, relu, noop, add2, clip, p3 + p4
+			Assert::AreEqual(size_t(8), report.size());
+			const auto& layers = net->GetLayers();
+			Assert::AreEqual(size_t(3), layers.size());
+			for (const auto& layer : layers)
+			{
+				Assert::IsTrue(layer->type == "InnerProduct" || layer->name == "p3");
+			}
+
+			// and the nets optimized by BindExecutor
+			std::vector<Ptr<dnn::Net>> nets = { net };
+			for (bool light_mode : { false, true })
+			{
+				dnn::Option opt;
+				opt.light_mode = light_mode;
+				opt.use_graph_optimization = true;
+				nets.push_back(CreateNet(opt));
+			}
+			for (const auto& optimized : nets)
+			{
+				auto outs = Run(optimized);
+				for (size_t n = 0; n < outs.size(); n++)
+				{
+					Assert::IsTrue(expected[n].shape == outs[n].shape);
+					for (size_t i = 0; i < outs[n].shape.vol(); i++)
+					{
+						Assert::AreEqual(expected[n][i], outs[n][i], 1e-6f);
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(SharedBlobs)
+		{
+			// fc is read twice and out is an output, nothing can go
+			auto net = dnn::Net::CreateNet();
+			net->AddLayer("InnerProduct", "ip", { "data" }, { "fc" })->Set("weight", W1);
+			net->AddLayer("BinaryOp", "add", { "fc", "res" }, { "sum" })->Set("op", dnn::BinOpType::ADD);
+			net->AddLayer("Noop", "noop", { "fc" }, { "out" });
+			Assert::AreEqual(size_t(0), net->Optimize().size());
+			Assert::AreEqual(size_t(3), net->GetLayers().size());
+		}
+
+		TEST_METHOD(BroadcastBias)
+		{
+			// the adds which are not a row of fc: a column which has the size of a row, a scalar and a larger left operand
+			std::mt19937 rng(1);
+			Tensor x = Random(Shape(5, 4), rng);
+			Tensor others[] = { Random(Shape(5, 1), rng), Random(Shape(1), rng), Random(Shape(3, 5, 5), rng) };
+			for (const Tensor& other : others)
+			{
+				for (bool left : { false, true })
+				{
+					auto create = [&](bool optimize) {
+						dnn::Option opt;
+						opt.use_graph_optimization = optimize;
+						auto net = dnn::Net::CreateNet();
+						net->SetOption(opt);
+						net->AddLayer("InnerProduct", "ip", { "data" }, { "fc" })->Set("weight", W1);
+						std::vector<std::string> bottoms = left ? std::vector<std::string>{ "other", "fc" } : std::vector<std::string>{ "fc", "other" };
+						net->AddLayer("BinaryOp", "add", bottoms, { "sum" })->Set("op", dnn::BinOpType::ADD);
+						net->AddLayer("Activation", "relu", { "sum" }, { "out" })->Set("activation_type", (int)dnn::RELU);
+						auto executor = net->BindExecutor();
+						executor->SetLayerData("data", x);
+						executor->SetLayerData("other", other);
+						executor->Forward();
+						Tensor out;
+						executor->GetLayerData("out", out);
+						return out;
+					};
+					Tensor expected = create(false), out = create(true);
+					Assert::IsTrue(expected.shape == out.shape);
+					for (size_t i = 0; i < out.shape.vol(); i++)
+					{
+						Assert::AreEqual(expected[i], out[i], 1e-6f);
+					}
+				}
+			}
+		}
+
+		Tensor X;
+		Tensor R;
+		Tensor B;
+		Tensor W1;
+		Tensor W2;
+	};
+}
\ No newline at end of file
@@ -17,7 +17,22 @@ namespace chaos
 		TEST_METHOD(P233)
 		{
 			auto layer = dnn::LayerRegistry::CreateLayer("Permute");
-			
+			float orders[] = { 2,0,1 };
+			layer->Set("orders", Tensor(Shape(3), Depth::D4, Packing::CHW, orders));
+
+			Tensor B;
+			layer->Forward(A233, B, dnn::Option());
+			Assert::IsTrue(Shape(3, 2, 3) == B.shape);
+			for (size_t w = 0; w < 3; w++)
+			{
+				for (size_t c = 0; c < 2; c++)
+				{
+					for (size_t h = 0; h < 3; h++)
+					{
+						Assert::AreEqual(A233[c * 9 + h * 3 + w], B[(w * 2 + c) * 3 + h]);
+					}
+				}
+			}
 		}
 
 		Tensor A233;
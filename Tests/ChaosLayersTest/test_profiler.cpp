@@ -0,0 +1,149 @@
+#include "core.hpp"
+
+#include "dnn/net.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace chaos
+{
+	TEST_CLASS(ProfilerTest)
+	{
+	public:
+		ProfilerTest()
+		{
+			X = Tensor(Shape(2, 4), Depth::D4);
+			W = Tensor(Shape(3, 4), Depth::D4);
+			for (size_t i = 0; i < X.shape.vol(); i++) X[i] = (float)i;
+			for (size_t i = 0; i < W.shape.vol(); i++) W[i] = (float)(i % 3);
+		}
+
+		// the branches ip1 and ip2 joined by add, in the order ip1 ip2 add noop
+		Ptr<dnn::Executor> CreateExecutor(const dnn::Option& opt)
+		{
+			auto net = dnn::Net::CreateNet();
+			net->SetOption(opt);
+			net->AddLayer("InnerProduct", "ip1", { "data" }, { "fc1" })->Set("weight", W);
+			net->AddLayer("InnerProduct", "ip2", { "data" }, { "fc2" })->Set("weight", W);
+			net->AddLayer("BinaryOp", "add", { "fc1", "fc2" }, { "sum" })->Set("op", dnn::BinOpType::ADD);
+			net->AddLayer("Noop", "noop", { "sum" }, { "out" });
+			auto executor = net->BindExecutor();
+			executor->SetLayerData("data", X);
+			return executor;
+		}
+
+		static size_t Count(const std::string& text, const std::string& pattern)
+		{
+			size_t count = 0;
+			for (size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + 1)) count++;
+			return count;
+		}
+
+		TEST_METHOD(Layers)
+		{
+			auto executor = CreateExecutor(dnn::Option());
+			dnn::Profiler profiler;
+			executor->SetProfiler(&profiler);
+			executor->Forward();
+			executor->Forward();
+			Assert::AreEqual(size_t(8), profiler.profiles.size());
+
+			const char* names[] = { "ip1", "ip2", "add", "noop" };
+			double flops[] = { 2. * 4 * 6, 2. * 4 * 6, 6., 0. };
+			for (size_t i = 0; i < profiler.profiles.size(); i++)
+			{
+				const dnn::LayerProfile& profile = profiler.profiles[i];
+				Assert::AreEqual(std::string(names[i % 4]), profile.name);
+				Assert::AreEqual(flops[i % 4], profile.flops);
+				Assert::AreEqual(0, profile.thread);
+				Assert::IsTrue(profile.begin <= profile.end);
+				Assert::IsTrue(Shape(2, 3) == profile.tops_shapes[0]);
+				// the replayed Forward asks the same of the allocators
+				Assert::AreEqual(profiler.profiles[i % 4].mallocs, profile.mallocs);
+			}
+			const dnn::LayerProfile& ip1 = profiler.profiles[0];
+			Assert::IsTrue(Shape(2, 4) == ip1.bottoms_shapes[0]);
+			Assert::AreEqual(size_t(8 * 4 + 6 * 4), ip1.bytes);
+			Assert::AreEqual(size_t(1), ip1.mallocs);
+			Assert::IsTrue(ip1.malloc_bytes >= size_t(6 * 4));
+			Assert::AreEqual(size_t(2), profiler.profiles[2].bottoms_shapes.size());
+
+			// no more records without the profiler
+			executor->SetProfiler(nullptr);
+			executor->Forward();
+			Assert::AreEqual(size_t(8), profiler.profiles.size());
+			profiler.Clear();
+			Assert::IsTrue(profiler.profiles.empty());
+		}
+
+		TEST_METHOD(Reports)
+		{
+			dnn::Option opt;
+			opt.light_mode = true;
+			auto executor = CreateExecutor(opt);
+			dnn::Profiler profiler;
+			executor->SetProfiler(&profiler);
+			for (int r = 0; r < 3; r++) executor->Forward();
+
+			std::string trace = profiler.ChromeTrace();
+			Assert::AreEqual(size_t(1), Count(trace, "\"traceEvents\":["));
+			Assert::AreEqual(size_t(12), Count(trace, "\"ph\":\"X\""));
+			Assert::AreEqual(size_t(3), Count(trace, "\"name\":\"ip2\""));
+			Assert::AreEqual(size_t(6), Count(trace, "\"bottoms\":\"[2,4]\""));
+
+			auto file = (std::filesystem::temp_directory_path() / "chaos_profiler_test.json").string();
+			profiler.SaveChromeTrace(file);
+			std::ifstream stream(file, std::ios::binary);
+			std::stringstream saved;
+			saved << stream.rdbuf();
+			stream.close();
+			std::filesystem::remove(file);
+			Assert::AreEqual(trace, saved.str());
+
+			// a header and a line per layer with its 3 runs
+			std::string summary = profiler.Summary();
+			Assert::AreEqual(size_t(5), Count(summary, "\n"));
+			for (const char* name : { "ip1", "ip2", "add", "noop" })
+			{
+				Assert::IsTrue(summary.find(name) != std::string::npos);
+			}
+			Assert::AreEqual(size_t(4), Count(summary, "      3 "));
+		}
+
+		TEST_METHOD(Branches)
+		{
+			dnn::Option opt;
+			opt.light_mode = true;
+			opt.use_inter_op_parallel = true;
+			auto executor = CreateExecutor(opt);
+			dnn::Profiler profiler;
+			executor->SetProfiler(&profiler);
+			for (int r = 0; r < 20; r++) executor->Forward();
+
+			// every layer once per Forward, add after both branches
+			Assert::AreEqual(size_t(80), profiler.profiles.size());
+			int runs[4] = {};
+			for (const auto& profile : profiler.profiles)
+			{
+				runs[profile.layer_idx]++;
+				Assert::IsTrue(Shape(2, 3) == profile.tops_shapes[0]);
+			}
+			for (int r : runs) Assert::AreEqual(20, r);
+			for (size_t f = 0; f < 20; f++)
+			{
+				int64 branches_end = 0, add_begin = 0;
+				for (size_t i = f * 4; i < f * 4 + 4; i++)
+				{
+					const auto& profile = profiler.profiles[i];
+					if (profile.layer_idx < 2) branches_end = std::max(branches_end, profile.end);
+					if (profile.layer_idx == 2) add_begin = profile.begin;
+				}
+				Assert::IsTrue(branches_end <= add_begin);
+			}
+		}
+
+		Tensor X;
+		Tensor W;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,387 @@
+#include "core.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
+namespace chaos
+{
+	TEST_CLASS(AllocatorTest)
+	{
+	public:
+		AllocatorTest() {}
+
+		TEST_METHOD(PoolReuse)
+		{
+			PoolAllocator pool;
+			void* a = pool.FastMalloc(100);
+			Assert::IsTrue(((size_t)a % MALLOC_ALIGN) == 0);
+			memset(a, 0xff, 100);
+			pool.FastFree(a);
+
+			// 100 and 110 fall in the same class (96, 112], the block is reused
+			void* b = pool.FastMalloc(110);
+			Assert::IsTrue(a == b);
+			// 200 does not
+			void* c = pool.FastMalloc(200);
+			Assert::IsTrue(c != b);
+
+			pool.FastFree(b);
+			pool.FastFree(c);
+		}
+
+		TEST_METHOD(UnlockedPoolReuse)
+		{
+			UnlockedPoolAllocator pool;
+			void* a = pool.FastMalloc(1 << 20);
+			void* b = pool.FastMalloc(1 << 20);
+			pool.FastFree(a);
+			pool.FastFree(b);
+			// LIFO, the last freed block comes first
+			Assert::IsTrue(b == pool.FastMalloc(1 << 20));
+			Assert::IsTrue(a == pool.FastMalloc((1 << 20) - 1000));
+			pool.FastFree(a);
+			pool.FastFree(b);
+		}
+
+		TEST_METHOD(PoolConcurrent)
+		{
+			PoolAllocator pool;
+			auto worker = [&pool](int seed) {
+				std::vector<uchar*> ptrs;
+				for (int i = 0; i < 20000; i++)
+				{
+					size_t size = 16 + (size_t)((i * 7919 + seed * 104729) % 4096);
+					uchar* ptr = (uchar*)pool.FastMalloc(size);
+					ptr[0] = ptr[size - 1] = (uchar)seed;
+					ptrs.push_back(ptr);
+					if (ptrs.size() > 16)
+					{
+						// nobody else may have written the block while we own it
+						uchar* p = ptrs[i % ptrs.size()];
+						Assert::IsTrue(p[0] == (uchar)seed);
+						pool.FastFree(p);
+						ptrs[i % ptrs.size()] = ptrs.back();
+						ptrs.pop_back();
+					}
+				}
+				for (uchar* p : ptrs)
+					pool.FastFree(p);
+			};
+
+			std::vector<std::thread> threads;
+			for (int t = 0; t < 4; t++)
+				threads.emplace_back(worker, t + 1);
+			for (auto& t : threads)
+				t.join();
+		}
+
+		TEST_METHOD(PoolStats)
+		{
+			PoolAllocator pool;
+			void* a = pool.FastMalloc(100);
+			void* b = pool.FastMalloc(1000);
+			AllocatorStats stats = pool.Snapshot();
+			Assert::AreEqual(size_t(1100), stats.in_use);
+			// 100 in the class of 112, 1000 in the class of 1024
+			Assert::AreEqual(size_t(12 + 24), stats.wasted);
+			Assert::AreEqual(size_t(2), stats.misses);
+			Assert::AreEqual(size_t(2), stats.blocks);
+			Assert::AreEqual(size_t(112 + 1024), stats.reserved);
+			pool.FastFree(a);
+			pool.FastFree(b);
+
+			a = pool.FastMalloc(110);
+			stats = pool.Snapshot();
+			Assert::AreEqual(size_t(110), stats.in_use);
+			Assert::AreEqual(size_t(1100), stats.peak);
+			Assert::AreEqual(size_t(2), stats.wasted);
+			Assert::AreEqual(size_t(3), stats.mallocs);
+			Assert::AreEqual(size_t(2), stats.frees);
+			Assert::AreEqual(size_t(1), stats.hits);
+			Assert::AreEqual(1. / 3., stats.HitRate(), 1e-9);
+			Assert::AreEqual(1. - 110. / (112 + 1024), stats.Fragmentation(), 1e-9);
+			Assert::AreEqual(size_t(2), stats.class_mallocs[SizeClassOf(100)]);
+			Assert::AreEqual(size_t(1), stats.class_mallocs.back());
+			Assert::AreEqual(size_t(1024), PoolAllocator::ClassBytes((int)stats.class_mallocs.size() - 1));
+			Assert::IsTrue(stats.ToString().find("1.0 KB:1") != std::string::npos);
+			pool.FastFree(a);
+
+			pool.Clear();
+			stats = pool.Snapshot();
+			Assert::AreEqual(size_t(0), stats.blocks);
+			Assert::AreEqual(size_t(0), stats.reserved);
+			Assert::AreEqual(size_t(0), stats.in_use);
+
+			// the peak between the snapshots is seen only when it is tracked
+			for (bool track_peak : { false, true })
+			{
+				PoolAllocator tracked(track_peak);
+				tracked.FastFree(tracked.FastMalloc(1000));
+				Assert::AreEqual(track_peak ? size_t(1000) : size_t(0), tracked.Snapshot().peak);
+			}
+		}
+
+		TEST_METHOD(UnlockedPoolStats)
+		{
+			UnlockedPoolAllocator pool;
+			void* a = pool.FastMalloc(100);
+			void* b = pool.FastMalloc(1000);
+			pool.FastFree(a);
+			pool.FastFree(b);
+			a = pool.FastMalloc(110);
+			AllocatorStats stats = pool.Snapshot();
+			Assert::AreEqual(size_t(110), stats.in_use);
+			Assert::AreEqual(size_t(1100), stats.peak);
+			Assert::AreEqual(size_t(2), stats.wasted);
+			Assert::AreEqual(size_t(3), stats.mallocs);
+			Assert::AreEqual(size_t(1), stats.hits);
+			Assert::AreEqual(size_t(2), stats.blocks);
+			Assert::AreEqual(size_t(112 + 1024), stats.reserved);
+			Assert::AreEqual(size_t(2), stats.class_mallocs[SizeClassOf(100)]);
+			pool.FastFree(a);
+			pool.Clear();
+			Assert::AreEqual(size_t(0), pool.Snapshot().reserved);
+		}
+
+		// the class of a size by its bytes
+		static size_t SizeClassOf(size_t size)
+		{
+			int cls = 0;
+			while (PoolAllocator::ClassBytes(cls) < size) cls++;
+			return cls;
+		}
+
+		TEST_METHOD(PagePolicies)
+		{
+			Assert::IsTrue(PageAllocator::NumNodes() >= 1);
+			int current = PageAllocator::CurrentNode();
+			Assert::IsTrue(current >= 0 && current < PageAllocator::NumNodes());
+			for (auto policy : { PageAllocator::ANY, PageAllocator::LOCAL, PageAllocator::BIND, PageAllocator::INTERLEAVE })
+			{
+				PageAllocator pages(1 << 16, policy, PageAllocator::NumNodes() - 1);
+				// from FastMalloc below the threshold, mapped above
+				uchar* small = (uchar*)pages.FastMalloc(1000);
+				Assert::IsTrue(((size_t)small % MALLOC_ALIGN) == 0);
+				Assert::AreEqual(size_t(0), pages.Snapshot().blocks);
+				size_t size = (5 << 20) + 100;
+				uchar* large = (uchar*)pages.FastMalloc(size);
+				Assert::IsTrue(((size_t)large % MALLOC_ALIGN) == 0);
+				// every stripe of an interleaved block is committed
+				memset(large, 0x5a, size);
+				memset(small, 0x5a, 1000);
+				Assert::IsTrue(large[size - 1] == 0x5a && large[2 << 20] == 0x5a);
+
+				AllocatorStats stats = pages.Snapshot();
+				Assert::AreEqual(size_t(1), stats.blocks);
+				Assert::IsTrue(stats.reserved >= size + MALLOC_ALIGN);
+				Assert::AreEqual(stats.reserved - size, stats.wasted);
+				Assert::AreEqual(size + 1000, stats.in_use);
+				Assert::IsTrue(pages.LargePageBytes() == 0 || pages.LargePageBytes() == stats.reserved);
+				pages.FastFree(large);
+				pages.FastFree(small);
+				stats = pages.Snapshot();
+				Assert::AreEqual(size_t(0), stats.reserved);
+				Assert::AreEqual(size + 1000, stats.peak);
+			}
+		}
+
+		TEST_METHOD(ThreadCacheReuse)
+		{
+			PoolAllocator pool;
+			ThreadCachingAllocator cache(&pool, 4096);
+			void* a = cache.FastMalloc(100);
+			Assert::IsTrue(((size_t)a % MALLOC_ALIGN) == 0);
+			cache.FastFree(a);
+			// the class of 112 bytes is cached
+			Assert::AreEqual(size_t(112), cache.Cached());
+			Assert::IsTrue(a == cache.FastMalloc(110));
+			Assert::AreEqual(size_t(0), cache.Cached());
+			cache.FastFree(a);
+
+			// above an eighth of the bound, not cached
+			void* b = cache.FastMalloc(1000);
+			cache.FastFree(b);
+			Assert::AreEqual(size_t(112), cache.Cached());
+
+			// the bound, 16 x 448 bytes do not fit in 4096
+			std::vector<void*> ptrs;
+			for (int i = 0; i < 16; i++) ptrs.push_back(cache.FastMalloc(400));
+			for (void* p : ptrs) cache.FastFree(p);
+			Assert::IsTrue(cache.Cached() <= 4096);
+			Assert::IsTrue(cache.Cached() > 4096 - 448);
+
+			cache.Flush();
+			Assert::AreEqual(size_t(0), cache.Cached());
+		}
+
+		TEST_METHOD(ThreadCacheRemoteFree)
+		{
+			PoolAllocator pool;
+			ThreadCachingAllocator cache(&pool);
+			// a producer allocates, a consumer frees, the blocks come back to the producer by batch
+			std::vector<void*> ptrs;
+			for (int i = 0; i < ThreadCachingAllocator::batch_size * 2; i++) ptrs.push_back(cache.FastMalloc(256));
+			std::thread consumer([&]() {
+				for (void* p : ptrs) cache.FastFree(p);
+				Assert::AreEqual(size_t(0), cache.Cached());
+			});
+			consumer.join();
+			Assert::AreEqual(size_t(0), cache.Cached());
+			void* p = cache.FastMalloc(256);
+			Assert::IsTrue(std::find(ptrs.begin(), ptrs.end(), p) != ptrs.end());
+			Assert::AreEqual(size_t(256 * (ptrs.size() - 1)), cache.Cached());
+			cache.FastFree(p);
+
+			// a partial batch waits for the flush of the consumer
+			void* q = cache.FastMalloc(64);
+			std::thread flusher([&]() {
+				cache.FastFree(q);
+				cache.Flush();
+			});
+			flusher.join();
+			Assert::IsTrue(q == cache.FastMalloc(64));
+			cache.FastFree(q);
+			cache.Flush();
+			Assert::AreEqual(size_t(0), cache.Cached());
+		}
+
+		TEST_METHOD(ThreadCacheConcurrent)
+		{
+			PoolAllocator pool;
+			{
+				ThreadCachingAllocator cache(&pool, 1 << 16);
+				// each thread frees the blocks of its neighbour through a mailbox
+				constexpr int num_threads = 4;
+				std::mutex lock;
+				std::vector<uchar*> mailboxes[num_threads];
+				auto worker = [&](int seed) {
+					std::vector<uchar*> ptrs;
+					for (int i = 0; i < 20000; i++)
+					{
+						size_t size = 16 + (size_t)((i * 7919 + seed * 104729) % 4096);
+						uchar* ptr = (uchar*)cache.FastMalloc(size);
+						ptr[0] = ptr[size - 1] = (uchar)seed;
+						ptrs.push_back(ptr);
+						if (ptrs.size() > 16)
+						{
+							uchar* p = ptrs[i % ptrs.size()];
+							Assert::IsTrue(p[0] == (uchar)seed);
+							ptrs[i % ptrs.size()] = ptrs.back();
+							ptrs.pop_back();
+							if (i % 2) cache.FastFree(p);
+							else
+							{
+								std::lock_guard<std::mutex> guard(lock);
+								mailboxes[(seed + 1) % num_threads].push_back(p);
+							}
+						}
+						if (i % 64 == 0)
+						{
+							std::vector<uchar*> mail;
+							{
+								std::lock_guard<std::mutex> guard(lock);
+								mail.swap(mailboxes[seed]);
+							}
+							for (uchar* p : mail) cache.FastFree(p);
+						}
+					}
+					for (uchar* p : ptrs) cache.FastFree(p);
+				};
+
+				std::vector<std::thread> threads;
+				for (int t = 0; t < num_threads; t++)
+					threads.emplace_back(worker, t);
+				for (auto& t : threads)
+					t.join();
+				for (auto& mail : mailboxes)
+				{
+					for (uchar* p : mail) cache.FastFree(p);
+				}
+			}
+			// every block went back to the pool, or its destructor would fail
+		}
+
+		TEST_METHOD(ArenaRewind)
+		{
+			ArenaAllocator arena(1024);
+			uchar* a = (uchar*)arena.FastMalloc(100);
+			Assert::IsTrue(((size_t)a % MALLOC_ALIGN) == 0);
+			// bumped to the next line
+			Assert::IsTrue(a + 128 == arena.FastMalloc(10));
+			auto mark = arena.Mark();
+			void* b = arena.FastMalloc(500);
+			Assert::AreEqual(size_t(128 + 64 + 512), arena.Used());
+			arena.Rewind(mark);
+			Assert::IsTrue(b == arena.FastMalloc(200));
+
+			// out of the chunk, another twice as large
+			arena.FastMalloc(1000);
+			Assert::AreEqual(size_t(1024 + 2048), arena.Capacity());
+			arena.Rewind(mark);
+			Assert::IsTrue(b == arena.FastMalloc(300));
+			// the reset merges the chunks so the next request fits in one
+			arena.Reset();
+			Assert::AreEqual(size_t(0), arena.Used());
+			Assert::AreEqual(size_t(1024 + 2048), arena.Capacity());
+			uchar* c = (uchar*)arena.FastMalloc(3000);
+			memset(c, 0xff, 3000);
+			Assert::AreEqual(size_t(1024 + 2048), arena.Capacity());
+		}
+
+		TEST_METHOD(ArenaThreads)
+		{
+			ArenaAllocator arena(4096);
+			auto worker = [&arena](int seed) {
+				for (int r = 0; r < 100; r++)
+				{
+					auto mark = arena.Mark();
+					std::vector<uchar*> ptrs;
+					for (int i = 0; i < 50; i++)
+					{
+						size_t size = 16 + (size_t)((i * 7919 + seed * 104729) % 1000);
+						ptrs.push_back((uchar*)arena.FastMalloc(size));
+						memset(ptrs.back(), seed, size);
+					}
+					// every thread bumps its own arena
+					for (uchar* p : ptrs) Assert::IsTrue(p[0] == (uchar)seed);
+					arena.Rewind(mark);
+				}
+				Assert::AreEqual(size_t(0), arena.Used());
+			};
+
+			std::vector<std::thread> threads;
+			for (int t = 0; t < 4; t++)
+				threads.emplace_back(worker, t + 1);
+			for (auto& t : threads)
+				t.join();
+			Assert::AreEqual(size_t(0), arena.Capacity());
+		}
+
+		TEST_METHOD(Workspace)
+		{
+			ArenaAllocator arena;
+			Assert::IsTrue(WorkspaceScope::Current() == nullptr);
+			{
+				WorkspaceScope scope(&arena);
+				Assert::IsTrue(WorkspaceScope::Current() == &arena);
+				// the stack first, then the workspace
+				WorkBuffer<float, 16> small(16);
+				Assert::AreEqual(size_t(0), arena.Used());
+				WorkBuffer<float, 16> large(100);
+				Assert::AreEqual(size_t(448), arena.Used());
+				Assert::AreEqual(size_t(100), large.size());
+
+				// Invert takes its scratch from the arena
+				Tensor a = Tensor(Shape(40, 40), Depth::D4), inv;
+				for (int i = 0; i < 1600; i++) a[i] = i % 41 == 0 ? 2.f : 0.f;
+				auto mark = arena.Mark();
+				Invert(a, inv, DECOMP_LU);
+				Assert::IsTrue(arena.Used() > 448);
+				arena.Rewind(mark);
+				Assert::AreEqual(0.5f, inv[41], FLT_EPSILON);
+			}
+			Assert::IsTrue(WorkspaceScope::Current() == nullptr);
+		}
+	};
+}
\ No newline at end of file
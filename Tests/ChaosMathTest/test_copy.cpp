@@ -69,5 +69,53 @@ namespace chaos
 				}
 			}
 		}
+
+		TEST_METHOD(StridedViewCopyTo)
+		{
+			// every other column of a 2x3x8 buffer, the channels are padded to 32
+			float buf[64];
+			for (int i = 0; i < 64; i++) buf[i] = (float)i;
+			Tensor A = Tensor(Shape(2, 3, 4), Depth::D4, Packing::CHW, buf, { 32,8,2 });
+			Tensor B;
+			A.CopyTo(B);
+			Assert::IsTrue(B.continua());
+			for (int c = 0; c < 2; c++)
+			{
+				for (int r = 0; r < 3; r++)
+				{
+					for (int w = 0; w < 4; w++)
+					{
+						Assert::AreEqual(buf[c * 32 + r * 8 + w * 2], B[(c * 3 + r) * 4 + w], FLT_EPSILON);
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(MoveTensor)
+		{
+			Tensor A = Tensor(Shape(2, 3), Depth::D4, Packing::CHW);
+			int* ref_cnt = A.ref_cnt;
+			void* data = A.data;
+			// the counter has its own cache line in front of the data
+			Assert::IsTrue((uchar*)data - (uchar*)ref_cnt == 64);
+			Assert::IsTrue(((size_t)data % MALLOC_ALIGN) == 0);
+
+			Tensor B = std::move(A);
+			Assert::IsTrue(A.data == nullptr && A.ref_cnt == nullptr);
+			Assert::IsTrue(B.data == data && B.ref_cnt == ref_cnt);
+			Assert::AreEqual(1, *B.ref_cnt);
+			Assert::IsTrue(Shape(2, 3) == B.shape);
+
+			Tensor C = B;
+			Assert::AreEqual(2, *B.ref_cnt);
+			C = std::move(B); // same data, B's reference moves to C and C's own goes away
+			Assert::AreEqual(1, *C.ref_cnt);
+			Assert::IsTrue(B.empty());
+
+			std::vector<Tensor> tensors;
+			for (int i = 0; i < 16; i++)
+				tensors.push_back(C); // reallocations move the elements
+			Assert::AreEqual(17, *C.ref_cnt);
+		}
 	};
 }
\ No newline at end of file
@@ -0,0 +1,232 @@
+#include "core.hpp"
+
+#include "math/gemm.hpp"
+
+#include <random>
+
+namespace chaos
+{
+	TEST_CLASS(GemmTest)
+	{
+	public:
+		GemmTest() {}
+
+		static void Random(std::vector<float>& data, size_t size, std::mt19937& rng)
+		{
+			std::uniform_real_distribution<float> dist(-1.f, 1.f);
+			data.resize(size);
+			for (auto& v : data) v = dist(rng);
+		}
+
+		// c = alpha * op(a) * op(b) + beta * c in double
+		static void Reference(bool ta, bool tb, int m, int n, int k, float alpha, const float* A, size_t lda,
+			const float* B, size_t ldb, float beta, float* C, size_t ldc)
+		{
+			for (int i = 0; i < m; i++)
+			{
+				for (int j = 0; j < n; j++)
+				{
+					double s = 0;
+					for (int p = 0; p < k; p++)
+						s += (double)(ta ? A[p * lda + i] : A[i * lda + p]) * (tb ? B[j * ldb + p] : B[p * ldb + j]);
+					C[i * ldc + j] = (float)(alpha * s + (beta == 0.f ? 0. : (double)beta * C[i * ldc + j]));
+				}
+			}
+		}
+
+		static void Check(bool ta, bool tb, int m, int n, int k, float alpha, float beta, std::mt19937& rng)
+		{
+			// padded rows to test the leading dimensions
+			size_t lda = (ta ? m : k) + 3, ldb = (tb ? k : n) + 1, ldc = n + 5;
+			std::vector<float> A, B, C;
+			Random(A, (ta ? k : m) * lda, rng);
+			Random(B, (tb ? n : k) * ldb, rng);
+			Random(C, m * ldc, rng);
+			std::vector<float> R = C;
+
+			Gemm(ta, tb, m, n, k, alpha, A.data(), lda, B.data(), ldb, beta, C.data(), ldc);
+			Reference(ta, tb, m, n, k, alpha, A.data(), lda, B.data(), ldb, beta, R.data(), ldc);
+
+			float eps = 1e-5f * (k + 1);
+			for (int i = 0; i < m; i++)
+			{
+				for (int j = 0; j < n; j++)
+				{
+					Assert::AreEqual(R[i * ldc + j], C[i * ldc + j], eps);
+				}
+				for (size_t j = n; j < ldc; j++) // the padding must not be touched
+				{
+					Assert::AreEqual(R[i * ldc + j], C[i * ldc + j]);
+				}
+			}
+		}
+
+		TEST_METHOD(Transposes)
+		{
+			std::mt19937 rng(0);
+			int sizes[][3] = { {1,1,1}, {1,37,19}, {2,64,300}, {3,5,7}, {7,17,33}, {31,65,129}, {130,40,270} };
+			for (auto& s : sizes)
+			{
+				for (int t = 0; t < 4; t++)
+				{
+					Check(t & 1, t & 2, s[0], s[1], s[2], 1.f, 0.f, rng);
+				}
+			}
+		}
+
+		TEST_METHOD(AlphaBeta)
+		{
+			std::mt19937 rng(1);
+			Check(false, true, 1, 50, 20, 0.5f, 1.f, rng);
+			Check(false, false, 2, 70, 9, -1.f, 2.f, rng);
+			Check(true, false, 45, 33, 300, 2.f, -0.5f, rng);
+			Check(false, true, 20, 20, 0, 1.f, 3.f, rng); // k = 0, just scales c
+		}
+
+		TEST_METHOD(Epilogue)
+		{
+			// the epilogue sees every element of c once, after its final sum
+			std::mt19937 rng(2);
+			int sizes[][3] = { {1,37,19}, {2,64,300}, {7,17,33}, {130,300,270} };
+			for (auto& s : sizes)
+			{
+				int m = s[0], n = s[1], k = s[2];
+				size_t ldc = n + 5;
+				std::vector<float> A, B, C, R(m * ldc, 0.f);
+				Random(A, m * k, rng);
+				Random(B, n * k, rng);
+				Random(C, m * ldc, rng);
+				std::vector<int> visits(m * ldc, 0);
+				Reference(false, true, m, n, k, 1.f, A.data(), k, B.data(), k, 0.f, R.data(), ldc);
+				Gemm(false, true, m, n, k, 1.f, A.data(), k, B.data(), k, 0.f, C.data(), ldc,
+					[&](float* c, size_t ld, int i, int j, int bm, int bn) {
+						Assert::IsTrue(ld == ldc && c == C.data() + i * ldc + j);
+						for (int r = 0; r < bm; r++)
+						{
+							for (int q = 0; q < bn; q++)
+							{
+								size_t idx = (i + r) * ldc + j + q;
+								Assert::AreEqual(R[idx], c[r * ld + q], 1e-5f * (k + 1));
+								visits[idx]++;
+								c[r * ld + q] = -c[r * ld + q];
+							}
+						}
+					});
+				for (int i = 0; i < m; i++)
+				{
+					for (int j = 0; j < n; j++)
+					{
+						Assert::AreEqual(1, visits[i * ldc + j]);
+						Assert::AreEqual(-R[i * ldc + j], C[i * ldc + j], 1e-5f * (k + 1));
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(Prepacked)
+		{
+			std::mt19937 rng(3);
+			int sizes[][3] = { {1,37,19}, {2,64,300}, {7,17,33}, {130,300,270} };
+			PackedMatrix::Format formats[] = { PackedMatrix::FP32, PackedMatrix::FP16, PackedMatrix::BF16, PackedMatrix::INT8 };
+			// the largest error of a packed element of B in [-1, 1]
+			float errors[] = { 0.f, 1.f / 2048, 1.f / 256, 1.f / 254 };
+			for (auto& s : sizes)
+			{
+				for (int f = 0; f < 4; f++)
+				{
+					if (formats[f] == PackedMatrix::FP16 && not CheckHardwareSupport(CpuFeature::F16C)) continue;
+					for (int t = 0; t < 4; t++)
+					{
+						bool ta = t & 1, tb = t & 2;
+						int m = s[0], n = s[1], k = s[2];
+						size_t lda = (ta ? m : k) + 3, ldb = (tb ? k : n) + 1, ldc = n + 5;
+						std::vector<float> A, B, C;
+						Random(A, (ta ? k : m) * lda, rng);
+						Random(B, (tb ? n : k) * ldb, rng);
+						Random(C, m * ldc, rng);
+						PackedMatrix P(tb, k, n, B.data(), ldb, formats[f]);
+
+						// the whole of B and the columns from its second panel
+						for (int j0 : { 0, P.nr })
+						{
+							if (j0 >= n) continue;
+							int cols = n - j0;
+							std::vector<float> R = C, D = C;
+							Reference(ta, tb, m, cols, k, 1.f, A.data(), lda, B.data() + (tb ? j0 * ldb : j0), ldb, 0.5f, R.data(), ldc);
+							Gemm(ta, m, cols, 1.f, A.data(), lda, P, j0, 0.5f, D.data(), ldc);
+							float eps = 1e-5f * (k + 1) + k * errors[f];
+							for (int i = 0; i < m; i++)
+							{
+								for (int j = 0; j < cols; j++)
+								{
+									Assert::AreEqual(R[i * ldc + j], D[i * ldc + j], eps);
+								}
+								for (size_t j = cols; j < ldc; j++)
+								{
+									Assert::AreEqual(C[i * ldc + j], D[i * ldc + j]);
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(Int8)
+		{
+			// exact int32 sums, k is padded to the groups of 4 and m has the tails of every kernel
+			std::mt19937 rng(4);
+			std::uniform_int_distribution<int> dist(-127, 127);
+			int sizes[][3] = { {1,37,19}, {2,64,300}, {5,17,33}, {7,100,6}, {130,300,270} };
+			for (auto& s : sizes)
+			{
+				int m = s[0], n = s[1], k = s[2];
+				size_t lda = k + 3;
+				std::vector<int8_t> A(m * lda);
+				for (auto& v : A) v = (int8_t)dist(rng);
+				// the columns of B hold whole numbers in [-127, 127] with 127 in the first row, so they are packed exactly
+				std::vector<float> B(n * k);
+				for (int j = 0; j < n; j++)
+				{
+					for (int p = 0; p < k; p++) B[j * k + p] = p == 0 ? 127.f : (float)dist(rng);
+				}
+				PackedMatrix P(true, k, n, B.data(), k, PackedMatrix::INT8_DOT);
+				for (int j0 : { 0, P.nr })
+				{
+					if (j0 >= n) continue;
+					int cols = n - j0;
+					std::vector<int> visits(m * cols, 0);
+					GemmInt8(m, cols, A.data(), lda, P, j0, [&](const int32_t* c, size_t ldc, int i, int j, int bm, int bn) {
+						for (int r = 0; r < bm; r++)
+						{
+							for (int q = 0; q < bn; q++)
+							{
+								int32_t ref = 0;
+								for (int p = 0; p < k; p++) ref += A[(i + r) * lda + p] * (int32_t)B[(j0 + j + q) * k + p];
+								Assert::AreEqual(ref, c[r * ldc + q]);
+								visits[(i + r) * cols + j + q]++;
+							}
+						}
+					});
+					for (int v : visits) Assert::AreEqual(1, v);
+				}
+			}
+		}
+
+		TEST_METHOD(Dot2x3x2)
+		{
+			float a[] = { 1,2,3, 4,5,6 };
+			float b[] = { 1,2, 3,4, 5,6 };
+			Tensor A = Tensor(Shape(2, 3), Depth::D4, Packing::CHW, a);
+			Tensor B = Tensor(Shape(3, 2), Depth::D4, Packing::CHW, b);
+
+			Tensor C;
+			Dot(A, B, C);
+			float c[] = { 22,28, 49,64 };
+			for (int i = 0; i < 4; i++)
+			{
+				Assert::AreEqual(c[i], C[i], FLT_EPSILON * 64);
+			}
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "core.hpp"
+
+#include "math/half.hpp"
+
+#include <cmath>
+#include <random>
+
+namespace chaos
+{
+	TEST_CLASS(HalfTest)
+	{
+	public:
+		HalfTest() {}
+
+		static float Bits(uint32_t u)
+		{
+			float x;
+			memcpy(&x, &u, sizeof(x));
+			return x;
+		}
+
+		TEST_METHOD(Scalars)
+		{
+			Assert::AreEqual((int)0x3C00, (int)ToFloat16(1.f).bits);
+			Assert::AreEqual((int)0xC000, (int)ToFloat16(-2.f).bits);
+			Assert::AreEqual((int)0x7BFF, (int)ToFloat16(65504.f).bits);
+			Assert::AreEqual((int)0x7C00, (int)ToFloat16(65520.f).bits); // rounds to inf
+			Assert::AreEqual((int)0x0001, (int)ToFloat16(Bits(0x33800001)).bits); // the smallest subnormal
+			Assert::AreEqual((int)0x3F80, (int)ToBFloat16(1.f).bits);
+			Assert::AreEqual((int)0x3F80, (int)ToBFloat16(Bits(0x3F808000)).bits); // a tie to even
+			Assert::AreEqual((int)0x3F82, (int)ToBFloat16(Bits(0x3F818000)).bits);
+			Assert::AreEqual((int)0x7F80, (int)ToBFloat16(INFINITY).bits);
+			Assert::IsTrue(std::isnan(ToFloat(ToBFloat16(Bits(0x7F800001)))));
+			Assert::IsTrue(std::isnan(ToFloat(ToFloat16(NAN))));
+			Assert::AreEqual(0.0999755859375f, ToFloat(ToFloat16(0.1f)));
+			Assert::AreEqual(0.10009765625f, ToFloat(ToBFloat16(0.1f)));
+		}
+
+		TEST_METHOD(RoundTrips)
+		{
+			// every half is a float exactly, and back to the same bits
+			std::vector<float16> h(65536), h2(65536);
+			std::vector<bfloat16> b(65536), b2(65536);
+			for (uint32_t i = 0; i < 65536; i++)
+			{
+				h[i].bits = (uint16)i;
+				b[i].bits = (uint16)i;
+			}
+			std::vector<float> x(65536);
+			Cast(h.data(), x.data(), x.size());
+			Cast(x.data(), h2.data(), x.size());
+			for (uint32_t i = 0; i < 65536; i++)
+			{
+				if (std::isnan(x[i])) Assert::IsTrue(std::isnan(ToFloat(h[i])) && std::isnan(ToFloat(h2[i])));
+				else
+				{
+					Assert::AreEqual(ToFloat(h[i]), x[i]);
+					Assert::AreEqual((int)h[i].bits, (int)h2[i].bits);
+				}
+			}
+			Cast(b.data(), x.data(), x.size());
+			Cast(x.data(), b2.data(), x.size());
+			for (uint32_t i = 0; i < 65536; i++)
+			{
+				// the subnormals may be flushed to 0 by AVX-512 BF16
+				if (std::isnan(x[i])) Assert::IsTrue(std::isnan(Bits(i << 16)) && std::isnan(ToFloat(b2[i])));
+				else
+				{
+					Assert::AreEqual(Bits(i << 16), x[i]);
+					if (std::fabs(x[i]) >= FLT_MIN || x[i] == 0.f) Assert::AreEqual((int)b[i].bits, (int)b2[i].bits);
+				}
+			}
+		}
+
+		TEST_METHOD(Arrays)
+		{
+			// the vectors and the tails against the scalar conversions, every 4099th float
+			std::vector<float> x;
+			for (uint64 bits = 0; bits < ((uint64)1 << 32); bits += 4099)
+			{
+				float v = Bits((uint32_t)bits);
+				if (std::isnan(v) || (std::fabs(v) < FLT_MIN && v != 0.f)) continue;
+				x.push_back(v);
+			}
+			for (size_t n : { x.size(), (size_t)1, (size_t)15, (size_t)33 })
+			{
+				std::vector<float16> h(n);
+				std::vector<bfloat16> b(n);
+				Cast(x.data(), h.data(), n);
+				Cast(x.data(), b.data(), n);
+				for (size_t i = 0; i < n; i++)
+				{
+					Assert::AreEqual((int)ToFloat16(x[i]).bits, (int)h[i].bits);
+					Assert::AreEqual((int)ToBFloat16(x[i]).bits, (int)b[i].bits);
+				}
+			}
+		}
+
+		TEST_METHOD(Tensors)
+		{
+			// a view with padded rows and a packed tensor
+			std::mt19937 rng(0);
+			std::uniform_real_distribution<float> dist(-100.f, 100.f);
+			std::vector<float> buf(5 * 40);
+			for (auto& v : buf) v = dist(rng);
+			Tensor views[] = {
+				Tensor(Shape(5, 37), Depth::D4, Packing::CHW, buf.data(), { 40,1 }),
+				Tensor(Shape(5, 10), Depth::D4, Packing::C4HW4, buf.data()),
+			};
+			for (auto& src : views)
+			{
+				for (int bf16 = 0; bf16 < 2; bf16++)
+				{
+					// the dsts of the shape and depth but not the packing are created again
+					Tensor half(src.shape, Depth::D2), back(src.shape, Depth::D4);
+					ToHalf(src, half, bf16);
+					Assert::IsTrue(Depth::D2 == half.depth && src.packing == half.packing && src.shape == half.shape);
+					Assert::IsTrue((bf16 ? ElemType::BFLOAT16 : ElemType::FLOAT) == half.type);
+					ToFloat(half, back);
+					Assert::IsTrue(Depth::D4 == back.depth && ElemType::FLOAT == back.type);
+					size_t p = (size_t)src.packing;
+					for (size_t i = 0; i < src.shape[0]; i++)
+					{
+						for (size_t j = 0; j < src.shape[1] * p; j++)
+						{
+							float v = ((const float*)src)[i * src.steps[0] * p + j];
+							float h = bf16 ? ToFloat(ToBFloat16(v)) : ToFloat(ToFloat16(v));
+							Assert::AreEqual(h, back[i * src.shape[1] * p + j]);
+						}
+					}
+				}
+			}
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include "core.hpp"
+
+#include <random>
+
+namespace chaos
+{
+	TEST_CLASS(PermuteTest)
+	{
+	public:
+		PermuteTest() {}
+
+		static Tensor Random(const Shape& shape, Depth depth, Packing packing, std::mt19937& rng)
+		{
+			Tensor t = Tensor(shape, depth, packing);
+			uchar* data = t;
+			for (size_t i = 0; i < t.shape.vol() * depth * packing; i++) data[i] = (uchar)rng();
+			return t;
+		}
+
+		// compare every element of dst with the one of src at the permuted index
+		static void Check(const Tensor& src, const Vec<uint>& orders, const Tensor& dst)
+		{
+			size_t num_axes = src.shape.size();
+			size_t esz = 1 * src.depth * src.packing;
+			for (size_t i = 0; i < num_axes; i++)
+				Assert::AreEqual(src.shape[orders[i]], dst.shape[i]);
+
+			for (size_t idx = 0; idx < dst.shape.vol(); idx++)
+			{
+				size_t rest = idx, s = 0, d = 0;
+				for (int64 i = num_axes - 1; i >= 0; i--)
+				{
+					size_t k = rest % dst.shape[i];
+					rest /= dst.shape[i];
+					d += k * dst.steps[i];
+					s += k * src.steps[orders[i]];
+				}
+				Assert::IsTrue(memcmp((const uchar*)src.data + s * esz, (const uchar*)dst.data + d * esz, esz) == 0);
+			}
+		}
+
+		TEST_METHOD(NCHW2NHWC)
+		{
+			std::mt19937 rng(0);
+			Vec<uint> to_nhwc = { 0,2,3,1 }, to_nchw = { 0,3,1,2 };
+			// the edges of the tiles, one channel, three channels and the threads
+			Shape shapes[] = { Shape(2,3,17,19), Shape(1,1,8,8), Shape(3,16,5,7), Shape(1,64,40,40) };
+			for (Depth depth : { Depth::D1, Depth::D2, Depth::D4, Depth::D8 })
+			{
+				for (const Shape& shape : shapes)
+				{
+					Tensor A = Random(shape, depth, Packing::CHW, rng);
+					Tensor B, C;
+					Permute(A, B, to_nhwc);
+					Check(A, to_nhwc, B);
+					Permute(B, C, to_nchw);
+					Assert::IsTrue(memcmp(A.data, C.data, shape.vol() * depth) == 0);
+				}
+			}
+		}
+
+		TEST_METHOD(PermuteOrders)
+		{
+			std::mt19937 rng(1);
+			std::vector<uint> axes = { 0,1,2,3,4 };
+			for (int r = 0; r < 24; r++)
+			{
+				std::shuffle(axes.begin(), axes.end(), rng);
+				Vec<uint> orders = Vec<uint>(axes.size(), axes.data());
+				for (Packing packing : { Packing::CHW, Packing::C3HW3 })
+				{
+					Tensor A = Random(Shape({ 2,3,1,5,6 }), Depth::D4, packing, rng);
+					Tensor B;
+					Permute(A, B, orders);
+					Assert::IsTrue(packing == B.packing);
+					Check(A, orders, B);
+				}
+			}
+		}
+
+		TEST_METHOD(PermuteViews)
+		{
+			std::mt19937 rng(2);
+			Tensor A = Random(Shape(4, 30, 40), Depth::D4, Packing::CHW, rng);
+
+			// padded rows, the transposes read with the steps of src
+			Tensor V = Tensor(Shape(4, 30, 33), Depth::D4, Packing::CHW, A.data, { 1200,40,1 });
+			Tensor B;
+			Permute(V, B, { 2,0,1 });
+			Check(V, { 2,0,1 }, B);
+
+			// every other column, no dense axis in src
+			Tensor W = Tensor(Shape(4, 30, 20), Depth::D4, Packing::CHW, A.data, { 1200,40,2 });
+			Tensor C;
+			Permute(W, C, { 1,2,0 });
+			Check(W, { 1,2,0 }, C);
+
+			// the identity is a copy and dst on src gets a new buffer
+			Tensor D = A.Clone(), E = A;
+			Permute(E, E, { 0,1,2 });
+			Assert::IsTrue(E.data != A.data);
+			Assert::IsTrue(memcmp(D.data, E.data, A.shape.vol() * sizeof(float)) == 0);
+			Permute(A, A, { 0,2,1 });
+			Check(D, { 0,2,1 }, A);
+		}
+	};
+}
\ No newline at end of file
@@ -0,0 +1,68 @@
+#include "core.hpp"
+
+#include "math/quantize.hpp"
+
+#include <cmath>
+#include <random>
+
+namespace chaos
+{
+	TEST_CLASS(QuantizeTest)
+	{
+	public:
+		QuantizeTest() {}
+
+		TEST_METHOD(AbsMaxTails)
+		{
+			std::mt19937 rng(0);
+			std::uniform_real_distribution<float> dist(-4.f, 4.f);
+			for (size_t n : { 0, 1, 15, 16, 17, 100, 1031 })
+			{
+				std::vector<float> x(n);
+				float max = 0.f;
+				for (auto& v : x)
+				{
+					v = dist(rng);
+					max = std::max(max, std::fabs(v));
+				}
+				Assert::AreEqual(max, AbsMax(x.data(), n));
+			}
+		}
+
+		TEST_METHOD(RoundAndClamp)
+		{
+			std::mt19937 rng(1);
+			std::uniform_real_distribution<float> dist(-300.f, 300.f);
+			for (size_t n : { 1, 31, 32, 33, 100, 1031 })
+			{
+				std::vector<float> x(n);
+				for (auto& v : x) v = dist(rng);
+				// the ties and the large values in the vector part
+				x[0] = 2.5f;
+				if (n > 3)
+				{
+					x[1] = -3.5f;
+					x[2] = 1e30f;
+					x[3] = -1e30f;
+				}
+				std::vector<int8_t> y(n);
+				Quantize(x.data(), y.data(), n, 1.f);
+				for (size_t i = 0; i < n; i++)
+				{
+					Assert::AreEqual((int)std::nearbyint(std::min(std::max(x[i], -127.f), 127.f)), (int)y[i]);
+				}
+			}
+		}
+
+		TEST_METHOD(Scale)
+		{
+			float x[] = { 0.f, 0.5f, -1.f, 0.26f, 1.f };
+			int8_t y[5];
+			Quantize(x, y, 5, 1.f / 127);
+			int8_t q[] = { 0, 64, -127, 33, 127 };
+			for (int i = 0; i < 5; i++) Assert::AreEqual((int)q[i], (int)y[i]);
+			Quantize(x, y, 5, 0.f);
+			for (int i = 0; i < 5; i++) Assert::AreEqual(0, (int)y[i]);
+		}
+	};
+}
\ No newline at end of file
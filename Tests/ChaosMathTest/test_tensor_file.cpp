@@ -0,0 +1,152 @@
+#include "core.hpp"
+
+#include "core/tensor_file.hpp"
+#include "math/half.hpp"
+
+#include <filesystem>
+#include <fstream>
+
+namespace chaos
+{
+	TEST_CLASS(TensorFileTest)
+	{
+	public:
+		TensorFileTest() {}
+
+		static std::string TempFile(const std::string& name)
+		{
+			return (std::filesystem::temp_directory_path() / name).string();
+		}
+
+		static Tensor Iota(const Shape& shape, float start)
+		{
+			Tensor t(shape, Depth::D4);
+			for (size_t i = 0; i < shape.vol(); i++) t[i] = start + i;
+			return t;
+		}
+
+		// the elements without the padding of the steps
+		static void AreEqual(const Tensor& expected, const Tensor& actual)
+		{
+			Assert::IsTrue(expected.shape == actual.shape);
+			Assert::IsTrue(expected.depth == actual.depth && expected.packing == actual.packing && expected.type == actual.type);
+			Tensor e = expected.Clone(), a = actual.Clone();
+			for (size_t i = 0; i < e.shape.vol(); i++)
+			{
+				Assert::AreEqual(e[i], a[i]);
+			}
+		}
+
+		TEST_METHOD(RoundTrips)
+		{
+			std::string file = TempFile("chaos_tensors.bin");
+			// a row padded to 8 floats keeps its steps
+			float padded[] = { 1,2,3,4,5,0,0,0, 6,7,8,9,10,0,0,0 };
+			std::map<std::string, Tensor> tensors;
+			tensors["a"] = Iota(Shape(3, 5, 7), 0.f);
+			tensors["b.weight"] = Iota(Shape(1), -1.f);
+			tensors["padded"] = Tensor(Shape(2, 5), Depth::D4, Packing::CHW, padded, Steps({ 8, 1 }));
+			SaveTensors(file, tensors, "graph text");
+
+			for (bool map : { true, false })
+			{
+				std::string meta;
+				auto loaded = LoadTensors(file, &meta, map);
+				Assert::AreEqual(std::string("graph text"), meta);
+				Assert::AreEqual(size_t(3), loaded.size());
+				for (const auto& [name, tensor] : tensors)
+				{
+					AreEqual(tensor, loaded[name]);
+					Assert::AreEqual(size_t(0), (size_t)loaded[name].data % 64);
+				}
+				Assert::AreEqual(map, loaded["padded"].steps == Steps({ 8, 1 }));
+			}
+			std::filesystem::remove(file);
+		}
+
+		TEST_METHOD(HalfTypes)
+		{
+			// the container keeps float16 and bfloat16 apart, npy gets the bfloat16 as float32
+			std::string file = TempFile("chaos_half.bin");
+			Tensor x = Iota(Shape(3, 7), -10.25f), h, bh;
+			ToHalf(x, h);
+			ToHalf(x, bh, true);
+			SaveTensors(file, { {"h", h}, {"bh", bh} });
+			for (bool map : { true, false })
+			{
+				auto loaded = LoadTensors(file, nullptr, map);
+				for (const char* name : { "h", "bh" })
+				{
+					// the mapped file allocates nothing, the float tensor needs a tensor of its own
+					Tensor t = loaded[name].Clone(), back;
+					Assert::IsTrue((name[0] == 'b' ? ElemType::BFLOAT16 : ElemType::FLOAT) == t.type);
+					ToFloat(t, back);
+					AreEqual(x, back);
+				}
+			}
+			std::filesystem::remove(file);
+
+			file = TempFile("chaos_half.npy");
+			SaveNpy(file, bh);
+			Tensor wide = LoadNpy(file, false);
+			AreEqual(x, wide);
+			std::filesystem::remove(file);
+		}
+
+		TEST_METHOD(ZeroCopy)
+		{
+			std::string file = TempFile("chaos_mapped.bin");
+			SaveTensors(file, { {"x", Iota(Shape(4, 100), 1.f)} });
+
+			Tensor x;
+			{
+				Ptr<MappedFile> mapped = MappedFile::Open(file);
+				auto header = mapped->data();
+				// the header and the entry of x take 117 bytes, its payload is aligned to 128
+				x = mapped->GetTensor(128, Shape(4, 100), Shape(4, 100).steps(), Depth::D4, Packing::CHW);
+				Assert::IsTrue((const uchar*)x.data > header && (const uchar*)x.data < header + mapped->size());
+				Tensor copy = x;
+			}
+			// the tensor keeps the mapping after the file is released, a write is private
+			x[0] = 42.f;
+			Assert::AreEqual(42.f, x[0]);
+			Assert::AreEqual(1.f, LoadTensors(file)["x"][0]);
+			x.Release();
+			std::filesystem::remove(file);
+		}
+
+		TEST_METHOD(Npy)
+		{
+			std::string file = TempFile("chaos_tensor.npy");
+			Tensor a = Iota(Shape(2, 3, 5), 0.5f);
+			SaveNpy(file, a);
+			for (bool map : { true, false })
+			{
+				AreEqual(a, LoadNpy(file, map));
+			}
+
+			// as numpy.save(file, numpy.array([1, -2, 3], dtype=numpy.int8)) writes it,
+			// the wider integers would be read as floats of their size and are refused
+			std::string header = "{'descr': '|i1', 'fortran_order': False, 'shape': (3,), }";
+			header.append(128 - 10 - header.size() - 1, ' ');
+			header += '\n';
+			int8_t values[] = { 1, -2, 3 };
+			{
+				std::ofstream stream(file, std::ios::binary);
+				uint16_t size = (uint16_t)header.size();
+				stream.write("\x93NUMPY\x01\x00", 8);
+				stream.write((const char*)&size, 2);
+				stream.write(header.data(), header.size());
+				stream.write((const char*)values, sizeof(values));
+			}
+			Tensor v = LoadNpy(file);
+			Assert::IsTrue(Shape(3) == v.shape && Depth::D1 == v.depth);
+			for (int i = 0; i < 3; i++)
+			{
+				Assert::AreEqual(values[i], ((const int8_t*)v.data)[i]);
+			}
+			v.Release();
+			std::filesystem::remove(file);
+		}
+	};
+}
\ No newline at end of file
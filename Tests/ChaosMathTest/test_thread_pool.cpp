@@ -0,0 +1,168 @@
+#include "core.hpp"
+
+#include "core/thread_pool.hpp"
+
+#include <atomic>
+#include <set>
+
+namespace chaos
+{
+	TEST_CLASS(ThreadPoolTest)
+	{
+	public:
+		ThreadPoolTest() {}
+
+		TEST_METHOD(CoverOnce)
+		{
+			ThreadPool pool(4);
+			std::vector<std::atomic<int>> visits(1000);
+			for (auto& v : visits) v = 0;
+			// the first chunks are slow, so the other threads have to steal them
+			pool.ParallelFor(0, visits.size(), 7, [&](size_t b, size_t e) {
+				if (b < 100) std::this_thread::sleep_for(std::chrono::microseconds(200));
+				for (size_t i = b; i < e; i++) visits[i]++;
+			});
+			for (auto& v : visits)
+			{
+				Assert::AreEqual(1, v.load());
+			}
+
+			// an offset range with a partial last chunk
+			std::atomic<size_t> sum = 0;
+			pool.ParallelFor(10, 1013, 100, [&](size_t b, size_t e) {
+				Assert::IsTrue(e - b <= 100);
+				for (size_t i = b; i < e; i++) sum += i;
+			}, 3);
+			Assert::AreEqual((size_t)(1012 * 1013 / 2 - 9 * 10 / 2), sum.load());
+		}
+
+		TEST_METHOD(Nested)
+		{
+			ThreadPool pool(3);
+			std::atomic<int> count = 0;
+			for (int r = 0; r < 50; r++)
+			{
+				pool.ParallelFor(0, 8, 1, [&](size_t b, size_t e) {
+					for (size_t i = b; i < e; i++)
+					{
+						// runs serially on the calling thread, or on the idle workers
+						pool.ParallelFor(0, 4, 1, [&](size_t b2, size_t e2) { count += (int)(e2 - b2); });
+					}
+				});
+			}
+			Assert::AreEqual(50 * 8 * 4, count.load());
+		}
+
+		TEST_METHOD(ConcurrentJobs)
+		{
+			// the jobs of two threads, each nesting one more, share the workers
+			ThreadPool pool(4);
+			std::vector<std::atomic<int>> visits(2 * 64 * 16);
+			for (auto& v : visits) v = 0;
+			auto run = [&](size_t base) {
+				pool.ParallelFor(0, 64, 1, [&](size_t b, size_t e) {
+					for (size_t i = b; i < e; i++)
+					{
+						pool.ParallelFor(0, 16, 1, [&](size_t b2, size_t e2) {
+							for (size_t j = b2; j < e2; j++) visits[base + i * 16 + j]++;
+						});
+					}
+				});
+			};
+			std::thread other(run, 64 * 16);
+			run(0);
+			other.join();
+			for (auto& v : visits)
+			{
+				Assert::AreEqual(1, v.load());
+			}
+		}
+
+		TEST_METHOD(Help)
+		{
+			// the chunk 1 sets the flag the chunk 0 waits for, either the worker or the helping thread takes it
+			ThreadPool pool(2);
+			std::atomic<bool> flag = false;
+			std::thread other([&]() {
+				pool.ParallelFor(0, 2, 1, [&](size_t b, size_t e) {
+					if (b == 1) flag = true;
+					while (not flag) std::this_thread::yield();
+				});
+			});
+			while (not flag)
+			{
+				if (not pool.Help()) std::this_thread::yield();
+			}
+			other.join();
+			Assert::IsFalse(pool.Help());
+		}
+
+		TEST_METHOD(HelpUntil)
+		{
+			// the chunk 1 waits for the chunk 0 in HelpUntil, as an idle worker it takes a part of the nested ParallelFor
+			ThreadPool pool(2);
+			std::atomic<bool> waiting = false, finished = false;
+			std::mutex lock;
+			std::set<std::thread::id> ids;
+			pool.ParallelFor(0, 2, 1, [&](size_t b, size_t e) {
+				if (b == 1)
+				{
+					pool.HelpUntil([&]() { waiting = true; return finished.load(); });
+					return;
+				}
+				while (not waiting) std::this_thread::yield();
+				std::this_thread::sleep_for(std::chrono::milliseconds(2));
+				pool.ParallelFor(0, 16, 1, [&](size_t, size_t) {
+					std::this_thread::sleep_for(std::chrono::microseconds(500));
+					std::lock_guard<std::mutex> guard(lock);
+					ids.insert(std::this_thread::get_id());
+				});
+				finished = true;
+				pool.Notify();
+			}, 2);
+			Assert::AreEqual(size_t(2), ids.size());
+		}
+
+		TEST_METHOD(Reduce)
+		{
+			std::vector<float> data(100000);
+			for (size_t i = 0; i < data.size(); i++) data[i] = 1.f / (1 + i % 97);
+			auto sum = [&](int threads) {
+				return ParallelReduce(0, data.size(), 1000, 0.f, [&](size_t b, size_t e) {
+					float s = 0;
+					for (size_t i = b; i < e; i++) s += data[i];
+					return s;
+				}, std::plus<float>(), threads);
+			};
+			float s1 = sum(1);
+			// the same chunks summed in the same order
+			Assert::AreEqual(s1, sum(0));
+			Assert::AreEqual(s1, sum(4));
+			double ref = 0;
+			for (float v : data) ref += v;
+			Assert::AreEqual(ref, (double)s1, 1e-2);
+		}
+
+		TEST_METHOD(NodeScope)
+		{
+			// the workers of a node pool run on its processors, and so do the ParallelFor nested in its jobs
+			ThreadPool pool(3, true, 0);
+			Assert::AreEqual(0, pool.node());
+			Assert::AreEqual(-1, ThreadPool::Global().node());
+			auto caller = std::this_thread::get_id();
+			std::atomic<int> off_node = 0, other_pool = 0;
+			{
+				ThreadPoolScope scope(&pool);
+				Assert::IsTrue(&ThreadPool::Current() == &pool);
+				ParallelFor(0, 64, 1, [&](size_t b, size_t e) {
+					std::this_thread::sleep_for(std::chrono::microseconds(100));
+					if (std::this_thread::get_id() != caller && PageAllocator::CurrentNode() != 0) off_node++;
+					if (&ThreadPool::Current() != &pool) other_pool++;
+				});
+			}
+			Assert::AreEqual(0, off_node.load());
+			Assert::AreEqual(0, other_pool.load());
+			Assert::IsTrue(&ThreadPool::Current() == &ThreadPool::Global());
+		}
+	};
+}
@@ -1,5 +1,7 @@
 #include "core.hpp"
 
+#include <random>
+
 namespace chaos
 {
 	TEST_CLASS(TransposeTest)
@@ -7,6 +9,87 @@ namespace chaos
 	public:
 		TransposeTest() {}
 		
+		// fill the bytes of a rows x cols tensor and check dst against it, element by element
+		static Tensor Random(int rows, int cols, Depth depth, Packing packing, std::mt19937& rng)
+		{
+			Tensor t = Tensor(Shape(rows, cols), depth, packing);
+			uchar* data = t;
+			for (size_t i = 0; i < t.shape.vol() * depth * packing; i++) data[i] = (uchar)rng();
+			return t;
+		}
+
+		static void Check(const Tensor& src, const uchar* expected, const Tensor& dst)
+		{
+			size_t esz = 1 * src.depth * src.packing;
+			int rows = src.shape[0], cols = src.shape[1];
+			Assert::IsTrue(Shape(cols, rows) == dst.shape);
+			for (int r = 0; r < rows; r++)
+			{
+				for (int c = 0; c < cols; c++)
+				{
+					const uchar* s = expected + (r * cols + c) * esz;
+					const uchar* d = (const uchar*)dst.data + (c * dst.steps[0] + r) * esz;
+					Assert::IsTrue(memcmp(s, d, esz) == 0);
+				}
+			}
+		}
+
+		TEST_METHOD(TransposeDepths)
+		{
+			std::mt19937 rng(0);
+			Depth depths[] = { Depth::D1, Depth::D2, Depth::D4, Depth::D8 };
+			// the register tiles, their edges, the blocks and the threads
+			int sizes[][2] = { {1,1}, {3,5}, {16,16}, {17,33}, {64,8}, {130,67}, {300,257} };
+			for (Depth depth : depths)
+			{
+				for (Packing packing : { Packing::CHW, Packing::C3HW3 })
+				{
+					for (auto& s : sizes)
+					{
+						Tensor A = Random(s[0], s[1], depth, packing, rng);
+						Tensor B;
+						Transpose(A, B);
+						Check(A, A, B);
+					}
+				}
+			}
+		}
+
+		TEST_METHOD(TransposeReusedDst)
+		{
+			// a dst of the shape but with smaller elements is created again, not overrun
+			std::mt19937 rng(3);
+			Tensor A = Random(17, 33, Depth::D8, Packing::C3HW3, rng);
+			Tensor B(Shape(33, 17), Depth::D1), C(Shape(33, 17), Depth::D8);
+			Transpose(A, B);
+			Transpose(A, C);
+			Assert::IsTrue(Depth::D8 == B.depth && Packing::C3HW3 == B.packing && Packing::C3HW3 == C.packing);
+			Check(A, A, B);
+			Check(A, A, C);
+		}
+
+		TEST_METHOD(TransposeInplaceLarge)
+		{
+			std::mt19937 rng(1);
+			for (Depth depth : { Depth::D1, Depth::D4, Depth::D8 })
+			{
+				// square, over several blocks, with padded rows
+				Tensor A = Random(150, 160, depth, Packing::CHW, rng);
+				Tensor S = Tensor(Shape(150, 150), depth, Packing::CHW, A.data, { 160,1 });
+				Tensor R = S.Clone();
+				Transpose(S, S);
+				Check(R, R, S);
+
+				// non-square, the cycles of the permutation
+				Tensor N = Random(37, 101, depth, Packing::CHW, rng);
+				Tensor M = N.Clone();
+				void* data = N.data;
+				Transpose(N, N);
+				Assert::IsTrue(data == N.data);
+				Check(M, M, N);
+			}
+		}
+
 		TEST_METHOD(TransposeInplace)
 		{
 			float a[] = { 1,2,3,4,5,6,7,8,9 };
@@ -0,0 +1,51 @@
+#include "core.hpp"
+
+namespace chaos
+{
+	TEST_CLASS(VecTest)
+	{
+	public:
+		VecTest() {}
+
+		TEST_METHOD(InsertRemove)
+		{
+			Shape shape = Shape(2, 3);
+			shape.Insert(0, 1);
+			Assert::IsTrue(Shape(1, 2, 3) == shape);
+			shape.Remove(1);
+			Assert::IsTrue(Shape(1, 3) == shape);
+
+			// grows past the inline storage and keeps the elements
+			for (uint i = 0; i < 10; i++)
+				shape.Insert(shape.size(), i + 4);
+			Assert::AreEqual(size_t(12), shape.size());
+			for (uint i = 0; i < 10; i++)
+				Assert::AreEqual(i + 4, shape[i + 2]);
+			Assert::AreEqual(size_t(3) * 4 * 5 * 6 * 7 * 8 * 9 * 10 * 11 * 12 * 13, shape.vol());
+		}
+
+		TEST_METHOD(CopyMove)
+		{
+			Shape small = Shape(4, 5, 6);
+			Shape large = { 1,2,3,4,5,6,7,8,9,10 };
+
+			Shape a = small, b = large;
+			Assert::IsTrue(a == small && b == large);
+			Assert::IsTrue(a.data() != small.data() && b.data() != large.data());
+
+			const uint* heap = b.data();
+			Shape c = std::move(b); // the heap buffer is taken over
+			Assert::IsTrue(c.data() == heap && c == large && b.empty());
+			Shape d = std::move(a); // the inline elements are copied
+			Assert::IsTrue(d == small && a.empty());
+
+			c = small; // fits the old heap buffer
+			Assert::IsTrue(c == small);
+			d = std::move(c);
+			Assert::IsTrue(d == small);
+
+			Steps steps = Shape(2, 3, 4).steps();
+			Assert::IsTrue(Steps({ 12, 4, 1 }) == steps);
+		}
+	};
+}
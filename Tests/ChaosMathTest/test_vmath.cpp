@@ -0,0 +1,94 @@
+#include "core.hpp"
+
+#include "math/vmath.hpp"
+
+#include <cmath>
+#include <functional>
+
+namespace chaos
+{
+	TEST_CLASS(VMathTest)
+	{
+	public:
+		VMathTest() {}
+
+		// the error of y in the ulps of the exact ref, the results under FLT_MIN only have to be under it too
+		static double Ulp(float y, double ref)
+		{
+			if (std::isnan(ref)) return std::isnan(y) ? 0. : INFINITY;
+			if (std::isinf((float)ref) || std::isinf(y)) return (float)ref == y ? 0. : INFINITY;
+			if (std::fabs(ref) < FLT_MIN) return std::fabs(y) < FLT_MIN ? 0. : INFINITY;
+			int e;
+			std::frexp(ref, &e);
+			return std::fabs(y - ref) / std::ldexp(1., e - 24);
+		}
+
+		// every 251th float of [lo, hi] against the double precision function
+		static void Sweep(void (*func)(const float*, float*, size_t), const std::function<double(double)>& ref, float lo, float hi, double max_ulp)
+		{
+			std::vector<float> x, y;
+			for (uint64 bits = 0; bits < ((uint64)1 << 32); bits += 251)
+			{
+				uint32_t u = (uint32_t)bits;
+				float v;
+				memcpy(&v, &u, sizeof(v));
+				if (v >= lo && v <= hi) x.push_back(v);
+			}
+			x.push_back(lo);
+			x.push_back(hi);
+			y.resize(x.size());
+			func(x.data(), y.data(), x.size());
+			for (size_t i = 0; i < x.size(); i++)
+			{
+				double ulp = Ulp(y[i], ref(x[i]));
+				if (ulp > max_ulp)
+				{
+					std::string msg = Format("%g ulp at %.9g", ulp, x[i]);
+					Assert::Fail(std::wstring(msg.begin(), msg.end()).c_str());
+				}
+			}
+		}
+
+		TEST_METHOD(Accuracy)
+		{
+			Sweep(Exp, [](double x) { return std::exp(x); }, -87.33654f, 88.72283f, 1.5);
+			Sweep(Log, [](double x) { return std::log(x); }, 0.f, INFINITY, 1.);
+			Sweep(Tanh, [](double x) { return std::tanh(x); }, -INFINITY, INFINITY, 1.5);
+			Sweep(Sigmoid, [](double x) { return 1. / (1. + std::exp(-x)); }, -87.f, INFINITY, 3.5);
+			Sweep(Mish, [](double x) { return x * std::tanh(std::log1p(std::exp(x))); }, -87.f, INFINITY, 4.5);
+		}
+
+		TEST_METHOD(Specials)
+		{
+			float x[] = { 0.f, -0.f, INFINITY, -INFINITY, NAN, -1.f, 100.f, -100.f };
+			float y[8];
+			Exp(x, y, 8);
+			Assert::IsTrue(y[0] == 1.f && y[2] == INFINITY && y[3] == 0.f && std::isnan(y[4]) && y[6] == INFINITY && y[7] == 0.f);
+			Log(x, y, 8);
+			Assert::IsTrue(y[0] == -INFINITY && y[1] == -INFINITY && y[2] == INFINITY && std::isnan(y[3]) && std::isnan(y[4]) && std::isnan(y[5]));
+			Tanh(x, y, 8);
+			Assert::IsTrue(y[0] == 0.f && y[2] == 1.f && y[3] == -1.f && std::isnan(y[4]) && y[6] == 1.f && y[7] == -1.f);
+			Sigmoid(x, y, 8);
+			Assert::IsTrue(y[0] == 0.5f && y[2] == 1.f && y[3] == 0.f && std::isnan(y[4]) && y[6] == 1.f && y[7] == 0.f);
+			Mish(x, y, 8);
+			Assert::IsTrue(y[0] == 0.f && y[2] == INFINITY && std::isnan(y[4]) && y[6] == 100.f);
+		}
+
+		TEST_METHOD(Tails)
+		{
+			// every length around the vector widths, in place, the elements after n untouched
+			std::vector<float> x(40), y(41);
+			for (size_t i = 0; i < x.size(); i++) x[i] = (float)i / 8.f - 2.f;
+			std::vector<float> full(x.size());
+			Mish(x.data(), full.data(), x.size());
+			for (size_t n = 0; n <= x.size(); n++)
+			{
+				std::fill(y.begin(), y.end(), -7.f);
+				std::copy(x.begin(), x.begin() + n, y.begin());
+				Mish(y.data(), y.data(), n);
+				for (size_t i = 0; i < n; i++) Assert::AreEqual(full[i], y[i]);
+				for (size_t i = n; i < y.size(); i++) Assert::AreEqual(-7.f, y[i]);
+			}
+		}
+	};
+}
\ No newline at end of file